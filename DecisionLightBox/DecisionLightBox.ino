@@ -2,26 +2,45 @@
 #include "secrets_local.h"
 #include <driver/ledc.h>
 #include <Arduino.h>
+#include "recovery.h"
+#include "backoff.h"
+#include "lift.h"
+#include "timers.h"
+#include "events.h"
+#include "profile.h"
+#include "health.h"
+#include "topics.h"
+#include "buzzer.h"
 
 const char* platform = "A";
 char fop[20];
 
-String downSignalTopic;
-String decisionTopic;
-String resetDecisionsTopic;
-
-String ref1Decision = "";
-String ref2Decision = "";
-String ref3Decision = "";
+char downSignalTopic[TOPIC_SIZE(TOPIC_PREFIX_DOWN)];
+char decisionTopic[TOPIC_SIZE(TOPIC_PREFIX_DECISION)];
+char resetDecisionsTopic[TOPIC_SIZE(TOPIC_PREFIX_RESET_DECISIONS)];
+// Countdown warnings: "warning" or "final"
+char buzzerTopic[TOPIC_SIZE(TOPIC_PREFIX_BUZZER)];
+// Retained lift status from the central box; see LiftStatus in decision.h
+char liftStateTopic[TOPIC_SIZE(TOPIC_PREFIX_LIFT_STATE)];
+// Display frames from the central box; see DisplayFrame in decision.h
+char displayTopic[TOPIC_SIZE(TOPIC_PREFIX_DISPLAY)];
+#ifdef PROFILING
+char profileTopic[TOPIC_SIZE(TOPIC_PREFIX_PROFILE)];
+#endif
 
-bool downTriggered = false;
-bool allDecisionsMade = false;
 bool silentMode = false; 
 
 // Variables for non-blocking timing of down signal
 unsigned long downSignalStartTime = 0;
-bool buzzerOn = false;
 bool downLedOn = false;
+bool lightsOn = false;
+
+// The buzzer times itself (BUZZER_DOWN_MS, see buzzer.h)
+#define DOWN_LED_MS 3000
+Timer downLedTimer;
+Timer lightsTimer;
+Timer liftTimer;
+Timer subscriptionTimer;
 
 //______Allocate Pins___________________________________________
 
@@ -37,151 +56,473 @@ const int refBadDecisions[] = {21, 22, 23};
 #include <WiFiClientSecure.h>
 #include "certificates.h"
 const int mqttPort = 8883;
+// Keeps a stalled handshake inside the watchdog timeout
+#define TLS_HANDSHAKE_TIMEOUT_S 5
 #else
 #include <WiFi.h>
 const int mqttPort = 1883;
 #endif
 
 #include "PubSubClient.h"
+#include "transport.h"
+#include "decision.h"
+#ifdef EMBEDDED_BROKER
+#include "broker.h"
+#endif
 #define ELEMENTCOUNT(x) (sizeof(x) / sizeof(x[0]))
 
+// How long the decision lights stay on at the start of the cooldown
+#define DECISION_LIGHTS_MS 3000
+
+// Longest the loop sleeps with nothing to do: PubSubClient needs loop() for its keep-alive.
+// Without a socket to watch (broker unreachable, TLS, or the embedded broker's clients)
+// the loop falls back to polling.
+#define LOOP_IDLE_MS 1000
+#define LOOP_POLL_MS 10
+// MQTT packets handled per loop pass, like the UDP transport's datagrams
+#define MQTT_DRAIN_PACKETS 8
+
+// Time allowed for the fast (cached channel/BSSID) join before falling back to a full scan
+#define WIFI_FAST_CONNECT_MS 1500
+// A progress dot per LED breath while the access point is missing
+#define WIFI_PROGRESS_MS 5120
+
+// Heartbeats let the central box notice a dead lightbox within a second; the retained
+// presence message (refreshed less often) carries signal strength
+#define HEARTBEAT_INTERVAL_MS 250
+#define PRESENCE_INTERVAL_MS 30000
+
 #ifdef TLS
 WiFiClientSecure wifiClient;
 #else
 WiFiClient wifiClient;
 #endif
 PubSubClient mqttClient;
+MqttTransport mqttTransport(mqttClient);
+UdpTransport udpTransport;
+TransportMux transport;
+
+#ifdef EMBEDDED_BROKER
+// Standalone mode without the RPI: controllers and the central box connect to the lightbox itself
+MqttBroker broker;
+BrokerServer brokerServer(broker);
+BrokerTransport brokerTransport(broker);
+#endif
 
 // networking values
 String macAddress;
 char mac[50];
 char clientId[50];
 
-unsigned long decisionStartTime = 0;
-unsigned long ignoreStartTime = 0;
-bool isWaitingForDecision = false;
-bool isIgnoringDecisions = false;
+ReconnectPolicy reconnectPolicy(RECONNECT_BASE_MS, RECONNECT_CAP_MS);
+
+char presenceTopic[TOPIC_CLIENT_SIZE(TOPIC_PREFIX_PRESENCE)];
+char heartbeatTopic[TOPIC_CLIENT_SIZE(TOPIC_PREFIX_HEARTBEAT)];
+Timer heartbeatTimer;
+Timer presenceTimer;
+uint32_t heartbeatCount = 0;
+
+char healthTopic[TOPIC_CLIENT_SIZE(TOPIC_PREFIX_HEALTH)];
+char healthWarningTopic[TOPIC_CLIENT_SUFFIX_SIZE(TOPIC_PREFIX_HEALTH, TOPIC_SUFFIX_WARNING)];
+Timer healthTimer;
+
+uint32_t liftClock() {
+  return millis();
+}
+
+void onLiftAction(LiftAction action, uint8_t referee);
+LiftEngine lift(liftClock, onLiftAction);
+// Drops repeated and reordered decisions before they reach the lift engine
+DecisionFilter decisionFilter;
+// Cleared on every connect: the first lift status after it is taken over as it stands
+bool liftStatusSynced = false;
+// Lift epoch of the last display frame, DECISION_NO_EPOCH until the central box sends one
+// and again after an OWLCMS reset; see framesDrive()
+uint8_t frameEpoch = DECISION_NO_EPOCH;
+uint8_t frameSeq = 0;
+uint8_t frameBuzzer = BUZZER_NONE;
+// Cleared on every connect: the first frame after it is taken whatever its sequence
+bool frameSeen = false;
+bool liftStateSubscribed = false;
+bool fallbackSubscribed = false;
+
+// Access point joined before a warm reset (channel 0 = unknown)
+uint8_t wifiChannel = 0;
+uint8_t wifiBssid[6];
 
 void setup() {
+  setupWatchdog();
+  timers.begin(timerClockMs());
+  setupEvents();
+  healthWatchTask("loop", NULL);
+  healthWatchTask("watcher", xTaskGetHandle("Socket Watcher"));
+  LightboxSnapshot snapshot;
+  bool warmStart = readSnapshot(snapshot);
+
   digitalWrite(downLedPin, HIGH);
   setupPins();
-  bootSequence();
+  if (warmStart) {
+    restoreState(snapshot);
+  } else {
+    bootSequence();
+  }
   #ifdef TLS
-    wifiClient.setCACert(rootCABuff);
-    wifiClient.setInsecure();
+    #ifdef TLS_PSK
+      // No certificate exchange or public-key math: reconnects take tens of ms instead of seconds
+      wifiClient.setPreSharedKey(pskIdentity, pskKey);
+    #else
+      wifiClient.setCACert(rootCABuff);
+      wifiClient.setInsecure();
+    #endif
+    wifiClient.setHandshakeTimeout(TLS_HANDSHAKE_TIMEOUT_S);
   #endif
   mqttClient.setKeepAlive(20);
+  // Keep a stalled connect well inside the watchdog timeout
+  mqttClient.setSocketTimeout(5);
   mqttClient.setClient(wifiClient);
+#ifdef PROFILING
+  // Histogram messages are longer than anything else we publish
+  mqttClient.setBufferSize(512);
+#endif
   Serial.begin(115200);
 
+#ifdef EMBEDDED_BROKER
+  brokerTransport.begin();
+  transport.add(brokerTransport, TRANSPORT_MQTT);
+#else
+  mqttTransport.begin();
+  transport.add(mqttTransport, TRANSPORT_MQTT);
+#endif
+  transport.add(udpTransport, TRANSPORT_UDP);
+  transport.setCallback(callback);
+
   wifiConnect();
   macAddress = WiFi.macAddress();
-  macAddress.toCharArray(clientId, macAddress.length() + 1);
 
+  // Stable per-device id so the broker can keep our session and two devices never collide
+  uint8_t macBytes[6];
+  WiFi.macAddress(macBytes);
+  sprintf(clientId, "replogic-lightbox-%02x%02x%02x%02x%02x%02x",
+          macBytes[0], macBytes[1], macBytes[2], macBytes[3], macBytes[4], macBytes[5]);
+  udpTransport.begin((macBytes[2] << 24) | (macBytes[3] << 16) | (macBytes[4] << 8) | macBytes[5]);
+  watchSocket(EVENT_SOCKET_UDP, udpTransport.fd());
+
+#ifdef EMBEDDED_BROKER
+  brokerServer.begin();
+  Serial.print("MQTT broker listening on ");
+  Serial.println(WiFi.localIP());
+#else
   Serial.print("MQTT server: ");
   Serial.println(mqttServer);
   mqttClient.setServer(mqttServer, mqttPort);
-  mqttClient.setCallback(callback);
+#endif
 
   strcpy(fop, platform);
-  downSignalTopic = "owlcms/fop/down/" + String(fop);
-  decisionTopic = "owlcms/decision/" + String(fop);
-  resetDecisionsTopic = "owlcms/fop/resetDecisions/" + String(fop);
+  buildTopic(downSignalTopic, TOPIC_PREFIX_DOWN, fop);
+  buildTopic(decisionTopic, TOPIC_PREFIX_DECISION, fop);
+  buildTopic(resetDecisionsTopic, TOPIC_PREFIX_RESET_DECISIONS, fop);
+  buildTopic(buzzerTopic, TOPIC_PREFIX_BUZZER, fop);
+  buildTopic(liftStateTopic, TOPIC_PREFIX_LIFT_STATE, fop);
+  buildTopic(displayTopic, TOPIC_PREFIX_DISPLAY, fop);
+#ifdef PROFILING
+  buildTopic(profileTopic, TOPIC_PREFIX_PROFILE, fop);
+#endif
+  buildTopic(presenceTopic, TOPIC_PREFIX_PRESENCE, fop, clientId);
+  buildTopic(heartbeatTopic, TOPIC_PREFIX_HEARTBEAT, fop, clientId);
+  buildTopic(healthTopic, TOPIC_PREFIX_HEALTH, fop, clientId);
+  buildTopic(healthWarningTopic, TOPIC_PREFIX_HEALTH, fop, clientId, TOPIC_SUFFIX_WARNING);
+  timers.start(heartbeatTimer, HEARTBEAT_INTERVAL_MS, sendHeartbeat);
+  timers.start(healthTimer, HEALTH_INTERVAL_MS, publishHealth);
+#ifdef EMBEDDED_BROKER
+  subscribeTopics();
+  publishPresence();
+#else
   mqttReconnect();
-  digitalWrite(downLedPin, LOW);
+#endif
+  digitalWrite(downLedPin, downLedOn ? HIGH : LOW);
 }
 
 void loop() {
-  delay(10);
+  // Sleep until a readable socket or the next timer deadline
+#ifdef EMBEDDED_BROKER
+  int mqttFd = -1;
+#else
+  int mqttFd = mqttClient.connected() ? wifiClient.fd() : -1;
+  watchSocket(EVENT_SOCKET_MQTT, mqttFd);
+#endif
+  waitForEvents(timers.msUntilNext(mqttFd >= 0 ? LOOP_IDLE_MS : LOOP_POLL_MS));
+  feedWatchdog();
+  timersLoop();
+#ifdef EMBEDDED_BROKER
+  if (WiFi.status() != WL_CONNECTED) {
+    wifiConnect();
+  }
+  brokerServer.loop();
+#else
   if (!mqttClient.connected()) {
     mqttReconnect();
   }
-  mqttClient.loop();
+#endif
+  transport.loop();
+#ifndef EMBEDDED_BROKER
+  drainMqtt();
+#endif
+  socketsDrained();
   //silentMode();
+}
 
-  unsigned long currentTime = millis();
-
-  // Handle down signal timing (non-blocking)
-  if (buzzerOn && (currentTime - downSignalStartTime >= 1500)) {
-    // Turn off buzzer after 1.5 seconds
-    digitalWrite(buzzerPin, LOW);
-    buzzerOn = false;
-    Serial.println("Buzzer turned off");
+// PubSubClient reads one packet per loop(): handle the rest of a burst before sleeping again.
+// Bytes mbedTLS has already pulled off the socket are invisible to the watcher's select(),
+// so a pass cut short by the bound wakes the loop straight away.
+void drainMqtt() {
+  for (int packets = 1; packets < MQTT_DRAIN_PACKETS && wifiClient.available(); packets++) {
+    if (!mqttClient.loop()) {
+      return;
+    }
   }
-  
-  if (downLedOn && (currentTime - downSignalStartTime >= 3000)) {
-    // Turn off down LED after 3 seconds
-    digitalWrite(downLedPin, LOW);
-    downLedOn = false;
-    Serial.println("Down LED turned off");
+  if (mqttClient.connected() && wifiClient.available()) {
+    postEvent(EVENT_WAKE);
   }
+}
 
-  // Handle decision timing
-  if (isWaitingForDecision && (currentTime - decisionStartTime >= 3000)) {
-    isWaitingForDecision = false;
-    setDecisionLights();
-    isIgnoringDecisions = true;
-    ignoreStartTime = currentTime;
-  }
+void downLedOff(void* context) {
+  digitalWrite(downLedPin, LOW);
+  downLedOn = false;
+  saveState();
+  Serial.println("Down LED turned off");
+}
+
+// Change window, cooldown and reminder timeouts of the lift engine
+void onLiftTimeout(void* context) {
+  lift.tick();
+  saveState();
+  scheduleLift();
+}
 
-  if (isIgnoringDecisions && (currentTime - ignoreStartTime >= 5000)) {
-    isIgnoringDecisions = false;
+// Call after every event fed to the lift engine
+void scheduleLift() {
+  uint32_t timeout = lift.msUntilTimeout();
+  if (timeout == LIFT_NO_TIMEOUT) {
+    timers.cancel(liftTimer);
+  } else {
+    timers.start(liftTimer, timeout, onLiftTimeout);
   }
 }
 
 void wifiConnect() {
   Serial.print("Connecting to WiFi ");
   Serial.print(wifiSSID);
+  WiFi.persistent(false);
   WiFi.mode(WIFI_STA);
-  WiFi.begin(wifiSSID, wifiPassword);
+
+  // After a warm reset, rejoin the same access point without scanning
+  bool fastConnect = wifiChannel != 0;
+  if (fastConnect) {
+    WiFi.begin(wifiSSID, wifiPassword, wifiChannel, wifiBssid);
+  } else {
+    WiFi.begin(wifiSSID, wifiPassword);
+  }
+
+  unsigned long startTime = millis();
+  unsigned long progressTime = startTime;
+  bool pulsing = false;
   while (WiFi.status() != WL_CONNECTED) {
-    disconnectLEDs();
-    delay(500);
-    Serial.print(".");
+    feedWatchdog();
+    delay(10);
+    if (millis() - startTime < WIFI_FAST_CONNECT_MS) {
+      continue;
+    }
+    if (fastConnect) {
+      Serial.print(" cached AP not found, scanning");
+      fastConnect = false;
+      WiFi.disconnect();
+      WiFi.begin(wifiSSID, wifiPassword);
+    }
+    // Polled every 10 ms so the join is noticed at once instead of after a 5 s breath
+    pulseDisconnectLEDs();
+    pulsing = true;
+    if (millis() - progressTime >= WIFI_PROGRESS_MS) {
+      Serial.print(".");
+      progressTime = millis();
+    }
+  }
+  if (pulsing) {
+    for (int i = 0; i < 3; i++) {
+      analogWrite(refBadDecisions[i], 0);
+    }
   }
   Serial.println(" connected");
+
+  wifiChannel = WiFi.channel();
+  memcpy(wifiBssid, WiFi.BSSID(), 6);
+  saveState();
 }
 
+// Makes at most one connection attempt, spaced out by the reconnect policy, so the
+// loop (and the UDP fast path) keeps running while the broker is unreachable
 void mqttReconnect() {
-  long r = random(1000);
-  sprintf(clientId, "owlcms-%ld", r);
   if (WiFi.status() != WL_CONNECTED) {
     wifiConnect();
   }
-  while (!mqttClient.connected()) {
-    Serial.print(macAddress);
-    Serial.print(" connecting to MQTT server...");
-
-    if (mqttClient.connect(clientId, mqttUserName, mqttPassword)) {
-      Serial.println(" connected");
-      mqttClient.subscribe(downSignalTopic.c_str());
-      mqttClient.subscribe(decisionTopic.c_str());
-      mqttClient.subscribe(resetDecisionsTopic.c_str());
-    } else {
-      Serial.print("MQTT connection failed, rc=");
-      Serial.print(mqttClient.state());
-      Serial.println(" try again in 5 second");
-      disconnectLEDs();
-      //delay(5000);
+  if (mqttClient.connected()) {
+    return;
+  }
+  if (!reconnectPolicy.due(millis())) {
+    pulseDisconnectLEDs();
+    return;
+  }
+
+  Serial.print(clientId);
+  Serial.print(" connecting to MQTT server...");
+
+  // cleanSession=false: the broker keeps our subscriptions (and queued QoS 1 messages) across reconnects.
+  // The retained will marks us offline as soon as the broker notices the connection is gone.
+  uint32_t connectStart = millis();
+  if (mqttClient.connect(clientId, mqttUserName, mqttPassword, presenceTopic, 1, true, "offline", false)) {
+    // Includes the TLS handshake in TLS builds
+    Serial.print(" connected in ");
+    Serial.print(millis() - connectStart);
+    Serial.println(" ms");
+    reconnectPolicy.succeeded();
+    for (int i = 0; i < 3; i++) {
+      analogWrite(refBadDecisions[i], 0);
     }
+    liftStatusSynced = false;
+    frameSeen = false;
+    subscribeTopics();
+    publishPresence();
+  } else {
+    uint32_t retryDelay = reconnectPolicy.failed(millis(), esp_random());
+    Serial.print("MQTT connection failed, rc=");
+    Serial.print(mqttClient.state());
+    Serial.print(" try again in ");
+    Serial.print(retryDelay);
+    Serial.println(" ms");
   }
 }
 
-void disconnectLEDs() {
-  for(int dutyCycle = 0; dutyCycle <= 255; dutyCycle++){   
-    analogWrite(refBadDecisions[0], dutyCycle);
-    analogWrite(refBadDecisions[1], dutyCycle);
-    analogWrite(refBadDecisions[2], dutyCycle);
-    delay(10);
+// Breathes the bad-decision LEDs over 5.12 s; called on every pass while WiFi or the broker is unreachable
+void pulseDisconnectLEDs() {
+  uint32_t phase = millis() % 5120;
+  int dutyCycle = phase < 2560 ? phase / 10 : 511 - phase / 10;
+  for (int i = 0; i < 3; i++) {
+    analogWrite(refBadDecisions[i], dutyCycle);
   }
+}
 
-  for(int dutyCycle = 255; dutyCycle >= 0; dutyCycle--){
-    analogWrite(refBadDecisions[0], dutyCycle);
-    analogWrite(refBadDecisions[1], dutyCycle);
-    analogWrite(refBadDecisions[2], dutyCycle);
-    delay(10);
+void publishPresence() {
+  char message[40];
+  TextWriter writer(message);
+  writer.text("online lightbox 0 ").integer(WiFi.RSSI());
+#ifdef EMBEDDED_BROKER
+  broker.publish(presenceTopic, (const uint8_t*)message, writer.length(), true);
+#else
+  mqttClient.publish(presenceTopic, message, true);
+#endif
+  timers.start(presenceTimer, PRESENCE_INTERVAL_MS, refreshPresence);
+}
+
+void refreshPresence(void* context) {
+#ifndef EMBEDDED_BROKER
+  if (!mqttClient.connected()) {
+    return;
+  }
+#endif
+  publishPresence();
+}
+
+void sendHeartbeat(void* context) {
+  timers.start(heartbeatTimer, HEARTBEAT_INTERVAL_MS, sendHeartbeat);
+  char message[24];
+  TextWriter(message).text("lightbox ").unsignedInteger(heartbeatCount++);
+  transport.publish(heartbeatTopic, message);
+}
+
+// Stack, heap and loop wake-up telemetry; a new warning is also logged and sent on its own topic
+void publishHealth(void* context) {
+  timers.start(healthTimer, HEALTH_INTERVAL_MS, publishHealth);
+  char message[HEALTH_MESSAGE_SIZE];
+  bool warning = healthSample();
+  size_t length = healthFormat(message, sizeof(message));
+  // Loop passes per second since the last report: the timers' rate when idle, more under traffic
+  static uint32_t reportedWakeups = 0;
+  uint32_t wakeups = eventWakeups();
+  float perSecond = (wakeups - reportedWakeups) * 1000.0f / HEALTH_INTERVAL_MS;
+  TextWriter(message + length, sizeof(message) - length).text(" wakeups/s=").fixed(perSecond, 1);
+  reportedWakeups = wakeups;
+  transport.publish(healthTopic, message);
+  if (warning) {
+    healthFormatWarnings(message, sizeof(message));
+    Serial.print("Health warning: ");
+    Serial.println(message);
+    transport.publish(healthWarningTopic, message);
+  }
+}
+
+// Always subscribed. The reset stays so that an OWLCMS reset can hand the outputs back to
+// the lift engine while frames drive.
+static char* const subscribedTopics[] = {
+  resetDecisionsTopic, displayTopic,
+#ifdef PROFILING
+  profileTopic,
+#endif
+};
+// What the lift engine and the outputs run on without display frames: subscribed until the
+// first frame after a connect, and again once OWLCMS takes over
+static char* const fallbackTopics[] = {
+  downSignalTopic, decisionTopic, buzzerTopic,
+};
+static_assert(ELEMENTCOUNT(subscribedTopics) + ELEMENTCOUNT(fallbackTopics) + 1 <= UDP_MAX_FILTERS,
+              "raise UDP_MAX_FILTERS in transport.h");
+
+void subscribeTopics() {
+  for (size_t i = 0; i < ELEMENTCOUNT(subscribedTopics); i++) {
+    transport.subscribe(subscribedTopics[i]);
+  }
+  for (size_t i = 0; i < ELEMENTCOUNT(fallbackTopics); i++) {
+    transport.subscribe(fallbackTopics[i]);
+  }
+  transport.subscribe(liftStateTopic);
+  liftStateSubscribed = true;
+  fallbackSubscribed = true;
+}
+
+// Drops the lift status once its retained copy has been read, and the fallback topics while
+// frames drive. Runs from a timer rather than callback(): PubSubClient builds the packet in
+// the buffer the message being handled still lives in.
+void updateSubscriptions(void* context) {
+  if (liftStatusSynced && liftStateSubscribed) {
+    transport.unsubscribe(liftStateTopic);
+    liftStateSubscribed = false;
+  }
+  bool fallback = !frameSeen || !framesDrive();
+  if (fallback != fallbackSubscribed) {
+    for (size_t i = 0; i < ELEMENTCOUNT(fallbackTopics); i++) {
+      if (fallback) {
+        transport.subscribe(fallbackTopics[i]);
+      } else {
+        transport.unsubscribe(fallbackTopics[i]);
+      }
+    }
+    fallbackSubscribed = fallback;
+  }
+}
+
+#ifdef PROFILING
+// Answers a request on owlcms/profile/<fop>: one message per probe, "reset" also clears them
+void publishProfile(bool reset) {
+  char topic[100];
+  char message[PROFILE_MESSAGE_SIZE];
+  for (int i = 0; i < PROBE_COUNT; i++) {
+    snprintf(topic, sizeof(topic), "owlcms/profile/%s/%s/%s", fop, clientId, profileName((ProfileProbe)i));
+    profileFormat((ProfileProbe)i, message, sizeof(message));
+    transport.publish(topic, message);
+  }
+  if (reset) {
+    profileReset();
   }
 }
+#endif
 
 void bootSequence() {
   for(int dutyCycle = 0; dutyCycle <= 255; dutyCycle++){   
@@ -205,7 +546,7 @@ void bootSequence() {
 
 void setupPins() {
   pinMode(downLedPin, OUTPUT);
-  pinMode(buzzerPin, OUTPUT);
+  buzzerBegin(buzzerPin);
   
   //pinMode(silentModePin, INPUT_PULLUP);
   
@@ -220,130 +561,313 @@ void setupPins() {
 }
 
 void callback(char* topic, byte* message, unsigned int length) {
-  String stTopic = String(topic);
-  String stMessage;
+  PROFILE_SCOPE(PROBE_CALLBACK);
+  if (strcmp(topic, decisionTopic) == 0) {
+    processDecision(message, length);
+  }
+
+  if (strcmp(topic, resetDecisionsTopic) == 0) {
+    // A retained reset comes back on every reconnect; only a new epoch starts a new lift
+    uint8_t epoch = parseEpoch(message, length);
+    if (!decisionFilter.reset(epoch)) {
+      return;
+    }
+    if (epoch == DECISION_NO_EPOCH && framesDrive()) {
+      // OWLCMS runs the lifts now: back to the lift engine and its topics
+      frameEpoch = DECISION_NO_EPOCH;
+      timers.start(subscriptionTimer, 0, updateSubscriptions);
+    }
+    lift.reset();
+    scheduleLift();
+    saveState();
+    buzzerPlay(BUZZER_RESET_ACK);
+  }
 
-  for (int i = 0; i < length; i++) {
-    stMessage += (char)message[i];
+  if (strcmp(topic, liftStateTopic) == 0) {
+    LiftStatus status;
+    // Only the retained copy sent on subscribing is needed: the display frames and the
+    // decisions carry the lift from there
+    if (decodeLiftStatus(message, length, status) && !decisionFilter.stale(status.epoch) &&
+        (decisionFilter.reset(status.epoch) || !liftStatusSynced)) {
+      syncLiftStatus(status);
+    }
+    timers.start(subscriptionTimer, 0, updateSubscriptions);
   }
 
-  if (stTopic.startsWith(decisionTopic)) {
-    if (!isIgnoringDecisions) {
-      processDecision(stMessage);
-      Serial.println(stTopic + stMessage);
-    } else {
-      Serial.println("Ignoring decision");
+  if (strcmp(topic, displayTopic) == 0) {
+    DisplayFrame frame;
+    if (decodeDisplayFrame(message, length, frame) && !decisionFilter.stale(frame.epoch) &&
+        (!frameSeen || frame.epoch != frameEpoch || (int8_t)(frame.seq - frameSeq) > 0)) {
+      renderFrame(frame);
+      if (fallbackSubscribed) {
+        timers.start(subscriptionTimer, 0, updateSubscriptions);
+      }
     }
   }
 
-  if (stTopic.startsWith(resetDecisionsTopic)) {
-    resetDecisions();
+  if (strcmp(topic, buzzerTopic) == 0) {
+    if (length == 7 && memcmp(message, "warning", 7) == 0) {
+      buzzerPlay(BUZZER_WARNING);
+    } else if (length == 5 && memcmp(message, "final", 5) == 0) {
+      buzzerPlay(BUZZER_FINAL);
+    }
   }
 
-  if (stTopic.startsWith(downSignalTopic)) {
-    Serial.println(stTopic + stMessage);
-    downSignal();
+  if (strcmp(topic, downSignalTopic) == 0) {
+    Serial.print(topic);
+    Serial.write(message, length);
+    Serial.println();
+    lift.down();
+    scheduleLift();
+    saveState();
   }
-}
 
-void processDecision(String message) {
-  int spaceIndex = message.indexOf(' ');
-  if (spaceIndex == -1) {
-    Serial.println("Invalid message format");
-    return;
+#ifdef PROFILING
+  if (strcmp(topic, profileTopic) == 0) {
+    publishProfile(payloadStartsWith(message, length, "reset"));
   }
+#endif
+}
 
-  String refNumber = message.substring(0, spaceIndex);
-  String decision = message.substring(spaceIndex + 1);
+// True while the central box drives the outputs with display frames; the lift engine then
+// only follows resets and the lift status
+bool framesDrive() {
+  return frameEpoch != DECISION_NO_EPOCH;
+}
 
-  if (decision != "good" && decision != "bad") {
-    Serial.println("Invalid decision in message");
+// Outputs requested by the lift engine
+void onLiftAction(LiftAction action, uint8_t referee) {
+  if (framesDrive() && (action == LIFT_ACTION_DOWN || action == LIFT_ACTION_SHOW || action == LIFT_ACTION_CLEAR)) {
     return;
   }
+  switch (action) {
+    case LIFT_ACTION_DOWN:
+      downSignal();
+      break;
+    case LIFT_ACTION_SHOW:
+      setDecisionLights();
+      break;
+    case LIFT_ACTION_CLEAR:
+      clearDecisionLights();
+      Serial.println("Lift reset");
+      break;
+    case LIFT_ACTION_REMIND:
+      // Reminders are sent by the central box
+      Serial.print("Waiting for referee "); Serial.println(referee);
+      break;
+    case LIFT_ACTION_IGNORE:
+      Serial.println("Ignoring decision");
+      break;
+    default:
+      break;
+  }
+}
 
-  if (refNumber == "1") {
-    ref1Decision = decision;
-  } else if (refNumber == "2") {
-    ref2Decision = decision;
-  } else if (refNumber == "3") {
-    ref3Decision = decision;
-  } else {
-    Serial.println("Invalid referee number in message");
+// Accepts both the OWLCMS text form and the binary decision format
+void processDecision(const byte* message, unsigned int length) {
+  Decision decision;
+  if (!decodeDecision(message, length, decision)) {
+    Serial.println("Invalid decision message");
     return;
   }
+  DecisionVerdict verdict = decisionFilter.check(decision);
+  if (verdict == DECISION_DUPLICATE || verdict == DECISION_STALE) {
+    Serial.print(verdict == DECISION_DUPLICATE ? "Duplicate" : "Stale");
+    Serial.print(" decision ref"); Serial.print(decision.referee);
+    Serial.print(" seq "); Serial.println(decision.seq);
+    return;
+  }
+  if (verdict == DECISION_NEW_EPOCH) {
+    // The reset for this lift never arrived
+    lift.reset();
+  }
 
-  //checkDecisions();
+  Serial.print("Decision ref"); Serial.print(decision.referee); Serial.print(decision.good ? " good" : " bad");
+  Serial.print(" seq "); Serial.println(decision.seq);
+  lift.decision(decision.referee, decision.good);
+  scheduleLift();
+  saveState();
 }
 
-// void checkDecisions() {
-//   //int goodCount = 0, badCount = 0;
-//   String decisions[] = {ref1Decision, ref2Decision, ref3Decision};
-
-//   // for (String d : decisions) {
-//   //   if (d == "good") goodCount++;
-//   //   else if (d == "bad") badCount++;
-//   // }
-
-//   // if (!downTriggered && (goodCount == 2 || badCount == 2)) {
-//   //   downSignal();
-//   //   downTriggered = true;
-//   // }
-
-//   if (!ref1Decision.isEmpty() && !ref2Decision.isEmpty() && !ref3Decision.isEmpty()) {
-//     setDecisionLights();
-//     resetDecisions();
-//   }
-// }
-
 void setDecisionLights() {
-  digitalWrite(buzzerPin, LOW);
+  uint8_t lights = 0;
+  for (int referee = 1; referee <= 3; referee++) {
+    if (lift.vote(referee) == 'g') {
+      lights |= DISPLAY_GOOD_LIGHT(referee);
+    } else if (lift.vote(referee) == 'b') {
+      lights |= DISPLAY_BAD_LIGHT(referee);
+    }
+  }
+  showLights(lights);
+}
+
+// lights as in a display frame
+void showLights(uint8_t lights) {
+  PROFILE_SCOPE(PROBE_DECISION_LIGHTS);
+  buzzerStop(BUZZER_DOWN);
   digitalWrite(downLedPin, LOW);
-  
-  analogWrite(refGoodDecisions[0], ref1Decision == "good" ? 255 : 0);
-  analogWrite(refBadDecisions[0], ref1Decision == "bad" ? 255 : 0);
 
-  analogWrite(refGoodDecisions[1], ref2Decision == "good" ? 255 : 0);
-  analogWrite(refBadDecisions[1], ref2Decision == "bad" ? 255 : 0);
+  for (int i = 0; i < 3; i++) {
+    analogWrite(refGoodDecisions[i], lights & DISPLAY_GOOD_LIGHT(i + 1) ? 255 : 0);
+    analogWrite(refBadDecisions[i], lights & DISPLAY_BAD_LIGHT(i + 1) ? 255 : 0);
+  }
+  lightsOn = true;
+  timers.start(lightsTimer, DECISION_LIGHTS_MS, lightsOff);
+}
+
+void lightsOff(void* context) {
+  clearDecisionLights();
+}
 
-  analogWrite(refGoodDecisions[2], ref3Decision == "good" ? 255 : 0);
-  analogWrite(refBadDecisions[2], ref3Decision == "bad" ? 255 : 0);
-   
-  delay(3000);
+void clearDecisionLights() {
+  timers.cancel(lightsTimer);
   for (int i = 0; i < 3; i++) {
     analogWrite(refBadDecisions[i], 0);
     analogWrite(refGoodDecisions[i], 0);
   }
-
-  resetDecisions();
+  lightsOn = false;
 }
 
 void downSignal() {
   // Turn on both down LED and buzzer
   digitalWrite(downLedPin, HIGH);
-  digitalWrite(buzzerPin, HIGH);
+  buzzerPlay(BUZZER_DOWN);
   
   // Record the time when down signal was triggered
   downSignalStartTime = millis();
   
   // Set flags to track states
-  buzzerOn = true;
   downLedOn = true;
+  timers.start(downLedTimer, DOWN_LED_MS, downLedOff);
   
   // Log the action
   Serial.println("Down signal activated - buzzer and LED ON");
+  saveState();
+}
 
-  if (!isWaitingForDecision && !isIgnoringDecisions) {
-    Serial.println("it reaches here");
-    isWaitingForDecision = true;
-    decisionStartTime = millis();
+// Shows what the central box's frame asks for. The down LED and the lights keep their own
+// timers, so a lost "off" frame cannot leave them on.
+void renderFrame(const DisplayFrame &frame) {
+  if (frame.epoch != frameEpoch) {
+    frameBuzzer = BUZZER_NONE;
+  }
+  frameSeen = true;
+  frameEpoch = frame.epoch;
+  frameSeq = frame.seq;
+
+  if (frame.buzzer != frameBuzzer) {
+    frameBuzzer = frame.buzzer;
+    if (frame.buzzer != BUZZER_NONE && frame.buzzer < BUZZER_PATTERN_COUNT) {
+      buzzerPlay((BuzzerPattern)frame.buzzer);
+    }
+  }
+  if (frame.down && !downLedOn) {
+    downSignalStartTime = millis();
+    downLedOn = true;
+    digitalWrite(downLedPin, HIGH);
+    timers.start(downLedTimer, DOWN_LED_MS, downLedOff);
+  } else if (!frame.down && downLedOn) {
+    timers.cancel(downLedTimer);
+    downLedOff(NULL);
+  }
+  if (frame.lights != 0) {
+    showLights(frame.lights);
+  } else if (lightsOn) {
+    clearDecisionLights();
   }
-  // checkDecisions();
+  saveState();
 }
 
-void resetDecisions() {
-  ref1Decision = "";
-  ref2Decision = "";  
-  ref3Decision = "";
-  downTriggered = false;
-  Serial.println(ref1Decision + ref2Decision + ref3Decision);
+// Rebuilds the lift and the outputs from the central box's status: the down signal and
+// the lights get whatever is left of their time, as after a warm reset
+void syncLiftStatus(const LiftStatus &status) {
+  liftStatusSynced = true;
+  LiftState phase = (LiftState)status.phase;
+  if (phase >= LIFT_STATE_COUNT) {
+    return;
+  }
+  Serial.print("Lift status: phase "); Serial.print(phase); Serial.print(" epoch "); Serial.println(status.epoch);
+  lift.sync(phase, status.votes, status.remainingMs);
+
+  unsigned long sincePhase = millis() - lift.stateEnteredMs();
+  if (phase == LIFT_CHANGE_WINDOW) {
+    if (!downLedOn) {
+      downSignalStartTime = lift.stateEnteredMs();
+      downLedOn = true;
+      digitalWrite(downLedPin, HIGH);
+      timers.start(downLedTimer, sincePhase < DOWN_LED_MS ? DOWN_LED_MS - sincePhase : 0, downLedOff);
+      if (sincePhase < BUZZER_DOWN_MS) {
+        buzzerPlay(BUZZER_DOWN, sincePhase);
+      }
+    }
+    clearDecisionLights();
+  } else if (phase == LIFT_COOLDOWN) {
+    // Redrawn even if already lit: the lights may show a change missed while offline
+    if (sincePhase < DECISION_LIGHTS_MS) {
+      setDecisionLights();
+      timers.start(lightsTimer, DECISION_LIGHTS_MS - sincePhase, lightsOff);
+    }
+  } else {
+    clearDecisionLights();
+    buzzerStop(BUZZER_DOWN);
+    if (downLedOn) {
+      timers.cancel(downLedTimer);
+      downLedOff(NULL);
+    }
+  }
+  scheduleLift();
+  saveState();
+}
+
+// Converts between millis() start times and the RTC clock, which keeps running across a reset
+uint64_t toRtcTime(unsigned long startTime) {
+  return rtcClockMs() - (millis() - startTime);
+}
+
+unsigned long fromRtcTime(uint64_t rtcTime) {
+  return millis() - (unsigned long)(rtcClockMs() - rtcTime);
+}
+
+void saveState() {
+  LightboxSnapshot snapshot;
+  memset(&snapshot, 0, sizeof(snapshot));
+  for (int i = 0; i < 3; i++) {
+    snapshot.decisions[i] = lift.vote(i + 1);
+  }
+  snapshot.downLedOn = downLedOn;
+  snapshot.buzzerOn = buzzerCurrent() == BUZZER_DOWN;
+  snapshot.liftState = lift.state();
+  snapshot.wifiChannel = wifiChannel;
+  memcpy(snapshot.wifiBssid, wifiBssid, 6);
+  snapshot.liftEpoch = decisionFilter.epoch();
+  snapshot.downSignalStart = toRtcTime(downSignalStartTime);
+  snapshot.liftStateStart = toRtcTime(lift.stateEnteredMs());
+  writeSnapshot(snapshot);
+}
+
+// Re-arms the timers with whatever was left of them; those that expired while the
+// device was down fire on the first pass through loop()
+void restoreState(const LightboxSnapshot &snapshot) {
+  Serial.println("Warm reset: restoring lift state");
+  lift.restore((LiftState)snapshot.liftState, snapshot.decisions, fromRtcTime(snapshot.liftStateStart));
+  downLedOn = snapshot.downLedOn;
+  wifiChannel = snapshot.wifiChannel;
+  memcpy(wifiBssid, snapshot.wifiBssid, 6);
+  decisionFilter.restore(snapshot.liftEpoch);
+  downSignalStartTime = fromRtcTime(snapshot.downSignalStart);
+
+  digitalWrite(downLedPin, downLedOn ? HIGH : LOW);
+  unsigned long sinceDown = millis() - downSignalStartTime;
+  if (snapshot.buzzerOn && sinceDown < BUZZER_DOWN_MS) {
+    buzzerPlay(BUZZER_DOWN, sinceDown);
+  }
+  if (downLedOn) {
+    timers.start(downLedTimer, sinceDown < DOWN_LED_MS ? DOWN_LED_MS - sinceDown : 0, downLedOff);
+  }
+  unsigned long sinceLights = millis() - lift.stateEnteredMs();
+  if (lift.state() == LIFT_COOLDOWN && sinceLights < DECISION_LIGHTS_MS) {
+    setDecisionLights();
+    timers.start(lightsTimer, DECISION_LIGHTS_MS - sinceLights, lightsOff);
+  }
+  scheduleLift();
 }
\ No newline at end of file
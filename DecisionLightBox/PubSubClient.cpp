@@ -8,6 +8,7 @@
 
 #include "PubSubClient.h"
 #include "Arduino.h"
+#include "profile.h"
 
 PubSubClient::PubSubClient() {
     this->_state = MQTT_DISCONNECTED;
@@ -311,6 +312,7 @@ boolean PubSubClient::readByte(uint8_t * result, uint16_t * index){
 }
 
 uint32_t PubSubClient::readPacket(uint8_t* lengthLength) {
+    PROFILE_SCOPE(PROBE_READ_PACKET);
     uint16_t len = 0;
     if(!readByte(this->buffer, &len)) return 0;
     bool isPublish = (this->buffer[0]&0xF0) == MQTTPUBLISH;
@@ -369,6 +371,7 @@ uint32_t PubSubClient::readPacket(uint8_t* lengthLength) {
 }
 
 boolean PubSubClient::loop() {
+    PROFILE_SCOPE(PROBE_MQTT_LOOP);
     if (connected()) {
         unsigned long t = millis();
         if ((t - lastInActivity > SIMULATION_SPEED*this->keepAlive*1000UL) || (t - lastOutActivity > SIMULATION_SPEED*this->keepAlive*1000UL)) {
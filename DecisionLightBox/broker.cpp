@@ -0,0 +1,718 @@
+#include <string.h>
+#include "broker.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+#define BROKER_CONNECT     0x10
+#define BROKER_CONNACK     0x20
+#define BROKER_PUBLISH     0x30
+#define BROKER_PUBACK      0x40
+#define BROKER_SUBSCRIBE   0x80
+#define BROKER_SUBACK      0x90
+#define BROKER_UNSUBSCRIBE 0xA0
+#define BROKER_UNSUBACK    0xB0
+#define BROKER_PINGREQ     0xC0
+#define BROKER_PINGRESP    0xD0
+#define BROKER_DISCONNECT  0xE0
+
+#define CONNACK_ACCEPTED      0
+#define CONNACK_BAD_PROTOCOL  1
+#define CONNACK_BAD_CLIENT_ID 2
+
+#define SUBACK_FAILURE 0x80
+
+// Space reserved in front of a packet body for the fixed header
+#define HEADER_RESERVE 5
+
+// Clients that open a socket but never send CONNECT are dropped after this long
+#define CONNECT_TIMEOUT_MS 10000
+
+// Reads a length-prefixed string; returns false if it would overrun the packet
+static bool readString(const uint8_t* body, size_t length, size_t& pos, const uint8_t*& str, uint16_t& strLength) {
+  if (pos + 2 > length) {
+    return false;
+  }
+  strLength = (body[pos] << 8) | body[pos + 1];
+  pos += 2;
+  if (pos + strLength > length) {
+    return false;
+  }
+  str = body + pos;
+  pos += strLength;
+  return true;
+}
+
+static bool copyString(char* dest, size_t size, const uint8_t* str, uint16_t strLength) {
+  if (strLength >= size) {
+    return false;
+  }
+  memcpy(dest, str, strLength);
+  dest[strLength] = '\0';
+  return true;
+}
+
+static bool hasWildcard(const char* topic) {
+  return strchr(topic, '+') != NULL || strchr(topic, '#') != NULL;
+}
+
+// ====== Connection handling ======================================================
+
+void MqttBroker::begin(BrokerIO& io) {
+  this->io = &io;
+  memset(sessions, 0, sizeof(sessions));
+  memset(localSubscriptions, 0, sizeof(localSubscriptions));
+  memset(retained, 0, sizeof(retained));
+}
+
+void MqttBroker::setLocalCallback(BrokerLocalCallback callback, void* context) {
+  localCallback = callback;
+  localContext = context;
+}
+
+void MqttBroker::clearSession(Session& session) {
+  memset(&session, 0, sizeof(session));
+}
+
+// Returns the slot for a new connection, or -1 if the broker is full
+int MqttBroker::accept() {
+  // Prefer an empty slot, then one holding the persistent session of an offline client
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < BROKER_MAX_CLIENTS; i++) {
+      Session& s = sessions[i];
+      if ((pass == 0 && !s.used) || (pass == 1 && !s.connected)) {
+        clearSession(s);
+        s.used = true;
+        s.connected = true;
+        s.lastActivity = nowMs;
+        return i;
+      }
+    }
+  }
+  return -1;
+}
+
+void MqttBroker::receive(int slot, const uint8_t* data, size_t length) {
+  Session& s = sessions[slot];
+  if (!s.connected) {
+    return;
+  }
+  s.lastActivity = nowMs;
+
+  while (length > 0) {
+    size_t chunk = BROKER_PACKET_SIZE - s.inputLength;
+    if (chunk == 0) {
+      drop(slot, true);
+      return;
+    }
+    if (chunk > length) {
+      chunk = length;
+    }
+    memcpy(s.input + s.inputLength, data, chunk);
+    s.inputLength += chunk;
+    data += chunk;
+    length -= chunk;
+
+    // Handle every complete packet in the buffer
+    while (s.inputLength >= 2) {
+      size_t remaining = 0;
+      size_t pos = 1;
+      uint32_t multiplier = 1;
+      bool complete = false;
+      while (pos < s.inputLength && pos <= 4) {
+        uint8_t digit = s.input[pos++];
+        remaining += (digit & 0x7F) * multiplier;
+        multiplier *= 128;
+        if (!(digit & 0x80)) {
+          complete = true;
+          break;
+        }
+      }
+      if (!complete) {
+        if (pos > 4) {
+          drop(slot, true);
+          return;
+        }
+        break;
+      }
+      if (pos + remaining > BROKER_PACKET_SIZE) {
+        drop(slot, true);
+        return;
+      }
+      if (pos + remaining > s.inputLength) {
+        break;
+      }
+
+      handlePacket(slot, s.input[0], s.input + pos, remaining);
+      if (!s.connected) {
+        return;
+      }
+      size_t consumed = pos + remaining;
+      memmove(s.input, s.input + consumed, s.inputLength - consumed);
+      s.inputLength -= consumed;
+    }
+  }
+}
+
+void MqttBroker::connectionLost(int slot) {
+  drop(slot, true);
+}
+
+void MqttBroker::tick(uint32_t nowMs) {
+  this->nowMs = nowMs;
+  for (int i = 0; i < BROKER_MAX_CLIENTS; i++) {
+    Session& s = sessions[i];
+    if (!s.connected) {
+      continue;
+    }
+    uint32_t idle = nowMs - s.lastActivity;
+    if (!s.established && idle > CONNECT_TIMEOUT_MS) {
+      drop(i, false);
+    } else if (s.established && s.keepAlive > 0 && idle > (uint32_t)s.keepAlive * 1500) {
+      drop(i, true);
+    }
+  }
+}
+
+// Closes the connection; the session survives if the client asked for a persistent one
+void MqttBroker::drop(int slot, bool sendWill) {
+  Session& s = sessions[slot];
+  if (!s.connected) {
+    return;
+  }
+  io->close(slot);
+  s.connected = false;
+
+  bool publishWill = sendWill && s.established && s.hasWill;
+  char willTopic[BROKER_MAX_TOPIC];
+  uint8_t willPayload[BROKER_MAX_PAYLOAD];
+  uint16_t willLength = s.willLength;
+  uint8_t willQos = s.willQos;
+  bool willRetain = s.willRetain;
+  if (publishWill) {
+    strcpy(willTopic, s.willTopic);
+    memcpy(willPayload, s.willPayload, willLength);
+  }
+
+  if (!s.established || s.cleanSession) {
+    clearSession(s);
+  } else {
+    s.established = false;
+    s.hasWill = false;
+    s.inputLength = 0;
+  }
+
+  if (publishWill) {
+    if (willRetain) {
+      storeRetained(willTopic, willPayload, willLength, willQos);
+    }
+    route(willTopic, willPayload, willLength, willQos, false);
+  }
+}
+
+// ====== Packet handling ======================================================
+
+void MqttBroker::handlePacket(int slot, uint8_t header, const uint8_t* body, size_t length) {
+  Session& s = sessions[slot];
+  uint8_t type = header & 0xF0;
+
+  if (!s.established && type != BROKER_CONNECT) {
+    drop(slot, false);
+    return;
+  }
+
+  switch (type) {
+    case BROKER_CONNECT:
+      if (s.established) {
+        drop(slot, true);
+      } else {
+        handleConnect(slot, body, length);
+      }
+      break;
+    case BROKER_PUBLISH:
+      handlePublish(slot, header, body, length);
+      break;
+    case BROKER_PUBACK:
+      // Outgoing QoS 1 messages are not retried, so there is nothing to release
+      break;
+    case BROKER_SUBSCRIBE:
+      handleSubscribe(slot, body, length);
+      break;
+    case BROKER_UNSUBSCRIBE:
+      handleUnsubscribe(slot, body, length);
+      break;
+    case BROKER_PINGREQ:
+      sendPacket(slot, BROKER_PINGRESP, NULL, 0);
+      break;
+    case BROKER_DISCONNECT:
+      s.hasWill = false;
+      drop(slot, false);
+      break;
+    default:
+      drop(slot, true);
+      break;
+  }
+}
+
+void MqttBroker::handleConnect(int slot, const uint8_t* body, size_t length) {
+  Session& s = sessions[slot];
+  size_t pos = 0;
+  const uint8_t* str;
+  uint16_t strLength;
+
+  if (!readString(body, length, pos, str, strLength) || pos + 4 > length) {
+    drop(slot, false);
+    return;
+  }
+  bool mqtt311 = strLength == 4 && memcmp(str, "MQTT", 4) == 0;
+  bool mqtt31 = strLength == 6 && memcmp(str, "MQIsdp", 6) == 0;
+  uint8_t level = body[pos++];
+  uint8_t flags = body[pos++];
+  uint16_t keepAlive = (body[pos] << 8) | body[pos + 1];
+  pos += 2;
+
+  uint8_t ack[2] = {0, CONNACK_ACCEPTED};
+  if (!(mqtt311 && level == 4) && !(mqtt31 && level == 3)) {
+    ack[1] = CONNACK_BAD_PROTOCOL;
+    sendPacket(slot, BROKER_CONNACK, ack, 2);
+    drop(slot, false);
+    return;
+  }
+
+  char clientId[BROKER_CLIENT_ID_SIZE];
+  bool cleanSession = flags & 0x02;
+  if (!readString(body, length, pos, str, strLength)) {
+    drop(slot, false);
+    return;
+  }
+  if (!copyString(clientId, sizeof(clientId), str, strLength) || (strLength == 0 && !cleanSession)) {
+    ack[1] = CONNACK_BAD_CLIENT_ID;
+    sendPacket(slot, BROKER_CONNACK, ack, 2);
+    drop(slot, false);
+    return;
+  }
+
+  s.hasWill = false;
+  if (flags & 0x04) {
+    const uint8_t* willMessage;
+    uint16_t willLength;
+    if (!readString(body, length, pos, str, strLength) || !readString(body, length, pos, willMessage, willLength)) {
+      drop(slot, false);
+      return;
+    }
+    // A will that does not fit is ignored rather than truncated
+    if (copyString(s.willTopic, sizeof(s.willTopic), str, strLength) && willLength <= BROKER_MAX_PAYLOAD &&
+        !hasWildcard(s.willTopic)) {
+      memcpy(s.willPayload, willMessage, willLength);
+      s.willLength = willLength;
+      s.willQos = (flags >> 3) & 0x03;
+      if (s.willQos > 1) {
+        s.willQos = 1;
+      }
+      s.willRetain = flags & 0x20;
+      s.hasWill = true;
+    }
+  }
+  // User name and password (flags 0x80 / 0x40) are accepted without checking, like allow_anonymous
+
+  // Take over an existing connection or persistent session with the same client id
+  if (strLength > 0) {
+    for (int i = 0; i < BROKER_MAX_CLIENTS; i++) {
+      Session& other = sessions[i];
+      if (i == slot || !other.used || strcmp(other.clientId, clientId) != 0) {
+        continue;
+      }
+      if (other.connected) {
+        io->close(i);
+      }
+      if (!cleanSession && !other.cleanSession) {
+        memcpy(s.subscriptions, other.subscriptions, sizeof(s.subscriptions));
+        ack[0] = 1;
+      }
+      clearSession(other);
+    }
+  }
+
+  strcpy(s.clientId, clientId);
+  s.cleanSession = cleanSession;
+  s.keepAlive = keepAlive;
+  s.nextPacketId = 1;
+  s.established = true;
+  sendPacket(slot, BROKER_CONNACK, ack, 2);
+}
+
+void MqttBroker::handlePublish(int slot, uint8_t header, const uint8_t* body, size_t length) {
+  uint8_t qos = (header >> 1) & 0x03;
+  bool retain = header & 0x01;
+  size_t pos = 0;
+  const uint8_t* str;
+  uint16_t strLength;
+  char topic[BROKER_MAX_TOPIC];
+
+  if (qos > 1 || !readString(body, length, pos, str, strLength) ||
+      !copyString(topic, sizeof(topic), str, strLength) || hasWildcard(topic)) {
+    drop(slot, true);
+    return;
+  }
+
+  if (qos == 1) {
+    if (pos + 2 > length) {
+      drop(slot, true);
+      return;
+    }
+    uint8_t ack[2] = {body[pos], body[pos + 1]};
+    pos += 2;
+    sendPacket(slot, BROKER_PUBACK, ack, 2);
+  }
+
+  const uint8_t* payload = body + pos;
+  unsigned int payloadLength = length - pos;
+  if (retain) {
+    storeRetained(topic, payload, payloadLength, qos);
+  }
+  route(topic, payload, payloadLength, qos, false);
+}
+
+void MqttBroker::handleSubscribe(int slot, const uint8_t* body, size_t length) {
+  Session& s = sessions[slot];
+  if (length < 2) {
+    drop(slot, true);
+    return;
+  }
+
+  uint8_t ack[2 + BROKER_MAX_SUBSCRIPTIONS];
+  ack[0] = body[0];
+  ack[1] = body[1];
+  size_t ackLength = 2;
+  int added[BROKER_MAX_SUBSCRIPTIONS];
+  int addedCount = 0;
+
+  size_t pos = 2;
+  while (pos < length) {
+    const uint8_t* str;
+    uint16_t strLength;
+    if (ackLength >= sizeof(ack) || !readString(body, length, pos, str, strLength) || pos >= length) {
+      drop(slot, true);
+      return;
+    }
+    uint8_t qos = body[pos++] & 0x03;
+    if (qos > 1) {
+      qos = 1;
+    }
+
+    char filter[BROKER_MAX_TOPIC];
+    int index = -1;
+    if (copyString(filter, sizeof(filter), str, strLength)) {
+      for (int i = 0; i < BROKER_MAX_SUBSCRIPTIONS; i++) {
+        if (s.subscriptions[i].used && strcmp(s.subscriptions[i].filter, filter) == 0) {
+          index = i;
+          break;
+        }
+      }
+      for (int i = 0; i < BROKER_MAX_SUBSCRIPTIONS && index < 0; i++) {
+        if (!s.subscriptions[i].used) {
+          index = i;
+        }
+      }
+    }
+
+    if (index < 0) {
+      ack[ackLength++] = SUBACK_FAILURE;
+      continue;
+    }
+    Subscription& sub = s.subscriptions[index];
+    strcpy(sub.filter, filter);
+    sub.qos = qos;
+    sub.used = true;
+    added[addedCount++] = index;
+    ack[ackLength++] = qos;
+  }
+  sendPacket(slot, BROKER_SUBACK, ack, ackLength);
+
+  // Retained messages go out after the SUBACK
+  for (int r = 0; r < BROKER_MAX_RETAINED; r++) {
+    Retained& msg = retained[r];
+    if (!msg.used) {
+      continue;
+    }
+    for (int a = 0; a < addedCount; a++) {
+      Subscription& sub = s.subscriptions[added[a]];
+      if (topicMatches(sub.filter, msg.topic)) {
+        sendPublish(slot, msg.topic, msg.payload, msg.length, msg.qos < sub.qos ? msg.qos : sub.qos, true);
+        break;
+      }
+    }
+  }
+}
+
+void MqttBroker::handleUnsubscribe(int slot, const uint8_t* body, size_t length) {
+  Session& s = sessions[slot];
+  if (length < 2) {
+    drop(slot, true);
+    return;
+  }
+
+  size_t pos = 2;
+  while (pos < length) {
+    const uint8_t* str;
+    uint16_t strLength;
+    if (!readString(body, length, pos, str, strLength)) {
+      drop(slot, true);
+      return;
+    }
+    for (int i = 0; i < BROKER_MAX_SUBSCRIPTIONS; i++) {
+      Subscription& sub = s.subscriptions[i];
+      if (sub.used && strlen(sub.filter) == strLength && memcmp(sub.filter, str, strLength) == 0) {
+        sub.used = false;
+      }
+    }
+  }
+
+  uint8_t ack[2] = {body[0], body[1]};
+  sendPacket(slot, BROKER_UNSUBACK, ack, 2);
+}
+
+// ====== Routing ======================================================
+
+void MqttBroker::route(const char* topic, const uint8_t* payload, unsigned int length, uint8_t qos, bool retain) {
+  for (int i = 0; i < BROKER_MAX_CLIENTS; i++) {
+    Session& s = sessions[i];
+    if (!s.connected || !s.established) {
+      continue;
+    }
+    // Overlapping subscriptions get one copy at the highest granted QoS
+    int best = -1;
+    for (int j = 0; j < BROKER_MAX_SUBSCRIPTIONS; j++) {
+      Subscription& sub = s.subscriptions[j];
+      if (sub.used && sub.qos > best && topicMatches(sub.filter, topic)) {
+        best = sub.qos;
+      }
+    }
+    if (best >= 0) {
+      sendPublish(i, topic, payload, length, qos < best ? qos : best, retain);
+    }
+  }
+
+  if (localCallback == NULL) {
+    return;
+  }
+  for (int j = 0; j < BROKER_MAX_SUBSCRIPTIONS; j++) {
+    if (localSubscriptions[j].used && topicMatches(localSubscriptions[j].filter, topic)) {
+      localCallback(localContext, (char*)topic, (uint8_t*)payload, length);
+      return;
+    }
+  }
+}
+
+void MqttBroker::storeRetained(const char* topic, const uint8_t* payload, unsigned int length, uint8_t qos) {
+  Retained* slot = NULL;
+  for (int i = 0; i < BROKER_MAX_RETAINED; i++) {
+    if (retained[i].used && strcmp(retained[i].topic, topic) == 0) {
+      slot = &retained[i];
+      break;
+    }
+  }
+
+  // An empty retained payload clears the topic; one that does not fit clears it too rather than leave it stale
+  if (length == 0 || length > BROKER_MAX_PAYLOAD) {
+    if (slot != NULL) {
+      slot->used = false;
+    }
+    return;
+  }
+
+  for (int i = 0; i < BROKER_MAX_RETAINED && slot == NULL; i++) {
+    if (!retained[i].used) {
+      slot = &retained[i];
+    }
+  }
+  if (slot == NULL) {
+    return;
+  }
+  slot->used = true;
+  strcpy(slot->topic, topic);
+  memcpy(slot->payload, payload, length);
+  slot->length = length;
+  slot->qos = qos;
+}
+
+bool MqttBroker::sendPublish(int slot, const char* topic, const uint8_t* payload, unsigned int length, uint8_t qos, bool retain) {
+  Session& s = sessions[slot];
+  size_t topicLength = strlen(topic);
+  size_t bodyLength = 2 + topicLength + (qos ? 2 : 0) + length;
+  if (bodyLength > BROKER_PACKET_SIZE) {
+    return false;
+  }
+
+  uint8_t* body = output + HEADER_RESERVE;
+  size_t pos = 0;
+  body[pos++] = topicLength >> 8;
+  body[pos++] = topicLength & 0xFF;
+  memcpy(body + pos, topic, topicLength);
+  pos += topicLength;
+  if (qos) {
+    if (s.nextPacketId == 0) {
+      s.nextPacketId = 1;
+    }
+    body[pos++] = s.nextPacketId >> 8;
+    body[pos++] = s.nextPacketId & 0xFF;
+    s.nextPacketId++;
+  }
+  memcpy(body + pos, payload, length);
+  pos += length;
+
+  return sendPacket(slot, BROKER_PUBLISH | (qos << 1) | (retain ? 1 : 0), body, pos);
+}
+
+// Builds the fixed header in front of the body (which may already sit in the output buffer) and sends it
+bool MqttBroker::sendPacket(int slot, uint8_t header, const uint8_t* body, size_t length) {
+  if (length > BROKER_PACKET_SIZE) {
+    return false;
+  }
+  uint8_t* packetBody = output + HEADER_RESERVE;
+  if (length > 0 && body != packetBody) {
+    memmove(packetBody, body, length);
+  }
+
+  uint8_t lengthBytes[4];
+  size_t lengthSize = 0;
+  size_t remaining = length;
+  do {
+    uint8_t digit = remaining % 128;
+    remaining /= 128;
+    if (remaining > 0) {
+      digit |= 0x80;
+    }
+    lengthBytes[lengthSize++] = digit;
+  } while (remaining > 0);
+
+  uint8_t* start = packetBody - lengthSize - 1;
+  start[0] = header;
+  memcpy(start + 1, lengthBytes, lengthSize);
+  return io->write(slot, start, 1 + lengthSize + length);
+}
+
+// ====== Local clients ======================================================
+
+bool MqttBroker::publish(const char* topic, const uint8_t* payload, unsigned int length, bool retain) {
+  if (strlen(topic) >= BROKER_MAX_TOPIC || hasWildcard(topic)) {
+    return false;
+  }
+  if (retain) {
+    storeRetained(topic, payload, length, 0);
+  }
+  route(topic, payload, length, 0, false);
+  return true;
+}
+
+bool MqttBroker::subscribeLocal(const char* filter) {
+  if (strlen(filter) >= BROKER_MAX_TOPIC) {
+    return false;
+  }
+  int index = -1;
+  for (int i = 0; i < BROKER_MAX_SUBSCRIPTIONS; i++) {
+    if (localSubscriptions[i].used && strcmp(localSubscriptions[i].filter, filter) == 0) {
+      return true;
+    }
+    if (!localSubscriptions[i].used && index < 0) {
+      index = i;
+    }
+  }
+  if (index < 0) {
+    return false;
+  }
+  strcpy(localSubscriptions[index].filter, filter);
+  localSubscriptions[index].used = true;
+
+  for (int r = 0; r < BROKER_MAX_RETAINED && localCallback != NULL; r++) {
+    if (retained[r].used && topicMatches(filter, retained[r].topic)) {
+      localCallback(localContext, retained[r].topic, retained[r].payload, retained[r].length);
+    }
+  }
+  return true;
+}
+
+bool MqttBroker::unsubscribeLocal(const char* filter) {
+  for (int i = 0; i < BROKER_MAX_SUBSCRIPTIONS; i++) {
+    if (localSubscriptions[i].used && strcmp(localSubscriptions[i].filter, filter) == 0) {
+      localSubscriptions[i].used = false;
+    }
+  }
+  return true;
+}
+
+void BrokerTransport::begin() {
+  broker.setLocalCallback(onLocalMessage, this);
+}
+
+bool BrokerTransport::publish(const char* topic, const uint8_t* payload, unsigned int length) {
+  return broker.publish(topic, payload, length, false);
+}
+
+bool BrokerTransport::subscribe(const char* topicFilter) {
+  return broker.subscribeLocal(topicFilter);
+}
+
+bool BrokerTransport::unsubscribe(const char* topicFilter) {
+  return broker.unsubscribeLocal(topicFilter);
+}
+
+void BrokerTransport::onLocalMessage(void* context, char* topic, uint8_t* payload, unsigned int length) {
+  BrokerTransport* self = (BrokerTransport*)context;
+  if (self->mux) {
+    self->mux->deliver(self->id, topic, payload, length, self->broker.now());
+  }
+}
+
+#ifdef ARDUINO
+
+// ====== BrokerServer ======================================================
+
+void BrokerServer::begin() {
+  broker.begin(*this);
+  server.begin();
+  server.setNoDelay(true);
+}
+
+void BrokerServer::loop() {
+  broker.tick(millis());
+
+  WiFiClient incoming = server.available();
+  if (incoming) {
+    int slot = broker.accept();
+    if (slot < 0) {
+      incoming.stop();
+    } else {
+      clients[slot] = incoming;
+      clients[slot].setNoDelay(true);
+    }
+  }
+
+  uint8_t buffer[128];
+  for (int i = 0; i < BROKER_MAX_CLIENTS; i++) {
+    if (!clients[i]) {
+      // Socket closed by the peer (or already closed by the broker, in which case this is a no-op)
+      broker.connectionLost(i);
+      continue;
+    }
+    int available;
+    while ((available = clients[i].available()) > 0) {
+      int length = clients[i].read(buffer, available < (int)sizeof(buffer) ? available : sizeof(buffer));
+      if (length <= 0) {
+        break;
+      }
+      broker.receive(i, buffer, length);
+    }
+  }
+}
+
+bool BrokerServer::write(int slot, const uint8_t* data, size_t length) {
+  return clients[slot].write(data, length) == length;
+}
+
+void BrokerServer::close(int slot) {
+  clients[slot].stop();
+}
+
+#endif
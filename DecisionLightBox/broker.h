@@ -0,0 +1,146 @@
+#ifndef BROKER_H
+#define BROKER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "transport.h"
+
+// Lightweight MQTT 3.1.1 broker for standalone operation (build with -DEMBEDDED_BROKER).
+// Supports the subset the system uses: QoS 0/1, + and # wildcards, retained messages,
+// last will and persistent sessions. QoS 1 messages are acknowledged but not redelivered.
+
+#define BROKER_PORT 1883
+// Host builds (Simulator/brokerd.cpp) raise it to serve load tests
+#ifndef BROKER_MAX_CLIENTS
+#define BROKER_MAX_CLIENTS 8
+#endif
+#define BROKER_MAX_SUBSCRIPTIONS 8
+#define BROKER_MAX_RETAINED 16
+// Room for owlcms/health/<fop>/replogic-lightbox-<mac>/warning with the longest fop
+#define BROKER_MAX_TOPIC 80
+#define BROKER_MAX_PAYLOAD 64
+// Device ids are replogic-ref-<mac> (25) and replogic-lightbox-<mac> (30), past the 23 of the spec
+#define BROKER_CLIENT_ID_SIZE 32
+#define BROKER_PACKET_SIZE 256
+
+// Network side of the broker: one connection per client slot
+class BrokerIO {
+public:
+  virtual ~BrokerIO() {}
+  virtual bool write(int slot, const uint8_t* data, size_t length) = 0;
+  virtual void close(int slot) = 0;
+};
+
+typedef void (*BrokerLocalCallback)(void* context, char* topic, uint8_t* payload, unsigned int length);
+
+class MqttBroker {
+public:
+  void begin(BrokerIO& io);
+  void setLocalCallback(BrokerLocalCallback callback, void* context);
+
+  // Connection events from the network side
+  int accept();
+  void receive(int slot, const uint8_t* data, size_t length);
+  void connectionLost(int slot);
+  void tick(uint32_t nowMs);
+  uint32_t now() const { return nowMs; }
+
+  // In-process publish and subscribe for the lightbox itself (no socket round trip)
+  bool publish(const char* topic, const uint8_t* payload, unsigned int length, bool retain);
+  bool subscribeLocal(const char* filter);
+  bool unsubscribeLocal(const char* filter);
+
+private:
+  struct Subscription {
+    char filter[BROKER_MAX_TOPIC];
+    uint8_t qos;
+    bool used;
+  };
+
+  struct Session {
+    bool used;          // slot holds a connection or a persistent session
+    bool connected;     // socket open
+    bool established;   // CONNECT accepted
+    bool cleanSession;
+    char clientId[BROKER_CLIENT_ID_SIZE];
+    uint16_t keepAlive;
+    uint32_t lastActivity;
+    uint16_t nextPacketId;
+    Subscription subscriptions[BROKER_MAX_SUBSCRIPTIONS];
+    bool hasWill;
+    bool willRetain;
+    uint8_t willQos;
+    char willTopic[BROKER_MAX_TOPIC];
+    uint8_t willPayload[BROKER_MAX_PAYLOAD];
+    uint16_t willLength;
+    uint8_t input[BROKER_PACKET_SIZE];
+    size_t inputLength;
+  };
+
+  struct Retained {
+    bool used;
+    char topic[BROKER_MAX_TOPIC];
+    uint8_t payload[BROKER_MAX_PAYLOAD];
+    uint16_t length;
+    uint8_t qos;
+  };
+
+  BrokerIO* io = NULL;
+  BrokerLocalCallback localCallback = NULL;
+  void* localContext = NULL;
+  uint32_t nowMs = 0;
+  Session sessions[BROKER_MAX_CLIENTS];
+  Subscription localSubscriptions[BROKER_MAX_SUBSCRIPTIONS];
+  Retained retained[BROKER_MAX_RETAINED];
+  uint8_t output[BROKER_PACKET_SIZE + 5];
+
+  void handlePacket(int slot, uint8_t header, const uint8_t* body, size_t length);
+  void handleConnect(int slot, const uint8_t* body, size_t length);
+  void handlePublish(int slot, uint8_t header, const uint8_t* body, size_t length);
+  void handleSubscribe(int slot, const uint8_t* body, size_t length);
+  void handleUnsubscribe(int slot, const uint8_t* body, size_t length);
+
+  void route(const char* topic, const uint8_t* payload, unsigned int length, uint8_t qos, bool retain);
+  void storeRetained(const char* topic, const uint8_t* payload, unsigned int length, uint8_t qos);
+  bool sendPublish(int slot, const char* topic, const uint8_t* payload, unsigned int length, uint8_t qos, bool retain);
+  bool sendPacket(int slot, uint8_t header, const uint8_t* body, size_t length);
+  void drop(int slot, bool sendWill);
+  void clearSession(Session& session);
+};
+
+// Serves the lightbox's own subscriptions straight from the embedded broker
+class BrokerTransport : public Transport {
+public:
+  BrokerTransport(MqttBroker& broker) : broker(broker) {}
+  void begin();
+  bool connected() override { return true; }
+  bool publish(const char* topic, const uint8_t* payload, unsigned int length) override;
+  bool subscribe(const char* topicFilter) override;
+  bool unsubscribe(const char* topicFilter) override;
+  void loop() override {}
+
+private:
+  MqttBroker& broker;
+  static void onLocalMessage(void* context, char* topic, uint8_t* payload, unsigned int length);
+};
+
+#ifdef ARDUINO
+#include <WiFi.h>
+
+// Accepts TCP clients and shuttles bytes between them and the broker
+class BrokerServer : public BrokerIO {
+public:
+  BrokerServer(MqttBroker& broker) : broker(broker), server(BROKER_PORT) {}
+  void begin();
+  void loop();
+  bool write(int slot, const uint8_t* data, size_t length) override;
+  void close(int slot) override;
+
+private:
+  MqttBroker& broker;
+  WiFiServer server;
+  WiFiClient clients[BROKER_MAX_CLIENTS];
+};
+#endif
+
+#endif
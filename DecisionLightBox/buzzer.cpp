@@ -0,0 +1,187 @@
+#include "buzzer.h"
+
+// ====== Pattern tables ======================================================
+
+static const BuzzerStep downSteps[] = {
+  {BUZZER_DOWN_MS, BUZZER_TONE_HZ},
+};
+
+static const BuzzerStep warningSteps[] = {
+  {150, BUZZER_TONE_HZ},
+  {100, 0},
+  {150, BUZZER_TONE_HZ},
+};
+
+static const BuzzerStep finalSteps[] = {
+  {100, BUZZER_HIGH_HZ},
+  {100, 0},
+  {100, BUZZER_HIGH_HZ},
+  {100, 0},
+  {100, BUZZER_HIGH_HZ},
+};
+
+static const BuzzerStep resetAckSteps[] = {
+  {40, BUZZER_HIGH_HZ},
+};
+
+struct BuzzerTable {
+  const BuzzerStep *steps;
+  uint8_t count;
+};
+
+#define STEPS(x) {x, sizeof(x) / sizeof(x[0])}
+
+static const BuzzerTable buzzerTables[BUZZER_PATTERN_COUNT] = {
+  {NULL, 0},              // BUZZER_NONE
+  STEPS(downSteps),       // BUZZER_DOWN
+  STEPS(warningSteps),    // BUZZER_WARNING
+  STEPS(finalSteps),      // BUZZER_FINAL
+  STEPS(resetAckSteps),   // BUZZER_RESET_ACK
+};
+
+// ====== Engine ======================================================
+
+void BuzzerEngine::play(BuzzerPattern next, uint32_t offsetMs) {
+  // A second down signal (a copy on the other path) must not stretch the first
+  if (pattern == BUZZER_DOWN) {
+    return;
+  }
+  pattern = next;
+  startMs = clock() - offsetMs;
+  tick();
+}
+
+void BuzzerEngine::stop(BuzzerPattern stopped) {
+  if (stopped == pattern) {
+    pattern = BUZZER_NONE;
+    sound(0);
+  }
+}
+
+void BuzzerEngine::sound(uint16_t hz) {
+  if (hz != tone) {
+    tone = hz;
+    writer(hz);
+  }
+}
+
+void BuzzerEngine::tick() {
+  const BuzzerTable &table = buzzerTables[pattern];
+  uint32_t elapsed = clock() - startMs;
+  uint32_t end = 0;
+  for (uint8_t i = 0; i < table.count; i++) {
+    end += table.steps[i].ms;
+    if (elapsed < end) {
+      stepEndMs = end;
+      sound(table.steps[i].hz);
+      return;
+    }
+  }
+  pattern = BUZZER_NONE;
+  sound(0);
+}
+
+uint32_t BuzzerEngine::msUntilNext() const {
+  if (pattern == BUZZER_NONE) {
+    return BUZZER_NO_TIMEOUT;
+  }
+  uint32_t elapsed = clock() - startMs;
+  return elapsed >= stepEndMs ? 0 : stepEndMs - elapsed;
+}
+
+// ====== LEDC output ======================================================
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+#include <driver/ledc.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+// A square wave at 50% duty; the timer and channel are clear of the ones analogWrite()
+// hands out for the decision lights
+#define BUZZER_LEDC_MODE LEDC_HIGH_SPEED_MODE
+#define BUZZER_LEDC_TIMER LEDC_TIMER_3
+#define BUZZER_LEDC_CHANNEL LEDC_CHANNEL_7
+#define BUZZER_DUTY_HALF 512   // of 10 bits
+
+static uint32_t buzzerClock() {
+  return millis();
+}
+
+static void writeTone(uint16_t hz) {
+  if (hz != 0) {
+    ledc_set_freq(BUZZER_LEDC_MODE, BUZZER_LEDC_TIMER, hz);
+  }
+  ledc_set_duty(BUZZER_LEDC_MODE, BUZZER_LEDC_CHANNEL, hz != 0 ? BUZZER_DUTY_HALF : 0);
+  ledc_update_duty(BUZZER_LEDC_MODE, BUZZER_LEDC_CHANNEL);
+}
+
+static BuzzerEngine buzzer(buzzerClock, writeTone);
+static esp_timer_handle_t buzzerTimer = NULL;
+// The timer callback runs on the esp_timer task, play and stop on the loop task
+static SemaphoreHandle_t buzzerLock = NULL;
+
+// Call with buzzerLock held
+static void scheduleBuzzer() {
+  esp_timer_stop(buzzerTimer);
+  uint32_t wait = buzzer.msUntilNext();
+  if (wait != BUZZER_NO_TIMEOUT) {
+    esp_timer_start_once(buzzerTimer, (wait > 0 ? wait : 1) * 1000ULL);
+  }
+}
+
+static void onBuzzerTimer(void* context) {
+  xSemaphoreTake(buzzerLock, portMAX_DELAY);
+  buzzer.tick();
+  scheduleBuzzer();
+  xSemaphoreGive(buzzerLock);
+}
+
+void buzzerBegin(int pin) {
+  ledc_timer_config_t timer = {};
+  timer.speed_mode = BUZZER_LEDC_MODE;
+  timer.duty_resolution = LEDC_TIMER_10_BIT;
+  timer.timer_num = BUZZER_LEDC_TIMER;
+  timer.freq_hz = BUZZER_TONE_HZ;
+  timer.clk_cfg = LEDC_AUTO_CLK;
+  ledc_timer_config(&timer);
+
+  ledc_channel_config_t channel = {};
+  channel.gpio_num = pin;
+  channel.speed_mode = BUZZER_LEDC_MODE;
+  channel.channel = BUZZER_LEDC_CHANNEL;
+  channel.timer_sel = BUZZER_LEDC_TIMER;
+  channel.duty = 0;
+  ledc_channel_config(&channel);
+
+  buzzerLock = xSemaphoreCreateMutex();
+  esp_timer_create_args_t args = {};
+  args.callback = onBuzzerTimer;
+  args.name = "buzzer";
+  esp_timer_create(&args, &buzzerTimer);
+}
+
+void buzzerPlay(BuzzerPattern pattern, uint32_t offsetMs) {
+  xSemaphoreTake(buzzerLock, portMAX_DELAY);
+  buzzer.play(pattern, offsetMs);
+  scheduleBuzzer();
+  xSemaphoreGive(buzzerLock);
+}
+
+void buzzerStop(BuzzerPattern pattern) {
+  xSemaphoreTake(buzzerLock, portMAX_DELAY);
+  buzzer.stop(pattern);
+  scheduleBuzzer();
+  xSemaphoreGive(buzzerLock);
+}
+
+BuzzerPattern buzzerCurrent() {
+  xSemaphoreTake(buzzerLock, portMAX_DELAY);
+  BuzzerPattern pattern = buzzer.current();
+  xSemaphoreGive(buzzerLock);
+  return pattern;
+}
+
+#endif
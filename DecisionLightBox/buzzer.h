@@ -0,0 +1,71 @@
+#ifndef BUZZER_H
+#define BUZZER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Tone patterns for the lightbox buzzer. Each pattern is a compiled table of tones and
+// rests; the buzzer runs off a one-shot timer of its own, so every tone (and the 1.5 s
+// down signal in particular) ends on time whatever the loop is doing.
+#define BUZZER_TONE_HZ 2700        // close to the resonance of common piezo buzzers
+#define BUZZER_HIGH_HZ 3400
+#define BUZZER_DOWN_MS 1500
+#define BUZZER_NO_TIMEOUT 0xFFFFFFFF
+
+enum BuzzerPattern : uint8_t {
+  BUZZER_NONE,
+  BUZZER_DOWN,          // one BUZZER_DOWN_MS tone
+  BUZZER_WARNING,       // countdown warning: two short tones
+  BUZZER_FINAL,         // last countdown warning: three short high tones
+  BUZZER_RESET_ACK,     // a short chirp when a new lift starts
+  BUZZER_PATTERN_COUNT
+};
+
+struct BuzzerStep {
+  uint16_t ms;
+  uint16_t hz;          // 0 for a rest
+};
+
+typedef uint32_t (*BuzzerClock)();
+// Sounds hz, or silences the buzzer for 0
+typedef void (*BuzzerWriter)(uint16_t hz);
+
+// Allocation-free and non-blocking; the clock and the output are injected so the same
+// code runs on the device and on a host.
+class BuzzerEngine {
+public:
+  BuzzerEngine(BuzzerClock clock, BuzzerWriter writer) : clock(clock), writer(writer) {}
+
+  // Replaces the current pattern, except that nothing cuts the down signal short or
+  // restarts it; offsetMs skips the start of the pattern (resuming after a warm reset)
+  void play(BuzzerPattern pattern, uint32_t offsetMs = 0);
+  // Silences the pattern if it is the one playing
+  void stop(BuzzerPattern pattern);
+  // The pattern still sounding, BUZZER_NONE once it has ended
+  BuzzerPattern current() const { return pattern; }
+
+  // Moves to the next tone; call when msUntilNext() is due
+  void tick();
+  // Time until the current tone or rest ends, or BUZZER_NO_TIMEOUT
+  uint32_t msUntilNext() const;
+
+private:
+  BuzzerClock clock;
+  BuzzerWriter writer;
+  BuzzerPattern pattern = BUZZER_NONE;
+  uint32_t startMs = 0;
+  uint32_t stepEndMs = 0;   // relative to startMs
+  uint16_t tone = 0;
+
+  void sound(uint16_t hz);
+};
+
+#ifdef ARDUINO
+// Drives the buzzer pin from an LEDC channel, cut off by an esp_timer
+void buzzerBegin(int pin);
+void buzzerPlay(BuzzerPattern pattern, uint32_t offsetMs = 0);
+void buzzerStop(BuzzerPattern pattern);
+BuzzerPattern buzzerCurrent();
+#endif
+
+#endif
@@ -57,4 +57,9 @@ const char* rootCABuff = \
     "YSEY1QSteDwsOoBrp+uvFRTp2InBuThs4pFsiv9kuXclVzDAGySj4dzp30d8tbQk\n" \
     "CAUw7C29C79Fv1C5qfPrmAESrciIxpg0X40KPMbp1ZWVbd4=\n" \
     "-----END CERTIFICATE-----\n";
-    */
\ No newline at end of file
+    */
+
+// Pre-shared key for the PSK build (-DTLS -DTLS_PSK), as hex. It must match the broker's
+// psk_file entry "replogic:<key>"; replace this placeholder with a random key for each venue.
+const char* pskIdentity = "replogic";
+const char* pskKey = "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f";
@@ -0,0 +1,135 @@
+#ifndef DECISION_H
+#define DECISION_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Payload formats for owlcms/decision/<fop>. OWLCMS only understands the text form
+// ("2 good"), so binary is for standalone mode; receivers accept both.
+#define DECISION_FORMAT_TEXT 0
+#define DECISION_FORMAT_BINARY 1
+
+// Binary layout (little-endian):
+//   version (1) | referee << 1 | good (1) | sequence (2) | press time ms (4) | flags (1) | epoch (1)
+// The version byte is below '0', so it can never be mistaken for the text form.
+// Version 1 had no epoch byte; it is still decoded, with epoch 0.
+#define DECISION_WIRE_VERSION 2
+#define DECISION_WIRE_SIZE 10
+#define DECISION_WIRE_V1_SIZE 9
+#define DECISION_TEXT_SIZE 8
+
+// Flags
+#define DECISION_FLAG_RESENT 0x01   // re-published after a reconnect or warm reset
+#define DECISION_FLAG_BOOT 0x02     // first press since a cold boot: the sequence restarted
+
+// Lift epoch: bumped by the central box on every reset and sent as the reset payload.
+// 0 means unknown (no central box, or an OWLCMS reset without one); it is never compared.
+#define DECISION_NO_EPOCH 0
+
+struct Decision {
+  uint8_t referee;      // 1-3
+  bool good;
+  uint16_t seq;         // per-controller press counter
+  uint32_t pressedMs;   // controller clock when the button was pressed
+  uint8_t flags;
+  uint8_t epoch;        // lift epoch when the button was pressed
+  uint8_t version;      // wire version it was decoded from, 0 for the text form
+};
+
+// Return the payload length, or 0 if the buffer is too small or the decision is invalid
+size_t encodeDecision(const Decision &decision, uint8_t *buffer, size_t size);
+size_t formatDecisionText(const Decision &decision, char *buffer, size_t size);
+
+// Accepts either format; fields the text form does not carry are left at 0
+bool decodeDecision(const uint8_t *payload, size_t length, Decision &decision);
+
+// Reset payload: the epoch as decimal text, or DECISION_NO_EPOCH if empty or invalid
+uint8_t parseEpoch(const uint8_t *payload, size_t length);
+
+// Receiver-side ordering. For each referee the highest sequence number of the current epoch
+// and a bitmap of the DECISION_WINDOW_SIZE numbers below it are kept: a number already seen
+// is a duplicate, an older one is stale (a newer press of that referee already counted).
+// A cold boot restarts a controller's numbers: the first copy of its first press carries
+// DECISION_FLAG_BOOT and starts a fresh window. Its press time tells a new boot from another
+// copy of the same press (one per transport path, or a late one), and a resent copy never
+// starts a fresh window.
+#define DECISION_WINDOW_SIZE 32
+
+enum DecisionVerdict : uint8_t {
+  DECISION_ACCEPT,
+  DECISION_NEW_EPOCH,   // accept, but a reset was missed: reset the lift first
+  DECISION_DUPLICATE,
+  DECISION_STALE        // older press, or from an earlier lift
+};
+
+class DecisionFilter {
+public:
+  // A reset from the central box or OWLCMS. Returns false for a repeat of the current epoch
+  // (a retained reset seen again after a reconnect), which must not reset the lift.
+  bool reset(uint8_t epoch);
+  // An epoch older than the current one (a message overtaken by the next reset)
+  bool stale(uint8_t epoch) const;
+  // The text form has no sequence number and is always accepted
+  DecisionVerdict check(const Decision &decision);
+  uint8_t epoch() const { return current; }
+  void restore(uint8_t epoch) { current = epoch; }
+
+private:
+  struct Window {
+    bool valid;
+    uint8_t epoch;
+    uint16_t highest;
+    uint32_t seen;   // bit n: highest - n was received
+    bool booted;
+    uint32_t bootPressedMs;   // press time of the boot press that last started the window
+  };
+
+  uint8_t current = DECISION_NO_EPOCH;
+  Window windows[3] = {};
+};
+
+// Lift status: the central box's state of the current lift, published retained on
+// owlcms/fop/liftState/<fop> at every transition, so a device that (re)connects mid-lift
+// rebuilds its state from the broker in one round trip. Layout:
+//   version (1) | epoch (1) | phase (1) | votes (1) | reminded referee (1) | ms left in phase (4)
+// phase is a LiftState value (lift.h); votes hold 2 bits per referee from bit 0, 0 = none,
+// 1 = good, 2 = bad. The time left is as of publishing; the next transition corrects it.
+#define LIFT_STATUS_VERSION 1
+#define LIFT_STATUS_SIZE 9
+#define LIFT_STATUS_NO_DEADLINE 0xFFFFFFFF
+
+struct LiftStatus {
+  uint8_t epoch;
+  uint8_t phase;
+  char votes[3];          // 'g', 'b' or 0
+  uint8_t reminded;       // referee waiting on a reminder, 0 for none
+  uint32_t remainingMs;   // LIFT_STATUS_NO_DEADLINE when the phase has no timeout
+};
+
+size_t encodeLiftStatus(const LiftStatus &status, uint8_t *buffer, size_t size);
+bool decodeLiftStatus(const uint8_t *payload, size_t length, LiftStatus &status);
+
+// Display frame: everything the lightbox shows, composed by the central box and published
+// on owlcms/fop/display/<fop> once per visible change. Layout:
+//   version (1) | epoch (1) | sequence (1) | lights (1) | down (1) | buzzer (1) | reminders (1)
+// lights: bit n is the good light of referee n + 1, bit n + 3 the bad one. buzzer is the
+// BuzzerPattern (buzzer.h) sounding, started when it changes. reminders: bit n = referee n + 1.
+// The sequence counts frames, so a late copy of an older frame can be told apart.
+#define DISPLAY_FRAME_VERSION 1
+#define DISPLAY_FRAME_SIZE 7
+#define DISPLAY_GOOD_LIGHT(referee) (1 << ((referee) - 1))
+#define DISPLAY_BAD_LIGHT(referee) (1 << ((referee) + 2))
+
+struct DisplayFrame {
+  uint8_t epoch;
+  uint8_t seq;
+  uint8_t lights;
+  bool down;
+  uint8_t buzzer;
+  uint8_t reminders;
+};
+
+size_t encodeDisplayFrame(const DisplayFrame &frame, uint8_t *buffer, size_t size);
+bool decodeDisplayFrame(const uint8_t *payload, size_t length, DisplayFrame &frame);
+
+#endif
@@ -0,0 +1,109 @@
+#include "health.h"
+#include "topics.h"
+#include <esp_heap_caps.h>
+
+struct HealthTask {
+  const char* label;
+  TaskHandle_t handle;
+  uint32_t stackLeft;   // bytes never used, lowest seen since boot
+};
+
+struct HealthWarnings {
+  uint32_t tasks;   // bit per watched task
+  bool heap;
+  bool block;
+};
+
+static HealthTask tasks[HEALTH_MAX_TASKS];
+static int taskCount = 0;
+
+static uint32_t freeHeap = 0;
+static uint32_t minFreeHeap = 0;
+static uint32_t largestBlock = 0;
+static HealthWarnings warnings = {};
+
+void healthWatchTask(const char* label, TaskHandle_t task) {
+  if (taskCount >= HEALTH_MAX_TASKS) {
+    return;
+  }
+  tasks[taskCount].label = label;
+  tasks[taskCount].handle = task != NULL ? task : xTaskGetCurrentTaskHandle();
+  tasks[taskCount].stackLeft = 0;
+  taskCount++;
+}
+
+// Raised below the threshold, cleared only once back above it with some margin
+static bool checkLow(bool active, uint32_t value, uint32_t threshold) {
+  if (value < threshold) {
+    return true;
+  }
+  return active && value < threshold + threshold * HEALTH_HYSTERESIS_PERCENT / 100;
+}
+
+bool healthSample() {
+  freeHeap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  minFreeHeap = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+  largestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+
+  HealthWarnings previous = warnings;
+  for (int i = 0; i < taskCount; i++) {
+    // On the ESP32 the high-water mark is in bytes, not words
+    tasks[i].stackLeft = uxTaskGetStackHighWaterMark(tasks[i].handle);
+    if (checkLow(previous.tasks & (1 << i), tasks[i].stackLeft, HEALTH_STACK_WARN_BYTES)) {
+      warnings.tasks |= 1 << i;
+    } else {
+      warnings.tasks &= ~(1 << i);
+    }
+  }
+  warnings.heap = checkLow(previous.heap, freeHeap, HEALTH_HEAP_WARN_BYTES);
+  warnings.block = checkLow(previous.block, largestBlock, HEALTH_BLOCK_WARN_BYTES);
+
+  return (warnings.tasks & ~previous.tasks) != 0 || (warnings.heap && !previous.heap) ||
+         (warnings.block && !previous.block);
+}
+
+// Share of the free heap not available as one block: 0 when it is all contiguous
+static uint32_t fragmentation() {
+  if (freeHeap == 0) {
+    return 0;
+  }
+  return 100 - (uint32_t)((uint64_t)largestBlock * 100 / freeHeap);
+}
+
+size_t healthFormat(char* buffer, size_t size) {
+  TextWriter writer(buffer, size);
+  writer.text("heap=").unsignedInteger(freeHeap).text(" min=").unsignedInteger(minFreeHeap);
+  writer.text(" block=").unsignedInteger(largestBlock).text(" frag=").unsignedInteger(fragmentation()).character('%');
+  for (int i = 0; i < taskCount; i++) {
+    writer.character(' ').text(tasks[i].label).character('=').unsignedInteger(tasks[i].stackLeft);
+  }
+  return writer.length();
+}
+
+// One "[<task> ]<what> <value> (warn <threshold>)" entry of the warning list
+static void appendWarning(TextWriter& writer, const char* task, const char* what, uint32_t value,
+                          uint32_t threshold) {
+  if (writer.length() > 0) {
+    writer.text(", ");
+  }
+  if (task != NULL) {
+    writer.text(task).character(' ');
+  }
+  writer.text(what).character(' ').unsignedInteger(value).text(" (warn ").unsignedInteger(threshold).character(')');
+}
+
+size_t healthFormatWarnings(char* buffer, size_t size) {
+  TextWriter writer(buffer, size);
+  for (int i = 0; i < taskCount; i++) {
+    if (warnings.tasks & (1 << i)) {
+      appendWarning(writer, tasks[i].label, "stack", tasks[i].stackLeft, HEALTH_STACK_WARN_BYTES);
+    }
+  }
+  if (warnings.heap) {
+    appendWarning(writer, NULL, "heap", freeHeap, HEALTH_HEAP_WARN_BYTES);
+  }
+  if (warnings.block) {
+    appendWarning(writer, NULL, "block", largestBlock, HEALTH_BLOCK_WARN_BYTES);
+  }
+  return writer.length();
+}
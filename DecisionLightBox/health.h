@@ -0,0 +1,32 @@
+#ifndef HEALTH_H
+#define HEALTH_H
+
+#include <Arduino.h>
+
+// Runtime health: per-task stack high-water marks and heap state, sampled periodically from
+// the loop task so stack sizes can be tuned from real data.
+
+#define HEALTH_INTERVAL_MS 10000
+#define HEALTH_MAX_TASKS 4
+#define HEALTH_MESSAGE_SIZE 160
+
+// Warn while a task has less stack than this left at its deepest point so far (bytes)
+#define HEALTH_STACK_WARN_BYTES 512
+// Warn while the free 8-bit heap or its largest block is smaller than this (bytes)
+#define HEALTH_HEAP_WARN_BYTES 16384
+#define HEALTH_BLOCK_WARN_BYTES 8192
+// A warning clears once the value is back above the threshold by this percentage
+#define HEALTH_HYSTERESIS_PERCENT 25
+
+// task NULL means the calling task; label is a short name used in the messages
+void healthWatchTask(const char* label, TaskHandle_t task);
+
+// Takes a sample; returns true if a warning was raised that was not already active
+bool healthSample();
+
+// "heap=.. min=.. block=.. frag=..% <task>=.. ..." from the last sample, stacks in bytes left
+size_t healthFormat(char* buffer, size_t size);
+// The checks currently failing, e.g. "battery stack 420 (warn 512)"
+size_t healthFormatWarnings(char* buffer, size_t size);
+
+#endif
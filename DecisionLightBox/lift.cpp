@@ -0,0 +1,126 @@
+#include <string.h>
+#include "lift.h"
+
+struct LiftTransition {
+  LiftState next;
+  LiftAction action;
+};
+
+#define T(next, action) {LIFT_##next, LIFT_ACTION_##action}
+
+// transitions[state][event]; a transition to the same state keeps its timer running
+static const LiftTransition transitions[LIFT_STATE_COUNT][LIFT_EVENT_COUNT] = {
+  //              DECISION                  MAJORITY                SPLIT                   PARTIAL                 DOWN                    TIMEOUT              RESET
+  /* IDLE     */ {T(IDLE, RECORD),          T(CHANGE_WINDOW, DOWN), T(SPLIT, NONE),         T(PENDING, NONE),       T(CHANGE_WINDOW, DOWN), T(IDLE, NONE),       T(IDLE, CLEAR)},
+  /* PENDING  */ {T(PENDING, RECORD),       T(CHANGE_WINDOW, DOWN), T(SPLIT, NONE),         T(PENDING, NONE),       T(CHANGE_WINDOW, DOWN), T(PENDING, NONE),    T(IDLE, CLEAR)},
+  /* SPLIT    */ {T(SPLIT, RECORD),         T(CHANGE_WINDOW, DOWN), T(SPLIT, NONE),         T(PENDING, NONE),       T(CHANGE_WINDOW, DOWN), T(REMINDED, REMIND), T(IDLE, CLEAR)},
+  /* REMINDED */ {T(REMINDED, RECORD),      T(CHANGE_WINDOW, DOWN), T(REMINDED, NONE),      T(PENDING, NONE),       T(CHANGE_WINDOW, DOWN), T(REMINDED, NONE),   T(IDLE, CLEAR)},
+  /* CHANGE   */ {T(CHANGE_WINDOW, RECORD), T(CHANGE_WINDOW, NONE), T(CHANGE_WINDOW, NONE), T(CHANGE_WINDOW, NONE), T(CHANGE_WINDOW, NONE), T(COOLDOWN, SHOW),   T(IDLE, CLEAR)},
+  /* COOLDOWN */ {T(COOLDOWN, IGNORE),      T(COOLDOWN, NONE),      T(COOLDOWN, NONE),      T(COOLDOWN, NONE),      T(COOLDOWN, NONE),      T(IDLE, CLEAR),      T(IDLE, CLEAR)},
+};
+
+#undef T
+
+// How long each state lasts before LIFT_EVENT_TIMEOUT (0 = no timeout)
+static const uint32_t stateTimeoutMs[LIFT_STATE_COUNT] = {
+  0,                        // IDLE
+  0,                        // PENDING
+  LIFT_REMINDER_DELAY_MS,   // SPLIT
+  0,                        // REMINDED
+  LIFT_CHANGE_WINDOW_MS,    // CHANGE_WINDOW
+  LIFT_COOLDOWN_MS,         // COOLDOWN
+};
+
+void LiftEngine::decision(uint8_t referee, bool good) {
+  if (referee < 1 || referee > 3) {
+    return;
+  }
+  dispatch(LIFT_EVENT_DECISION, referee, good);
+}
+
+void LiftEngine::down() {
+  dispatch(LIFT_EVENT_DOWN, 0, false);
+}
+
+void LiftEngine::reset() {
+  dispatch(LIFT_EVENT_RESET, 0, false);
+}
+
+void LiftEngine::tick() {
+  uint32_t timeout = stateTimeoutMs[current];
+  if (timeout != 0 && clock() - enteredMs >= timeout) {
+    dispatch(LIFT_EVENT_TIMEOUT, 0, false);
+  }
+}
+
+uint32_t LiftEngine::msUntilTimeout() const {
+  uint32_t timeout = stateTimeoutMs[current];
+  if (timeout == 0) {
+    return LIFT_NO_TIMEOUT;
+  }
+  uint32_t elapsed = clock() - enteredMs;
+  return elapsed >= timeout ? 0 : timeout - elapsed;
+}
+
+void LiftEngine::restore(LiftState state, const char savedVotes[3], uint32_t savedEnteredMs) {
+  current = state < LIFT_STATE_COUNT ? state : LIFT_IDLE;
+  memcpy(votes, savedVotes, sizeof(votes));
+  enteredMs = savedEnteredMs;
+}
+
+void LiftEngine::sync(LiftState state, const char syncedVotes[3], uint32_t remainingMs) {
+  uint32_t timeout = stateTimeoutMs[state < LIFT_STATE_COUNT ? state : LIFT_IDLE];
+  uint32_t elapsed = timeout != 0 && remainingMs < timeout ? timeout - remainingMs : 0;
+  restore(state, syncedVotes, clock() - elapsed);
+}
+
+void LiftEngine::dispatch(LiftEvent event, uint8_t referee, bool good) {
+  const LiftTransition &transition = transitions[current][event];
+  if (transition.next != current) {
+    current = transition.next;
+    enteredMs = clock();
+  }
+
+  switch (transition.action) {
+    case LIFT_ACTION_RECORD:
+      votes[referee - 1] = good ? 'g' : 'b';
+      // The outcome of the new vote is a follow-up event through the same table
+      dispatch(classify(), 0, false);
+      return;
+    case LIFT_ACTION_CLEAR:
+      memset(votes, 0, sizeof(votes));
+      break;
+    case LIFT_ACTION_REMIND:
+      referee = missingReferee();
+      break;
+    default:
+      break;
+  }
+  if (transition.action != LIFT_ACTION_NONE && handler) {
+    handler(transition.action, referee);
+  }
+}
+
+LiftEvent LiftEngine::classify() const {
+  int good = 0, bad = 0;
+  for (int i = 0; i < 3; i++) {
+    good += votes[i] == 'g';
+    bad += votes[i] == 'b';
+  }
+  if (good >= 2 || bad >= 2) {
+    return LIFT_EVENT_MAJORITY;
+  }
+  if (good == 1 && bad == 1) {
+    return LIFT_EVENT_SPLIT;
+  }
+  return LIFT_EVENT_PARTIAL;
+}
+
+uint8_t LiftEngine::missingReferee() const {
+  for (int i = 0; i < 3; i++) {
+    if (votes[i] == 0) {
+      return i + 1;
+    }
+  }
+  return 0;
+}
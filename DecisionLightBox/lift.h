@@ -0,0 +1,86 @@
+#ifndef LIFT_H
+#define LIFT_H
+
+#include <stdint.h>
+
+// Decision rules for one lift, shared with the central box:
+//  - two matching decisions (or all three) trigger the down signal
+//  - a 1-1 split with the third referee missing sends that referee a reminder after 3 s
+//  - decisions may still change for 3 s after the down signal, then the lights are shown
+//  - further decisions are ignored for 5 s, after which the lift resets
+#define LIFT_REMINDER_DELAY_MS 3000
+#define LIFT_CHANGE_WINDOW_MS 3000
+#define LIFT_COOLDOWN_MS 5000
+#define LIFT_NO_TIMEOUT 0xFFFFFFFF
+
+enum LiftState : uint8_t {
+  LIFT_IDLE,            // no decisions yet
+  LIFT_PENDING,         // one decision, or more without a majority or split
+  LIFT_SPLIT,           // 1-1 with the third referee missing, reminder timer running
+  LIFT_REMINDED,        // reminder sent, still waiting for the third referee
+  LIFT_CHANGE_WINDOW,   // down signalled, decisions may still change
+  LIFT_COOLDOWN,        // lights shown, decisions ignored
+  LIFT_STATE_COUNT
+};
+
+enum LiftEvent : uint8_t {
+  LIFT_EVENT_DECISION,  // a referee pressed a button
+  LIFT_EVENT_MAJORITY,  // after a recorded decision: two or more agree
+  LIFT_EVENT_SPLIT,     // after a recorded decision: 1-1 with one missing
+  LIFT_EVENT_PARTIAL,   // after a recorded decision: anything else
+  LIFT_EVENT_DOWN,      // down signal from the central box or OWLCMS
+  LIFT_EVENT_TIMEOUT,   // the current state's timer expired
+  LIFT_EVENT_RESET,     // explicit reset
+  LIFT_EVENT_COUNT
+};
+
+enum LiftAction : uint8_t {
+  LIFT_ACTION_NONE,
+  LIFT_ACTION_RECORD,   // store the decision (internal)
+  LIFT_ACTION_IGNORE,   // drop the decision
+  LIFT_ACTION_DOWN,     // give the down signal
+  LIFT_ACTION_REMIND,   // remind the missing referee (passed as the argument)
+  LIFT_ACTION_SHOW,     // show the decision lights
+  LIFT_ACTION_CLEAR     // lift over, clear lights and decisions
+};
+
+typedef uint32_t (*LiftClock)();
+typedef void (*LiftActionHandler)(LiftAction action, uint8_t referee);
+
+// Allocation-free state machine driven by an explicit transition table.
+// The clock is injected so the same code runs on the device and on a host.
+class LiftEngine {
+public:
+  LiftEngine(LiftClock clock, LiftActionHandler handler) : clock(clock), handler(handler) {}
+
+  void decision(uint8_t referee, bool good);
+  void down();
+  void reset();
+  // Fires the timeout of the current state once it is due
+  void tick();
+  // Time left before tick() has something to do, or LIFT_NO_TIMEOUT
+  uint32_t msUntilTimeout() const;
+
+  LiftState state() const { return current; }
+  uint32_t stateEnteredMs() const { return enteredMs; }
+  // 'g', 'b' or 0 for referee 1-3
+  char vote(uint8_t referee) const { return votes[referee - 1]; }
+  void restore(LiftState state, const char savedVotes[3], uint32_t savedEnteredMs);
+  // Takes over a state from elsewhere (the central box's lift status) with remainingMs
+  // of its timeout left; no actions are reported
+  void sync(LiftState state, const char syncedVotes[3], uint32_t remainingMs);
+  // Referee a split is waiting for, 0 if none is missing
+  uint8_t missingReferee() const;
+
+private:
+  LiftClock clock;
+  LiftActionHandler handler;
+  LiftState current = LIFT_IDLE;
+  uint32_t enteredMs = 0;
+  char votes[3] = {0, 0, 0};
+
+  void dispatch(LiftEvent event, uint8_t referee, bool good);
+  LiftEvent classify() const;
+};
+
+#endif
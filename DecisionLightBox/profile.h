@@ -0,0 +1,60 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Scoped timing probes, each feeding a log-linear histogram in static storage.
+// Build with -DPROFILING; otherwise PROFILE_SCOPE expands to nothing and no code or data
+// from this module is compiled in.
+
+enum ProfileProbe : uint8_t {
+  PROBE_MQTT_LOOP,        // PubSubClient::loop
+  PROBE_READ_PACKET,      // PubSubClient::readPacket
+  PROBE_CALLBACK,         // the sketch's MQTT callback
+  PROBE_BUTTON_LOOP,      // controller: buttonLoop
+  PROBE_BATTERY_LEDS,     // controller: updateBatteryLEDs
+  PROBE_DECISION_LIGHTS,  // lightbox: setDecisionLights
+  PROBE_COUNT
+};
+
+#ifdef PROFILING
+
+// Four linear sub-buckets per power of two: exact below 4 cycles, then at most 25% wide
+#define PROFILE_SUB_BITS 2
+#define PROFILE_BUCKETS 124
+#define PROFILE_MESSAGE_SIZE 200
+
+// CPU cycles (ESP.getCycleCount()) on the device, nanoseconds on a host
+uint32_t profileCycles();
+uint32_t profileCyclesPerUs();
+
+void profileRecord(ProfileProbe probe, uint32_t cycles);
+void profileReset();
+const char* profileName(ProfileProbe probe);
+
+// "n=.. mean=.. p50=.. p90=.. p99=.. max=.. us|<cycles per us>|<bucket floor>:<count>,..."
+// Buckets that do not fit are dropped and the line ends in '+'.
+size_t profileFormat(ProfileProbe probe, char* buffer, size_t size);
+
+class ProfileScope {
+public:
+  ProfileScope(ProfileProbe probe) : probe(probe), start(profileCycles()) {}
+  ~ProfileScope() { profileRecord(probe, profileCycles() - start); }
+
+private:
+  ProfileProbe probe;
+  uint32_t start;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(probe) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(probe)
+
+#else
+
+#define PROFILE_SCOPE(probe)
+
+#endif
+
+#endif
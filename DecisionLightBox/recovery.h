@@ -0,0 +1,32 @@
+#ifndef RECOVERY_H
+#define RECOVERY_H
+
+#include <Arduino.h>
+
+// Hang detection: the loop task must feed the watchdog at least this often
+#define WATCHDOG_TIMEOUT_S 10
+
+// State kept in RTC slow memory so a crash or brownout mid-lift can resume where it left off.
+// Times are rtcClockMs() values since millis() restarts from zero after a reset.
+struct LightboxSnapshot {
+  uint32_t magic;
+  char decisions[3];      // 'g', 'b' or 0 per referee
+  uint8_t downLedOn;
+  uint8_t buzzerOn;
+  uint8_t liftState;      // LiftState
+  uint8_t wifiChannel;
+  uint8_t wifiBssid[6];
+  uint8_t liftEpoch;      // DecisionFilter epoch
+  uint64_t downSignalStart;
+  uint64_t liftStateStart;
+  uint32_t checksum;
+};
+
+void setupWatchdog();
+void feedWatchdog();
+bool isWarmReset();
+uint64_t rtcClockMs();
+bool readSnapshot(LightboxSnapshot &snapshot);
+void writeSnapshot(const LightboxSnapshot &snapshot);
+
+#endif
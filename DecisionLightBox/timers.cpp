@@ -0,0 +1,205 @@
+#include "timers.h"
+
+#ifdef ARDUINO
+#include <esp_timer.h>
+#endif
+
+TimerWheel timers;
+
+void TimerWheel::begin(uint64_t nowMs) {
+  current = nowMs;
+}
+
+void TimerWheel::start(Timer &timer, uint32_t delayMs, TimerCallback callback, void *context) {
+  if (timer.bucket != NULL) {
+    unlink(timer);
+  }
+  timer.callback = callback;
+  timer.context = context;
+  // A zero delay fires on the next tick rather than from inside start()
+  timer.deadline = current + (delayMs > 0 ? delayMs : 1);
+  file(timer);
+  activeCount++;
+}
+
+void TimerWheel::cancel(Timer &timer) {
+  if (timer.bucket != NULL) {
+    unlink(timer);
+    activeCount--;
+  }
+}
+
+// Puts the timer in the slot matching its distance from the current time
+void TimerWheel::file(Timer &timer) {
+  // A deadline equal to the current tick (from a cascade) lands in the slot being expired
+  uint64_t deadline = timer.deadline < current ? current : timer.deadline;
+  uint64_t delta = deadline - current;
+  if (delta >= TIMER_RANGE_MS) {
+    deadline = current + TIMER_RANGE_MS - 1;
+    delta = TIMER_RANGE_MS - 1;
+  }
+
+  Timer **bucket;
+  if (delta < TIMER_LEVEL0_SIZE) {
+    bucket = &level0[deadline & (TIMER_LEVEL0_SIZE - 1)];
+  } else {
+    int level = 0;
+    int shift = TIMER_LEVEL0_BITS;
+    while (delta >= (1ULL << (shift + TIMER_LEVEL_BITS))) {
+      level++;
+      shift += TIMER_LEVEL_BITS;
+    }
+    bucket = &levels[level][(deadline >> shift) & (TIMER_LEVEL_SIZE - 1)];
+  }
+
+  timer.bucket = bucket;
+  timer.prev = NULL;
+  timer.next = *bucket;
+  if (*bucket != NULL) {
+    (*bucket)->prev = &timer;
+  } else {
+    markSlot(bucket, true);
+  }
+  *bucket = &timer;
+}
+
+void TimerWheel::unlink(Timer &timer) {
+  if (timer.prev != NULL) {
+    timer.prev->next = timer.next;
+  } else {
+    *timer.bucket = timer.next;
+  }
+  if (timer.next != NULL) {
+    timer.next->prev = timer.prev;
+  }
+  if (*timer.bucket == NULL) {
+    markSlot(timer.bucket, false);
+  }
+  timer.next = timer.prev = NULL;
+  timer.bucket = NULL;
+}
+
+void TimerWheel::markSlot(Timer **bucket, bool used) {
+  uint64_t *word;
+  size_t index;
+  if (bucket >= level0 && bucket < level0 + TIMER_LEVEL0_SIZE) {
+    index = bucket - level0;
+    word = &level0Used[index / 64];
+  } else {
+    size_t slot = bucket - &levels[0][0];
+    index = slot % TIMER_LEVEL_SIZE;
+    word = &levelsUsed[slot / TIMER_LEVEL_SIZE];
+  }
+  uint64_t bit = 1ULL << (index % 64);
+  *word = used ? (*word | bit) : (*word & ~bit);
+}
+
+// Slots from 'from' onwards, wrapping around, to the first occupied one; -1 if none is
+static int slotsToOccupied(const uint64_t *words, int wordCount, int from) {
+  int size = wordCount * 64;
+  for (int scanned = 0; scanned <= size; ) {
+    int index = (from + scanned) % size;
+    uint64_t word = words[index / 64] >> (index % 64);
+    if (word != 0) {
+      return scanned + __builtin_ctzll(word);
+    }
+    scanned += 64 - index % 64;
+  }
+  return -1;
+}
+
+// The earliest tick after the current one with a level-0 slot to expire or a higher slot to
+// cascade; every tick before it would find only empty slots
+uint64_t TimerWheel::nextEvent() const {
+  uint64_t next = UINT64_MAX;
+  int ahead = slotsToOccupied(level0Used, TIMER_LEVEL0_WORDS, (current + 1) & (TIMER_LEVEL0_SIZE - 1));
+  if (ahead >= 0) {
+    next = current + 1 + ahead;
+  }
+  int shift = TIMER_LEVEL0_BITS;
+  for (int level = 0; level < TIMER_LEVELS - 1; level++) {
+    uint64_t slot = current >> shift;
+    ahead = slotsToOccupied(&levelsUsed[level], 1, (slot + 1) & (TIMER_LEVEL_SIZE - 1));
+    if (ahead >= 0 && ((slot + 1 + ahead) << shift) < next) {
+      next = (slot + 1 + ahead) << shift;
+    }
+    shift += TIMER_LEVEL_BITS;
+  }
+  return next;
+}
+
+// Re-files every timer of a higher-level slot once the wheel reaches it
+void TimerWheel::cascade(Timer *&bucket) {
+  Timer *timer = bucket;
+  if (timer != NULL) {
+    bucket = NULL;
+    markSlot(&bucket, false);
+  }
+  while (timer != NULL) {
+    Timer *next = timer->next;
+    file(*timer);
+    timer = next;
+  }
+}
+
+void TimerWheel::advance(uint64_t nowMs) {
+  while (current < nowMs) {
+    uint64_t next = activeCount == 0 ? UINT64_MAX : nextEvent();
+    if (next > nowMs) {
+      current = nowMs;
+      return;
+    }
+    current = next;
+
+    // Cascade from the top so timers can fall through more than one level in a tick
+    if ((current & (TIMER_LEVEL0_SIZE - 1)) == 0) {
+      int shift = TIMER_LEVEL0_BITS;
+      int level = 0;
+      while (level < TIMER_LEVELS - 2 && ((current >> shift) & (TIMER_LEVEL_SIZE - 1)) == 0) {
+        level++;
+        shift += TIMER_LEVEL_BITS;
+      }
+      for (; level >= 0; level--) {
+        cascade(levels[level][(current >> shift) & (TIMER_LEVEL_SIZE - 1)]);
+        shift -= TIMER_LEVEL_BITS;
+      }
+    }
+
+    Timer *&bucket = level0[current & (TIMER_LEVEL0_SIZE - 1)];
+    while (bucket != NULL) {
+      Timer &timer = *bucket;
+      unlink(timer);
+      if (timer.deadline > current) {
+        // Parked beyond the wheel's range; file it again
+        file(timer);
+        continue;
+      }
+      activeCount--;
+      // The callback may re-arm this or any other timer
+      if (timer.callback) {
+        timer.callback(timer.context);
+      }
+    }
+  }
+}
+
+uint32_t TimerWheel::msUntilNext(uint32_t limitMs) const {
+  if (activeCount == 0) {
+    return limitMs;
+  }
+  // A cascade may fire nothing, so this can be early but never late
+  uint64_t ahead = nextEvent() - current;
+  return ahead < limitMs ? (uint32_t)ahead : limitMs;
+}
+
+#ifdef ARDUINO
+
+uint64_t timerClockMs() {
+  return esp_timer_get_time() / 1000;
+}
+
+void timersLoop() {
+  timers.advance(timerClockMs());
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef TIMERS_H
+#define TIMERS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Hierarchical timer wheel with 1 ms ticks: 256 slots of 1 ms, then 64 slots of 256 ms,
+// then 64 slots of 16.384 s. Start, cancel and expiry are O(1); timers due further out
+// than the top level (about 17 minutes) are parked in its farthest slot and re-filed.
+// A bitmap of occupied slots per level lets advance() jump straight to the next slot
+// that has timers to expire or cascade, so a long sleep costs a few steps, not one per ms.
+#define TIMER_LEVEL0_BITS 8
+#define TIMER_LEVEL_BITS 6
+#define TIMER_LEVELS 3
+#define TIMER_LEVEL0_SIZE (1 << TIMER_LEVEL0_BITS)
+#define TIMER_LEVEL_SIZE (1 << TIMER_LEVEL_BITS)
+#define TIMER_RANGE_MS (1ULL << (TIMER_LEVEL0_BITS + (TIMER_LEVELS - 1) * TIMER_LEVEL_BITS))
+#define TIMER_LEVEL0_WORDS (TIMER_LEVEL0_SIZE / 64)
+
+typedef void (*TimerCallback)(void *context);
+
+// Owned by the caller (usually a global); the wheel only links it into a slot
+struct Timer {
+  Timer *next = NULL;
+  Timer *prev = NULL;
+  Timer **bucket = NULL;   // slot list the timer is in, NULL when idle
+  uint64_t deadline = 0;
+  TimerCallback callback = NULL;
+  void *context = NULL;
+};
+
+class TimerWheel {
+public:
+  void begin(uint64_t nowMs);
+
+  // (Re)arms the timer to fire delayMs after the wheel's current time
+  void start(Timer &timer, uint32_t delayMs, TimerCallback callback, void *context = NULL);
+  void cancel(Timer &timer);
+  bool active(const Timer &timer) const { return timer.bucket != NULL; }
+
+  // Runs the callbacks of every timer due at or before nowMs (monotonic, 64-bit)
+  void advance(uint64_t nowMs);
+  uint64_t now() const { return current; }
+
+  // Lower bound on the time until the next timer fires, capped at limitMs
+  uint32_t msUntilNext(uint32_t limitMs) const;
+
+private:
+  Timer *level0[TIMER_LEVEL0_SIZE] = {};
+  Timer *levels[TIMER_LEVELS - 1][TIMER_LEVEL_SIZE] = {};
+  // One bit per slot, set while the slot holds a timer (a higher level's 64 slots fit one word)
+  uint64_t level0Used[TIMER_LEVEL0_WORDS] = {};
+  uint64_t levelsUsed[TIMER_LEVELS - 1] = {};
+  uint64_t current = 0;
+  uint32_t activeCount = 0;
+
+  void file(Timer &timer);
+  void unlink(Timer &timer);
+  void cascade(Timer *&bucket);
+  void markSlot(Timer **bucket, bool used);
+  uint64_t nextEvent() const;
+};
+
+extern TimerWheel timers;
+
+#ifdef ARDUINO
+// Monotonic milliseconds since boot; 64-bit, so unlike millis() it never wraps
+uint64_t timerClockMs();
+// Fires due timers; call from loop()
+void timersLoop();
+#endif
+
+#endif
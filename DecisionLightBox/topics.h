@@ -0,0 +1,88 @@
+#ifndef TOPICS_H
+#define TOPICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Topic buffers sized at compile time from the prefix literal and the longest platform
+// name and client id, then filled once in setup(): publishing needs no heap and no sprintf.
+
+// Longest platform name and client id kept in a topic (fop[20] and clientId[50])
+#define TOPIC_FOP_MAX 19
+#define TOPIC_CLIENT_ID_MAX 49
+
+#define TOPIC_PREFIX_DECISION "owlcms/decision/"
+#define TOPIC_PREFIX_DOWN "owlcms/fop/down/"
+#define TOPIC_PREFIX_RESET_DECISIONS "owlcms/fop/resetDecisions/"
+#define TOPIC_PREFIX_BUZZER "owlcms/fop/buzzer/"
+#define TOPIC_PREFIX_LIFT_STATE "owlcms/fop/liftState/"
+#define TOPIC_PREFIX_DISPLAY "owlcms/fop/display/"
+#define TOPIC_PREFIX_PROFILE "owlcms/profile/"
+#define TOPIC_PREFIX_PRESENCE "owlcms/presence/"
+#define TOPIC_PREFIX_HEARTBEAT "owlcms/heartbeat/"
+#define TOPIC_PREFIX_HEALTH "owlcms/health/"
+#define TOPIC_SUFFIX_WARNING "/warning"
+
+// Buffer sizes for <prefix><fop>, <prefix><fop>/<clientId> and <prefix><fop>/<clientId><suffix>
+#define TOPIC_SIZE(prefix) (sizeof(prefix) + TOPIC_FOP_MAX)
+#define TOPIC_CLIENT_SIZE(prefix) (TOPIC_SIZE(prefix) + 1 + TOPIC_CLIENT_ID_MAX)
+#define TOPIC_CLIENT_SUFFIX_SIZE(prefix, suffix) (TOPIC_CLIENT_SIZE(prefix) + sizeof(suffix) - 1)
+
+// clientId and suffix may be NULL; returns the topic length
+size_t topicConcat(char* buffer, size_t size, const char* prefix, const char* fop, const char* clientId,
+                   const char* suffix);
+
+template <size_t N, size_t P>
+size_t buildTopic(char (&buffer)[N], const char (&prefix)[P], const char* fop) {
+  static_assert(N >= P + TOPIC_FOP_MAX, "topic buffer too small, declare it with TOPIC_SIZE()");
+  return topicConcat(buffer, N, prefix, fop, NULL, NULL);
+}
+
+template <size_t N, size_t P>
+size_t buildTopic(char (&buffer)[N], const char (&prefix)[P], const char* fop, const char* clientId) {
+  static_assert(N >= P + TOPIC_FOP_MAX + 1 + TOPIC_CLIENT_ID_MAX,
+                "topic buffer too small, declare it with TOPIC_CLIENT_SIZE()");
+  return topicConcat(buffer, N, prefix, fop, clientId, NULL);
+}
+
+template <size_t N, size_t P, size_t S>
+size_t buildTopic(char (&buffer)[N], const char (&prefix)[P], const char* fop, const char* clientId,
+                  const char (&suffix)[S]) {
+  static_assert(N >= P + TOPIC_FOP_MAX + 1 + TOPIC_CLIENT_ID_MAX + S - 1,
+                "topic buffer too small, declare it with TOPIC_CLIENT_SUFFIX_SIZE()");
+  return topicConcat(buffer, N, prefix, fop, clientId, suffix);
+}
+
+// Number in the last level of a received topic ("owlcms/summon/A/2" gives 2); 0 when that
+// level is empty or does not start with a digit, as String::toInt() did
+int topicLastNumber(const char* topic);
+
+// Payloads are not NUL-terminated; true if the first bytes are text
+bool payloadStartsWith(const uint8_t* payload, size_t length, const char* text);
+
+// Builds payloads in a caller-owned buffer without printf or the heap. Output is always
+// NUL-terminated; anything that does not fit is dropped and overflowed() turns true.
+class TextWriter {
+public:
+  TextWriter(char* buffer, size_t size) : buffer(buffer), size(size) { buffer[0] = '\0'; }
+  template <size_t N> TextWriter(char (&buffer)[N]) : TextWriter(buffer, N) {}
+
+  TextWriter& text(const char* value);
+  TextWriter& character(char value);
+  TextWriter& integer(int32_t value);
+  TextWriter& unsignedInteger(uint32_t value);
+  // Rounded to the given number of decimals (at most 6)
+  TextWriter& fixed(float value, uint8_t decimals);
+
+  const char* c_str() const { return buffer; }
+  size_t length() const { return used; }
+  bool overflowed() const { return overflow; }
+
+private:
+  char* buffer;
+  size_t size;
+  size_t used = 0;
+  bool overflow = false;
+};
+
+#endif
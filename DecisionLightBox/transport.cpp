@@ -0,0 +1,403 @@
+#include <string.h>
+#include "transport.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <WiFi.h>
+#include <lwip/sockets.h>
+#endif
+
+// A sequence number this far behind the newest one means the sender restarted
+#define SEQUENCE_RESTART_GAP 1024
+
+// Topics that are also sent over UDP multicast: decisions, down signal, display frames,
+// reminders and heartbeats
+static const char* fastPathPrefixes[] = {
+  "owlcms/decision/",
+  "owlcms/fop/down/",
+  "owlcms/fop/display/",
+  "owlcms/decisionRequest/",
+  "owlcms/heartbeat/",
+};
+
+bool isFastPathTopic(const char* topic) {
+  for (size_t i = 0; i < sizeof(fastPathPrefixes) / sizeof(fastPathPrefixes[0]); i++) {
+    if (strncmp(topic, fastPathPrefixes[i], strlen(fastPathPrefixes[i])) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// MQTT topic filter matching with + and # wildcards
+bool topicMatches(const char* filter, const char* topic) {
+  while (*filter) {
+    if (*filter == '#') {
+      return true;
+    }
+    if (*filter == '+') {
+      while (*topic && *topic != '/') {
+        topic++;
+      }
+      filter++;
+      continue;
+    }
+    // "a/#" also matches "a"
+    if (*filter == '/' && filter[1] == '#' && *topic == '\0') {
+      return true;
+    }
+    if (*filter != *topic) {
+      return false;
+    }
+    filter++;
+    topic++;
+  }
+  return *topic == '\0';
+}
+
+static uint32_t messageHash(const char* topic, const uint8_t* payload, unsigned int length) {
+  uint32_t hash = 2166136261u;
+  for (const char* c = topic; *c; c++) {
+    hash = (hash ^ (uint8_t)*c) * 16777619u;
+  }
+  hash = (hash ^ 0) * 16777619u;
+  for (unsigned int i = 0; i < length; i++) {
+    hash = (hash ^ payload[i]) * 16777619u;
+  }
+  return hash;
+}
+
+// ====== TransportMux ======================================================
+
+void TransportMux::add(Transport& transport, uint8_t id) {
+  transports[id] = &transport;
+  transport.attach(this, id);
+}
+
+bool TransportMux::publish(const char* topic, const char* payload) {
+  return publish(topic, (const uint8_t*)payload, strlen(payload));
+}
+
+bool TransportMux::publish(const char* topic, const uint8_t* payload, unsigned int length) {
+  bool sent = false;
+  // Fast path first: a blocking TCP write must not hold back the datagram
+  for (int i = TRANSPORT_COUNT - 1; i >= 0; i--) {
+    if (transports[i] == NULL || !transports[i]->connected()) {
+      continue;
+    }
+    if (i != TRANSPORT_MQTT && !isFastPathTopic(topic)) {
+      continue;
+    }
+    sent |= transports[i]->publish(topic, payload, length);
+  }
+  return sent;
+}
+
+bool TransportMux::subscribe(const char* topicFilter) {
+  bool subscribed = true;
+  for (int i = 0; i < TRANSPORT_COUNT; i++) {
+    if (transports[i] != NULL) {
+      subscribed &= transports[i]->subscribe(topicFilter);
+    }
+  }
+  return subscribed;
+}
+
+bool TransportMux::unsubscribe(const char* topicFilter) {
+  bool unsubscribed = true;
+  for (int i = 0; i < TRANSPORT_COUNT; i++) {
+    if (transports[i] != NULL) {
+      unsubscribed &= transports[i]->unsubscribe(topicFilter);
+    }
+  }
+  return unsubscribed;
+}
+
+void TransportMux::loop() {
+  for (int i = 0; i < TRANSPORT_COUNT; i++) {
+    if (transports[i] != NULL) {
+      transports[i]->loop();
+    }
+  }
+}
+
+void TransportMux::deliver(uint8_t transportId, char* topic, uint8_t* payload, unsigned int length, uint32_t nowMs) {
+  if (isFastPathTopic(topic)) {
+    uint32_t hash = messageHash(topic, payload, length);
+    for (int i = 0; i < TRANSPORT_DEDUP_SLOTS; i++) {
+      Recent& r = recent[i];
+      if (r.pending && r.hash == hash && r.transportId != transportId && nowMs - r.timeMs < TRANSPORT_DEDUP_WINDOW_MS) {
+        // Second copy of a message already delivered by the faster transport
+        r.pending = false;
+        return;
+      }
+    }
+    recent[nextSlot] = {hash, nowMs, transportId, true};
+    nextSlot = (nextSlot + 1) % TRANSPORT_DEDUP_SLOTS;
+  }
+
+  if (callback) {
+    callback(topic, payload, length);
+  }
+}
+
+// ====== SequenceWindow ======================================================
+
+bool SequenceWindow::accept(uint32_t senderId, uint32_t seq) {
+  Sender* sender = NULL;
+  for (int i = 0; i < UDP_MAX_SENDERS; i++) {
+    if (senders[i].used && senders[i].id == senderId) {
+      sender = &senders[i];
+      break;
+    }
+  }
+
+  if (sender == NULL) {
+    sender = &senders[nextEvict];
+    nextEvict = (nextEvict + 1) % UDP_MAX_SENDERS;
+    *sender = {senderId, seq, 1, true};
+    return true;
+  }
+
+  if ((int32_t)(seq - sender->highest) > 0) {
+    uint32_t shift = seq - sender->highest;
+    sender->seen = shift >= 32 ? 0 : sender->seen << shift;
+    sender->seen |= 1;
+    sender->highest = seq;
+    return true;
+  }
+
+  uint32_t offset = sender->highest - seq;
+  if (offset >= SEQUENCE_RESTART_GAP) {
+    *sender = {senderId, seq, 1, true};
+    return true;
+  }
+  if (offset >= 32 || (sender->seen & (1u << offset))) {
+    return false;
+  }
+  sender->seen |= 1u << offset;
+  return true;
+}
+
+// ====== UDP frame ======================================================
+
+// The topic length is one byte, and the longest topic leaves room for a payload
+static_assert(TRANSPORT_MAX_TOPIC <= 255 && UDP_FRAME_HEADER_SIZE + TRANSPORT_MAX_TOPIC + 64 <= UDP_FRAME_MAX_SIZE,
+              "TRANSPORT_MAX_TOPIC does not fit a frame");
+
+static void putUint32(uint8_t* buffer, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    buffer[i] = (value >> (8 * i)) & 0xFF;
+  }
+}
+
+static uint32_t getUint32(const uint8_t* buffer) {
+  return buffer[0] | (buffer[1] << 8) | (buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+}
+
+size_t encodeUdpFrame(uint8_t* buffer, size_t size, uint32_t senderId, uint32_t seq,
+                      const char* topic, const uint8_t* payload, unsigned int length) {
+  size_t topicLength = strlen(topic);
+  size_t frameLength = UDP_FRAME_HEADER_SIZE + topicLength + length;
+  if (topicLength == 0 || topicLength >= TRANSPORT_MAX_TOPIC || frameLength > size) {
+    return 0;
+  }
+
+  buffer[0] = UDP_FRAME_MAGIC0;
+  buffer[1] = UDP_FRAME_MAGIC1;
+  buffer[2] = UDP_FRAME_VERSION;
+  putUint32(buffer + 3, senderId);
+  putUint32(buffer + 7, seq);
+  buffer[11] = topicLength;
+  memcpy(buffer + UDP_FRAME_HEADER_SIZE, topic, topicLength);
+  memcpy(buffer + UDP_FRAME_HEADER_SIZE + topicLength, payload, length);
+  return frameLength;
+}
+
+bool decodeUdpFrame(uint8_t* buffer, size_t length, uint32_t& senderId, uint32_t& seq,
+                    char*& topic, uint8_t*& payload, unsigned int& payloadLength) {
+  if (length < UDP_FRAME_HEADER_SIZE || buffer[0] != UDP_FRAME_MAGIC0 || buffer[1] != UDP_FRAME_MAGIC1 ||
+      buffer[2] != UDP_FRAME_VERSION) {
+    return false;
+  }
+
+  size_t topicLength = buffer[11];
+  if (topicLength == 0 || topicLength >= TRANSPORT_MAX_TOPIC || UDP_FRAME_HEADER_SIZE + topicLength > length) {
+    return false;
+  }
+
+  senderId = getUint32(buffer + 3);
+  seq = getUint32(buffer + 7);
+
+  // Shift the topic back over the length byte so it can be NUL-terminated without touching the payload
+  memmove(buffer + UDP_FRAME_HEADER_SIZE - 1, buffer + UDP_FRAME_HEADER_SIZE, topicLength);
+  buffer[UDP_FRAME_HEADER_SIZE - 1 + topicLength] = '\0';
+  topic = (char*)buffer + UDP_FRAME_HEADER_SIZE - 1;
+  payload = buffer + UDP_FRAME_HEADER_SIZE + topicLength;
+  payloadLength = length - UDP_FRAME_HEADER_SIZE - topicLength;
+  return true;
+}
+
+#ifdef ARDUINO
+
+// ====== MqttTransport ======================================================
+
+void MqttTransport::begin() {
+  client.setCallback([this](char* topic, uint8_t* payload, unsigned int length) {
+    if (mux) {
+      mux->deliver(id, topic, payload, length, millis());
+    }
+  });
+}
+
+bool MqttTransport::connected() {
+  return client.connected();
+}
+
+bool MqttTransport::publish(const char* topic, const uint8_t* payload, unsigned int length) {
+  return client.publish(topic, payload, length);
+}
+
+// QoS 1 so a persistent session queues these messages while we are offline
+bool MqttTransport::subscribe(const char* topicFilter) {
+  return client.subscribe(topicFilter, 1);
+}
+
+bool MqttTransport::unsubscribe(const char* topicFilter) {
+  return client.unsubscribe(topicFilter);
+}
+
+void MqttTransport::loop() {
+  client.loop();
+}
+
+// ====== UdpTransport ======================================================
+
+// Must be called once Wi-Fi is up; the multicast group is joined on the station interface
+void UdpTransport::begin(uint32_t senderId) {
+  this->senderId = senderId;
+  // Random start so receivers can tell a restarted sender from a replay
+  nextSeq = esp_random();
+
+  sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (sock < 0) {
+    return;
+  }
+  int reuse = 1;
+  setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  struct sockaddr_in local = {};
+  local.sin_family = AF_INET;
+  local.sin_port = htons(UDP_MULTICAST_PORT);
+  local.sin_addr.s_addr = htonl(INADDR_ANY);
+
+  struct ip_mreq membership = {};
+  membership.imr_multiaddr.s_addr = (uint32_t)IPAddress(UDP_MULTICAST_GROUP);
+  membership.imr_interface.s_addr = (uint32_t)WiFi.localIP();
+  uint8_t ttl = 1;
+
+  if (bind(sock, (struct sockaddr*)&local, sizeof(local)) < 0 ||
+      setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) < 0 ||
+      setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0) {
+    close(sock);
+    sock = -1;
+    return;
+  }
+  fcntl(sock, F_SETFL, O_NONBLOCK);
+}
+
+bool UdpTransport::connected() {
+  return sock >= 0 && WiFi.status() == WL_CONNECTED;
+}
+
+bool UdpTransport::publish(const char* topic, const uint8_t* payload, unsigned int length) {
+  size_t frameLength = encodeUdpFrame(frame, UDP_FRAME_MAX_SIZE, senderId, nextSeq++, topic, payload, length);
+  if (frameLength == 0) {
+    // Logged once; the count shows how often it happened since
+    if (rejectedCount++ == 0) {
+      Serial.print("UDP: message does not fit a frame, not sent: ");
+      Serial.println(topic);
+    }
+    return false;
+  }
+
+  struct sockaddr_in group = {};
+  group.sin_family = AF_INET;
+  group.sin_port = htons(UDP_MULTICAST_PORT);
+  group.sin_addr.s_addr = (uint32_t)IPAddress(UDP_MULTICAST_GROUP);
+
+  bool sent = false;
+  for (int i = 0; i < UDP_REPEAT; i++) {
+    sent |= sendto(sock, frame, frameLength, 0, (struct sockaddr*)&group, sizeof(group)) == (int)frameLength;
+  }
+  return sent;
+}
+
+bool UdpTransport::subscribe(const char* topicFilter) {
+  for (int i = 0; i < filterCount; i++) {
+    if (strcmp(filters[i], topicFilter) == 0) {
+      return true;
+    }
+  }
+  if (filterCount >= UDP_MAX_FILTERS || strlen(topicFilter) >= TRANSPORT_MAX_TOPIC) {
+    rejectedCount++;
+    Serial.print("UDP: cannot add filter ");
+    Serial.println(topicFilter);
+    return false;
+  }
+  strcpy(filters[filterCount++], topicFilter);
+  return true;
+}
+
+bool UdpTransport::unsubscribe(const char* topicFilter) {
+  for (int i = 0; i < filterCount; i++) {
+    if (strcmp(filters[i], topicFilter) == 0) {
+      filterCount--;
+      if (i != filterCount) {
+        strcpy(filters[i], filters[filterCount]);
+      }
+      break;
+    }
+  }
+  return true;
+}
+
+void UdpTransport::loop() {
+  if (sock < 0) {
+    return;
+  }
+
+  // Bounded so a flood of datagrams cannot starve the rest of the loop
+  for (int packets = 0; packets < 8; packets++) {
+    // One byte of slack to spot (and drop) datagrams that were truncated
+    int length = recv(sock, frame, UDP_FRAME_MAX_SIZE + 1, MSG_DONTWAIT);
+    if (length < 0) {
+      return;
+    }
+    if (length > UDP_FRAME_MAX_SIZE) {
+      continue;
+    }
+
+    uint32_t sender, seq;
+    char* topic;
+    uint8_t* payload;
+    unsigned int payloadLength;
+    if (length <= 0 || !decodeUdpFrame(frame, length, sender, seq, topic, payload, payloadLength)) {
+      continue;
+    }
+    if (sender == senderId || !window.accept(sender, seq)) {
+      continue;
+    }
+
+    for (int i = 0; i < filterCount; i++) {
+      if (topicMatches(filters[i], topic)) {
+        if (mux) {
+          mux->deliver(id, topic, payload, payloadLength, millis());
+        }
+        break;
+      }
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "topics.h"
+
+// Transports carrying the same logical topic space
+#define TRANSPORT_MQTT 0
+#define TRANSPORT_UDP 1
+#define TRANSPORT_COUNT 2
+
+// LAN multicast group used for the latency-critical topics
+#define UDP_MULTICAST_GROUP 239, 255, 76, 1
+#define UDP_MULTICAST_PORT 47601
+// Multicast has no link-layer retries, so every datagram is sent this many times
+#define UDP_REPEAT 2
+
+// Frame: magic (2) | version (1) | sender id (4) | sequence (4) | topic length (1) | topic | payload
+#define UDP_FRAME_MAGIC0 'R'
+#define UDP_FRAME_MAGIC1 'L'
+#define UDP_FRAME_VERSION 1
+#define UDP_FRAME_HEADER_SIZE 12
+#define UDP_FRAME_MAX_SIZE 256
+
+// A copy arriving on the other transport within this window is a duplicate
+#define TRANSPORT_DEDUP_WINDOW_MS 1000
+#define TRANSPORT_DEDUP_SLOTS 8
+#define UDP_MAX_SENDERS 8
+// Filters a UdpTransport holds; the firmwares check their subscription counts against it
+#define UDP_MAX_FILTERS 12
+// Room for the longest topic in topics.h: owlcms/health/<fop>/<clientId>/warning
+#define TRANSPORT_MAX_TOPIC TOPIC_CLIENT_SUFFIX_SIZE(TOPIC_PREFIX_HEALTH, TOPIC_SUFFIX_WARNING)
+
+typedef void (*TransportCallback)(char* topic, uint8_t* payload, unsigned int length);
+
+class TransportMux;
+
+class Transport {
+public:
+  virtual ~Transport() {}
+  virtual bool connected() = 0;
+  virtual bool publish(const char* topic, const uint8_t* payload, unsigned int length) = 0;
+  virtual bool subscribe(const char* topicFilter) = 0;
+  virtual bool unsubscribe(const char* topicFilter) = 0;
+  virtual void loop() = 0;
+
+  void attach(TransportMux* mux, uint8_t id) { this->mux = mux; this->id = id; }
+
+protected:
+  TransportMux* mux = NULL;
+  uint8_t id = 0;
+};
+
+// Publishes on every transport and delivers whichever copy of a message arrives first
+class TransportMux {
+public:
+  void add(Transport& transport, uint8_t id);
+  void setCallback(TransportCallback callback) { this->callback = callback; }
+
+  bool publish(const char* topic, const char* payload);
+  bool publish(const char* topic, const uint8_t* payload, unsigned int length);
+  bool subscribe(const char* topicFilter);
+  bool unsubscribe(const char* topicFilter);
+  void loop();
+
+  // Called by transports for every received message
+  void deliver(uint8_t transportId, char* topic, uint8_t* payload, unsigned int length, uint32_t nowMs);
+
+private:
+  struct Recent {
+    uint32_t hash;
+    uint32_t timeMs;
+    uint8_t transportId;
+    bool pending;   // still waiting for the copy from the other transport
+  };
+
+  Transport* transports[TRANSPORT_COUNT] = {NULL, NULL};
+  TransportCallback callback = NULL;
+  Recent recent[TRANSPORT_DEDUP_SLOTS] = {};
+  uint8_t nextSlot = 0;
+};
+
+bool isFastPathTopic(const char* topic);
+bool topicMatches(const char* filter, const char* topic);
+
+// Sliding window over the last 32 sequence numbers of each sender
+class SequenceWindow {
+public:
+  bool accept(uint32_t senderId, uint32_t seq);
+
+private:
+  struct Sender {
+    uint32_t id;
+    uint32_t highest;
+    uint32_t seen;   // bit n set = highest - n already received
+    bool used;
+  };
+  Sender senders[UDP_MAX_SENDERS] = {};
+  uint8_t nextEvict = 0;
+};
+
+size_t encodeUdpFrame(uint8_t* buffer, size_t size, uint32_t senderId, uint32_t seq,
+                      const char* topic, const uint8_t* payload, unsigned int length);
+// Splits a frame in place: topic is NUL-terminated inside buffer, payload points into buffer
+bool decodeUdpFrame(uint8_t* buffer, size_t length, uint32_t& senderId, uint32_t& seq,
+                    char*& topic, uint8_t*& payload, unsigned int& payloadLength);
+
+#ifdef ARDUINO
+#include "PubSubClient.h"
+
+class MqttTransport : public Transport {
+public:
+  MqttTransport(PubSubClient& client) : client(client) {}
+  void begin();
+  bool connected() override;
+  bool publish(const char* topic, const uint8_t* payload, unsigned int length) override;
+  bool subscribe(const char* topicFilter) override;
+  bool unsubscribe(const char* topicFilter) override;
+  void loop() override;
+
+private:
+  PubSubClient& client;
+};
+
+// Plain lwIP socket rather than WiFiUDP so the event loop can select() on it
+class UdpTransport : public Transport {
+public:
+  void begin(uint32_t senderId);
+  int fd() const { return sock; }
+  bool connected() override;
+  bool publish(const char* topic, const uint8_t* payload, unsigned int length) override;
+  bool subscribe(const char* topicFilter) override;
+  bool unsubscribe(const char* topicFilter) override;
+  void loop() override;
+  // Messages not sent and filters not added because a topic was too long or the filters full
+  uint32_t rejected() const { return rejectedCount; }
+
+private:
+  int sock = -1;
+  uint32_t senderId = 0;
+  uint32_t nextSeq = 1;
+  SequenceWindow window;
+  char filters[UDP_MAX_FILTERS][TRANSPORT_MAX_TOPIC];
+  uint8_t filterCount = 0;
+  uint32_t rejectedCount = 0;
+  uint8_t frame[UDP_FRAME_MAX_SIZE + 1];
+};
+#endif
+
+#endif
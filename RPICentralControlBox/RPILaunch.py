@@ -5,6 +5,11 @@ import psutil
 import os
 from gpiozero import Button, LED
 from paho.mqtt.client import Client
+from fastpath import FastPath
+from decision import decode_decision, format_decision_text, DecisionFilter, ACCEPT, NEW_EPOCH, NO_EPOCH
+from decision import (LiftStatus, encode_lift_status, PHASE_IDLE, PHASE_PENDING, PHASE_SPLIT,
+                      PHASE_REMINDED, PHASE_CHANGE_WINDOW, PHASE_COOLDOWN)
+from decision import DisplayFrame, encode_display_frame, display_lights, BUZZER_NONE, BUZZER_DOWN
 
 from time import sleep
 
@@ -22,6 +27,16 @@ MQTT_DECISION_TOPIC = "owlcms/decision/A"
 MQTT_DOWN_TOPIC = "owlcms/fop/down/A"
 MQTT_DECISION_REQUEST_TOPIC = "owlcms/decisionRequest/A/"
 MQTT_RESET_TOPIC = "owlcms/fop/resetDecisions/A"
+MQTT_LIFT_STATE_TOPIC = "owlcms/fop/liftState/A"
+MQTT_DISPLAY_TOPIC = "owlcms/fop/display/A"
+MQTT_PRESENCE_TOPIC = "owlcms/presence/A/"
+MQTT_HEARTBEAT_TOPIC = "owlcms/heartbeat/A/"
+MQTT_HEALTH_TOPIC = "owlcms/health/A/"
+CENTRAL_CLIENT_ID = "replogic-central"
+# Devices heartbeat every 0.25 s; three missed beats means the device is gone
+HEARTBEAT_TIMEOUT = 0.75
+# Lift epoch survives a restart of this script, so devices never see it go backwards
+EPOCH_FILE = os.path.expanduser("~/.replogic-epoch")
 
 # === GPIO Devices ===
 switch = Button(SWITCH_PIN)
@@ -40,15 +55,28 @@ font = ImageFont.truetype("/usr/share/fonts/truetype/dejavu/DejaVuSansMono.ttf",
 # === State Variables ===
 mqtt_client = None
 mqtt_connected = False
+fast_path = None
 ref1Decision = None
 ref2Decision = None
 ref3Decision = None
 decisionsMade = 0
 reminder_timer = None
 down_signal_time = None
-decision_lock = threading.Lock()
+# Held for every use of the lift state and decision_filter: the paho, fast path and timer
+# threads all get here. Re-entrant, as resetLift() runs both inside and outside it.
+decision_lock = threading.RLock()
 down_signal_triggered = False
 dot_counter = 0
+last_heartbeat = {}
+offline_devices = set()
+decision_filter = DecisionFilter()
+# Lift phase as published on MQTT_LIFT_STATE_TOPIC; the deadline is on time.monotonic()
+lift_phase = PHASE_IDLE
+phase_deadline = None
+reminded_referee = 0
+# Last display frame published: its sequence number and what it showed
+display_seq = 0
+last_display = None
 
 
 # === Functions ===
@@ -124,6 +152,15 @@ def oled_update_loop():
         time.sleep(1)  # Update every 0.5 seconds for smoother animation
 
 
+def publish(topic, payload):
+    """Publishes over MQTT and, for latency-critical topics, the UDP fast path."""
+    if mqtt_client is None:
+        return
+    mqtt_client.publish(topic, payload)
+    if fast_path is not None:
+        fast_path.publish(topic, payload)
+
+
 def cancel_timer():
     global reminder_timer
     if reminder_timer is not None:
@@ -131,29 +168,117 @@ def cancel_timer():
         reminder_timer = None
 
 
+def load_epoch():
+    try:
+        with open(EPOCH_FILE) as f:
+            return int(f.read()) & 0xFF
+    except (OSError, ValueError):
+        return 0
+
+
+def next_epoch():
+    """Bumps the lift epoch (1-255, 0 is reserved for unknown) and remembers it."""
+    with decision_lock:
+        epoch = decision_filter.epoch % 255 + 1
+        decision_filter.reset(epoch)
+    try:
+        with open(EPOCH_FILE, "w") as f:
+            f.write(str(epoch))
+    except OSError as e:
+        print(f"Cannot save lift epoch: {e}")
+    return epoch
+
+
+def publish_reset(epoch):
+    # Retained so a device that reconnects learns the epoch; receivers ignore a repeat
+    # No client before the first switch to standalone; on_connect publishes the epoch then
+    if mqtt_client is None:
+        return
+    mqtt_client.publish(MQTT_RESET_TOPIC, str(epoch), qos=1, retain=True)
+
+
+def set_lift_phase(phase, seconds=None, reminded=0):
+    global lift_phase, phase_deadline, reminded_referee
+    lift_phase = phase
+    phase_deadline = None if seconds is None else time.monotonic() + seconds
+    reminded_referee = reminded
+    publish_lift_state()
+
+
+def publish_lift_state():
+    """Retained, so a device that reconnects mid-lift picks up where the lift stands."""
+    if mqtt_client is None:
+        return
+    remaining_ms = None
+    if phase_deadline is not None:
+        remaining_ms = max(0.0, phase_deadline - time.monotonic()) * 1000
+    status = LiftStatus(decision_filter.epoch, lift_phase, (ref1Decision, ref2Decision, ref3Decision),
+                        reminded_referee, remaining_ms)
+    mqtt_client.publish(MQTT_LIFT_STATE_TOPIC, encode_lift_status(status), qos=1, retain=True)
+    publish_display_frame()
+
+
+def publish_display_frame():
+    """One frame per visible change; the lightbox renders from it rather than from the decisions."""
+    global display_seq, last_display
+    votes = (ref1Decision, ref2Decision, ref3Decision)
+    shown = (display_lights(votes) if lift_phase == PHASE_COOLDOWN else 0,
+             lift_phase == PHASE_CHANGE_WINDOW,
+             BUZZER_DOWN if lift_phase == PHASE_CHANGE_WINDOW else BUZZER_NONE,
+             1 << (reminded_referee - 1) if reminded_referee else 0)
+    # A new epoch alone changes nothing on the lightbox; it rides on the next frame
+    if shown == last_display:
+        return
+    last_display = shown
+    display_seq = (display_seq + 1) & 0xFF
+    frame = DisplayFrame(decision_filter.epoch, display_seq, *shown)
+    publish(MQTT_DISPLAY_TOPIC, encode_display_frame(frame))
+
+
+def enter_cooldown(epoch):
+    with decision_lock:
+        if decision_filter.epoch == epoch and lift_phase == PHASE_CHANGE_WINDOW:
+            set_lift_phase(PHASE_COOLDOWN, 5)
+
+
+def auto_reset(epoch):
+    # A timer of an earlier lift does nothing once that lift was reset
+    with decision_lock:
+        if decision_filter.epoch == epoch:
+            resetLift()
+
+
 def resetLift():
     global decisionsMade, ref1Decision, ref2Decision, ref3Decision
     global reminder_timer, down_signal_triggered, down_signal_time
-    cancel_timer()
-    decisionsMade = 0
-    ref1Decision = None
-    ref2Decision = None
-    ref3Decision = None
-    down_signal_time = None
-    down_signal_triggered = False
-    print("Lift reset: Decisions and counters cleared.")
-    mqtt_client.publish(MQTT_RESET_TOPIC, "")
+    with decision_lock:
+        cancel_timer()
+        decisionsMade = 0
+        ref1Decision = None
+        ref2Decision = None
+        ref3Decision = None
+        down_signal_time = None
+        down_signal_triggered = False
+        epoch = next_epoch()
+        print(f"Lift reset: Decisions and counters cleared, epoch {epoch}.")
+        publish_reset(epoch)
+        set_lift_phase(PHASE_IDLE)
 
 
 def process_down_signal():
+    # Also carried by the display frame of the change window; the topic stays for OWLCMS and
+    # for a lightbox that has no frames yet
     global down_signal_time
     down_signal_time = time.time()
-    mqtt_client.publish(MQTT_DOWN_TOPIC, "")
+    publish(MQTT_DOWN_TOPIC, "")
     print("Down signal triggered.")
 
 
 def process_decision_request(ref_number):
-    mqtt_client.publish(MQTT_DECISION_REQUEST_TOPIC + ref_number, "on")
+    publish(MQTT_DECISION_REQUEST_TOPIC + ref_number, "on")
+    with decision_lock:
+        if lift_phase == PHASE_SPLIT:
+            set_lift_phase(PHASE_REMINDED, reminded=int(ref_number))
     print(f"Reminder sent to referee {ref_number}.")
 
 
@@ -210,11 +335,14 @@ def process_referee_decision(message):
                     process_down_signal()
                     down_signal_time = time.time()
                     down_signal_triggered = True
-                    mqtt_client.publish(MQTT_DECISION_REQUEST_TOPIC + ref_number, "off")
+                    publish(MQTT_DECISION_REQUEST_TOPIC + ref_number, "off")
                     cancel_timer()
-                    threading.Timer(8, resetLift).start()
+                    threading.Timer(8, auto_reset, args=(decision_filter.epoch,)).start()
+                    threading.Timer(3, enter_cooldown, args=(decision_filter.epoch,)).start()
+                    set_lift_phase(PHASE_CHANGE_WINDOW, 3)
                 else:
                     cancel_timer()
+                    set_lift_phase(PHASE_PENDING)
                     if total_decided == 2 and (good_count == 1 and bad_count == 1):
                         if ref1Decision is None:
                             reminder_timer = threading.Timer(3, process_decision_request, args=("1",))
@@ -223,6 +351,10 @@ def process_referee_decision(message):
                         elif ref3Decision is None:
                             reminder_timer = threading.Timer(3, process_decision_request, args=("3",))
                         reminder_timer.start()
+                        set_lift_phase(PHASE_SPLIT, 3)
+            else:
+                # A change inside the window: same phase and deadline, new votes
+                publish_lift_state()
     except ValueError:
         print(f"Invalid message format: {message}")
 
@@ -234,6 +366,12 @@ def on_connect(client, userdata, flags, rc):
     if rc == 0:
         mqtt_connected = True
         client.subscribe(MQTT_DECISION_TOPIC)
+        client.subscribe(MQTT_HEARTBEAT_TOPIC + "+")
+        client.subscribe(MQTT_HEALTH_TOPIC + "+/warning")
+        client.publish(MQTT_PRESENCE_TOPIC + CENTRAL_CLIENT_ID, "online central", qos=1, retain=True)
+        with decision_lock:
+            publish_reset(decision_filter.epoch)
+            publish_lift_state()
         print("Connected to MQTT broker.")
         MQTT_LED_ON.on()
         MQTT_LED_OFF.off()
@@ -245,14 +383,70 @@ def on_connect(client, userdata, flags, rc):
 
 
 def on_message(client, userdata, message):
-    message_str = message.payload.decode()
-    if message.topic == MQTT_DECISION_TOPIC:
-        process_referee_decision(message_str)
+    fast_path.deliver("mqtt", message.topic, message.payload)
+
+
+# Called once per message, for whichever of the MQTT and UDP copies arrived first
+def handle_message(topic, payload):
+    if topic == MQTT_DECISION_TOPIC:
+        # Controllers send either the OWLCMS text form or the binary form
+        decision = decode_decision(payload)
+        if decision is None:
+            print(f"Invalid decision payload: {payload!r}")
+            return
+        # Checked and applied in one go, so a copy on the other path or a reset in between
+        # cannot slip past the filter
+        with decision_lock:
+            verdict = decision_filter.check(decision)
+            if verdict not in (ACCEPT, NEW_EPOCH):
+                print(f"Dropped {verdict} decision: ref {decision.referee} seq {decision.seq} epoch {decision.epoch}")
+                return
+            process_referee_decision(format_decision_text(decision))
+    elif topic.startswith(MQTT_HEARTBEAT_TOPIC):
+        process_heartbeat(topic[len(MQTT_HEARTBEAT_TOPIC):])
+    elif topic.startswith(MQTT_HEALTH_TOPIC) and topic.endswith("/warning"):
+        client_id = topic[len(MQTT_HEALTH_TOPIC):-len("/warning")]
+        print(f"{client_id} low on memory: {payload.decode(errors='replace')}")
+
+
+def process_heartbeat(client_id):
+    with decision_lock:
+        last_heartbeat[client_id] = time.monotonic()
+        recovered = client_id in offline_devices
+        offline_devices.discard(client_id)
+    if recovered:
+        print(f"{client_id} is back online.")
+        # Replaces the retained "offline" the monitor published, without waiting for the device's refresh
+        if mqtt_connected:
+            mqtt_client.publish(MQTT_PRESENCE_TOPIC + client_id, "online", qos=1, retain=True)
+
+
+def heartbeat_monitor_loop():
+    """Marks devices offline much sooner than the broker's keep-alive would."""
+    while True:
+        now = time.monotonic()
+        with decision_lock:
+            lost = [c for c, t in last_heartbeat.items()
+                    if c not in offline_devices and now - t > HEARTBEAT_TIMEOUT]
+            offline_devices.update(lost)
+        for client_id in lost:
+            print(f"{client_id} missed its heartbeats, marking offline.")
+            if mqtt_connected:
+                mqtt_client.publish(MQTT_PRESENCE_TOPIC + client_id, "offline", qos=1, retain=True)
+        time.sleep(0.05)
 
 
 def setup_mqtt():
-    global mqtt_client
-    mqtt_client = Client()
+    global mqtt_client, fast_path
+    if fast_path is None:
+        fast_path = FastPath({MQTT_DECISION_TOPIC, MQTT_HEARTBEAT_TOPIC + "+"}, handle_message)
+        threading.Thread(target=heartbeat_monitor_loop, daemon=True).start()
+        with decision_lock:
+            decision_filter.reset(load_epoch())
+            if decision_filter.epoch == NO_EPOCH:
+                next_epoch()
+    mqtt_client = Client(client_id=CENTRAL_CLIENT_ID)
+    mqtt_client.will_set(MQTT_PRESENCE_TOPIC + CENTRAL_CLIENT_ID, "offline", qos=1, retain=True)
     mqtt_client.on_connect = on_connect
     mqtt_client.on_message = on_message
     mqtt_client.connect(MQTT_BROKER, MQTT_PORT)
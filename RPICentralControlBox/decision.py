@@ -0,0 +1,257 @@
+"""Decision payloads for owlcms/decision/<fop> (must match decision.h in the firmwares).
+
+OWLCMS sends and expects the text form ("2 good"). Standalone controllers may send
+the compact binary form instead; decode_decision() accepts either.
+
+It also holds the retained lift status on owlcms/fop/liftState/<fop> (LiftStatus in decision.h)
+and the display frame on owlcms/fop/display/<fop> (DisplayFrame).
+
+Run as a script to encode or decode payloads by hand:
+    python3 decision.py encode 2 good --seq 7 --epoch 3
+    python3 decision.py decode 02050700000000000003
+    python3 decision.py status 01030416000b0b0000
+    python3 decision.py frame 01030711000000
+"""
+import argparse
+import struct
+from collections import namedtuple
+
+WIRE_VERSION = 2
+# version | referee << 1 | good | sequence | press time ms | flags | epoch
+WIRE_FORMAT = struct.Struct("<BBHIBB")
+# Version 1 had no epoch byte
+WIRE_FORMAT_V1 = struct.Struct("<BBHIB")
+FLAG_RESENT = 0x01
+FLAG_BOOT = 0x02
+# Lift epoch 0 means unknown and is never compared
+NO_EPOCH = 0
+WINDOW_SIZE = 32
+
+ACCEPT = "accept"
+NEW_EPOCH = "new epoch"
+DUPLICATE = "duplicate"
+STALE = "stale"
+
+# version is the wire version the decision was decoded from, 0 for the text form
+Decision = namedtuple("Decision", "referee good seq pressed_ms flags epoch version")
+
+LIFT_STATUS_VERSION = 1
+# version | epoch | phase | votes, 2 bits per referee | reminded referee | ms left in phase
+LIFT_STATUS_FORMAT = struct.Struct("<BBBBBI")
+LIFT_STATUS_NO_DEADLINE = 0xFFFFFFFF
+# Phases, the LiftState values of lift.h
+PHASE_IDLE = 0
+PHASE_PENDING = 1
+PHASE_SPLIT = 2
+PHASE_REMINDED = 3
+PHASE_CHANGE_WINDOW = 4
+PHASE_COOLDOWN = 5
+_VOTE_BITS = {None: 0, "good": 1, "bad": 2}
+
+# votes: "good", "bad" or None per referee; remaining_ms: None when the phase has no timeout
+LiftStatus = namedtuple("LiftStatus", "epoch phase votes reminded remaining_ms")
+
+DISPLAY_FRAME_VERSION = 1
+# version | epoch | sequence | lights | down | buzzer | reminders
+DISPLAY_FRAME_FORMAT = struct.Struct("<BBBBBBB")
+# Buzzer patterns, the BuzzerPattern values of buzzer.h
+BUZZER_NONE = 0
+BUZZER_DOWN = 1
+
+# lights: bit n = good light of referee n+1, bit n+3 = bad light; reminders: bit n = referee n+1
+DisplayFrame = namedtuple("DisplayFrame", "epoch seq lights down buzzer reminders")
+
+
+def encode_decision(decision):
+    if decision.referee not in (1, 2, 3):
+        raise ValueError(f"invalid referee {decision.referee}")
+    return WIRE_FORMAT.pack(WIRE_VERSION, (decision.referee << 1) | int(decision.good),
+                            decision.seq & 0xFFFF, decision.pressed_ms & 0xFFFFFFFF, decision.flags,
+                            decision.epoch & 0xFF)
+
+
+def format_decision_text(decision):
+    return f"{decision.referee} {'good' if decision.good else 'bad'}"
+
+
+def decode_decision(payload):
+    """Returns a Decision, or None if the payload is neither format."""
+    if not payload:
+        return None
+    if payload[0] in (1, WIRE_VERSION):
+        version = payload[0]
+        wire_format = WIRE_FORMAT_V1 if version == 1 else WIRE_FORMAT
+        if len(payload) != wire_format.size:
+            return None
+        fields = wire_format.unpack(payload)
+        referee_verdict, seq, pressed_ms, flags = fields[1:5]
+        epoch = fields[5] if version != 1 else NO_EPOCH
+        referee = referee_verdict >> 1
+        if referee not in (1, 2, 3):
+            return None
+        return Decision(referee, bool(referee_verdict & 1), seq, pressed_ms, flags, epoch, version)
+
+    try:
+        ref_number, verdict = payload.decode().split(" ")
+    except (UnicodeDecodeError, ValueError):
+        return None
+    if ref_number not in ("1", "2", "3") or verdict not in ("good", "bad"):
+        return None
+    return Decision(int(ref_number), verdict == "good", 0, 0, 0, NO_EPOCH, 0)
+
+
+def encode_lift_status(status):
+    votes = 0
+    for i, vote in enumerate(status.votes):
+        votes |= _VOTE_BITS[vote] << (2 * i)
+    remaining = LIFT_STATUS_NO_DEADLINE if status.remaining_ms is None else max(0, int(status.remaining_ms))
+    return LIFT_STATUS_FORMAT.pack(LIFT_STATUS_VERSION, status.epoch & 0xFF, status.phase, votes,
+                                   status.reminded, remaining)
+
+
+def decode_lift_status(payload):
+    """Returns a LiftStatus, or None if the payload is not one."""
+    if len(payload) != LIFT_STATUS_FORMAT.size or payload[0] != LIFT_STATUS_VERSION:
+        return None
+    _, epoch, phase, votes, reminded, remaining = LIFT_STATUS_FORMAT.unpack(payload)
+    names = {bits: vote for vote, bits in _VOTE_BITS.items()}
+    decoded = tuple(names.get((votes >> (2 * i)) & 3, "invalid") for i in range(3))
+    if "invalid" in decoded or reminded > 3:
+        return None
+    return LiftStatus(epoch, phase, decoded, reminded,
+                      None if remaining == LIFT_STATUS_NO_DEADLINE else remaining)
+
+
+def display_lights(votes):
+    """Light bits for votes given as "good", "bad" or None per referee."""
+    lights = 0
+    for i, vote in enumerate(votes):
+        if vote == "good":
+            lights |= 1 << i
+        elif vote == "bad":
+            lights |= 1 << (i + 3)
+    return lights
+
+
+def encode_display_frame(frame):
+    return DISPLAY_FRAME_FORMAT.pack(DISPLAY_FRAME_VERSION, frame.epoch & 0xFF, frame.seq & 0xFF, frame.lights,
+                                     1 if frame.down else 0, frame.buzzer, frame.reminders)
+
+
+def decode_display_frame(payload):
+    """Returns a DisplayFrame, or None if the payload is not one."""
+    if len(payload) != DISPLAY_FRAME_FORMAT.size or payload[0] != DISPLAY_FRAME_VERSION:
+        return None
+    _, epoch, seq, lights, down, buzzer, reminders = DISPLAY_FRAME_FORMAT.unpack(payload)
+    if lights > 0x3F or down > 1 or reminders > 7:
+        return None
+    return DisplayFrame(epoch, seq, lights, bool(down), buzzer, reminders)
+
+
+def parse_epoch(payload):
+    """Epoch from a reset payload, or NO_EPOCH if it has none."""
+    try:
+        epoch = int(payload)
+    except ValueError:
+        return NO_EPOCH
+    return epoch if 0 <= epoch <= 255 else NO_EPOCH
+
+
+def epoch_distance(a, b):
+    """Signed distance from b to a, with wrap-around."""
+    return ((a - b + 128) & 0xFF) - 128
+
+
+class DecisionFilter:
+    """Drops duplicate and stale decisions (must match DecisionFilter in decision.cpp)."""
+
+    def __init__(self):
+        self.epoch = NO_EPOCH
+        # referee -> [epoch, highest seq, bitmap of the WINDOW_SIZE numbers below it]
+        self.windows = {}
+        # referee -> press time of the boot press that last started its window
+        self.boots = {}
+
+    def reset(self, epoch):
+        """Returns False for a repeat of the current epoch, which must not reset the lift."""
+        if epoch == NO_EPOCH:
+            return True
+        if epoch == self.epoch:
+            return False
+        self.epoch = epoch
+        return True
+
+    def check(self, decision):
+        if decision.version == 0:
+            return ACCEPT
+        verdict = ACCEPT
+        if decision.epoch != NO_EPOCH and self.epoch != NO_EPOCH and decision.epoch != self.epoch:
+            if epoch_distance(decision.epoch, self.epoch) < 0:
+                return STALE
+            self.epoch = decision.epoch
+            verdict = NEW_EPOCH
+
+        window = self.windows.get(decision.referee)
+        if (window is not None and decision.epoch != NO_EPOCH and window[0] != NO_EPOCH
+                and epoch_distance(decision.epoch, window[0]) < 0):
+            return STALE
+        # A new boot, not another copy of the boot press; a resent copy never restarts
+        rebooted = (decision.flags & FLAG_BOOT and not decision.flags & FLAG_RESENT
+                    and self.boots.get(decision.referee) != decision.pressed_ms)
+        if rebooted:
+            self.boots[decision.referee] = decision.pressed_ms
+        if window is None or rebooted or decision.epoch != window[0]:
+            self.windows[decision.referee] = [decision.epoch, decision.seq, 1]
+            return verdict
+
+        _, highest, seen = window
+        ahead = (decision.seq - highest) & 0xFFFF
+        if 0 < ahead < 0x8000:
+            window[1] = decision.seq
+            window[2] = ((seen << ahead) | 1) & 0xFFFFFFFF if ahead < WINDOW_SIZE else 1
+            return verdict
+        behind = (highest - decision.seq) & 0xFFFF
+        if behind < WINDOW_SIZE:
+            if seen & (1 << behind):
+                return DUPLICATE
+            window[2] = seen | (1 << behind)
+        return STALE
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Encode or decode decision payloads.")
+    commands = parser.add_subparsers(dest="command", required=True)
+    encode = commands.add_parser("encode")
+    encode.add_argument("referee", type=int)
+    encode.add_argument("verdict", choices=("good", "bad"))
+    encode.add_argument("--seq", type=int, default=0)
+    encode.add_argument("--pressed-ms", type=int, default=0)
+    encode.add_argument("--epoch", type=int, default=NO_EPOCH)
+    encode.add_argument("--resent", action="store_true")
+    encode.add_argument("--text", action="store_true", help="print the OWLCMS text form instead")
+    decode = commands.add_parser("decode")
+    decode.add_argument("payload", help="hex bytes, or the text form in quotes")
+    status = commands.add_parser("status", help="decode a retained lift status")
+    status.add_argument("payload", help="hex bytes")
+    frame = commands.add_parser("frame", help="decode a display frame")
+    frame.add_argument("payload", help="hex bytes")
+    args = parser.parse_args()
+
+    if args.command == "encode":
+        decision = Decision(args.referee, args.verdict == "good", args.seq, args.pressed_ms,
+                            FLAG_RESENT if args.resent else 0, args.epoch, WIRE_VERSION)
+        print(format_decision_text(decision) if args.text else encode_decision(decision).hex())
+    elif args.command == "status":
+        print(decode_lift_status(bytes.fromhex(args.payload)))
+    elif args.command == "frame":
+        print(decode_display_frame(bytes.fromhex(args.payload)))
+    else:
+        try:
+            payload = bytes.fromhex(args.payload)
+        except ValueError:
+            payload = args.payload.encode()
+        print(decode_decision(payload))
+
+
+if __name__ == "__main__":
+    main()
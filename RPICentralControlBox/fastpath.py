@@ -0,0 +1,150 @@
+import random
+import socket
+import struct
+import threading
+import time
+
+# === Configuration (must match transport.h in the firmwares) ===
+MULTICAST_GROUP = "239.255.76.1"
+MULTICAST_PORT = 47601
+REPEAT = 2
+FRAME_MAGIC = b"RL"
+FRAME_VERSION = 1
+FRAME_HEADER = struct.Struct("<2sBIIB")
+DEDUP_WINDOW = 1.0
+SEQUENCE_RESTART_GAP = 1024
+FAST_PATH_PREFIXES = (
+    "owlcms/decision/",
+    "owlcms/fop/down/",
+    "owlcms/fop/display/",
+    "owlcms/decisionRequest/",
+    "owlcms/heartbeat/",
+)
+
+
+def is_fast_path_topic(topic):
+    return topic.startswith(FAST_PATH_PREFIXES)
+
+
+def topic_matches(topic_filter, topic):
+    """MQTT topic filter matching with + and # wildcards."""
+    filter_levels = topic_filter.split("/")
+    topic_levels = topic.split("/")
+    for i, level in enumerate(filter_levels):
+        if level == "#":
+            return True
+        if i >= len(topic_levels) or (level != "+" and level != topic_levels[i]):
+            return False
+    return len(filter_levels) == len(topic_levels)
+
+
+def encode_frame(sender_id, seq, topic, payload):
+    topic_bytes = topic.encode()
+    return FRAME_HEADER.pack(FRAME_MAGIC, FRAME_VERSION, sender_id, seq, len(topic_bytes)) + topic_bytes + payload
+
+
+def decode_frame(data):
+    if len(data) < FRAME_HEADER.size:
+        return None
+    magic, version, sender_id, seq, topic_length = FRAME_HEADER.unpack_from(data)
+    if magic != FRAME_MAGIC or version != FRAME_VERSION or FRAME_HEADER.size + topic_length > len(data):
+        return None
+    topic = data[FRAME_HEADER.size:FRAME_HEADER.size + topic_length].decode(errors="replace")
+    payload = data[FRAME_HEADER.size + topic_length:]
+    return sender_id, seq, topic, payload
+
+
+class SequenceWindow:
+    """Drops repeated datagrams using the last 32 sequence numbers of each sender."""
+
+    def __init__(self):
+        self.senders = {}
+
+    def accept(self, sender_id, seq):
+        if sender_id not in self.senders:
+            self.senders[sender_id] = [seq, 1]
+            return True
+        highest, seen = self.senders[sender_id]
+        ahead = (seq - highest) & 0xFFFFFFFF
+        if 0 < ahead < 0x80000000:
+            seen = (seen << ahead) & 0xFFFFFFFF if ahead < 32 else 0
+            self.senders[sender_id] = [seq, seen | 1]
+            return True
+        offset = (highest - seq) & 0xFFFFFFFF
+        if offset >= SEQUENCE_RESTART_GAP:
+            self.senders[sender_id] = [seq, 1]
+            return True
+        if offset >= 32 or seen & (1 << offset):
+            return False
+        self.senders[sender_id][1] = seen | (1 << offset)
+        return True
+
+
+class FastPath:
+    """UDP multicast copy of the latency-critical topics.
+
+    Messages arriving over MQTT and UDP are both passed to deliver(); whichever
+    copy arrives first is handed to on_message and the other one is dropped.
+    """
+
+    def __init__(self, topic_filters, on_message):
+        self.topic_filters = topic_filters
+        self.on_message = on_message
+        self.sender_id = random.getrandbits(32)
+        self.next_seq = random.getrandbits(32)
+        self.window = SequenceWindow()
+        self.recent = []
+        self.lock = threading.Lock()
+
+        self.send_sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+        self.send_sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_TTL, 1)
+
+        self.recv_sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+        self.recv_sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.recv_sock.bind(("", MULTICAST_PORT))
+        membership = struct.pack("4sl", socket.inet_aton(MULTICAST_GROUP), socket.INADDR_ANY)
+        self.recv_sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, membership)
+
+        threading.Thread(target=self.receive_loop, daemon=True).start()
+
+    def publish(self, topic, payload):
+        if not is_fast_path_topic(topic):
+            return
+        if isinstance(payload, str):
+            payload = payload.encode()
+        with self.lock:
+            seq = self.next_seq
+            self.next_seq = (self.next_seq + 1) & 0xFFFFFFFF
+        frame = encode_frame(self.sender_id, seq, topic, payload)
+        for _ in range(REPEAT):
+            self.send_sock.sendto(frame, (MULTICAST_GROUP, MULTICAST_PORT))
+
+    def receive_loop(self):
+        while True:
+            data, _ = self.recv_sock.recvfrom(512)
+            frame = decode_frame(data)
+            if frame is None:
+                continue
+            sender_id, seq, topic, payload = frame
+            if sender_id == self.sender_id:
+                continue
+            if not any(topic_matches(f, topic) for f in self.topic_filters):
+                continue
+            with self.lock:
+                if not self.window.accept(sender_id, seq):
+                    continue
+            self.deliver("udp", topic, payload)
+
+    def deliver(self, source, topic, payload):
+        if is_fast_path_topic(topic):
+            now = time.monotonic()
+            key = (topic, bytes(payload))
+            with self.lock:
+                self.recent = [r for r in self.recent if now - r[1] < DEDUP_WINDOW]
+                for r in self.recent:
+                    if r[0] == key and r[2] != source:
+                        # Second copy of a message already delivered by the faster path
+                        self.recent.remove(r)
+                        return
+                self.recent.append((key, now, source))
+        self.on_message(topic, payload)
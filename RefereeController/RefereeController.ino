@@ -1,11 +1,17 @@
 // ====== START CONFIG SECTION ======================================================
 #include <Arduino.h>
-#include <EEPROM.h>
 #include "battery.h"
+#include "config.h"
 #include "connections.h"
-//#include "decision.h"
-
-#define EEPROM_SIZE 1
+#include "recovery.h"
+#include "decision.h"
+#include "timers.h"
+#include "events.h"
+#include "profile.h"
+#include "health.h"
+#include "topics.h"
+#include "input.h"
+#include "pattern.h"
 
 //______Allocate Pins___________________________________________
 int decisionPins[] = {14, 27};
@@ -15,258 +21,445 @@ int batteryPins[] = {16, 17, 22, 23};
 
 #define ELEMENTCOUNT(x)  (sizeof(x) / sizeof(x[0]))
 
+// Haptic motor strength in percent of full PWM duty
+#define HAPTIC1_INTENSITY 100
+#define HAPTIC2_INTENSITY 100
+
+// An undelivered decision older than this belongs to a finished lift and is dropped
+#define PENDING_DECISION_MAX_AGE_MS 8000
+
+// Referee selection gives up after this long without a button press
+#define REF_SELECT_TIMEOUT_MS 15000
+
+// Longest the loop sleeps with nothing to do: PubSubClient needs loop() for its keep-alive.
+// Without a socket to watch (broker unreachable, or TLS, which hides the socket) the
+// loop falls back to polling.
+#define LOOP_IDLE_MS 1000
+#define LOOP_POLL_MS 10
+// MQTT packets handled per loop pass, like the UDP transport's datagrams
+#define MQTT_DRAIN_PACKETS 8
+
 // ====== END CONFIG SECTION ======================================================
 
 // ====== Globals ======================================================
 int referee = 1;
-const char* platform = "A";
+const char* platform = config.platform;
 char fop[20];
 
 int ref13Number = 0;
-int prevDecisionPinState[] = {-1, -1, -1, -1, -1, -1};
-int ledStartedMillis[] = {0, 0, 0};
-int ledDuration[] = {0, 0, 0};
-
-bool refSet = false;
+bool refSelecting = false;
+Timer refSelectTimer;
+
+bool readButton(uint8_t button);
+uint32_t inputClock();
+void onInput(InputEvent event, uint8_t button);
+InputEngine input(inputClock, readButton, onInput);
+Timer inputTimer;
+
+// Lift state mirrored into the RTC snapshot
+bool reminderOn = false;
+bool summonOn = false;
+char lastDecision = 0;
+bool decisionSent = false;
+uint64_t decisionTime = 0;
+uint16_t decisionSeq = 0;
+uint8_t decisionEpoch = DECISION_NO_EPOCH;
+// Set by a cold boot, which starts decisionSeq over, until a fresh press was handed over
+bool bootDecisionPending = true;
+// Lift epoch from the central box's resets, stamped on each press so receivers can drop
+// decisions that belong to an earlier lift
+uint8_t liftEpoch = DECISION_NO_EPOCH;
 
 // ====== Function Prototypes ======================================================
-void setRefNumber();
+void startRefSelect();
+void showRefSelection();
+void finishRefSelect();
+void onRefSelectTimeout(void* context);
 void setupPins();
 void buttonLoop();
-void ledLoop();
 void sendDecision(int ref02Number, const char* decision);
+void publishPendingDecision(bool resent);
+void resendPendingDecision();
+void saveState();
+void restoreState(const ControllerSnapshot &snapshot);
 void changeReminderStatus(int ref13Number, boolean warn);
 void changeSummonStatus(int ref02Number, boolean warn);
+void syncLiftStatus(const LiftStatus &status);
 void callback(char* topic, byte* message, unsigned int length);
 
 // ====== Function Definitions ======================================================
 
-void setRefNumber() {
+// Referee selection: the good button steps through 1-3 on the battery LEDs, the bad button
+// (or REF_SELECT_TIMEOUT_MS without a press) keeps the current choice
+void startRefSelect() {
   Serial.println("Set Ref Mode Initiated");
-  if (referee > 1) {
-    for (int i = 0; i < referee; i++) {
-      analogWrite(batteryPins[i], 100);
-    }
-  } else { 
-    analogWrite(batteryPins[0], 100);
+  refSelecting = true;
+  batteryLEDsPaused = true;
+  showRefSelection();
+  timers.start(refSelectTimer, REF_SELECT_TIMEOUT_MS, onRefSelectTimeout);
+}
+
+void showRefSelection() {
+  for (int i = 0; i < 3; i++) {
+    analogWrite(batteryPins[i], i < referee ? 100 : 0);
   }
-  
-  // Add timestamp for timeout
-  unsigned long startTime = millis();
-  const unsigned long timeout = 15000; // 15 seconds in milliseconds
-  
-  while (!refSet) {
-    bool buttonA = digitalRead(decisionPins[0]) == LOW;
-    bool buttonB = digitalRead(decisionPins[1]) == LOW;
-    
-    // Check if timeout has elapsed
-    if (millis() - startTime >= timeout) {
-      Serial.println("Timeout: Exiting function automatically after 15 seconds.");
-      Serial.print("Referee set to: ");
-      Serial.println(referee);
-      EEPROM.write(0, referee);
-      EEPROM.commit();
-      refSet = true;
-      return;
-    }
+}
 
-    // Exit condition: button B pressed
-    if (buttonB) {
-      Serial.print("Exiting function. Referee set to: ");
-      Serial.println(referee);
-      EEPROM.write(0, referee);
-      EEPROM.commit();
-      refSet = true;
-      return;
-    }
+void finishRefSelect() {
+  timers.cancel(refSelectTimer);
+  refSelecting = false;
+  batteryLEDsPaused = false;
+  Serial.print("Referee set to: ");
+  Serial.println(referee);
+  config.referee = referee;
+  saveConfig();
+  saveState();
+  if (mqttClient.connected()) {
+    publishPresence();
+  }
+}
 
-    // Increment condition: only button A pressed
-    if (buttonA) {
-      delay(200); // Simple debounce
-      while (digitalRead(decisionPins[0]) == LOW); // Wait for release
-      
-      // Reset the timeout timer when user interacts
-      startTime = millis();
-
-      if (referee < 3) {
-        analogWrite(batteryPins[referee], 100);
-        Serial.println(referee);
-        referee++;
-      } else {
-        // Reset all except LED 0
-        for (int i = 1; i < 3; i++) {
-          analogWrite(batteryPins[i], 0);
-        }
-        referee = 1; // Reset count (LED 0 stays on)
-        Serial.println("Cycle complete. LEDs reset.");
-      }
-    }
+void onRefSelectTimeout(void* context) {
+  Serial.println("Timeout: leaving referee selection.");
+  finishRefSelect();
+}
+
+void refSelectInput(InputEvent event, uint8_t button) {
+  if (event != INPUT_PRESS) {
+    return;
   }
+  if (button == 1) {
+    finishRefSelect();
+    return;
+  }
+  // Each interaction restarts the timeout
+  timers.start(refSelectTimer, REF_SELECT_TIMEOUT_MS, onRefSelectTimeout);
+  referee = referee < 3 ? referee + 1 : 1;
+  Serial.println(referee);
+  showRefSelection();
 }
 
-void buttonLoop() {
-  for (int j = 0; j < ELEMENTCOUNT(decisionPins); j++) {
-    int state = digitalRead(decisionPins[j]);
-    int prevState = prevDecisionPinState[j];
-    if (state != prevState) {
-      prevDecisionPinState[j] = state;
-      if (state == LOW) {
-        if (j % 2 == 0) {
-          sendDecision(j / 2, "good");
-        } else {
-          sendDecision(j / 2, "bad");
-        }
-        analogWrite(ledPins[0], 0);
-        digitalWrite(hapticPins[0], LOW);
-        digitalWrite(hapticPins[1], LOW);
-        return;
-      }
+bool readButton(uint8_t button) {
+  return digitalRead(decisionPins[button]) == LOW;
+}
+
+uint32_t inputClock() {
+  return millis();
+}
+
+void onInput(InputEvent event, uint8_t button) {
+  if (refSelecting) {
+    refSelectInput(event, button);
+    return;
+  }
+  if (event == INPUT_PRESS) {
+    if (button % 2 == 0) {
+      sendDecision(button / 2, "good");
+    } else {
+      sendDecision(button / 2, "bad");
     }
+    patternStop(PATTERN_REMINDER);
+    patternStop(PATTERN_SUMMON);
+    reminderOn = false;
+    summonOn = false;
+    saveState();
+  } else if (event == INPUT_CHORD_LONG) {
+    // Both buttons held: change the referee number without a reboot. The engine holds a
+    // lone press back for the chord window, so the chord itself sends no decision.
+    startRefSelect();
   }
 }
 
-void ledLoop() {
-  for (int j = 0; j < ELEMENTCOUNT(ledStartedMillis); j++) {
-    if (ledStartedMillis[j] > 0) {
-      if (millis() - ledStartedMillis[j] >= ledDuration[j]) {
-        analogWrite(ledPins[0], 0);
-        digitalWrite(hapticPins[j], LOW);
-        ledStartedMillis[j] = 0;
-      }
-    }
+void onInputTimer(void* context) {
+  buttonLoop();
+}
+
+void buttonLoop() {
+  PROFILE_SCOPE(PROBE_BUTTON_LOOP);
+  input.poll();
+  // Come back when a debounce or hold deadline is due, even if no edge wakes the loop
+  uint32_t wait = input.msUntilNext();
+  if (wait == INPUT_NO_TIMEOUT) {
+    timers.cancel(inputTimer);
+  } else {
+    timers.start(inputTimer, wait, onInputTimer);
   }
 }
 
 void sendDecision(int ref02Number, const char* decision) {
-  if (referee > 0) {
-    ref02Number = referee - 1;
+  lastDecision = decision[0];
+  decisionTime = rtcClockMs();
+  decisionSent = false;
+  decisionSeq++;
+  decisionEpoch = liftEpoch;
+  saveState();
+  publishPendingDecision(false);
+}
+
+void publishPendingDecision(bool resent) {
+  Decision decision;
+  decision.referee = referee;
+  decision.good = lastDecision == 'g';
+  decision.seq = decisionSeq;
+  decision.pressedMs = (uint32_t)decisionTime;
+  decision.flags = resent ? DECISION_FLAG_RESENT : 0;
+  // The counter starts over after a cold boot (a warm reset restores it), and decisionSeq
+  // wraps, so a separate flag marks the first press. Receivers only restart their window for
+  // the first copy, so a resent one does not carry the flag.
+  if (bootDecisionPending && !resent) {
+    decision.flags |= DECISION_FLAG_BOOT;
   }
+  decision.epoch = decisionEpoch;
+
+  // Binary unless built for OWLCMS, which only reads the text form (CONFIG_DECISION_FORMAT)
+  uint8_t payload[DECISION_WIRE_SIZE];
+  char message[DECISION_TEXT_SIZE];
+  if (config.decisionFormat == DECISION_FORMAT_BINARY) {
+    size_t length = encodeDecision(decision, payload, sizeof(payload));
+    decisionSent = transport.publish(decisionTopic, payload, length);
+    TextWriter(message).character('#').unsignedInteger(decisionSeq);
+  } else {
+    formatDecisionText(decision, message, sizeof(message));
+    decisionSent = transport.publish(decisionTopic, message);
+  }
+  if (decisionSent && !resent) {
+    bootDecisionPending = false;
+  }
+  saveState();
+  Serial.print(decisionTopic); Serial.print(" "); Serial.print(message); Serial.println(decisionSent ? " sent." : " not sent.");
+}
 
-  char topic[50];
-  sprintf(topic, "owlcms/decision/%s", fop);
-  char message[32];
-  sprintf(message, "%i %s", ref02Number + 1, decision);
+// Re-publishes a decision that was pressed while offline or just before a reset
+void resendPendingDecision() {
+  if (lastDecision == 0 || decisionSent) {
+    return;
+  }
+  if (rtcClockMs() - decisionTime < PENDING_DECISION_MAX_AGE_MS) {
+    publishPendingDecision(true);
+  } else {
+    lastDecision = 0;
+    saveState();
+  }
+}
 
-  mqttClient.publish(topic, message);
-  Serial.print(topic); Serial.print(" "); Serial.print(message); Serial.println(" sent.");
+void saveState() {
+  ControllerSnapshot snapshot;
+  memset(&snapshot, 0, sizeof(snapshot));
+  snapshot.referee = referee;
+  snapshot.reminderOn = reminderOn;
+  snapshot.summonOn = summonOn;
+  snapshot.lastDecision = lastDecision;
+  snapshot.decisionSent = decisionSent;
+  snapshot.decisionTime = decisionTime;
+  snapshot.decisionSeq = decisionSeq;
+  snapshot.decisionEpoch = decisionEpoch;
+  snapshot.liftEpoch = liftEpoch;
+  snapshot.bootDecisionPending = bootDecisionPending;
+  writeSnapshot(snapshot);
+}
+
+void restoreState(const ControllerSnapshot &snapshot) {
+  Serial.println("Warm reset: restoring lift state");
+  referee = snapshot.referee;
+  lastDecision = snapshot.lastDecision;
+  decisionSent = snapshot.decisionSent;
+  decisionTime = snapshot.decisionTime;
+  decisionSeq = snapshot.decisionSeq;
+  decisionEpoch = snapshot.decisionEpoch;
+  liftEpoch = snapshot.liftEpoch;
+  bootDecisionPending = snapshot.bootDecisionPending;
+  if (snapshot.reminderOn) {
+    changeReminderStatus(referee, true);
+  }
+  if (snapshot.summonOn) {
+    changeSummonStatus(0, true);
+  }
 }
 
 void changeReminderStatus(int ref13Number, boolean warn) {
   Serial.print("reminder "); Serial.print(warn); Serial.print(" "); Serial.println(ref13Number);
   if (ref13Number == referee) {
+    reminderOn = warn;
+    saveState();
     if (warn) {
-      analogWrite(ledPins[0], 255);
-      digitalWrite(hapticPins[0], HIGH);
-      digitalWrite(hapticPins[1], HIGH);
+      patternPlay(PATTERN_REMINDER);
     } else {
-      analogWrite(ledPins[0], 0);
-      digitalWrite(hapticPins[0], LOW);
-      digitalWrite(hapticPins[1], LOW);
+      patternStop(PATTERN_REMINDER);
     }
   }
 }
 
 void changeSummonStatus(int ref02Number, boolean warn) {
   Serial.print("summon "); Serial.print(warn); Serial.print(" "); Serial.println(ref02Number + 1);
+  summonOn = warn;
+  saveState();
   if (warn) {
-    analogWrite(ledPins[0], 255);
-    digitalWrite(hapticPins[0], HIGH);
-    digitalWrite(hapticPins[1], HIGH);
+    patternPlay(PATTERN_SUMMON);
   } else {
-    analogWrite(ledPins[0], 0);
-    digitalWrite(hapticPins[0], LOW);
-    digitalWrite(hapticPins[1], LOW);
+    patternStop(PATTERN_SUMMON);
   }
 }
 
+// After a reconnect or a missed reset: take the epoch and the reminder from the central box
+void syncLiftStatus(const LiftStatus &status) {
+  liftStatusSynced = true;
+  if (status.epoch != DECISION_NO_EPOCH) {
+    liftEpoch = status.epoch;
+  }
+  bool reminded = status.reminded == referee;
+  if (reminded != reminderOn) {
+    changeReminderStatus(referee, reminded);
+  }
+  saveState();
+}
+
 void setupPins() {
   for (int j = 0; j < ELEMENTCOUNT(decisionPins); j++) {
     pinMode(decisionPins[j], INPUT_PULLUP);
-    prevDecisionPinState[j] = digitalRead(decisionPins[j]);
+    watchPin(decisionPins[j]);
   }
+  input.begin(ELEMENTCOUNT(decisionPins));
 
-  pinMode(ledPins[0], OUTPUT);
-
-  for (int j = 0; j < ELEMENTCOUNT(hapticPins); j++) {
-    pinMode(hapticPins[j], OUTPUT);
-    digitalWrite(hapticPins[j], LOW);
-  }
+  // The LED and the motors are driven by the pattern sequencer
+  patternBegin(ledPins[0], hapticPins[0], hapticPins[1]);
+  patternSetIntensity(PATTERN_HAPTIC1, HAPTIC1_INTENSITY);
+  patternSetIntensity(PATTERN_HAPTIC2, HAPTIC2_INTENSITY);
 }
 
 // ====== MQTT Callback ======================================================
 
-String decisionRequestTopic = String("owlcms/decisionRequest/") + fop;
-String summonTopic = String("owlcms/summon/") + fop;
-String ledTopic = String("owlcms/led/") + fop;
-String resetTopic = String("owlcms/reset/");
-
 void callback(char* topic, byte* message, unsigned int length) {
-  String stTopic = String(topic);
-  Serial.print("Message arrived on topic: "); Serial.print(stTopic); Serial.print("; Message: ");
+  PROFILE_SCOPE(PROBE_CALLBACK);
+  // Payloads are partly binary (lift status, epochs), so only the topic is logged
+  Serial.print("Message arrived on topic: "); Serial.println(topic);
 
-  String stMessage;
-  for (int i = 0; i < length; i++) {
-    stMessage += (char)message[i];
-  }
-
-  int refIndex = stTopic.lastIndexOf("/") + 1;
-  String refString = stTopic.substring(refIndex);
-  int ref13Number = refString.toInt();
+  int ref13Number = topicLastNumber(topic);
+  bool on = payloadStartsWith(message, length, "on");
 
-  if (stTopic.startsWith(decisionRequestTopic)) {
-    changeReminderStatus(ref13Number, stMessage.startsWith("on"));
-  } else if (stTopic.startsWith(summonTopic)) {
+  int subscription = matchSubscription(topic);
+  if (subscription == TOPIC_DECISION_REQUEST) {
+    changeReminderStatus(ref13Number, on);
+  } else if (subscription == TOPIC_SUMMON) {
     if (ref13Number == 0) {
       for (int j = 0; j < ELEMENTCOUNT(ledPins); j++) {
-        changeSummonStatus(j, stMessage.startsWith("on"));
+        changeSummonStatus(j, on);
       }
     } else {
-      changeSummonStatus(ref13Number, stMessage.startsWith("on"));
+      changeSummonStatus(ref13Number, on);
     }
-  } else if (stTopic.startsWith(ledTopic)) {
+  } else if (subscription == TOPIC_LED) {
     if (ref13Number == 0) {
       for (int j = 0; j < ELEMENTCOUNT(ledPins); j++) {
-        changeSummonStatus(j, stMessage.startsWith("on"));
+        changeSummonStatus(j, on);
       }
     } else {
-      changeSummonStatus(ref13Number - 1, stMessage.startsWith("on"));
+      changeSummonStatus(ref13Number - 1, on);
+    }
+  } else if (subscription == TOPIC_RESET_DECISIONS) {
+    // Without an epoch (an OWLCMS reset) keep the one we have
+    uint8_t epoch = parseEpoch(message, length);
+    if (epoch != DECISION_NO_EPOCH && epoch != liftEpoch) {
+      liftEpoch = epoch;
+      saveState();
     }
-  } else if (stTopic.startsWith(resetTopic)) {
-    analogWrite(ledPins[0], 0);
+  } else if (subscription == TOPIC_LIFT_STATE) {
+    LiftStatus status;
+    if (decodeLiftStatus(message, length, status) && (!liftStatusSynced || status.epoch != liftEpoch)) {
+      syncLiftStatus(status);
+    }
+  } else if (subscription == TOPIC_RESET) {
+    patternStop(PATTERN_REMINDER);
+    patternStop(PATTERN_SUMMON);
+    reminderOn = false;
+    summonOn = false;
+    lastDecision = 0;
+    saveState();
+#ifdef PROFILING
+  } else if (subscription == TOPIC_PROFILE) {
+    publishProfile(payloadStartsWith(message, length, "reset"));
+#endif
   }
 }
 
 // ====== Setup and Loop ======================================================
 
 void setup() {
-  EEPROM.begin(EEPROM_SIZE);
-  if (EEPROM.read(0) == NULL) {
-    referee = 1; 
-  } else {
-    referee = EEPROM.read(0);
-  }
+  setupWatchdog();
+  timers.begin(timerClockMs());
+  setupEvents();
+  healthWatchTask("loop", NULL);
+  healthWatchTask("watcher", xTaskGetHandle("Socket Watcher"));
+  ControllerSnapshot snapshot;
+  bool warmStart = readSnapshot(snapshot);
+
+  bool configStored = loadConfig();
+  referee = config.referee;
+  calibrationFactor = config.calibrationFactor;
+
   setupBatteryPins();
   setupPins();
-  setRefNumber();
+
+  // Only enter referee selection on first boot or when the good button is held at power-on
+  bool selectHeld = digitalRead(decisionPins[0]) == LOW;
+  if (warmStart) {
+    restoreState(snapshot);
+  } else {
+    patternPlay(PATTERN_BOOT);
+    if (!configStored || selectHeld) {
+      // The held button only reports its release, so it does not count as a step
+      startRefSelect();
+      while (refSelecting) {
+        waitForEvents(timers.msUntilNext(LOOP_IDLE_MS));
+        feedWatchdog();
+        timersLoop();
+        buttonLoop();
+      }
+    }
+  }
+  saveState();
   Serial.print(referee);
+  TaskHandle_t batteryTask = NULL;
   xTaskCreatePinnedToCore(
     batteryMonitoringTask,
     "Battery Monitor",
-    2048,
+    BATTERY_TASK_STACK,
     NULL,
     1,
-    NULL,
+    &batteryTask,
     1
   );
+  healthWatchTask("battery", batteryTask);
   setupConnections();
+  resendPendingDecision();
 }
 
 void loop() {
-  delay(10);
+  // Sleep until a button edge, a readable socket or the next timer deadline
+  int mqttFd = mqttClient.connected() ? wifiClient.fd() : -1;
+  watchSocket(EVENT_SOCKET_MQTT, mqttFd);
+  waitForEvents(timers.msUntilNext(mqttFd >= 0 ? LOOP_IDLE_MS : LOOP_POLL_MS));
+  feedWatchdog();
+  timersLoop();
   if (!mqttClient.connected()) {
     mqttReconnect();
+    resendPendingDecision();
   }
-  mqttClient.loop();
+  transport.loop();
+  drainMqtt();
   buttonLoop();
-  ledLoop();
+  socketsDrained();
+}
+
+// PubSubClient reads one packet per loop(): handle the rest of a burst before sleeping again.
+// Bytes mbedTLS has already pulled off the socket are invisible to the watcher's select(),
+// so a pass cut short by the bound wakes the loop straight away.
+void drainMqtt() {
+  for (int packets = 1; packets < MQTT_DRAIN_PACKETS && wifiClient.available(); packets++) {
+    if (!mqttClient.loop()) {
+      return;
+    }
+  }
+  if (mqttClient.connected() && wifiClient.available()) {
+    postEvent(EVENT_WAKE);
+  }
 }
\ No newline at end of file
@@ -0,0 +1,21 @@
+#include "backoff.h"
+
+// Returns the delay before the next attempt
+uint32_t ReconnectPolicy::failed(uint32_t nowMs, uint32_t randomValue) {
+  uint32_t upper = delayMs * 3;
+  if (upper > capMs || upper < delayMs) {
+    upper = capMs;
+  }
+  delayMs = baseMs + randomValue % (upper - baseMs + 1);
+  if (delayMs > capMs) {
+    delayMs = capMs;
+  }
+  nextAttemptMs = nowMs + delayMs;
+  waiting = true;
+  return delayMs;
+}
+
+void ReconnectPolicy::succeeded() {
+  delayMs = baseMs;
+  waiting = false;
+}
@@ -0,0 +1,29 @@
+#ifndef BACKOFF_H
+#define BACKOFF_H
+
+#include <stdint.h>
+
+// Reconnect spacing: first retry after RECONNECT_BASE_MS, never more than RECONNECT_CAP_MS apart
+#define RECONNECT_BASE_MS 500
+#define RECONNECT_CAP_MS 15000
+
+// Decorrelated jitter backoff: each delay is drawn from [base, 3 x previous delay], capped.
+// Devices that lost the broker at the same moment spread out instead of retrying in lockstep.
+class ReconnectPolicy {
+public:
+  ReconnectPolicy(uint32_t baseMs, uint32_t capMs) : baseMs(baseMs), capMs(capMs), delayMs(baseMs) {}
+
+  bool due(uint32_t nowMs) const { return !waiting || (int32_t)(nowMs - nextAttemptMs) >= 0; }
+  // randomValue is any uniformly distributed 32-bit value (esp_random() on the device)
+  uint32_t failed(uint32_t nowMs, uint32_t randomValue);
+  void succeeded();
+
+private:
+  uint32_t baseMs;
+  uint32_t capMs;
+  uint32_t delayMs;
+  uint32_t nextAttemptMs = 0;
+  bool waiting = false;
+};
+
+#endif
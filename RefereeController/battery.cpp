@@ -1,5 +1,7 @@
 #include <Arduino.h>
 #include "battery.h"
+#include "config.h"
+#include "profile.h"
 
 // Battery monitoring settings
 #define BATTERY_ADC_PIN 35
@@ -35,6 +37,10 @@ float calibrationFactor = DEFAULT_CALIBRATION_FACTOR;
 // Variable to track lowest recorded voltage
 float lowestVoltage = VOLTAGE_100;
 
+// Latest averaged reading, reported in the presence message
+float batteryVoltage = 0;
+volatile bool batteryLEDsPaused = false;
+
 // Reads a single voltage value with averaging to reduce noise
 float readRawVoltage() {
   int32_t adcSum = 0;
@@ -112,6 +118,7 @@ int getActiveLED(float voltage, bool isCharging) {
 
 // Updates the battery LED display
 void updateBatteryLEDs(float voltage, int activeLED, bool flashState) {
+  PROFILE_SCOPE(PROBE_BATTERY_LEDS);
   int adcChargeValue = analogRead(MONITOR_ADC_PIN);
   bool isCharging = (adcChargeValue > 1000);
   float fullVoltage = isCharging ? VOLTAGE_100_CHARGING : VOLTAGE_100;
@@ -216,6 +223,7 @@ void batteryMonitoringTask(void *parameter) {
     
     // Calculate average voltage
     float averageVoltage = calculateAverage(voltageReadings, NUM_READINGS);
+    batteryVoltage = averageVoltage;
     
     // Check charging state
     bool isCharging = (analogRead(MONITOR_ADC_PIN) > 1000);
@@ -224,7 +232,9 @@ void batteryMonitoringTask(void *parameter) {
     int activeLED = getActiveLED(averageVoltage, isCharging);
     
     // Update LEDs
-    updateBatteryLEDs(averageVoltage, activeLED, flashState);
+    if (!batteryLEDsPaused) {
+      updateBatteryLEDs(averageVoltage, activeLED, flashState);
+    }
     
     // Handle flashing logic for the active LED
     unsigned long currentTime = millis();
@@ -286,6 +296,8 @@ void calibrateVoltage() {
     
     Serial.print("New calibration factor: ");
     Serial.println(calibrationFactor, 4);
+    config.calibrationFactor = calibrationFactor;
+    saveConfig();
     Serial.println("Calibration complete!");
   } else {
     Serial.println("Invalid values, calibration aborted.");
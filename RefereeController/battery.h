@@ -2,9 +2,15 @@
 #define BATTERY_H
 
 #define BATTERY_PIN_COUNT 4
+// Stack for batteryMonitoringTask in bytes; check the "battery" figure on owlcms/health before shrinking it
+#define BATTERY_TASK_STACK 2048
 extern int batteryPins[BATTERY_PIN_COUNT];
 
 extern int batteryPins[];
+extern float calibrationFactor;
+extern float batteryVoltage;
+// Set while the battery LEDs show something else (referee selection)
+extern volatile bool batteryLEDsPaused;
 
 void batteryMonitoringTask(void *parameter);
 void setupBatteryPins();
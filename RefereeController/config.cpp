@@ -0,0 +1,185 @@
+#include <string.h>
+#include "config.h"
+#include "decision.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <Preferences.h>
+#endif
+
+#define CONFIG_NAMESPACE "refctl"
+#define CONFIG_KEY "config"
+
+// Legacy layout: the referee number was the only byte stored in EEPROM
+#define LEGACY_EEPROM_SIZE 1
+
+DeviceConfig config;
+
+// Copies at most size - 1 characters of value and always terminates
+static void copyString(char *dest, const char *value, size_t size) {
+  size_t length = strnlen(value, size - 1);
+  memcpy(dest, value, length);
+  dest[length] = '\0';
+}
+
+// Compiled-in defaults, used until a record has been saved to NVS
+void setDefaultConfig(DeviceConfig &cfg) {
+  memset(&cfg, 0, sizeof(cfg));
+  cfg.referee = 1;
+  copyString(cfg.wifiSSID, CONFIG_WIFI_SSID, sizeof(cfg.wifiSSID));
+  copyString(cfg.wifiPassword, CONFIG_WIFI_PASSWORD, sizeof(cfg.wifiPassword));
+  copyString(cfg.mqttServer, CONFIG_MQTT_SERVER, sizeof(cfg.mqttServer));
+  copyString(cfg.platform, "A", sizeof(cfg.platform));
+  cfg.calibrationFactor = 1.08;
+  cfg.decisionFormat = CONFIG_DECISION_FORMAT;
+}
+
+// CRC-16/CCITT-FALSE over the header and payload
+static uint16_t crc16(const uint8_t *data, size_t length) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int b = 0; b < 8; b++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+static void putString(uint8_t *buffer, size_t &pos, const char *value, size_t fieldSize) {
+  memset(buffer + pos, 0, fieldSize);
+  copyString((char *)buffer + pos, value, fieldSize);
+  pos += fieldSize;
+}
+
+static void getString(const uint8_t *buffer, size_t &pos, char *value, size_t fieldSize) {
+  memcpy(value, buffer + pos, fieldSize);
+  value[fieldSize - 1] = '\0';
+  pos += fieldSize;
+}
+
+// Writes the record in a fixed little-endian layout so it does not depend on struct padding.
+// Returns the number of bytes written, or 0 if the buffer is too small.
+size_t serializeConfig(const DeviceConfig &cfg, uint8_t *buffer, size_t size) {
+  if (size < CONFIG_RECORD_SIZE) {
+    return 0;
+  }
+
+  size_t pos = 0;
+  buffer[pos++] = CONFIG_VERSION;
+  buffer[pos++] = CONFIG_PAYLOAD_SIZE & 0xFF;
+  buffer[pos++] = CONFIG_PAYLOAD_SIZE >> 8;
+
+  buffer[pos++] = cfg.referee;
+  putString(buffer, pos, cfg.wifiSSID, CONFIG_SSID_SIZE);
+  putString(buffer, pos, cfg.wifiPassword, CONFIG_PASSWORD_SIZE);
+  putString(buffer, pos, cfg.mqttServer, CONFIG_SERVER_SIZE);
+  putString(buffer, pos, cfg.platform, CONFIG_PLATFORM_SIZE);
+
+  uint32_t calibrationBits;
+  memcpy(&calibrationBits, &cfg.calibrationFactor, sizeof(calibrationBits));
+  for (int i = 0; i < 4; i++) {
+    buffer[pos++] = (calibrationBits >> (8 * i)) & 0xFF;
+  }
+
+  buffer[pos++] = cfg.wifiChannel;
+  memcpy(buffer + pos, cfg.wifiBssid, 6);
+  pos += 6;
+  buffer[pos++] = cfg.decisionFormat;
+
+  uint16_t crc = crc16(buffer, pos);
+  buffer[pos++] = crc & 0xFF;
+  buffer[pos++] = crc >> 8;
+  return pos;
+}
+
+// Returns false (leaving cfg untouched) for truncated, corrupt or unknown-version records.
+// Version 1 records (no decision format) are still accepted and get the default format.
+bool deserializeConfig(const uint8_t *buffer, size_t length, DeviceConfig &cfg) {
+  if (length < CONFIG_HEADER_SIZE || buffer[0] < 1 || buffer[0] > CONFIG_VERSION) {
+    return false;
+  }
+
+  uint8_t version = buffer[0];
+  size_t expectedLength = version == 1 ? CONFIG_V1_PAYLOAD_SIZE : CONFIG_PAYLOAD_SIZE;
+  size_t payloadLength = buffer[1] | (buffer[2] << 8);
+  if (payloadLength != expectedLength || length < CONFIG_HEADER_SIZE + payloadLength + 2) {
+    return false;
+  }
+
+  size_t crcPos = CONFIG_HEADER_SIZE + payloadLength;
+  uint16_t storedCrc = buffer[crcPos] | (buffer[crcPos + 1] << 8);
+  if (crc16(buffer, crcPos) != storedCrc) {
+    return false;
+  }
+
+  DeviceConfig loaded;
+  size_t pos = CONFIG_HEADER_SIZE;
+  loaded.referee = buffer[pos++];
+  getString(buffer, pos, loaded.wifiSSID, CONFIG_SSID_SIZE);
+  getString(buffer, pos, loaded.wifiPassword, CONFIG_PASSWORD_SIZE);
+  getString(buffer, pos, loaded.mqttServer, CONFIG_SERVER_SIZE);
+  getString(buffer, pos, loaded.platform, CONFIG_PLATFORM_SIZE);
+
+  uint32_t calibrationBits = 0;
+  for (int i = 0; i < 4; i++) {
+    calibrationBits |= (uint32_t)buffer[pos++] << (8 * i);
+  }
+  memcpy(&loaded.calibrationFactor, &calibrationBits, sizeof(calibrationBits));
+
+  loaded.wifiChannel = buffer[pos++];
+  memcpy(loaded.wifiBssid, buffer + pos, 6);
+  pos += 6;
+  loaded.decisionFormat = version >= 2 ? buffer[pos++] : CONFIG_DECISION_FORMAT;
+
+  if (loaded.referee < 1 || loaded.referee > 3 || loaded.decisionFormat > DECISION_FORMAT_BINARY) {
+    return false;
+  }
+
+  cfg = loaded;
+  return true;
+}
+
+#ifdef ARDUINO
+
+// Loads the stored record into config. Returns false if nothing has been stored yet,
+// in which case config holds the defaults (plus the referee number from the old EEPROM layout).
+bool loadConfig() {
+  setDefaultConfig(config);
+
+  Preferences prefs;
+  prefs.begin(CONFIG_NAMESPACE, true);
+  uint8_t buffer[CONFIG_RECORD_SIZE];
+  size_t length = prefs.getBytes(CONFIG_KEY, buffer, sizeof(buffer));
+  prefs.end();
+
+  if (length > 0 && deserializeConfig(buffer, length, config)) {
+    return true;
+  }
+  if (length > 0) {
+    Serial.println("Stored config invalid, using defaults");
+  }
+
+  EEPROM.begin(LEGACY_EEPROM_SIZE);
+  uint8_t legacyReferee = EEPROM.read(0);
+  EEPROM.end();
+  if (legacyReferee >= 1 && legacyReferee <= 3) {
+    config.referee = legacyReferee;
+    saveConfig();
+    return true;
+  }
+  return false;
+}
+
+void saveConfig() {
+  uint8_t buffer[CONFIG_RECORD_SIZE];
+  size_t length = serializeConfig(config, buffer, sizeof(buffer));
+
+  Preferences prefs;
+  prefs.begin(CONFIG_NAMESPACE, false);
+  prefs.putBytes(CONFIG_KEY, buffer, length);
+  prefs.end();
+}
+
+#endif
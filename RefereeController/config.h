@@ -0,0 +1,64 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Bump when the record layout changes; deserializeConfig() rejects unknown versions
+#define CONFIG_VERSION 2
+
+#define CONFIG_SSID_SIZE 33
+#define CONFIG_PASSWORD_SIZE 65
+#define CONFIG_SERVER_SIZE 40
+#define CONFIG_PLATFORM_SIZE 20
+
+// Network defaults for a board with no stored record, set at build time so no credentials live
+// in the source, e.g. -DCONFIG_WIFI_SSID='"Wu"' -DCONFIG_WIFI_PASSWORD='"..."'
+#ifndef CONFIG_WIFI_SSID
+#define CONFIG_WIFI_SSID ""
+#endif
+#ifndef CONFIG_WIFI_PASSWORD
+#define CONFIG_WIFI_PASSWORD ""
+#endif
+#ifndef CONFIG_MQTT_SERVER
+#define CONFIG_MQTT_SERVER "192.168.68.60"
+#endif
+// Binary, so the receivers can drop duplicate and stale copies by sequence number and epoch.
+// OWLCMS reads only the text form: build with -DCONFIG_DECISION_FORMAT=DECISION_FORMAT_TEXT
+// for integrated mode. Either name comes from decision.h.
+#ifndef CONFIG_DECISION_FORMAT
+#define CONFIG_DECISION_FORMAT DECISION_FORMAT_BINARY
+#endif
+
+// version (1) + payload length (2) + payload + crc16 (2)
+#define CONFIG_HEADER_SIZE 3
+#define CONFIG_V1_PAYLOAD_SIZE (1 + CONFIG_SSID_SIZE + CONFIG_PASSWORD_SIZE + CONFIG_SERVER_SIZE + CONFIG_PLATFORM_SIZE + 4 + 1 + 6)
+#define CONFIG_PAYLOAD_SIZE (CONFIG_V1_PAYLOAD_SIZE + 1)
+#define CONFIG_RECORD_SIZE (CONFIG_HEADER_SIZE + CONFIG_PAYLOAD_SIZE + 2)
+
+struct DeviceConfig {
+  uint8_t referee;
+  char wifiSSID[CONFIG_SSID_SIZE];
+  char wifiPassword[CONFIG_PASSWORD_SIZE];
+  char mqttServer[CONFIG_SERVER_SIZE];
+  char platform[CONFIG_PLATFORM_SIZE];
+  float calibrationFactor;
+  // Last access point we joined, used to skip the scan on the next boot (channel 0 = unknown)
+  uint8_t wifiChannel;
+  uint8_t wifiBssid[6];
+  // DECISION_FORMAT_BINARY (the default) or DECISION_FORMAT_TEXT for OWLCMS in integrated mode
+  uint8_t decisionFormat;
+};
+
+extern DeviceConfig config;
+
+void setDefaultConfig(DeviceConfig &cfg);
+size_t serializeConfig(const DeviceConfig &cfg, uint8_t *buffer, size_t size);
+bool deserializeConfig(const uint8_t *buffer, size_t length, DeviceConfig &cfg);
+
+#ifdef ARDUINO
+bool loadConfig();
+void saveConfig();
+#endif
+
+#endif
@@ -1,10 +1,26 @@
 #include <Arduino.h>
 #include "connections.h"
+#include "config.h"
+#include "recovery.h"
+#include "backoff.h"
+#include "battery.h"
+#include "timers.h"
+#include "events.h"
+#include "profile.h"
+#include "health.h"
+#include "topics.h"
+#include "pattern.h"
 
-const char* wifiSSID = "Wu";
-const char* wifiPassword = "Welcome98!";
+// Time allowed for the fast (cached channel/BSSID) join before falling back to a full scan
+#define WIFI_FAST_CONNECT_MS 1500
+// A progress dot per LED breath while the access point is missing
+#define WIFI_PROGRESS_MS 5120
+
+// Heartbeats let the central box notice a dead controller within a second; the retained
+// presence message (refreshed less often) carries battery and signal strength
+#define HEARTBEAT_INTERVAL_MS 250
+#define PRESENCE_INTERVAL_MS 30000
 
-const char* mqttServer = "192.168.68.60";
 const char* mqttUserName= "";
 const char* mqttPassword = "";
 
@@ -16,93 +32,273 @@ WiFiClient wifiClient;
 #endif
 
 PubSubClient mqttClient;
+MqttTransport mqttTransport(mqttClient);
+UdpTransport udpTransport;
+TransportMux transport;
 
 String macAddress;
 char mac[50];
 char clientId[50];
 
+ReconnectPolicy reconnectPolicy(RECONNECT_BASE_MS, RECONNECT_CAP_MS);
+
+char decisionTopic[TOPIC_SIZE(TOPIC_PREFIX_DECISION)];
+char presenceTopic[TOPIC_CLIENT_SIZE(TOPIC_PREFIX_PRESENCE)];
+char heartbeatTopic[TOPIC_CLIENT_SIZE(TOPIC_PREFIX_HEARTBEAT)];
+Timer heartbeatTimer;
+Timer presenceTimer;
+uint32_t heartbeatCount = 0;
+
+char healthTopic[TOPIC_CLIENT_SIZE(TOPIC_PREFIX_HEALTH)];
+char healthWarningTopic[TOPIC_CLIENT_SUFFIX_SIZE(TOPIC_PREFIX_HEALTH, TOPIC_SUFFIX_WARNING)];
+Timer healthTimer;
+
+void sendHeartbeat(void* context);
+void refreshPresence(void* context);
+void publishHealth(void* context);
+
+// Subscription table: prefix (with %s for the platform) and the wildcard appended to form the filter.
+// Scoping by platform keeps traffic for the other platforms of a venue off this controller.
+struct SubscriptionFormat {
+  const char* prefix;
+  const char* wildcard;
+};
+
+static const SubscriptionFormat subscriptionFormats[TOPIC_COUNT] = {
+  {"owlcms/decisionRequest/%s/", "+"},   // TOPIC_DECISION_REQUEST
+  {"owlcms/led/%s/", "#"},               // TOPIC_LED
+  {"owlcms/summon/%s/", "#"},            // TOPIC_SUMMON
+  {"owlcms/reset/%s", ""},               // TOPIC_RESET
+  {"owlcms/fop/resetDecisions/%s", ""},  // TOPIC_RESET_DECISIONS
+  {"owlcms/fop/liftState/%s", ""},       // TOPIC_LIFT_STATE
+#ifdef PROFILING
+  {"owlcms/profile/%s", ""},             // TOPIC_PROFILE
+#endif
+};
+static_assert(TOPIC_COUNT <= UDP_MAX_FILTERS, "raise UDP_MAX_FILTERS in transport.h");
+
+char subscriptionPrefixes[TOPIC_COUNT][50];
+bool liftStatusSynced = false;
+
 
 void setupConnections() {
   #ifdef TLS
-    wifiClient.setCACert(rootCABuff);
-    wifiClient.setInsecure();
+    #ifdef TLS_PSK
+      // No certificate exchange or public-key math: reconnects take tens of ms instead of seconds
+      wifiClient.setPreSharedKey(pskIdentity, pskKey);
+    #else
+      wifiClient.setCACert(rootCABuff);
+      wifiClient.setInsecure();
+    #endif
+    wifiClient.setHandshakeTimeout(TLS_HANDSHAKE_TIMEOUT_S);
   #endif
   mqttClient.setKeepAlive(20);
+  // Keep a stalled connect well inside the watchdog timeout
+  mqttClient.setSocketTimeout(5);
   mqttClient.setClient(wifiClient);
+#ifdef PROFILING
+  // Histogram messages are longer than anything else we publish
+  mqttClient.setBufferSize(512);
+#endif
   Serial.begin(115200);
 
+  mqttTransport.begin();
+  transport.add(mqttTransport, TRANSPORT_MQTT);
+  transport.add(udpTransport, TRANSPORT_UDP);
+  transport.setCallback(callback);
+
   wifiConnect();
   macAddress = WiFi.macAddress();
-  macAddress.toCharArray(clientId, macAddress.length() + 1);
+
+  // Stable per-device id so the broker can keep our session and two devices never collide
+  uint8_t macBytes[6];
+  WiFi.macAddress(macBytes);
+  sprintf(clientId, "replogic-ref-%02x%02x%02x%02x%02x%02x",
+          macBytes[0], macBytes[1], macBytes[2], macBytes[3], macBytes[4], macBytes[5]);
+  udpTransport.begin((macBytes[2] << 24) | (macBytes[3] << 16) | (macBytes[4] << 8) | macBytes[5]);
+  watchSocket(EVENT_SOCKET_UDP, udpTransport.fd());
 
   Serial.print("MQTT server: ");
-  Serial.println(mqttServer);
-  mqttClient.setServer(mqttServer, mqttPort);
-  mqttClient.setCallback(callback);
+  Serial.println(config.mqttServer);
+  mqttClient.setServer(config.mqttServer, mqttPort);
 
   strcpy(fop, platform);
+  buildSubscriptions();
+  buildTopic(decisionTopic, TOPIC_PREFIX_DECISION, fop);
+  buildTopic(presenceTopic, TOPIC_PREFIX_PRESENCE, fop, clientId);
+  buildTopic(heartbeatTopic, TOPIC_PREFIX_HEARTBEAT, fop, clientId);
+  buildTopic(healthTopic, TOPIC_PREFIX_HEALTH, fop, clientId);
+  buildTopic(healthWarningTopic, TOPIC_PREFIX_HEALTH, fop, clientId, TOPIC_SUFFIX_WARNING);
+  timers.start(heartbeatTimer, HEARTBEAT_INTERVAL_MS, sendHeartbeat);
+  timers.start(healthTimer, HEALTH_INTERVAL_MS, publishHealth);
   mqttReconnect();
 }
 
 void wifiConnect() {
   Serial.print("Connecting to WiFi ");
-  Serial.print(wifiSSID);
+  Serial.print(config.wifiSSID);
+  WiFi.persistent(false);
   WiFi.mode(WIFI_STA);
-  WiFi.begin(wifiSSID, wifiPassword);
+
+  // Rejoin the last access point directly so the boot does not wait for a channel scan
+  bool fastConnect = config.wifiChannel != 0;
+  if (fastConnect) {
+    WiFi.begin(config.wifiSSID, config.wifiPassword, config.wifiChannel, config.wifiBssid);
+  } else {
+    WiFi.begin(config.wifiSSID, config.wifiPassword);
+  }
+
+  unsigned long startTime = millis();
+  unsigned long progressTime = startTime;
   while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-    Serial.print(".");
-    disconnectLEDs();
+    feedWatchdog();
+    delay(10);
+    if (millis() - startTime < WIFI_FAST_CONNECT_MS) {
+      continue;
+    }
+    if (fastConnect) {
+      Serial.print(" cached AP not found, scanning");
+      fastConnect = false;
+      WiFi.disconnect();
+      WiFi.begin(config.wifiSSID, config.wifiPassword);
+    }
+    patternPlay(PATTERN_DISCONNECT);
+    if (millis() - progressTime >= WIFI_PROGRESS_MS) {
+      Serial.print(".");
+      progressTime = millis();
+    }
   }
+  patternStop(PATTERN_DISCONNECT);
   Serial.println(" connected");
+
+  if (WiFi.channel() != config.wifiChannel || memcmp(WiFi.BSSID(), config.wifiBssid, 6) != 0) {
+    config.wifiChannel = WiFi.channel();
+    memcpy(config.wifiBssid, WiFi.BSSID(), 6);
+    saveConfig();
+  }
 }
 
+// Makes at most one connection attempt, spaced out by the reconnect policy, so the
+// loop (and the UDP fast path) keeps running while the broker is unreachable
 void mqttReconnect() {
-  long r = random(1000);
-  sprintf(clientId, "owlcms-%ld", r);
   if (WiFi.status() != WL_CONNECTED) {
     wifiConnect();
   }
-  while (!mqttClient.connected()) { 
-    Serial.print(macAddress);
-    Serial.print(" connecting to MQTT server...");
-
-    if (mqttClient.connect(clientId, mqttUserName, mqttPassword)) {
-      Serial.println(" connected");
-      char requestTopic[50];
-      sprintf(requestTopic, "owlcms/decisionRequest/%s/+", fop);
-      mqttClient.subscribe(requestTopic);
-
-      char ledTopic[50];
-      sprintf(ledTopic, "owlcms/led/#", fop);
-      mqttClient.subscribe(ledTopic);
-
-      char summonTopic[50];
-      sprintf(summonTopic, "owlcms/summon/#", fop);
-      mqttClient.subscribe(summonTopic);
-
-      char resetTopic[50];
-      sprintf(resetTopic, "owlcms/reset/");
-      mqttClient.subscribe(resetTopic);
-
-    } else {
-      Serial.print("MQTT connection failed, rc=");
-      Serial.print(mqttClient.state());
-      Serial.println(" try again in 5 second");
-      disconnectLEDs();
-      //delay(5000);
+  if (mqttClient.connected()) {
+    return;
+  }
+  if (!reconnectPolicy.due(millis())) {
+    patternPlay(PATTERN_DISCONNECT);
+    return;
+  }
+
+  Serial.print(clientId);
+  Serial.print(" connecting to MQTT server...");
+
+  // cleanSession=false: the broker keeps our subscriptions (and queued QoS 1 messages) across reconnects.
+  // The retained will marks us offline as soon as the broker notices the connection is gone.
+  uint32_t connectStart = millis();
+  if (mqttClient.connect(clientId, mqttUserName, mqttPassword, presenceTopic, 1, true, "offline", false)) {
+    // Includes the TLS handshake in TLS builds
+    Serial.print(" connected in ");
+    Serial.print(millis() - connectStart);
+    Serial.println(" ms");
+    reconnectPolicy.succeeded();
+    patternStop(PATTERN_DISCONNECT);
+    liftStatusSynced = false;
+    publishPresence();
+
+    for (int i = 0; i < TOPIC_COUNT; i++) {
+      char filter[60];
+      sprintf(filter, "%s%s", subscriptionPrefixes[i], subscriptionFormats[i].wildcard);
+      transport.subscribe(filter);
     }
+  } else {
+    uint32_t retryDelay = reconnectPolicy.failed(millis(), esp_random());
+    Serial.print("MQTT connection failed, rc=");
+    Serial.print(mqttClient.state());
+    Serial.print(" try again in ");
+    Serial.print(retryDelay);
+    Serial.println(" ms");
   }
 }
 
-void disconnectLEDs() {
-  for(int dutyCycle = 0; dutyCycle <= 255; dutyCycle++){   
-    analogWrite(ledPins[0], dutyCycle);
-    delay(10);
+// Expands the subscription table for the current platform; call again if fop changes
+void buildSubscriptions() {
+  for (int i = 0; i < TOPIC_COUNT; i++) {
+    snprintf(subscriptionPrefixes[i], sizeof(subscriptionPrefixes[i]), subscriptionFormats[i].prefix, fop);
   }
+}
 
-  for(int dutyCycle = 255; dutyCycle >= 0; dutyCycle--){
-    analogWrite(ledPins[0], dutyCycle);
-    delay(10);
+// Returns the subscription a received topic belongs to, or -1
+int matchSubscription(const char* topic) {
+  for (int i = 0; i < TOPIC_COUNT; i++) {
+    size_t length = strlen(subscriptionPrefixes[i]);
+    if (strncmp(topic, subscriptionPrefixes[i], length) == 0) {
+      // The reset topic has no wildcard and must match exactly
+      if (*subscriptionFormats[i].wildcard == '\0' && topic[length] != '\0') {
+        continue;
+      }
+      return i;
+    }
+  }
+  return -1;
+}
+
+void publishPresence() {
+  char message[40];
+  TextWriter(message).text("online ref").integer(referee).character(' ')
+    .fixed(batteryVoltage, 2).character(' ').integer(WiFi.RSSI());
+  mqttClient.publish(presenceTopic, message, true);
+  timers.start(presenceTimer, PRESENCE_INTERVAL_MS, refreshPresence);
+}
+
+void refreshPresence(void* context) {
+  if (mqttClient.connected()) {
+    publishPresence();
   }
-}
\ No newline at end of file
+}
+
+void sendHeartbeat(void* context) {
+  timers.start(heartbeatTimer, HEARTBEAT_INTERVAL_MS, sendHeartbeat);
+  char message[24];
+  TextWriter(message).text("ref").integer(referee).character(' ').unsignedInteger(heartbeatCount++);
+  transport.publish(heartbeatTopic, message);
+}
+
+// Stack, heap and loop wake-up telemetry; a new warning is also logged and sent on its own topic
+void publishHealth(void* context) {
+  timers.start(healthTimer, HEALTH_INTERVAL_MS, publishHealth);
+  char message[HEALTH_MESSAGE_SIZE];
+  bool warning = healthSample();
+  size_t length = healthFormat(message, sizeof(message));
+  // Loop passes per second since the last report: the timers' rate when idle, more under traffic
+  static uint32_t reportedWakeups = 0;
+  uint32_t wakeups = eventWakeups();
+  float perSecond = (wakeups - reportedWakeups) * 1000.0f / HEALTH_INTERVAL_MS;
+  TextWriter(message + length, sizeof(message) - length).text(" wakeups/s=").fixed(perSecond, 1);
+  reportedWakeups = wakeups;
+  transport.publish(healthTopic, message);
+  if (warning) {
+    healthFormatWarnings(message, sizeof(message));
+    Serial.print("Health warning: ");
+    Serial.println(message);
+    transport.publish(healthWarningTopic, message);
+  }
+}
+
+#ifdef PROFILING
+// Answers a request on owlcms/profile/<fop>: one message per probe, "reset" also clears them
+void publishProfile(bool reset) {
+  char topic[100];
+  char message[PROFILE_MESSAGE_SIZE];
+  for (int i = 0; i < PROBE_COUNT; i++) {
+    snprintf(topic, sizeof(topic), "owlcms/profile/%s/%s/%s", fop, clientId, profileName((ProfileProbe)i));
+    profileFormat((ProfileProbe)i, message, sizeof(message));
+    transport.publish(topic, message);
+  }
+  if (reset) {
+    profileReset();
+  }
+}
+#endif
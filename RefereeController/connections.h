@@ -3,11 +3,14 @@
 
 #include <WiFi.h>
 #include "PubSubClient.h"
+#include "transport.h"
 
 #ifdef TLS
 #include <WiFiClientSecure.h>
 #include "certificates.h"
 const int mqttPort = 8883;
+// Keeps a stalled handshake inside the watchdog timeout
+#define TLS_HANDSHAKE_TIMEOUT_S 5
 #else
 #include <WiFi.h>
 const int mqttPort = 1883;
@@ -21,21 +24,47 @@ extern WiFiClient wifiClient;
 
 // Declare external variables if needed
 extern PubSubClient mqttClient;
+extern TransportMux transport;
 
 extern String macAddress;
 extern char mac[50];
 extern char clientId[50];
+// owlcms/decision/<fop>, built once the platform is known
+extern char decisionTopic[];
 
 extern const char* platform;  
 extern char fop[20];  
+extern int referee;
 
-extern int ledPins[];
+// Topics the controller subscribes to, all scoped to its platform
+enum SubscriptionTopic {
+  TOPIC_DECISION_REQUEST,
+  TOPIC_LED,
+  TOPIC_SUMMON,
+  TOPIC_RESET,
+  TOPIC_RESET_DECISIONS,
+  TOPIC_LIFT_STATE,
+#ifdef PROFILING
+  TOPIC_PROFILE,
+#endif
+  TOPIC_COUNT
+};
+
+// Platform-expanded topic prefix for each subscription, for matching in callback()
+extern char subscriptionPrefixes[TOPIC_COUNT][50];
+// Cleared on every connect: the first lift status after it is taken over as it stands
+extern bool liftStatusSynced;
 
 // Function declarations
 void setupConnections();
+void buildSubscriptions();
+int matchSubscription(const char* topic);
 void wifiConnect();
 void mqttReconnect();
-void disconnectLEDs();
+void publishPresence();
+#ifdef PROFILING
+void publishProfile(bool reset);
+#endif
 void callback(char* topic, byte* payload, unsigned int length);
 
 #endif
@@ -0,0 +1,230 @@
+#include <string.h>
+#include "decision.h"
+
+size_t encodeDecision(const Decision &decision, uint8_t *buffer, size_t size) {
+  if (size < DECISION_WIRE_SIZE || decision.referee < 1 || decision.referee > 3) {
+    return 0;
+  }
+  buffer[0] = DECISION_WIRE_VERSION;
+  buffer[1] = (decision.referee << 1) | (decision.good ? 1 : 0);
+  buffer[2] = decision.seq & 0xFF;
+  buffer[3] = decision.seq >> 8;
+  for (int i = 0; i < 4; i++) {
+    buffer[4 + i] = (decision.pressedMs >> (8 * i)) & 0xFF;
+  }
+  buffer[8] = decision.flags;
+  buffer[9] = decision.epoch;
+  return DECISION_WIRE_SIZE;
+}
+
+size_t formatDecisionText(const Decision &decision, char *buffer, size_t size) {
+  if (size < DECISION_TEXT_SIZE || decision.referee < 1 || decision.referee > 3) {
+    return 0;
+  }
+  // Built by hand: this runs on every press, and printf is slow and may allocate
+  buffer[0] = '0' + decision.referee;
+  buffer[1] = ' ';
+  strcpy(buffer + 2, decision.good ? "good" : "bad");
+  return strlen(buffer);
+}
+
+static bool decodeBinary(const uint8_t *payload, size_t length, Decision &decision) {
+  uint8_t version = payload[0];
+  if (length != (version == 1 ? DECISION_WIRE_V1_SIZE : DECISION_WIRE_SIZE)) {
+    return false;
+  }
+  uint8_t referee = payload[1] >> 1;
+  if (referee < 1 || referee > 3) {
+    return false;
+  }
+  decision.referee = referee;
+  decision.good = payload[1] & 1;
+  decision.seq = payload[2] | (payload[3] << 8);
+  decision.pressedMs = payload[4] | (payload[5] << 8) | (payload[6] << 16) | ((uint32_t)payload[7] << 24);
+  decision.flags = payload[8];
+  decision.epoch = version == 1 ? DECISION_NO_EPOCH : payload[9];
+  decision.version = version;
+  return true;
+}
+
+// "<referee> good" or "<referee> bad", as sent by OWLCMS-compatible controllers
+static bool decodeText(const uint8_t *payload, size_t length, Decision &decision) {
+  if (length < 2 || payload[0] < '1' || payload[0] > '3' || payload[1] != ' ') {
+    return false;
+  }
+  const char *verdict = (const char *)payload + 2;
+  size_t verdictLength = length - 2;
+  bool good;
+  if (verdictLength == 4 && memcmp(verdict, "good", 4) == 0) {
+    good = true;
+  } else if (verdictLength == 3 && memcmp(verdict, "bad", 3) == 0) {
+    good = false;
+  } else {
+    return false;
+  }
+  memset(&decision, 0, sizeof(decision));
+  decision.referee = payload[0] - '0';
+  decision.good = good;
+  return true;
+}
+
+bool decodeDecision(const uint8_t *payload, size_t length, Decision &decision) {
+  if (length == 0) {
+    return false;
+  }
+  if (payload[0] == 1 || payload[0] == DECISION_WIRE_VERSION) {
+    return decodeBinary(payload, length, decision);
+  }
+  return decodeText(payload, length, decision);
+}
+
+uint8_t parseEpoch(const uint8_t *payload, size_t length) {
+  unsigned value = 0;
+  if (length == 0 || length > 3) {
+    return DECISION_NO_EPOCH;
+  }
+  for (size_t i = 0; i < length; i++) {
+    if (payload[i] < '0' || payload[i] > '9') {
+      return DECISION_NO_EPOCH;
+    }
+    value = value * 10 + (payload[i] - '0');
+  }
+  return value <= 255 ? value : DECISION_NO_EPOCH;
+}
+
+// Epochs wrap: a is ahead of b if it is less than half the range past it
+static int8_t epochDistance(uint8_t a, uint8_t b) {
+  return (int8_t)(uint8_t)(a - b);
+}
+
+bool DecisionFilter::reset(uint8_t epoch) {
+  if (epoch == DECISION_NO_EPOCH) {
+    // OWLCMS reset: a new lift, but the controllers keep stamping the epoch they know
+    return true;
+  }
+  if (epoch == current) {
+    return false;
+  }
+  current = epoch;
+  return true;
+}
+
+bool DecisionFilter::stale(uint8_t epoch) const {
+  return epoch != DECISION_NO_EPOCH && current != DECISION_NO_EPOCH && epochDistance(epoch, current) < 0;
+}
+
+DecisionVerdict DecisionFilter::check(const Decision &decision) {
+  if (decision.version == 0 || decision.referee < 1 || decision.referee > 3) {
+    return DECISION_ACCEPT;
+  }
+  DecisionVerdict verdict = DECISION_ACCEPT;
+  if (decision.epoch != DECISION_NO_EPOCH && current != DECISION_NO_EPOCH && decision.epoch != current) {
+    if (epochDistance(decision.epoch, current) < 0) {
+      return DECISION_STALE;
+    }
+    current = decision.epoch;
+    verdict = DECISION_NEW_EPOCH;
+  }
+
+  // Sequence numbers run on across lifts; a controller that rebooted or a new lift starts
+  // a fresh window
+  Window &window = windows[decision.referee - 1];
+  if (window.valid && decision.epoch != DECISION_NO_EPOCH && window.epoch != DECISION_NO_EPOCH &&
+      epochDistance(decision.epoch, window.epoch) < 0) {
+    return DECISION_STALE;
+  }
+  bool rebooted = (decision.flags & DECISION_FLAG_BOOT) && !(decision.flags & DECISION_FLAG_RESENT) &&
+                  !(window.booted && window.bootPressedMs == decision.pressedMs);
+  if (rebooted) {
+    window.booted = true;
+    window.bootPressedMs = decision.pressedMs;
+  }
+  if (!window.valid || rebooted || decision.epoch != window.epoch) {
+    window.valid = true;
+    window.epoch = decision.epoch;
+    window.highest = decision.seq;
+    window.seen = 1;
+    return verdict;
+  }
+
+  uint16_t ahead = decision.seq - window.highest;
+  if (ahead != 0 && ahead < 0x8000) {
+    window.seen = ahead < DECISION_WINDOW_SIZE ? (window.seen << ahead) | 1 : 1;
+    window.highest = decision.seq;
+    return verdict;
+  }
+  uint16_t behind = window.highest - decision.seq;
+  if (behind < DECISION_WINDOW_SIZE) {
+    uint32_t bit = (uint32_t)1 << behind;
+    if (window.seen & bit) {
+      return DECISION_DUPLICATE;
+    }
+    window.seen |= bit;
+  }
+  return DECISION_STALE;
+}
+
+size_t encodeLiftStatus(const LiftStatus &status, uint8_t *buffer, size_t size) {
+  if (size < LIFT_STATUS_SIZE) {
+    return 0;
+  }
+  buffer[0] = LIFT_STATUS_VERSION;
+  buffer[1] = status.epoch;
+  buffer[2] = status.phase;
+  buffer[3] = 0;
+  for (int i = 0; i < 3; i++) {
+    uint8_t vote = status.votes[i] == 'g' ? 1 : status.votes[i] == 'b' ? 2 : 0;
+    buffer[3] |= vote << (2 * i);
+  }
+  buffer[4] = status.reminded;
+  for (int i = 0; i < 4; i++) {
+    buffer[5 + i] = (status.remainingMs >> (8 * i)) & 0xFF;
+  }
+  return LIFT_STATUS_SIZE;
+}
+
+bool decodeLiftStatus(const uint8_t *payload, size_t length, LiftStatus &status) {
+  if (length != LIFT_STATUS_SIZE || payload[0] != LIFT_STATUS_VERSION || payload[4] > 3) {
+    return false;
+  }
+  status.epoch = payload[1];
+  status.phase = payload[2];
+  for (int i = 0; i < 3; i++) {
+    uint8_t vote = (payload[3] >> (2 * i)) & 3;
+    if (vote == 3) {
+      return false;
+    }
+    status.votes[i] = vote == 1 ? 'g' : vote == 2 ? 'b' : 0;
+  }
+  status.reminded = payload[4];
+  status.remainingMs = payload[5] | (payload[6] << 8) | (payload[7] << 16) | ((uint32_t)payload[8] << 24);
+  return true;
+}
+
+size_t encodeDisplayFrame(const DisplayFrame &frame, uint8_t *buffer, size_t size) {
+  if (size < DISPLAY_FRAME_SIZE) {
+    return 0;
+  }
+  buffer[0] = DISPLAY_FRAME_VERSION;
+  buffer[1] = frame.epoch;
+  buffer[2] = frame.seq;
+  buffer[3] = frame.lights;
+  buffer[4] = frame.down ? 1 : 0;
+  buffer[5] = frame.buzzer;
+  buffer[6] = frame.reminders;
+  return DISPLAY_FRAME_SIZE;
+}
+
+bool decodeDisplayFrame(const uint8_t *payload, size_t length, DisplayFrame &frame) {
+  if (length != DISPLAY_FRAME_SIZE || payload[0] != DISPLAY_FRAME_VERSION || payload[3] > 0x3F ||
+      payload[4] > 1 || payload[6] > 7) {
+    return false;
+  }
+  frame.epoch = payload[1];
+  frame.seq = payload[2];
+  frame.lights = payload[3];
+  frame.down = payload[4] != 0;
+  frame.buzzer = payload[5];
+  frame.reminders = payload[6];
+  return true;
+}
@@ -0,0 +1,87 @@
+#include "events.h"
+#include <lwip/sockets.h>
+
+// How long the watcher blocks in select() before re-reading the watched sockets
+#define WATCHER_SELECT_MS 100
+
+static TaskHandle_t loopTask = NULL;
+static TaskHandle_t watcherTask = NULL;
+static volatile int watchedSockets[EVENT_SOCKET_COUNT] = {-1, -1};
+static volatile uint32_t wakeups = 0;
+
+static void IRAM_ATTR onPinChange() {
+  BaseType_t woken = pdFALSE;
+  xTaskNotifyFromISR(loopTask, EVENT_INPUT, eSetBits, &woken);
+  if (woken) {
+    portYIELD_FROM_ISR();
+  }
+}
+
+// lwIP select() runs here so the loop task can sleep on its notification instead
+static void socketWatcherTask(void *parameter) {
+  while (true) {
+    // Drop drain notices left over from loop passes that had nothing to do with us
+    ulTaskNotifyTake(pdTRUE, 0);
+
+    fd_set readable;
+    FD_ZERO(&readable);
+    int maxFd = -1;
+    for (int i = 0; i < EVENT_SOCKET_COUNT; i++) {
+      int fd = watchedSockets[i];
+      if (fd >= 0) {
+        FD_SET(fd, &readable);
+        maxFd = fd > maxFd ? fd : maxFd;
+      }
+    }
+    if (maxFd < 0) {
+      vTaskDelay(pdMS_TO_TICKS(WATCHER_SELECT_MS));
+      continue;
+    }
+
+    struct timeval timeout = {0, WATCHER_SELECT_MS * 1000};
+    int ready = select(maxFd + 1, &readable, NULL, NULL, &timeout);
+    if (ready == 0) {
+      continue;
+    }
+    // Readable, closed or failed: in every case the loop has something to look at.
+    // Wait until it has, since select() would otherwise report the same data again.
+    postEvent(EVENT_NETWORK);
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(WATCHER_SELECT_MS));
+  }
+}
+
+void setupEvents() {
+  loopTask = xTaskGetCurrentTaskHandle();
+  xTaskCreatePinnedToCore(socketWatcherTask, "Socket Watcher", 2048, NULL, 2, &watcherTask, 1);
+}
+
+uint32_t waitForEvents(uint32_t timeoutMs) {
+  uint32_t bits = 0;
+  xTaskNotifyWait(0, 0xFFFFFFFF, &bits, pdMS_TO_TICKS(timeoutMs));
+  wakeups++;
+  return bits;
+}
+
+void postEvent(uint32_t bits) {
+  if (loopTask != NULL) {
+    xTaskNotify(loopTask, bits, eSetBits);
+  }
+}
+
+void watchPin(int pin) {
+  attachInterrupt(digitalPinToInterrupt(pin), onPinChange, CHANGE);
+}
+
+void watchSocket(int slot, int fd) {
+  watchedSockets[slot] = fd;
+}
+
+void socketsDrained() {
+  if (watcherTask != NULL) {
+    xTaskNotifyGive(watcherTask);
+  }
+}
+
+uint32_t eventWakeups() {
+  return wakeups;
+}
@@ -0,0 +1,34 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <Arduino.h>
+
+// Wake-up reasons for the loop task, delivered as task notification bits
+#define EVENT_INPUT   (1 << 0)   // a watched pin changed
+#define EVENT_NETWORK (1 << 1)   // a watched socket is readable
+#define EVENT_WAKE    (1 << 2)   // posted by another task
+
+// Sockets watched for readability
+#define EVENT_SOCKET_MQTT 0
+#define EVENT_SOCKET_UDP 1
+#define EVENT_SOCKET_COUNT 2
+
+// Call from setup(); the loop task is the one that waits for events
+void setupEvents();
+
+// Blocks until an event is posted or timeoutMs passes; returns the event bits (0 on timeout)
+uint32_t waitForEvents(uint32_t timeoutMs);
+void postEvent(uint32_t bits);
+
+// Posts EVENT_INPUT from a GPIO interrupt on every edge of the pin
+void watchPin(int pin);
+
+// fd < 0 stops watching the slot. Call socketsDrained() once the loop has read what was
+// pending, so the watcher does not report the same data again.
+void watchSocket(int slot, int fd);
+void socketsDrained();
+
+// Number of times waitForEvents() has returned, for wake-up rate statistics
+uint32_t eventWakeups();
+
+#endif
@@ -0,0 +1,172 @@
+#include "input.h"
+
+void InputEngine::begin(uint8_t buttonCount) {
+  count = buttonCount < INPUT_MAX_BUTTONS ? buttonCount : INPUT_MAX_BUTTONS;
+  sampleMs = clock();
+  for (uint8_t i = 0; i < count; i++) {
+    Button& button = buttons[i];
+    button.raw = reader(i);
+    button.pressed = button.raw;
+    button.reported = button.raw;
+    button.integrator = button.raw ? INPUT_DEBOUNCE_MS : 0;
+    // A button held at power-on reports its release but never a long press
+    button.longReported = true;
+    button.pressedMs = sampleMs;
+  }
+  held = INPUT_NO_BUTTON;
+  chord = false;
+  chordLongReported = false;
+}
+
+// The level seen at the last sample is taken to have held since then (sample and hold),
+// so a bounce only counts for as long as it was actually observed.
+void InputEngine::integrate(Button& button, uint32_t elapsedMs) {
+  if (button.raw) {
+    uint32_t room = INPUT_DEBOUNCE_MS - button.integrator;
+    button.integrator += elapsedMs < room ? elapsedMs : room;
+  } else {
+    button.integrator -= elapsedMs < button.integrator ? elapsedMs : button.integrator;
+  }
+}
+
+void InputEngine::poll() {
+  uint32_t now = clock();
+  uint32_t elapsed = now - sampleMs;
+  sampleMs = now;
+
+  for (uint8_t i = 0; i < count; i++) {
+    Button& button = buttons[i];
+    integrate(button, elapsed);
+    button.raw = reader(i);
+
+    if (!button.pressed && button.integrator == INPUT_DEBOUNCE_MS) {
+      button.pressed = true;
+      button.longReported = false;
+      button.pressedMs = now;
+      pressButton(i, now);
+    } else if (button.pressed && button.integrator == 0) {
+      button.pressed = false;
+      releaseButton(i);
+    }
+  }
+  if (chord && pressedCount() == 0) {
+    chord = false;
+  }
+
+  checkHolds(now);
+}
+
+uint8_t InputEngine::pressedCount() const {
+  uint8_t pressed = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    pressed += buttons[i].pressed;
+  }
+  return pressed;
+}
+
+void InputEngine::pressButton(uint8_t index, uint32_t now) {
+  buttons[index].reported = false;
+  if (chord) {
+    // Pressed again while the chord is let go: not a decision
+    return;
+  }
+  if (held != INPUT_NO_BUTTON && now - buttons[held].pressedMs < INPUT_CHORD_WINDOW_MS) {
+    if (pressedCount() == count) {
+      // The held press turns out to be half of a chord and is never reported
+      held = INPUT_NO_BUTTON;
+      chord = true;
+      chordLongReported = false;
+      chordMs = now;
+      handler(INPUT_CHORD, index);
+      return;
+    }
+  } else if (held != INPUT_NO_BUTTON) {
+    // A late poll: the window ran out before this press
+    uint8_t late = held;
+    held = INPUT_NO_BUTTON;
+    reportPress(late);
+  }
+  if (count > 1 && pressedCount() == 1) {
+    held = index;
+  } else {
+    reportPress(index);
+  }
+}
+
+void InputEngine::releaseButton(uint8_t index) {
+  if (held == index) {
+    // A tap shorter than the chord window
+    held = INPUT_NO_BUTTON;
+    reportPress(index);
+  }
+  if (chord) {
+    chordLongReported = true;
+  }
+  if (buttons[index].reported) {
+    handler(INPUT_RELEASE, index);
+  }
+}
+
+void InputEngine::reportPress(uint8_t index) {
+  buttons[index].reported = true;
+  handler(INPUT_PRESS, index);
+}
+
+void InputEngine::checkHolds(uint32_t now) {
+  if (held != INPUT_NO_BUTTON && now - buttons[held].pressedMs >= INPUT_CHORD_WINDOW_MS) {
+    uint8_t alone = held;
+    held = INPUT_NO_BUTTON;
+    reportPress(alone);
+  }
+  if (chord) {
+    // Releasing any of the chord's buttons cancels the long chord
+    if (!chordLongReported && now - chordMs >= INPUT_CHORD_LONG_MS) {
+      chordLongReported = true;
+      handler(INPUT_CHORD_LONG, 0);
+    }
+    // Buttons held as part of a chord never report a long press of their own
+    for (uint8_t i = 0; i < count; i++) {
+      buttons[i].longReported = true;
+    }
+    return;
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    Button& button = buttons[i];
+    if (button.pressed && !button.longReported && now - button.pressedMs >= INPUT_LONG_PRESS_MS) {
+      button.longReported = true;
+      handler(INPUT_LONG_PRESS, i);
+    }
+  }
+}
+
+uint32_t InputEngine::msUntilNext() const {
+  uint32_t now = clock();
+  uint32_t next = INPUT_NO_TIMEOUT;
+  for (uint8_t i = 0; i < count; i++) {
+    const Button& button = buttons[i];
+    uint32_t wait = INPUT_NO_TIMEOUT;
+    uint32_t rail = button.raw ? INPUT_DEBOUNCE_MS : 0;
+    if (button.integrator != rail) {
+      // The integrator reaches the rail of the sampled level after this long if the level
+      // holds: a pending press or release settles, or a bounce is worked off
+      uint32_t elapsed = now - sampleMs;
+      uint32_t distance = button.raw ? INPUT_DEBOUNCE_MS - button.integrator : button.integrator;
+      wait = elapsed < distance ? distance - elapsed : 0;
+    } else if (button.pressed && !button.longReported && !chord) {
+      uint32_t held = now - button.pressedMs;
+      wait = held < INPUT_LONG_PRESS_MS ? INPUT_LONG_PRESS_MS - held : 0;
+    }
+    next = wait < next ? wait : next;
+  }
+  if (held != INPUT_NO_BUTTON) {
+    uint32_t waited = now - buttons[held].pressedMs;
+    uint32_t wait = waited < INPUT_CHORD_WINDOW_MS ? INPUT_CHORD_WINDOW_MS - waited : 0;
+    next = wait < next ? wait : next;
+  }
+  if (chord && !chordLongReported) {
+    uint32_t held = now - chordMs;
+    uint32_t wait = held < INPUT_CHORD_LONG_MS ? INPUT_CHORD_LONG_MS - held : 0;
+    next = wait < next ? wait : next;
+  }
+  return next;
+}
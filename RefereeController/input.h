@@ -0,0 +1,81 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdint.h>
+
+// Button handling for the controller:
+//  - each button feeds an integrator that counts milliseconds of the sampled level, so a
+//    level must win by INPUT_DEBOUNCE_MS before a press or release is reported
+//  - a button held for INPUT_LONG_PRESS_MS also reports a long press
+//  - both buttons pressed within INPUT_CHORD_WINDOW_MS report a chord instead of their presses,
+//    and a long chord after INPUT_CHORD_LONG_MS
+// The chord lives on the decision buttons, so a press made alone is held back for the chord
+// window (or until its release, if sooner). Press latency is INPUT_DEBOUNCE_MS plus that window;
+// without the hold-back the first press of every chord would go out as a decision.
+#define INPUT_MAX_BUTTONS 2
+#define INPUT_DEBOUNCE_MS 3
+#define INPUT_CHORD_WINDOW_MS 80
+#define INPUT_LONG_PRESS_MS 1500
+#define INPUT_CHORD_LONG_MS 3000
+#define INPUT_NO_TIMEOUT 0xFFFFFFFF
+#define INPUT_NO_BUTTON 0xFF
+
+enum InputEvent : uint8_t {
+  INPUT_PRESS,        // debounced press of the button passed with the event
+  INPUT_RELEASE,      // only after a reported press, or for a button held at power-on
+  INPUT_LONG_PRESS,   // held alone for INPUT_LONG_PRESS_MS
+  INPUT_CHORD,        // every button down within the window; passed the button that completed it
+  INPUT_CHORD_LONG    // every button of the chord held for INPUT_CHORD_LONG_MS
+};
+
+typedef uint32_t (*InputClock)();
+// Raw level of a button, true while pressed
+typedef bool (*InputReader)(uint8_t button);
+typedef void (*InputHandler)(InputEvent event, uint8_t button);
+
+// Allocation-free and non-blocking; the clock and the pins are injected so the same
+// code runs on the device and on a host.
+class InputEngine {
+public:
+  InputEngine(InputClock clock, InputReader reader, InputHandler handler)
+    : clock(clock), reader(reader), handler(handler) {}
+
+  // Takes the current levels as settled without reporting them (a button held at power-on)
+  void begin(uint8_t count);
+  // Samples every button; call on each loop pass, and again after msUntilNext()
+  void poll();
+  // Time until poll() has a debounce or hold deadline to check, or INPUT_NO_TIMEOUT
+  uint32_t msUntilNext() const;
+
+  bool pressed(uint8_t button) const { return buttons[button].pressed; }
+
+private:
+  struct Button {
+    bool raw;             // level at the last sample
+    bool pressed;         // debounced state
+    bool reported;        // the press went to the handler (not held back or part of a chord)
+    bool longReported;
+    uint8_t integrator;   // 0 = settled released, INPUT_DEBOUNCE_MS = settled pressed
+    uint32_t pressedMs;   // when the debounced press was reported
+  };
+
+  InputClock clock;
+  InputReader reader;
+  InputHandler handler;
+  Button buttons[INPUT_MAX_BUTTONS] = {};
+  uint8_t count = 0;
+  uint32_t sampleMs = 0;
+  uint8_t held = INPUT_NO_BUTTON;   // press held back while a chord may still follow
+  bool chord = false;               // set until every button of the chord is released
+  bool chordLongReported = false;
+  uint32_t chordMs = 0;
+
+  void integrate(Button& button, uint32_t elapsedMs);
+  uint8_t pressedCount() const;
+  void pressButton(uint8_t index, uint32_t now);
+  void releaseButton(uint8_t index);
+  void reportPress(uint8_t index);
+  void checkHolds(uint32_t now);
+};
+
+#endif
@@ -0,0 +1,238 @@
+#include "pattern.h"
+
+// ====== Pattern tables ======================================================
+//                                 ms   glide   LED haptic1 haptic2
+
+static const PatternStep bootSteps[] = {
+  {120, false, {255, 255, 255}},
+  {100, false, {0, 0, 0}},
+  {120, false, {255, 255, 255}},
+};
+
+static const PatternStep reminderSteps[] = {
+  {150, false, {255, 255, 255}},
+  {100, false, {255, 0, 0}},
+  {150, false, {255, 255, 255}},
+  {600, false, {255, 0, 0}},
+};
+
+static const PatternStep summonSteps[] = {
+  {250, false, {255, 255, 255}},
+  {250, false, {255, 0, 0}},
+};
+
+// 5.12 s breathing on the LED, no haptics
+static const PatternStep disconnectSteps[] = {
+  {2560, true, {255, 0, 0}},
+  {2560, true, {0, 0, 0}},
+};
+
+#define STEPS(x) x, sizeof(x) / sizeof(x[0])
+
+static const PatternTable patternTables[PATTERN_COUNT] = {
+  {NULL, 0, false, 0, {0, 0, 0}},                       // PATTERN_NONE
+  {STEPS(bootSteps), false, 0, {0, 0, 0}},              // PATTERN_BOOT
+  {STEPS(reminderSteps), true, 3000, {255, 0, 0}},      // PATTERN_REMINDER
+  {STEPS(summonSteps), true, 5000, {255, 0, 0}},        // PATTERN_SUMMON
+  {STEPS(disconnectSteps), true, 0, {0, 0, 0}},         // PATTERN_DISCONNECT
+};
+
+// ====== Engine ======================================================
+
+void PatternEngine::setIntensity(uint8_t channel, uint8_t percent) {
+  if (channel < PATTERN_CHANNELS) {
+    intensity[channel] = percent >= 100 ? 255 : percent * 255 / 100;
+  }
+}
+
+void PatternEngine::play(Pattern next) {
+  if (next == pattern) {
+    return;
+  }
+  pattern = next;
+  startMs = tickMs = clock();
+  tick();
+}
+
+void PatternEngine::stop(Pattern stopped) {
+  if (stopped == pattern) {
+    play(PATTERN_NONE);
+  }
+}
+
+// Levels the pattern asks for at elapsed ms, and how long they stay valid
+void PatternEngine::target(uint32_t elapsed, uint8_t *levels, uint32_t &untilChange) const {
+  const PatternTable &table = patternTables[pattern];
+  uint32_t cycleMs = 0;
+  for (uint8_t i = 0; i < table.count; i++) {
+    cycleMs += table.steps[i].ms;
+  }
+  bool expired = table.durationMs != 0 && elapsed >= table.durationMs;
+  if (cycleMs == 0 || expired || (!table.repeat && elapsed >= cycleMs)) {
+    for (int c = 0; c < PATTERN_CHANNELS; c++) {
+      levels[c] = table.hold[c];
+    }
+    untilChange = PATTERN_NO_TIMEOUT;
+    return;
+  }
+
+  uint32_t t = table.repeat ? elapsed % cycleMs : elapsed;
+  uint8_t index = 0;
+  while (t >= table.steps[index].ms) {
+    t -= table.steps[index].ms;
+    index++;
+  }
+  const PatternStep &step = table.steps[index];
+  if (step.glide) {
+    static const uint8_t off[PATTERN_CHANNELS] = {};
+    const uint8_t *from = index > 0 ? table.steps[index - 1].level
+                        : table.repeat ? table.steps[table.count - 1].level : off;
+    for (int c = 0; c < PATTERN_CHANNELS; c++) {
+      levels[c] = from[c] + ((int)step.level[c] - from[c]) * (int)t / step.ms;
+    }
+    untilChange = step.ms - t < PATTERN_RAMP_STEP_MS ? step.ms - t : PATTERN_RAMP_STEP_MS;
+  } else {
+    for (int c = 0; c < PATTERN_CHANNELS; c++) {
+      levels[c] = step.level[c];
+    }
+    untilChange = step.ms - t;
+  }
+  if (table.durationMs != 0 && table.durationMs - elapsed < untilChange) {
+    untilChange = table.durationMs - elapsed;
+  }
+}
+
+void PatternEngine::tick() {
+  uint32_t now = clock();
+  uint32_t elapsedTick = now - tickMs;
+  tickMs = now;
+
+  uint8_t levels[PATTERN_CHANNELS] = {};
+  uint32_t untilChange = PATTERN_NO_TIMEOUT;
+  if (pattern != PATTERN_NONE) {
+    target(now - startMs, levels, untilChange);
+  }
+
+  // A rise only earns the time spent ramping, not the idle time before the step
+  uint32_t rise = softStarting ? elapsedTick * 255 / PATTERN_SOFT_START_MS : 0;
+  softStarting = false;
+  for (int c = 0; c < PATTERN_CHANNELS; c++) {
+    uint8_t level = levels[c] * intensity[c] / 255;
+    // Rising edges of soft-start channels are rate limited; falling edges are immediate
+    if ((PATTERN_SOFT_START_MASK & (1 << c)) && level > output[c] && output[c] + rise < level) {
+      level = output[c] + rise;
+      softStarting = true;
+      untilChange = untilChange < PATTERN_RAMP_STEP_MS ? untilChange : PATTERN_RAMP_STEP_MS;
+    }
+    if (level != output[c]) {
+      output[c] = level;
+      writer(c, level);
+    }
+  }
+  nextMs = untilChange;
+}
+
+uint32_t PatternEngine::msUntilNext() const {
+  if (nextMs == PATTERN_NO_TIMEOUT) {
+    return PATTERN_NO_TIMEOUT;
+  }
+  uint32_t elapsed = clock() - tickMs;
+  return elapsed >= nextMs ? 0 : nextMs - elapsed;
+}
+
+// ====== LEDC outputs ======================================================
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+#include <driver/ledc.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+// Above hearing, so the motors do not whine. The high-speed timer and channels are clear of
+// the ones analogWrite() hands out for the battery LEDs.
+#define PATTERN_PWM_HZ 20000
+#define PATTERN_LEDC_MODE LEDC_HIGH_SPEED_MODE
+#define PATTERN_LEDC_TIMER LEDC_TIMER_3
+#define PATTERN_LEDC_CHANNEL0 LEDC_CHANNEL_5
+
+static uint32_t patternClock() {
+  return millis();
+}
+
+static void writeChannel(uint8_t channel, uint8_t level) {
+  ledc_channel_t ledcChannel = (ledc_channel_t)(PATTERN_LEDC_CHANNEL0 + channel);
+  ledc_set_duty(PATTERN_LEDC_MODE, ledcChannel, level);
+  ledc_update_duty(PATTERN_LEDC_MODE, ledcChannel);
+}
+
+static PatternEngine patterns(patternClock, writeChannel);
+static esp_timer_handle_t patternTimer = NULL;
+// The timer callback runs on the esp_timer task, play and stop on the loop task
+static SemaphoreHandle_t patternLock = NULL;
+
+// Call with patternLock held
+static void schedulePattern() {
+  esp_timer_stop(patternTimer);
+  uint32_t wait = patterns.msUntilNext();
+  if (wait != PATTERN_NO_TIMEOUT) {
+    esp_timer_start_once(patternTimer, (wait > 0 ? wait : 1) * 1000ULL);
+  }
+}
+
+static void onPatternTimer(void* context) {
+  xSemaphoreTake(patternLock, portMAX_DELAY);
+  patterns.tick();
+  schedulePattern();
+  xSemaphoreGive(patternLock);
+}
+
+void patternBegin(int ledPin, int hapticPin1, int hapticPin2) {
+  ledc_timer_config_t timer = {};
+  timer.speed_mode = PATTERN_LEDC_MODE;
+  timer.duty_resolution = LEDC_TIMER_8_BIT;
+  timer.timer_num = PATTERN_LEDC_TIMER;
+  timer.freq_hz = PATTERN_PWM_HZ;
+  timer.clk_cfg = LEDC_AUTO_CLK;
+  ledc_timer_config(&timer);
+
+  const int pins[PATTERN_CHANNELS] = {ledPin, hapticPin1, hapticPin2};
+  for (int c = 0; c < PATTERN_CHANNELS; c++) {
+    ledc_channel_config_t channel = {};
+    channel.gpio_num = pins[c];
+    channel.speed_mode = PATTERN_LEDC_MODE;
+    channel.channel = (ledc_channel_t)(PATTERN_LEDC_CHANNEL0 + c);
+    channel.timer_sel = PATTERN_LEDC_TIMER;
+    channel.duty = 0;
+    ledc_channel_config(&channel);
+  }
+
+  patternLock = xSemaphoreCreateMutex();
+  esp_timer_create_args_t args = {};
+  args.callback = onPatternTimer;
+  args.name = "pattern";
+  esp_timer_create(&args, &patternTimer);
+}
+
+void patternSetIntensity(uint8_t channel, uint8_t percent) {
+  xSemaphoreTake(patternLock, portMAX_DELAY);
+  patterns.setIntensity(channel, percent);
+  xSemaphoreGive(patternLock);
+}
+
+void patternPlay(Pattern pattern) {
+  xSemaphoreTake(patternLock, portMAX_DELAY);
+  patterns.play(pattern);
+  schedulePattern();
+  xSemaphoreGive(patternLock);
+}
+
+void patternStop(Pattern pattern) {
+  xSemaphoreTake(patternLock, portMAX_DELAY);
+  patterns.stop(pattern);
+  schedulePattern();
+  xSemaphoreGive(patternLock);
+}
+
+#endif
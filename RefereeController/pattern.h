@@ -0,0 +1,90 @@
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// LED and haptic patterns for the controller. Each pattern is a compiled table of steps
+// that set the level (0-255) of the red LED and the two haptic motors; a step can glide
+// to its levels instead of jumping. The sequencer runs off its own timer, so patterns
+// keep playing while the loop sleeps or blocks in a reconnect.
+//  - per-channel intensity scales every level of that channel (motor strength)
+//  - channels with soft start rise by at most 255 per PATTERN_SOFT_START_MS, so the motors
+//    do not draw their stall current from the battery all at once
+#define PATTERN_CHANNELS 3
+#define PATTERN_LED 0
+#define PATTERN_HAPTIC1 1
+#define PATTERN_HAPTIC2 2
+#define PATTERN_SOFT_START_MASK ((1 << PATTERN_HAPTIC1) | (1 << PATTERN_HAPTIC2))
+#define PATTERN_SOFT_START_MS 60
+#define PATTERN_RAMP_STEP_MS 5     // update interval while a level glides
+#define PATTERN_NO_TIMEOUT 0xFFFFFFFF
+
+enum Pattern : uint8_t {
+  PATTERN_NONE,
+  PATTERN_BOOT,         // two short buzzes with the LED, once
+  PATTERN_REMINDER,     // LED on, a double buzz every second for 3 s
+  PATTERN_SUMMON,       // LED on, haptics pulsing for 5 s
+  PATTERN_DISCONNECT,   // LED breathing until connected
+  PATTERN_COUNT
+};
+
+struct PatternStep {
+  uint16_t ms;
+  bool glide;                        // move linearly from the previous levels over the step
+  uint8_t level[PATTERN_CHANNELS];
+};
+
+struct PatternTable {
+  const PatternStep *steps;
+  uint8_t count;
+  bool repeat;                       // loop the steps until stopped or durationMs
+  uint16_t durationMs;               // 0: no limit
+  uint8_t hold[PATTERN_CHANNELS];    // levels kept once the steps end, until stopped
+};
+
+typedef uint32_t (*PatternClock)();
+typedef void (*PatternWriter)(uint8_t channel, uint8_t level);
+
+// Allocation-free and non-blocking; the clock and the outputs are injected so the same
+// code runs on the device and on a host.
+class PatternEngine {
+public:
+  PatternEngine(PatternClock clock, PatternWriter writer) : clock(clock), writer(writer) {}
+
+  // Percent of full scale for a channel (default 100)
+  void setIntensity(uint8_t channel, uint8_t percent);
+  // Replaces the current pattern; playing the pattern already running leaves it alone
+  void play(Pattern pattern);
+  // Stops the pattern if it is the one playing and turns everything off
+  void stop(Pattern pattern);
+  Pattern current() const { return pattern; }
+
+  // Updates the outputs; call when msUntilNext() is due
+  void tick();
+  // Time until tick() has something to change, or PATTERN_NO_TIMEOUT
+  uint32_t msUntilNext() const;
+
+private:
+  PatternClock clock;
+  PatternWriter writer;
+  Pattern pattern = PATTERN_NONE;
+  uint32_t startMs = 0;
+  uint32_t tickMs = 0;
+  uint32_t nextMs = PATTERN_NO_TIMEOUT;   // relative to tickMs
+  bool softStarting = false;              // a rise was held back at the last tick
+  uint8_t intensity[PATTERN_CHANNELS] = {255, 255, 255};
+  uint8_t output[PATTERN_CHANNELS] = {};
+
+  void target(uint32_t elapsed, uint8_t *levels, uint32_t &untilChange) const;
+};
+
+#ifdef ARDUINO
+// Drives the LED and motor pins from LEDC, sequenced by an esp_timer
+void patternBegin(int ledPin, int hapticPin1, int hapticPin2);
+void patternSetIntensity(uint8_t channel, uint8_t percent);
+void patternPlay(Pattern pattern);
+void patternStop(Pattern pattern);
+#endif
+
+#endif
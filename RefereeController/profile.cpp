@@ -0,0 +1,125 @@
+#include "profile.h"
+
+#ifdef PROFILING
+
+#include <stdio.h>
+#include <string.h>
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <time.h>
+#endif
+
+struct ProfileHistogram {
+  uint32_t count;
+  uint64_t total;
+  uint32_t max;
+  uint32_t buckets[PROFILE_BUCKETS];
+};
+
+static ProfileHistogram histograms[PROBE_COUNT];
+
+static const char* const probeNames[PROBE_COUNT] = {
+  "mqttLoop", "readPacket", "callback", "buttonLoop", "batteryLEDs", "decisionLights"
+};
+
+uint32_t profileCycles() {
+#ifdef ARDUINO
+  return ESP.getCycleCount();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint32_t)(now.tv_sec * 1000000000ULL + now.tv_nsec);
+#endif
+}
+
+uint32_t profileCyclesPerUs() {
+#ifdef ARDUINO
+  return ESP.getCpuFreqMHz();
+#else
+  return 1000;
+#endif
+}
+
+static int bucketOf(uint32_t cycles) {
+  if (cycles < (1u << PROFILE_SUB_BITS)) {
+    return cycles;
+  }
+  int octave = 31 - __builtin_clz(cycles);
+  int sub = (cycles >> (octave - PROFILE_SUB_BITS)) & ((1 << PROFILE_SUB_BITS) - 1);
+  return ((octave - PROFILE_SUB_BITS + 1) << PROFILE_SUB_BITS) + sub;
+}
+
+// Smallest value that falls in the bucket
+static uint32_t bucketFloor(int bucket) {
+  if (bucket < (1 << PROFILE_SUB_BITS)) {
+    return bucket;
+  }
+  int octave = (bucket >> PROFILE_SUB_BITS) + PROFILE_SUB_BITS - 1;
+  uint32_t sub = bucket & ((1 << PROFILE_SUB_BITS) - 1);
+  return ((1u << PROFILE_SUB_BITS) + sub) << (octave - PROFILE_SUB_BITS);
+}
+
+void profileRecord(ProfileProbe probe, uint32_t cycles) {
+  ProfileHistogram& histogram = histograms[probe];
+  histogram.count++;
+  histogram.total += cycles;
+  if (cycles > histogram.max) {
+    histogram.max = cycles;
+  }
+  histogram.buckets[bucketOf(cycles)]++;
+}
+
+void profileReset() {
+  memset(histograms, 0, sizeof(histograms));
+}
+
+const char* profileName(ProfileProbe probe) {
+  return probeNames[probe];
+}
+
+static uint32_t percentile(const ProfileHistogram& histogram, uint32_t perMille) {
+  uint64_t target = ((uint64_t)histogram.count * perMille + 999) / 1000;
+  uint64_t seen = 0;
+  for (int i = 0; i < PROFILE_BUCKETS; i++) {
+    seen += histogram.buckets[i];
+    if (seen >= target && histogram.buckets[i] > 0) {
+      return bucketFloor(i);
+    }
+  }
+  return histogram.max;
+}
+
+size_t profileFormat(ProfileProbe probe, char* buffer, size_t size) {
+  const ProfileHistogram& histogram = histograms[probe];
+  float perUs = profileCyclesPerUs();
+  int length = snprintf(buffer, size, "n=%lu mean=%.2f p50=%.2f p90=%.2f p99=%.2f max=%.2f us|%lu|",
+                        (unsigned long)histogram.count,
+                        histogram.count ? histogram.total / (float)histogram.count / perUs : 0.0f,
+                        percentile(histogram, 500) / perUs, percentile(histogram, 900) / perUs,
+                        percentile(histogram, 990) / perUs, histogram.max / perUs,
+                        (unsigned long)profileCyclesPerUs());
+  if (length < 0 || (size_t)length >= size) {
+    return size ? size - 1 : 0;
+  }
+
+  for (int i = 0; i < PROFILE_BUCKETS; i++) {
+    if (histogram.buckets[i] == 0) {
+      continue;
+    }
+    char entry[24];
+    int entryLength = snprintf(entry, sizeof(entry), "%lu:%lu,", (unsigned long)bucketFloor(i),
+                               (unsigned long)histogram.buckets[i]);
+    // Keep room for the truncation mark
+    if ((size_t)(length + entryLength) + 2 > size) {
+      buffer[length++] = '+';
+      break;
+    }
+    memcpy(buffer + length, entry, entryLength);
+    length += entryLength;
+  }
+  buffer[length] = '\0';
+  return length;
+}
+
+#endif
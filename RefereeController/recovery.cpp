@@ -0,0 +1,66 @@
+#include <Arduino.h>
+#include <esp_system.h>
+#include <esp_task_wdt.h>
+#include <sys/time.h>
+#include <stddef.h>
+#include "recovery.h"
+
+// Changed with the ControllerSnapshot layout, so an update does not restore an old one
+#define SNAPSHOT_MAGIC 0x52454644  // "REFD"
+
+// Survives software, panic, watchdog and brownout resets; garbage after power-on
+RTC_NOINIT_ATTR static ControllerSnapshot rtcSnapshot;
+
+// FNV-1a over everything before the checksum field
+static uint32_t snapshotChecksum(const ControllerSnapshot &snapshot) {
+  const uint8_t *bytes = (const uint8_t *)&snapshot;
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < offsetof(ControllerSnapshot, checksum); i++) {
+    hash = (hash ^ bytes[i]) * 16777619u;
+  }
+  return hash;
+}
+
+void setupWatchdog() {
+  esp_task_wdt_init(WATCHDOG_TIMEOUT_S, true);
+  esp_task_wdt_add(NULL);
+}
+
+void feedWatchdog() {
+  esp_task_wdt_reset();
+}
+
+bool isWarmReset() {
+  switch (esp_reset_reason()) {
+    case ESP_RST_SW:
+    case ESP_RST_PANIC:
+    case ESP_RST_INT_WDT:
+    case ESP_RST_TASK_WDT:
+    case ESP_RST_WDT:
+    case ESP_RST_BROWNOUT:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Wall clock kept by the RTC, so unlike millis() it keeps counting across a warm reset
+uint64_t rtcClockMs() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+bool readSnapshot(ControllerSnapshot &snapshot) {
+  if (!isWarmReset() || rtcSnapshot.magic != SNAPSHOT_MAGIC || rtcSnapshot.checksum != snapshotChecksum(rtcSnapshot)) {
+    return false;
+  }
+  memcpy(&snapshot, &rtcSnapshot, sizeof(snapshot));
+  return true;
+}
+
+void writeSnapshot(const ControllerSnapshot &snapshot) {
+  memcpy(&rtcSnapshot, &snapshot, sizeof(rtcSnapshot));
+  rtcSnapshot.magic = SNAPSHOT_MAGIC;
+  rtcSnapshot.checksum = snapshotChecksum(rtcSnapshot);
+}
@@ -0,0 +1,32 @@
+#ifndef RECOVERY_H
+#define RECOVERY_H
+
+#include <Arduino.h>
+
+// Hang detection: the loop task must feed the watchdog at least this often
+#define WATCHDOG_TIMEOUT_S 10
+
+// State kept in RTC slow memory so a crash or brownout mid-lift can resume where it left off
+struct ControllerSnapshot {
+  uint32_t magic;
+  uint8_t referee;
+  uint8_t reminderOn;
+  uint8_t summonOn;
+  char lastDecision;      // 'g', 'b' or 0 if nothing pressed this lift
+  uint8_t decisionSent;   // lastDecision was handed to the broker
+  uint16_t decisionSeq;   // sequence number of lastDecision
+  uint64_t decisionTime;  // rtcClockMs() when lastDecision was pressed
+  uint8_t decisionEpoch;  // lift epoch lastDecision was pressed in
+  uint8_t liftEpoch;      // latest epoch from the central box
+  uint8_t bootDecisionPending;  // no decision sent since the last cold boot
+  uint32_t checksum;
+};
+
+void setupWatchdog();
+void feedWatchdog();
+bool isWarmReset();
+uint64_t rtcClockMs();
+bool readSnapshot(ControllerSnapshot &snapshot);
+void writeSnapshot(const ControllerSnapshot &snapshot);
+
+#endif
@@ -0,0 +1,105 @@
+#include "topics.h"
+#include <string.h>
+
+// Appends at most limit characters of value, leaving room for the terminator
+static size_t appendText(char* buffer, size_t size, size_t used, const char* value, size_t limit) {
+  while (*value != '\0' && limit > 0 && used + 1 < size) {
+    buffer[used++] = *value++;
+    limit--;
+  }
+  buffer[used] = '\0';
+  return used;
+}
+
+size_t topicConcat(char* buffer, size_t size, const char* prefix, const char* fop, const char* clientId,
+                   const char* suffix) {
+  size_t used = appendText(buffer, size, 0, prefix, size);
+  used = appendText(buffer, size, used, fop, TOPIC_FOP_MAX);
+  if (clientId != NULL) {
+    used = appendText(buffer, size, used, "/", 1);
+    used = appendText(buffer, size, used, clientId, TOPIC_CLIENT_ID_MAX);
+  }
+  if (suffix != NULL) {
+    used = appendText(buffer, size, used, suffix, size);
+  }
+  return used;
+}
+
+int topicLastNumber(const char* topic) {
+  const char* level = strrchr(topic, '/');
+  level = level != NULL ? level + 1 : topic;
+  int number = 0;
+  // Referee numbers are one digit; the bound only keeps junk from overflowing
+  while (*level >= '0' && *level <= '9' && number < 100000) {
+    number = number * 10 + (*level++ - '0');
+  }
+  return number;
+}
+
+bool payloadStartsWith(const uint8_t* payload, size_t length, const char* text) {
+  size_t textLength = strlen(text);
+  return length >= textLength && memcmp(payload, text, textLength) == 0;
+}
+
+TextWriter& TextWriter::text(const char* value) {
+  size_t before = used;
+  used = appendText(buffer, size, used, value, size);
+  if (value[used - before] != '\0') {
+    overflow = true;
+  }
+  return *this;
+}
+
+TextWriter& TextWriter::character(char value) {
+  if (used + 1 < size) {
+    buffer[used++] = value;
+    buffer[used] = '\0';
+  } else {
+    overflow = true;
+  }
+  return *this;
+}
+
+TextWriter& TextWriter::unsignedInteger(uint32_t value) {
+  char digits[10];
+  int count = 0;
+  do {
+    digits[count++] = '0' + value % 10;
+    value /= 10;
+  } while (value != 0);
+  while (count > 0) {
+    character(digits[--count]);
+  }
+  return *this;
+}
+
+TextWriter& TextWriter::integer(int32_t value) {
+  if (value < 0) {
+    character('-');
+    return unsignedInteger(0 - (uint32_t)value);
+  }
+  return unsignedInteger(value);
+}
+
+TextWriter& TextWriter::fixed(float value, uint8_t decimals) {
+  static const uint32_t scales[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+  if (decimals > 6) {
+    decimals = 6;
+  }
+  if (value < 0) {
+    character('-');
+    value = -value;
+  }
+  uint32_t scale = scales[decimals];
+  // Battery voltages and the like: the scaled value comfortably fits in 32 bits
+  uint32_t scaled = (uint32_t)(value * scale + 0.5f);
+  unsignedInteger(scaled / scale);
+  if (decimals > 0) {
+    character('.');
+    uint32_t fraction = scaled % scale;
+    for (uint32_t digit = scale / 10; digit > 0; digit /= 10) {
+      character('0' + fraction / digit % 10);
+    }
+  }
+  return *this;
+}
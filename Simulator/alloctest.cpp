@@ -0,0 +1,182 @@
+// Allocation-count test for the message paths that replaced sprintf and String: topic building,
+// TextWriter, the topic and payload helpers of the MQTT callbacks, and the decision, lift status
+// and display frame codecs. malloc and friends are counted while the paths run; any heap use
+// is a failure. The helpers' results are checked along the way.
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=c++11 -IDecisionLightBox -o alloctest Simulator/alloctest.cpp DecisionLightBox/topics.cpp
+//     DecisionLightBox/decision.cpp
+//   ./alloctest
+//
+// Counting goes through glibc's __libc_malloc, so this builds on Linux with glibc only.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "decision.h"
+#include "topics.h"
+
+#define ALLOC_ITERATIONS 100000
+
+// ====== Counting allocator ======================================================
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* pointer, size_t size);
+
+static bool counting = false;
+static unsigned long allocations = 0;
+
+extern "C" void* malloc(size_t size) {
+  allocations += counting;
+  return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+  allocations += counting;
+  return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* pointer, size_t size) {
+  allocations += counting;
+  return __libc_realloc(pointer, size);
+}
+
+// ====== Message paths ======================================================
+
+// Longest platform name and client id the buffers are sized for
+static const char longFop[] = "platform-name-19-ch";
+static const char longClientId[] = "replogic-lightbox-0123456789abcdef0123456789abcde";
+
+static volatile size_t sink = 0;
+
+static void buildTopics() {
+  char decisionTopic[TOPIC_SIZE(TOPIC_PREFIX_DECISION)];
+  char presenceTopic[TOPIC_CLIENT_SIZE(TOPIC_PREFIX_PRESENCE)];
+  char warningTopic[TOPIC_CLIENT_SUFFIX_SIZE(TOPIC_PREFIX_HEALTH, TOPIC_SUFFIX_WARNING)];
+  sink += buildTopic(decisionTopic, TOPIC_PREFIX_DECISION, longFop);
+  sink += buildTopic(presenceTopic, TOPIC_PREFIX_PRESENCE, longFop, longClientId);
+  sink += buildTopic(warningTopic, TOPIC_PREFIX_HEALTH, longFop, longClientId, TOPIC_SUFFIX_WARNING);
+}
+
+// Presence, heartbeat and health messages as the firmwares write them
+static void writeMessages(uint32_t i) {
+  char presence[40];
+  TextWriter(presence).text("online ref").integer(1 + i % 3).character(' ')
+    .fixed(3.7f + (i % 50) / 100.0f, 2).character(' ').integer(-40 - (int32_t)(i % 50));
+  char heartbeat[24];
+  TextWriter(heartbeat).text("ref").integer(2).character(' ').unsignedInteger(i);
+  char health[160];
+  TextWriter writer(health);
+  writer.text("heap=").unsignedInteger(180000 + i % 1000).text(" frag=").unsignedInteger(i % 100).character('%');
+  writer.text(" wakeups/s=").fixed((i % 1000) / 10.0f, 1);
+  sink += strlen(presence) + strlen(heartbeat) + writer.length();
+}
+
+// The controller callback's parsing of a reminder or summon message
+static void parseCallback(uint32_t i) {
+  static const char* topics[] = {"owlcms/decisionRequest/A/1", "owlcms/summon/A/0", "owlcms/led/A/3"};
+  static const uint8_t on[] = {'o', 'n'};
+  static const uint8_t off[] = {'o', 'f', 'f'};
+  sink += topicLastNumber(topics[i % 3]);
+  sink += i & 1 ? payloadStartsWith(on, sizeof(on), "on") : payloadStartsWith(off, sizeof(off), "on");
+}
+
+static void runCodecs(uint32_t i) {
+  Decision decision = {};
+  decision.referee = 1 + i % 3;
+  decision.good = i & 1;
+  decision.seq = i;
+  decision.pressedMs = i * 7;
+  decision.epoch = i >> 4;
+  uint8_t binary[DECISION_WIRE_SIZE];
+  char text[DECISION_TEXT_SIZE];
+  size_t binaryLength = encodeDecision(decision, binary, sizeof(binary));
+  size_t textLength = formatDecisionText(decision, text, sizeof(text));
+  Decision decoded;
+  sink += decodeDecision(binary, binaryLength, decoded) + decodeDecision((const uint8_t*)text, textLength, decoded);
+
+  static const uint8_t epoch[] = {'1', '7'};
+  sink += parseEpoch(epoch, sizeof(epoch));
+
+  LiftStatus status = {(uint8_t)i, 2, {'g', 'b', 0}, 3, 1500};
+  uint8_t statusPayload[LIFT_STATUS_SIZE];
+  LiftStatus statusDecoded;
+  sink += decodeLiftStatus(statusPayload, encodeLiftStatus(status, statusPayload, sizeof(statusPayload)), statusDecoded);
+
+  DisplayFrame frame = {(uint8_t)i, (uint8_t)(i >> 1), DISPLAY_GOOD_LIGHT(1) | DISPLAY_BAD_LIGHT(3), true, 0, 2};
+  uint8_t framePayload[DISPLAY_FRAME_SIZE];
+  DisplayFrame frameDecoded;
+  sink += decodeDisplayFrame(framePayload, encodeDisplayFrame(frame, framePayload, sizeof(framePayload)), frameDecoded);
+}
+
+// ====== Tests ======================================================
+
+// The counter itself sees an allocation
+static void testCounterWorks() {
+  counting = true;
+  allocations = 0;
+  void* volatile pointer = malloc(16);
+  counting = false;
+  free(pointer);
+  CHECK_EQ(allocations, 1);
+}
+
+static void testNoAllocations() {
+  struct Path {
+    const char* name;
+    void (*run)(uint32_t);
+  };
+  const Path paths[] = {
+    {"topics", [](uint32_t) { buildTopics(); }},
+    {"messages", writeMessages},
+    {"callback parsing", parseCallback},
+    {"codecs", runCodecs},
+  };
+  for (const Path& path : paths) {
+    counting = true;
+    allocations = 0;
+    for (uint32_t i = 0; i < ALLOC_ITERATIONS; i++) {
+      path.run(i);
+    }
+    counting = false;
+    if (!CHECK_EQ(allocations, 0)) {
+      printf("  %s allocated %lu times in %d runs\n", path.name, allocations, ALLOC_ITERATIONS);
+    }
+  }
+}
+
+static void testTopicLastNumber() {
+  CHECK_EQ(topicLastNumber("owlcms/decisionRequest/A/2"), 2);
+  CHECK_EQ(topicLastNumber("owlcms/summon/A/0"), 0);
+  CHECK_EQ(topicLastNumber("owlcms/led/platform-name-19-ch/3"), 3);
+  // No referee level: the platform name is not a number
+  CHECK_EQ(topicLastNumber("owlcms/summon/A"), 0);
+  CHECK_EQ(topicLastNumber("owlcms/summon/A/"), 0);
+  CHECK_EQ(topicLastNumber("owlcms/led/A/2x"), 2);
+  CHECK_EQ(topicLastNumber("7"), 7);
+  // A digit run far too long for a referee stops short of overflowing
+  CHECK(topicLastNumber("owlcms/led/A/99999999999999999999") > 0);
+}
+
+static void testPayloadStartsWith() {
+  static const uint8_t on[] = {'o', 'n'};
+  static const uint8_t onWithMore[] = {'o', 'n', ' ', '2'};
+  static const uint8_t off[] = {'o', 'f', 'f'};
+  CHECK(payloadStartsWith(on, sizeof(on), "on"));
+  CHECK(payloadStartsWith(onWithMore, sizeof(onWithMore), "on"));
+  CHECK(!payloadStartsWith(off, sizeof(off), "on"));
+  CHECK(!payloadStartsWith(on, 1, "on"));
+  CHECK(!payloadStartsWith(on, 0, "on"));
+  CHECK(payloadStartsWith(on, 0, ""));
+}
+
+int main() {
+  testCounterWorks();
+  testNoAllocations();
+  testTopicLastNumber();
+  testPayloadStartsWith();
+  return checkResult("alloctest");
+}
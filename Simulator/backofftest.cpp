@@ -0,0 +1,115 @@
+// Tests for the reconnect policy (backoff.h/backoff.cpp): every delay stays between the base and
+// the cap and within three times the previous one, the largest draws grow by three each failure
+// up to the cap, success starts over, due() follows the delay across a millis() wrap, and a cap
+// near 2^32 does not overflow.
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=c++11 -IDecisionLightBox -o backofftest Simulator/backofftest.cpp DecisionLightBox/backoff.cpp
+//   ./backofftest
+
+#include <stdio.h>
+#include <random>
+
+#include "backoff.h"
+#include "check.h"
+
+static std::mt19937 random32(1);
+
+// Random failures: each delay in [base, min(cap, 3 x previous)], and the range is covered
+static void testBounds(uint32_t base, uint32_t cap) {
+  ReconnectPolicy policy(base, cap);
+  uint32_t previous = base;
+  uint32_t now = 0;
+  bool hitBase = false, hitCap = false;
+  int failuresBefore = checkFailures;
+  for (int i = 0; i < 200000 && checkFailures == failuresBefore; i++) {
+    uint32_t upper = previous * 3 < cap ? previous * 3 : cap;
+    uint32_t delay = policy.failed(now, random32());
+    if (!CHECK(delay >= base && delay <= upper)) {
+      printf("  delay %u after %u, base %u cap %u\n", delay, previous, base, cap);
+    }
+    hitBase |= delay == base;
+    hitCap |= delay == cap;
+    now += delay;
+    previous = delay;
+    if (i % 50 == 49) {
+      policy.succeeded();
+      previous = base;
+    }
+  }
+  CHECK(hitBase);
+  CHECK(hitCap);
+}
+
+// The largest draw triples the delay each time until the cap, the smallest stays at the base
+static void testGrowth() {
+  ReconnectPolicy policy(RECONNECT_BASE_MS, RECONNECT_CAP_MS);
+  uint32_t expected = RECONNECT_BASE_MS;
+  for (int i = 0; i < 10; i++) {
+    expected = expected * 3 < RECONNECT_CAP_MS ? expected * 3 : RECONNECT_CAP_MS;
+    // randomValue % (upper - base + 1) is largest at upper - base
+    CHECK_EQ(policy.failed(0, expected - RECONNECT_BASE_MS), expected);
+  }
+  CHECK_EQ(expected, RECONNECT_CAP_MS);
+
+  ReconnectPolicy low(RECONNECT_BASE_MS, RECONNECT_CAP_MS);
+  for (int i = 0; i < 10; i++) {
+    CHECK_EQ(low.failed(0, 0), RECONNECT_BASE_MS);
+  }
+}
+
+// A success starts over from the base and allows an attempt at once
+static void testSucceeded() {
+  ReconnectPolicy policy(RECONNECT_BASE_MS, RECONNECT_CAP_MS);
+  CHECK(policy.due(0));
+  for (int i = 0; i < 6; i++) {
+    policy.failed(0, 0xFFFFFFFF);
+  }
+  CHECK(!policy.due(1));
+  policy.succeeded();
+  CHECK(policy.due(1));
+  CHECK(policy.failed(0, 0xFFFFFFFF) <= 3 * RECONNECT_BASE_MS);
+}
+
+// due() is false until the delay has passed, also across the millis() wrap
+static void testDue() {
+  const uint32_t starts[] = {0, 123456, 0xFFFFFFFF - 700};
+  for (uint32_t start : starts) {
+    ReconnectPolicy policy(RECONNECT_BASE_MS, RECONNECT_CAP_MS);
+    uint32_t delay = policy.failed(start, random32());
+    CHECK(!policy.due(start));
+    CHECK(!policy.due(start + delay - 1));
+    CHECK(policy.due(start + delay));
+    CHECK(policy.due(start + delay + 60000));
+  }
+}
+
+// With the cap near 2^32, three times the delay wraps; the delay still stays in range
+static void testLargeCap() {
+  ReconnectPolicy policy(1000, 0xFFFFFFF0);
+  uint32_t previous = 1000;
+  for (int i = 0; i < 100; i++) {
+    uint32_t delay = policy.failed(0, random32() | 0x80000000);
+    CHECK(delay >= 1000 && delay <= 0xFFFFFFF0);
+    CHECK(previous > 0x55555555 || delay <= previous * 3);
+    previous = delay;
+  }
+  // Grown past a third of 2^32, the largest draw reaches the cap rather than a wrapped bound
+  ReconnectPolicy grown(1000, 0xFFFFFFF0);
+  uint32_t delay = 1000;
+  while (delay <= 0x55555555) {
+    delay = grown.failed(0, delay * 3 - 1000);
+  }
+  CHECK_EQ(grown.failed(0, 0xFFFFFFF0 - 1000), 0xFFFFFFF0);
+}
+
+int main() {
+  testBounds(RECONNECT_BASE_MS, RECONNECT_CAP_MS);
+  testBounds(1, 7);
+  testBounds(5000, 5000);
+  testGrowth();
+  testSucceeded();
+  testDue();
+  testLargeCap();
+  return checkResult("backofftest");
+}
@@ -0,0 +1,563 @@
+// Latency benchmarks for the hot path, run natively against the firmware's portable modules:
+// decision codec, transport mux, lift engine, timer wheel and the vendored PubSubClient.
+// The decision_* rows compare the codec with the sprintf / String path it replaced
+// (std::string stands in for Arduino's String, which also allocates on every append).
+// The network is an in-memory Client and the pins are an array, so only our code is timed.
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=c++11 -ISimulator/posix -IDecisionLightBox -o bench Simulator/bench.cpp
+//     DecisionLightBox/PubSubClient.cpp DecisionLightBox/decision.cpp DecisionLightBox/transport.cpp
+//     DecisionLightBox/lift.cpp DecisionLightBox/timers.cpp DecisionLightBox/buzzer.cpp
+//   ./bench --baseline Simulator/bench_baseline.csv
+//
+// Options:
+//   --output FILE     write the results as CSV (benchmark,p50_ns,p99_ns,max_ns); "-" for stdout
+//   --baseline FILE   compare against a previous --output; exits with 1 on a regression
+//   --threshold PCT   allowed p50/p99 slowdown against the baseline (default 50)
+//   --samples N       samples per benchmark (default 20000)
+//
+// A sample is the mean of BENCH_BATCH consecutive operations, so clock overhead does not
+// swamp sub-microsecond paths. max is reported but not compared: it mostly measures the
+// host's scheduler. Baselines are per machine; refresh them with --output after an
+// intentional change, on the machine that runs the comparison.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "Client.h"
+#include "PubSubClient.h"
+#include "buzzer.h"
+#include "decision.h"
+#include "lift.h"
+#include "timers.h"
+#include "transport.h"
+
+#define BENCH_BATCH 16
+#define BENCH_WARMUP 2000
+#define BENCH_MAX_RESULTS 16
+
+static int sampleCount = 20000;
+static double thresholdPct = 50;
+
+static uint64_t nowNs() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// ====== In-memory network ======================================================
+
+// Client backed by two buffers: what PubSubClient writes is kept, what it reads is fed in
+class MemoryClient : public Client {
+public:
+  std::vector<uint8_t> output;
+
+  // The bytes are not copied and must outlive the reads
+  void feed(const std::vector<uint8_t> &bytes) {
+    input = bytes.data();
+    inputSize = bytes.size();
+    position = 0;
+  }
+  int connect(IPAddress, uint16_t) override { return 1; }
+  int connect(const char *, uint16_t) override { return 1; }
+  size_t write(uint8_t value) override {
+    output.push_back(value);
+    return 1;
+  }
+  size_t write(const uint8_t *buffer, size_t size) override {
+    output.insert(output.end(), buffer, buffer + size);
+    return size;
+  }
+  int available() override { return inputSize - position; }
+  int read() override { return position < inputSize ? input[position++] : -1; }
+  int read(uint8_t *buffer, size_t size) override {
+    size_t count = std::min(size, inputSize - position);
+    memcpy(buffer, input + position, count);
+    position += count;
+    return count;
+  }
+  int peek() override { return position < inputSize ? input[position] : -1; }
+  void flush() override {}
+  void stop() override {}
+  uint8_t connected() override { return 1; }
+  operator bool() override { return true; }
+
+private:
+  const uint8_t *input = NULL;
+  size_t inputSize = 0;
+  size_t position = 0;
+};
+
+// QoS 0 PUBLISH packet, as the broker would send it
+static std::vector<uint8_t> publishPacket(const char *topic, const uint8_t *payload, size_t length) {
+  size_t topicLength = strlen(topic);
+  size_t remaining = 2 + topicLength + length;
+  std::vector<uint8_t> packet;
+  packet.push_back(MQTTPUBLISH);
+  do {
+    uint8_t digit = remaining % 128;
+    remaining /= 128;
+    packet.push_back(remaining > 0 ? digit | 0x80 : digit);
+  } while (remaining > 0);
+  packet.push_back(topicLength >> 8);
+  packet.push_back(topicLength & 0xFF);
+  packet.insert(packet.end(), topic, topic + topicLength);
+  packet.insert(packet.end(), payload, payload + length);
+  return packet;
+}
+
+// Same shape as MqttTransport, which is Arduino-only; PubSubClient callbacks carry no context
+static TransportMux *mqttMux = NULL;
+
+class BenchMqttTransport : public Transport {
+public:
+  BenchMqttTransport(PubSubClient &client) : client(client) {}
+  void begin() {
+    mqttMux = mux;
+    client.setCallback(onMessage);
+  }
+  bool connected() override { return client.connected(); }
+  bool publish(const char *topic, const uint8_t *payload, unsigned int length) override {
+    return client.publish(topic, payload, length);
+  }
+  bool subscribe(const char *topicFilter) override { return client.subscribe(topicFilter, 1); }
+  bool unsubscribe(const char *topicFilter) override { return client.unsubscribe(topicFilter); }
+  void loop() override { client.loop(); }
+
+private:
+  PubSubClient &client;
+  static void onMessage(char *topic, uint8_t *payload, unsigned int length) {
+    mqttMux->deliver(TRANSPORT_MQTT, topic, payload, length, 0);
+  }
+};
+
+// Same as UdpTransport::publish without the socket: frame it UDP_REPEAT times
+class BenchUdpTransport : public Transport {
+public:
+  bool connected() override { return true; }
+  bool publish(const char *topic, const uint8_t *payload, unsigned int length) override {
+    for (int i = 0; i < UDP_REPEAT; i++) {
+      sent += encodeUdpFrame(frame, sizeof(frame), 1, nextSeq, topic, payload, length);
+    }
+    nextSeq++;
+    return true;
+  }
+  bool subscribe(const char *) override { return true; }
+  bool unsubscribe(const char *) override { return true; }
+  void loop() override {}
+
+  size_t sent = 0;
+
+private:
+  uint32_t nextSeq = 1;
+  uint8_t frame[UDP_FRAME_MAX_SIZE];
+};
+
+// ====== Firmware stand-ins ======================================================
+
+static uint8_t pins[40];   // last level written to each pin
+static uint32_t clockMs = 0;
+static TimerWheel benchTimers;
+static Timer downLedTimer;
+
+static uint32_t liftClock() {
+  return clockMs;
+}
+
+static void timerNoop(void *) {}
+
+static void writeBuzzer(uint16_t hz) {
+  pins[4] = hz != 0;
+}
+
+static BuzzerEngine buzzer(liftClock, writeBuzzer);
+
+// downSignal() from the lightbox: the pin writes are the LED commit
+static void downSignal() {
+  pins[2] = 1;   // down LED
+  buzzer.play(BUZZER_DOWN);
+  benchTimers.start(downLedTimer, 3000, timerNoop);
+}
+
+static void onLiftAction(LiftAction action, uint8_t) {
+  if (action == LIFT_ACTION_DOWN) {
+    downSignal();
+  }
+}
+
+static LiftEngine lift(liftClock, onLiftAction);
+
+static const char decisionTopic[] = "owlcms/decision/A";
+static const char downTopic[] = "owlcms/fop/down/A";
+static const char resetTopic[] = "owlcms/fop/resetDecisions/A";
+
+// The lightbox's topic dispatch, with the full-topic checks of its callback
+static void lightboxCallback(char *topic, uint8_t *payload, unsigned int length) {
+  if (strcmp(topic, decisionTopic) == 0) {
+    Decision decision;
+    if (decodeDecision(payload, length, decision)) {
+      lift.decision(decision.referee, decision.good);
+    }
+  } else if (strcmp(topic, resetTopic) == 0) {
+    lift.reset();
+  } else if (strcmp(topic, downTopic) == 0) {
+    lift.down();
+  }
+}
+
+static volatile unsigned int dispatched = 0;
+
+static void countingCallback(char *, uint8_t *, unsigned int length) {
+  dispatched += length;
+}
+
+// ====== Harness ======================================================
+
+struct Result {
+  const char *name;
+  uint64_t p50;
+  uint64_t p99;
+  uint64_t max;
+};
+
+static Result results[BENCH_MAX_RESULTS];
+static int resultCount = 0;
+
+typedef void (*BenchOperation)(uint32_t iteration);
+
+static void run(const char *name, BenchOperation operation) {
+  uint32_t iteration = 0;
+  for (int i = 0; i < BENCH_WARMUP; i++) {
+    operation(iteration++);
+  }
+  std::vector<uint64_t> samples(sampleCount);
+  for (int s = 0; s < sampleCount; s++) {
+    uint64_t start = nowNs();
+    for (int i = 0; i < BENCH_BATCH; i++) {
+      operation(iteration++);
+    }
+    samples[s] = (nowNs() - start) / BENCH_BATCH;
+  }
+  std::sort(samples.begin(), samples.end());
+  Result &result = results[resultCount++];
+  result.name = name;
+  result.p50 = samples[samples.size() / 2];
+  result.p99 = samples[samples.size() * 99 / 100];
+  result.max = samples.back();
+}
+
+// ====== Benchmarks ======================================================
+
+static MemoryClient memoryClient;
+static PubSubClient mqttClient(memoryClient);
+static BenchMqttTransport mqttTransport(mqttClient);
+static BenchUdpTransport udpTransport;
+static TransportMux transport;
+
+static std::vector<std::vector<uint8_t> > decisionPackets;
+static std::vector<uint8_t> downPacket;
+static std::vector<uint8_t> heartbeatPacket;
+
+// Button press on a controller: build the decision, encode it, publish on MQTT and UDP
+static void benchPressToPublish(uint32_t iteration) {
+  Decision decision = {};
+  decision.referee = 1 + iteration % 3;
+  decision.good = iteration & 1;
+  decision.seq = iteration;
+  decision.pressedMs = iteration;
+  char payload[DECISION_TEXT_SIZE];
+  size_t length = formatDecisionText(decision, payload, sizeof(payload));
+  transport.publish(decisionTopic, (const uint8_t *)payload, length);
+  memoryClient.output.clear();
+}
+
+// Decision packet read off the socket, through the mux, into the lift engine
+static void benchPublishToLightbox(uint32_t iteration) {
+  if (iteration % 3 == 0) {
+    lift.reset();
+  }
+  memoryClient.feed(decisionPackets[iteration % decisionPackets.size()]);
+  mqttClient.loop();
+}
+
+// Down packet read off the socket to the down LED and buzzer pins
+static void benchDownToLed(uint32_t) {
+  lift.reset();
+  memoryClient.feed(downPacket);
+  mqttClient.loop();
+}
+
+static void benchPubSubEncode(uint32_t iteration) {
+  static const uint8_t payload[] = "2 good";
+  mqttClient.publish(iteration & 1 ? decisionTopic : downTopic, payload, sizeof(payload) - 1);
+  memoryClient.output.clear();
+}
+
+static void benchPubSubDecode(uint32_t) {
+  memoryClient.feed(heartbeatPacket);
+  mqttClient.loop();
+}
+
+// ====== Timer wheel ======================================================
+
+static TimerWheel idleTimers;
+static Timer heartbeatTimer;
+static Timer presenceTimer;
+
+static void heartbeatTick(void *) {
+  idleTimers.start(heartbeatTimer, 250, heartbeatTick);
+}
+
+static void presenceTick(void *) {
+  idleTimers.start(presenceTimer, 60000, presenceTick);
+}
+
+// A loop waking after a second's sleep with the idle lightbox's timers: heartbeat and presence
+static void benchTimerAdvance(uint32_t) {
+  idleTimers.advance(idleTimers.now() + 1000);
+}
+
+// ====== Decision codec against the string path ======================================
+
+static volatile uint32_t decoded = 0;
+static std::vector<std::vector<uint8_t> > binaryPayloads;
+static std::vector<std::string> textPayloads;
+
+static Decision benchDecision(uint32_t iteration) {
+  Decision decision = {};
+  decision.referee = 1 + iteration % 3;
+  decision.good = iteration & 1;
+  decision.seq = iteration;
+  decision.pressedMs = iteration * 7;
+  decision.epoch = iteration >> 4;
+  return decision;
+}
+
+static void benchEncodeBinary(uint32_t iteration) {
+  uint8_t payload[DECISION_WIRE_SIZE];
+  decoded += encodeDecision(benchDecision(iteration), payload, sizeof(payload));
+}
+
+static void benchEncodeText(uint32_t iteration) {
+  char payload[DECISION_TEXT_SIZE];
+  decoded += formatDecisionText(benchDecision(iteration), payload, sizeof(payload));
+}
+
+// The controller before user-033: sprintf(message, "%i %s", ref02Number + 1, decision)
+static void benchEncodeSprintf(uint32_t iteration) {
+  Decision decision = benchDecision(iteration);
+  char payload[DECISION_TEXT_SIZE];
+  decoded += sprintf(payload, "%i %s", decision.referee, decision.good ? "good" : "bad");
+}
+
+static void benchDecodeBinary(uint32_t iteration) {
+  const std::vector<uint8_t> &payload = binaryPayloads[iteration % binaryPayloads.size()];
+  Decision decision;
+  decoded += decodeDecision(payload.data(), payload.size(), decision) ? decision.referee : 0;
+}
+
+static void benchDecodeText(uint32_t iteration) {
+  const std::string &payload = textPayloads[iteration % textPayloads.size()];
+  Decision decision;
+  decoded += decodeDecision((const uint8_t *)payload.data(), payload.size(), decision) ? decision.referee : 0;
+}
+
+// The lightbox before user-033: the payload copied into a String one character at a time,
+// then processDecision()'s indexOf, substring and string comparisons
+static void benchParseString(uint32_t iteration) {
+  const std::string &payload = textPayloads[iteration % textPayloads.size()];
+  std::string message;
+  for (size_t i = 0; i < payload.size(); i++) {
+    message += payload[i];
+  }
+  size_t spaceIndex = message.find(' ');
+  if (spaceIndex == std::string::npos) {
+    return;
+  }
+  std::string refNumber = message.substr(0, spaceIndex);
+  std::string verdict = message.substr(spaceIndex + 1);
+  if (verdict != "good" && verdict != "bad") {
+    return;
+  }
+  if (refNumber == "1") {
+    decoded += 1;
+  } else if (refNumber == "2") {
+    decoded += 2;
+  } else if (refNumber == "3") {
+    decoded += 3;
+  }
+}
+
+// Mux de-duplication plus the lightbox's topic dispatch, without the MQTT layer
+static void benchCallbackDispatch(uint32_t iteration) {
+  static char topics[3][32];
+  static uint8_t payload[DECISION_TEXT_SIZE];
+  if (topics[0][0] == 0) {
+    strcpy(topics[0], decisionTopic);
+    strcpy(topics[1], resetTopic);
+    strcpy(topics[2], "owlcms/heartbeat/A/ref1");
+  }
+  Decision decision = {};
+  decision.referee = 1 + iteration % 3;
+  decision.good = true;
+  size_t length = formatDecisionText(decision, (char *)payload, sizeof(payload));
+  transport.deliver(iteration & 1, topics[iteration % 3], payload, length, iteration / 64);
+}
+
+static void setup() {
+  static const std::vector<uint8_t> connack = {MQTTCONNACK, 2, 0, 0};
+  memoryClient.feed(connack);
+  mqttClient.connect("bench");
+  transport.add(mqttTransport, TRANSPORT_MQTT);
+  transport.add(udpTransport, TRANSPORT_UDP);
+  mqttTransport.begin();
+  benchTimers.begin(0);
+  idleTimers.begin(0);
+  heartbeatTick(NULL);
+  presenceTick(NULL);
+
+  for (int i = 0; i < 64; i++) {
+    Decision decision = {};
+    decision.referee = 1 + i % 3;
+    decision.good = i % 5 != 0;
+    decision.seq = i;
+    decision.pressedMs = 1000 * i;
+    uint8_t payload[DECISION_WIRE_SIZE];
+    size_t length = encodeDecision(decision, payload, sizeof(payload));
+    decisionPackets.push_back(publishPacket(decisionTopic, payload, length));
+  }
+  for (int i = 0; i < 64; i++) {
+    Decision decision = benchDecision(i);
+    uint8_t payload[DECISION_WIRE_SIZE];
+    size_t length = encodeDecision(decision, payload, sizeof(payload));
+    binaryPayloads.push_back(std::vector<uint8_t>(payload, payload + length));
+    char text[DECISION_TEXT_SIZE];
+    length = formatDecisionText(decision, text, sizeof(text));
+    textPayloads.push_back(std::string(text, length));
+  }
+  downPacket = publishPacket(downTopic, NULL, 0);
+  static const uint8_t heartbeat[] = "ref1 123456";
+  heartbeatPacket = publishPacket("owlcms/heartbeat/A/ref1", heartbeat, sizeof(heartbeat) - 1);
+}
+
+// ====== Baselines ======================================================
+
+static bool writeResults(const char *path) {
+  FILE *file = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+  if (file == NULL) {
+    return false;
+  }
+  fprintf(file, "benchmark,p50_ns,p99_ns,max_ns\n");
+  for (int i = 0; i < resultCount; i++) {
+    fprintf(file, "%s,%llu,%llu,%llu\n", results[i].name, (unsigned long long)results[i].p50,
+            (unsigned long long)results[i].p99, (unsigned long long)results[i].max);
+  }
+  if (file != stdout) {
+    fclose(file);
+  }
+  return true;
+}
+
+static bool regressed(uint64_t value, uint64_t baseline) {
+  return value > baseline * (1 + thresholdPct / 100);
+}
+
+// Returns the number of regressions, or -1 if the baseline cannot be read
+static int compareBaseline(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return -1;
+  }
+  char line[128];
+  int regressions = 0;
+  printf("\n%-24s %10s %10s %10s %10s\n", "against baseline", "p50", "base", "p99", "base");
+  while (fgets(line, sizeof(line), file) != NULL) {
+    char name[64];
+    unsigned long long p50, p99, max;
+    if (sscanf(line, "%63[^,],%llu,%llu,%llu", name, &p50, &p99, &max) != 4) {
+      continue;   // header
+    }
+    for (int i = 0; i < resultCount; i++) {
+      if (strcmp(results[i].name, name) != 0) {
+        continue;
+      }
+      bool slow = regressed(results[i].p50, p50) || regressed(results[i].p99, p99);
+      printf("%-24s %10llu %10llu %10llu %10llu %s\n", name, (unsigned long long)results[i].p50, p50,
+             (unsigned long long)results[i].p99, p99, slow ? "REGRESSION" : "ok");
+      regressions += slow;
+    }
+  }
+  fclose(file);
+  return regressions;
+}
+
+// ====== Main ======================================================
+
+int main(int argc, char **argv) {
+  const char *outputPath = NULL;
+  const char *baselinePath = NULL;
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : "0";
+    if (strcmp(arg, "--output") == 0) {
+      outputPath = value, i++;
+    } else if (strcmp(arg, "--baseline") == 0) {
+      baselinePath = value, i++;
+    } else if (strcmp(arg, "--threshold") == 0) {
+      thresholdPct = atof(value), i++;
+    } else if (strcmp(arg, "--samples") == 0) {
+      sampleCount = atoi(value), i++;
+    } else {
+      fprintf(stderr, "unknown option %s\n", arg);
+      return 2;
+    }
+  }
+
+  setup();
+  transport.setCallback(lightboxCallback);
+  run("press_to_publish", benchPressToPublish);
+  run("publish_to_lightbox", benchPublishToLightbox);
+  run("down_to_led_commit", benchDownToLed);
+  run("pubsub_encode", benchPubSubEncode);
+  transport.setCallback(countingCallback);
+  run("pubsub_decode", benchPubSubDecode);
+  transport.setCallback(lightboxCallback);
+  run("callback_dispatch", benchCallbackDispatch);
+  run("decision_encode_binary", benchEncodeBinary);
+  run("decision_encode_text", benchEncodeText);
+  run("decision_encode_sprintf", benchEncodeSprintf);
+  run("decision_decode_binary", benchDecodeBinary);
+  run("decision_decode_text", benchDecodeText);
+  run("decision_parse_string", benchParseString);
+  run("timer_advance_1s", benchTimerAdvance);
+
+  printf("%-24s %10s %10s %10s\n", "benchmark (ns/op)", "p50", "p99", "max");
+  for (int i = 0; i < resultCount; i++) {
+    printf("%-24s %10llu %10llu %10llu\n", results[i].name, (unsigned long long)results[i].p50,
+           (unsigned long long)results[i].p99, (unsigned long long)results[i].max);
+  }
+  if (pins[2] == 0 || udpTransport.sent == 0 || dispatched == 0) {
+    fprintf(stderr, "a benchmark did not reach its end point\n");
+    return 2;
+  }
+
+  if (outputPath != NULL && !writeResults(outputPath)) {
+    fprintf(stderr, "cannot write %s\n", outputPath);
+    return 2;
+  }
+  if (baselinePath != NULL) {
+    int regressions = compareBaseline(baselinePath);
+    if (regressions < 0) {
+      fprintf(stderr, "cannot read %s\n", baselinePath);
+      return 2;
+    }
+    printf("%d regression(s) over %.0f%%\n", regressions, thresholdPct);
+    return regressions > 0 ? 1 : 0;
+  }
+  return 0;
+}
@@ -0,0 +1,163 @@
+// The lightbox's embedded broker (broker.cpp) as a Linux TCP server, so loadgen and the
+// presence test can run against the same code the EMBEDDED_BROKER firmware serves.
+//
+// Build and run from the repository root (raise BROKER_MAX_CLIENTS to the device count;
+// the firmware keeps 8):
+//   g++ -O2 -std=c++11 -DBROKER_MAX_CLIENTS=256 -IDecisionLightBox -o brokerd Simulator/brokerd.cpp
+//     DecisionLightBox/broker.cpp DecisionLightBox/transport.cpp
+//   ./brokerd --port 1883
+//
+// Writes block like the firmware's WiFiClient, so one slow subscriber slows everyone: this is
+// a test broker, not a replacement for Mosquitto.
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "broker.h"
+
+// Broker keepalive and connect timeouts are checked this often
+#define TICK_MS 100
+
+static uint32_t nowMs() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint32_t)(now.tv_sec * 1000ULL + now.tv_nsec / 1000000);
+}
+
+class SocketIO : public BrokerIO {
+public:
+  int fds[BROKER_MAX_CLIENTS];
+
+  SocketIO() {
+    for (int i = 0; i < BROKER_MAX_CLIENTS; i++) {
+      fds[i] = -1;
+    }
+  }
+
+  bool write(int slot, const uint8_t* data, size_t length) override {
+    size_t written = 0;
+    while (fds[slot] >= 0 && written < length) {
+      ssize_t sent = send(fds[slot], data + written, length - written, MSG_NOSIGNAL);
+      if (sent < 0 && errno == EINTR) {
+        continue;
+      }
+      if (sent <= 0) {
+        return false;
+      }
+      written += sent;
+    }
+    return written == length;
+  }
+
+  void close(int slot) override {
+    if (fds[slot] >= 0) {
+      ::close(fds[slot]);
+      fds[slot] = -1;
+    }
+  }
+};
+
+static MqttBroker broker;
+static SocketIO io;
+
+static int listenOn(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(fd, 64) != 0) {
+    perror("brokerd");
+    exit(1);
+  }
+  return fd;
+}
+
+static void acceptClient(int listenFd) {
+  int fd = accept(listenFd, NULL, NULL);
+  if (fd < 0) {
+    return;
+  }
+  int slot = broker.accept();
+  if (slot < 0) {
+    fprintf(stderr, "brokerd: all %d slots in use, refusing a connection\n", BROKER_MAX_CLIENTS);
+    close(fd);
+    return;
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  io.fds[slot] = fd;
+}
+
+int main(int argc, char** argv) {
+  int port = BROKER_PORT;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+      port = atoi(argv[++i]);
+    } else {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  int listenFd = listenOn(port);
+  broker.begin(io);
+  printf("brokerd: listening on port %d, %d client slots\n", port, BROKER_MAX_CLIENTS);
+  fflush(stdout);
+
+  struct pollfd polled[BROKER_MAX_CLIENTS + 1];
+  int slots[BROKER_MAX_CLIENTS + 1];
+  uint32_t lastTick = nowMs();
+  while (true) {
+    int count = 0;
+    polled[count].fd = listenFd;
+    polled[count].events = POLLIN;
+    slots[count++] = -1;
+    for (int i = 0; i < BROKER_MAX_CLIENTS; i++) {
+      if (io.fds[i] >= 0) {
+        polled[count].fd = io.fds[i];
+        polled[count].events = POLLIN;
+        slots[count++] = i;
+      }
+    }
+
+    poll(polled, count, TICK_MS);
+    uint32_t now = nowMs();
+    if (now - lastTick >= TICK_MS) {
+      broker.tick(now);
+      lastTick = now;
+    }
+
+    if (polled[0].revents & POLLIN) {
+      acceptClient(listenFd);
+    }
+    uint8_t buffer[1024];
+    for (int p = 1; p < count; p++) {
+      int slot = slots[p];
+      // The broker may have closed this slot while handling an earlier one
+      if (polled[p].revents == 0 || io.fds[slot] != polled[p].fd) {
+        continue;
+      }
+      ssize_t length = recv(io.fds[slot], buffer, sizeof(buffer), 0);
+      if (length > 0) {
+        broker.receive(slot, buffer, length);
+      } else if (length == 0 || errno != EINTR) {
+        broker.connectionLost(slot);
+        io.close(slot);
+      }
+    }
+  }
+}
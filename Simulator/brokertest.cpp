@@ -0,0 +1,226 @@
+// Connect test for the embedded broker: the firmware's own PubSubClient connects to MqttBroker
+// through an in-memory link, with the client ids, will and topics the devices really use.
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=c++11 -ISimulator/posix -IDecisionLightBox -o brokertest Simulator/brokertest.cpp
+//     DecisionLightBox/broker.cpp DecisionLightBox/PubSubClient.cpp DecisionLightBox/topics.cpp
+//     DecisionLightBox/transport.cpp
+//   ./brokertest
+
+#include <stdio.h>
+#include <string.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "Client.h"
+#include "PubSubClient.h"
+#include "broker.h"
+#include "check.h"
+#include "topics.h"
+
+// ====== In-memory link ======================================================
+
+class LinkClient;
+
+// Hands broker output to the client that owns the slot
+class LinkIO : public BrokerIO {
+public:
+  LinkClient* clients[BROKER_MAX_CLIENTS] = {};
+  bool write(int slot, const uint8_t* data, size_t length) override;
+  void close(int slot) override;
+};
+
+static MqttBroker broker;
+static LinkIO io;
+
+// Client whose writes go straight into MqttBroker::receive(); the broker answers synchronously
+class LinkClient : public Client {
+public:
+  std::deque<uint8_t> input;
+  int slot = -1;
+
+  int connect(IPAddress, uint16_t) override { return open(); }
+  int connect(const char*, uint16_t) override { return open(); }
+  size_t write(uint8_t value) override { return write(&value, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override {
+    if (slot < 0) {
+      return 0;
+    }
+    broker.receive(slot, buffer, size);
+    return size;
+  }
+  int available() override { return input.size(); }
+  int read() override {
+    if (input.empty()) {
+      return -1;
+    }
+    uint8_t value = input.front();
+    input.pop_front();
+    return value;
+  }
+  int read(uint8_t* buffer, size_t size) override {
+    size_t count = 0;
+    while (count < size && !input.empty()) {
+      buffer[count++] = read();
+    }
+    return count;
+  }
+  int peek() override { return input.empty() ? -1 : input.front(); }
+  void flush() override {}
+  void stop() override {
+    if (slot >= 0) {
+      io.clients[slot] = NULL;
+      broker.connectionLost(slot);
+      slot = -1;
+    }
+  }
+  uint8_t connected() override { return slot >= 0; }
+  operator bool() override { return slot >= 0; }
+
+  // Socket dropped without DISCONNECT, as when a device loses power
+  void sever() { stop(); }
+
+private:
+  int open() {
+    input.clear();
+    slot = broker.accept();
+    if (slot >= 0) {
+      io.clients[slot] = this;
+    }
+    return slot >= 0;
+  }
+};
+
+bool LinkIO::write(int slot, const uint8_t* data, size_t length) {
+  if (clients[slot] == NULL) {
+    return false;
+  }
+  clients[slot]->input.insert(clients[slot]->input.end(), data, data + length);
+  return true;
+}
+
+void LinkIO::close(int slot) {
+  if (clients[slot] != NULL) {
+    clients[slot]->slot = -1;
+    clients[slot] = NULL;
+  }
+}
+
+// ====== Local subscriber ======================================================
+
+struct Message {
+  std::string topic;
+  std::string payload;
+};
+
+static std::vector<Message> received;
+
+static void onLocal(void*, char* topic, uint8_t* payload, unsigned int length) {
+  received.push_back({topic, std::string((const char*)payload, length)});
+}
+
+static bool receivedOn(const char* topic, const char* payload) {
+  for (const Message& m : received) {
+    if (m.topic == topic && m.payload == payload) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// ====== Tests ======================================================
+
+// A device as the firmware sets it up: presence will, then heartbeat and health warning topics
+struct Device {
+  LinkClient link;
+  PubSubClient mqtt;
+  char presenceTopic[TOPIC_CLIENT_SIZE(TOPIC_PREFIX_PRESENCE)];
+  char heartbeatTopic[TOPIC_CLIENT_SIZE(TOPIC_PREFIX_HEARTBEAT)];
+  char healthWarningTopic[TOPIC_CLIENT_SUFFIX_SIZE(TOPIC_PREFIX_HEALTH, TOPIC_SUFFIX_WARNING)];
+
+  Device() : mqtt(link) { mqtt.setServer("broker", BROKER_PORT); }
+
+  bool connect(const char* clientId, const char* fop) {
+    buildTopic(presenceTopic, TOPIC_PREFIX_PRESENCE, fop, clientId);
+    buildTopic(heartbeatTopic, TOPIC_PREFIX_HEARTBEAT, fop, clientId);
+    buildTopic(healthWarningTopic, TOPIC_PREFIX_HEALTH, fop, clientId, TOPIC_SUFFIX_WARNING);
+    return mqtt.connect(clientId, "", "", presenceTopic, 1, true, "offline", false);
+  }
+};
+
+// Same formats as connections.cpp and DecisionLightBox.ino
+static void deviceId(char* buffer, const char* kind, const uint8_t* mac) {
+  sprintf(buffer, "replogic-%s-%02x%02x%02x%02x%02x%02x", kind, mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+
+static void testDevice(const char* kind, const char* fop) {
+  static const uint8_t mac[6] = {0xa4, 0xcf, 0x12, 0x9b, 0x3e, 0x71};
+  char clientId[50];
+  deviceId(clientId, kind, mac);
+
+  received.clear();
+  Device device;
+  if (!CHECK(device.connect(clientId, fop))) {
+    printf("  %s (%d chars) on fop \"%s\": state %d\n", clientId, (int)strlen(clientId), fop, device.mqtt.state());
+    return;
+  }
+  CHECK_EQ(device.mqtt.state(), MQTT_CONNECTED);
+
+  // Retained presence and heartbeats, as after every connect
+  CHECK(device.mqtt.publish(device.presenceTopic, "online", true));
+  CHECK(device.mqtt.publish(device.heartbeatTopic, "1"));
+  CHECK(device.mqtt.publish(device.healthWarningTopic, "wifi"));
+  CHECK(device.mqtt.connected());
+  CHECK(receivedOn(device.presenceTopic, "online"));
+  CHECK(receivedOn(device.heartbeatTopic, "1"));
+  CHECK(receivedOn(device.healthWarningTopic, "wifi"));
+
+  // The will carries the full presence topic
+  device.link.sever();
+  CHECK(receivedOn(device.presenceTopic, "offline"));
+}
+
+// Reconnecting with the same id takes over the old connection
+static void testTakeover() {
+  static const uint8_t mac[6] = {0x24, 0x0a, 0xc4, 0x00, 0x00, 0x01};
+  char clientId[50];
+  deviceId(clientId, "ref", mac);
+
+  Device first;
+  Device second;
+  CHECK(first.connect(clientId, "A"));
+  CHECK(second.connect(clientId, "A"));
+  CHECK(second.mqtt.connected());
+  CHECK(!first.link.connected());
+  second.mqtt.disconnect();
+}
+
+// Ids past the broker's limit are refused with CONNACK 2 rather than truncated
+static void testIdTooLong() {
+  char clientId[BROKER_CLIENT_ID_SIZE + 1];
+  memset(clientId, 'x', BROKER_CLIENT_ID_SIZE);
+  clientId[BROKER_CLIENT_ID_SIZE] = '\0';
+
+  Device device;
+  CHECK(!device.connect(clientId, "A"));
+  CHECK_EQ(device.mqtt.state(), MQTT_CONNECT_BAD_CLIENT_ID);
+}
+
+int main() {
+  broker.begin(io);
+  broker.setLocalCallback(onLocal, NULL);
+  broker.subscribeLocal("owlcms/#");
+
+  char longFop[TOPIC_FOP_MAX + 1];
+  memset(longFop, 'P', TOPIC_FOP_MAX);
+  longFop[TOPIC_FOP_MAX] = '\0';
+
+  testDevice("ref", "A");
+  testDevice("ref", longFop);
+  testDevice("lightbox", "A");
+  testDevice("lightbox", longFop);
+  testTakeover();
+  testIdTooLong();
+  return checkResult("brokertest");
+}
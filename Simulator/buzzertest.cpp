@@ -0,0 +1,161 @@
+// Tests for the lightbox's buzzer engine (buzzer.h/buzzer.cpp) on a virtual clock: the tones and
+// rests of every pattern, the down signal ending exactly BUZZER_DOWN_MS after it starts however
+// it is played over, resuming with an offset, and stopping. The engine is ticked the way its
+// one-shot esp_timer drives it: at each msUntilNext() deadline.
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=c++11 -IDecisionLightBox -o buzzertest Simulator/buzzertest.cpp DecisionLightBox/buzzer.cpp
+//   ./buzzertest
+
+#include <stdio.h>
+#include <vector>
+
+#include "buzzer.h"
+#include "check.h"
+
+struct Tone {
+  uint32_t ms;   // since the start of the test
+  uint16_t hz;
+};
+
+static uint32_t startMs = 0;
+static uint32_t nowMs = 0;
+static std::vector<Tone> tones;
+
+static uint32_t testClock() {
+  return nowMs;
+}
+
+static void testWriter(uint16_t hz) {
+  tones.push_back({nowMs - startMs, hz});
+}
+
+static BuzzerEngine engine(testClock, testWriter);
+
+static void setUp(uint32_t start) {
+  startMs = nowMs = start;
+  tones.clear();
+  engine = BuzzerEngine(testClock, testWriter);
+}
+
+// Ticks at every deadline until untilMs after the start
+static void runUntil(uint32_t untilMs) {
+  while (true) {
+    uint32_t wait = engine.msUntilNext();
+    // Like scheduleBuzzer(): never less than 1 ms
+    uint32_t next = wait == BUZZER_NO_TIMEOUT ? startMs + untilMs : nowMs + (wait > 0 ? wait : 1);
+    if (next - startMs >= untilMs) {
+      nowMs = startMs + untilMs;
+      return;
+    }
+    nowMs = next;
+    engine.tick();
+  }
+}
+
+static bool sameTones(const std::vector<Tone>& expected) {
+  if (!CHECK_EQ(tones.size(), expected.size())) {
+    return false;
+  }
+  bool same = true;
+  for (size_t i = 0; i < expected.size(); i++) {
+    same &= CHECK_EQ(tones[i].ms, expected[i].ms) & CHECK_EQ(tones[i].hz, expected[i].hz);
+  }
+  return same;
+}
+
+static void testDown(uint32_t start) {
+  setUp(start);
+  engine.play(BUZZER_DOWN);
+  runUntil(3000);
+  sameTones({{0, BUZZER_TONE_HZ}, {BUZZER_DOWN_MS, 0}});
+  CHECK_EQ(engine.current(), BUZZER_NONE);
+  CHECK_EQ(engine.msUntilNext(), BUZZER_NO_TIMEOUT);
+}
+
+static void testPatterns() {
+  setUp(0);
+  engine.play(BUZZER_WARNING);
+  runUntil(1000);
+  sameTones({{0, BUZZER_TONE_HZ}, {150, 0}, {250, BUZZER_TONE_HZ}, {400, 0}});
+
+  setUp(0);
+  engine.play(BUZZER_FINAL);
+  runUntil(1000);
+  sameTones({{0, BUZZER_HIGH_HZ}, {100, 0}, {200, BUZZER_HIGH_HZ}, {300, 0}, {400, BUZZER_HIGH_HZ}, {500, 0}});
+
+  setUp(0);
+  engine.play(BUZZER_RESET_ACK);
+  runUntil(1000);
+  sameTones({{0, BUZZER_HIGH_HZ}, {40, 0}});
+  CHECK_EQ(engine.current(), BUZZER_NONE);
+}
+
+// Nothing played over the down signal shortens, stretches or changes it
+static void testDownNotDisturbed() {
+  const BuzzerPattern others[] = {BUZZER_DOWN, BUZZER_WARNING, BUZZER_FINAL, BUZZER_RESET_ACK, BUZZER_NONE};
+  for (BuzzerPattern other : others) {
+    for (uint32_t at = 1; at < BUZZER_DOWN_MS; at += 149) {
+      setUp(0xFFFFFFFF - 700);
+      engine.play(BUZZER_DOWN);
+      runUntil(at);
+      engine.play(other);
+      engine.stop(BUZZER_WARNING);
+      runUntil(3000);
+      if (!sameTones({{0, BUZZER_TONE_HZ}, {BUZZER_DOWN_MS, 0}})) {
+        printf("  pattern %d played %u ms into the down signal\n", other, at);
+      }
+    }
+  }
+}
+
+// The down signal replaces anything else, and a new pattern may follow it
+static void testDownReplaces() {
+  setUp(100);
+  engine.play(BUZZER_WARNING);
+  runUntil(200);
+  engine.play(BUZZER_DOWN);
+  runUntil(1800);
+  engine.play(BUZZER_RESET_ACK);
+  runUntil(2000);
+  sameTones({{0, BUZZER_TONE_HZ}, {150, 0}, {200, BUZZER_TONE_HZ}, {200 + BUZZER_DOWN_MS, 0},
+             {1800, BUZZER_HIGH_HZ}, {1840, 0}});
+}
+
+// Resuming after a warm reset: only what is left of the down signal sounds
+static void testOffset() {
+  setUp(0);
+  engine.play(BUZZER_DOWN, 1000);
+  runUntil(2000);
+  sameTones({{0, BUZZER_TONE_HZ}, {BUZZER_DOWN_MS - 1000, 0}});
+
+  setUp(0);
+  engine.play(BUZZER_DOWN, BUZZER_DOWN_MS);
+  runUntil(2000);
+  CHECK_EQ(tones.size(), 0);
+  CHECK_EQ(engine.current(), BUZZER_NONE);
+}
+
+static void testStop() {
+  setUp(0);
+  engine.play(BUZZER_DOWN);
+  runUntil(500);
+  engine.stop(BUZZER_DOWN);
+  CHECK_EQ(engine.current(), BUZZER_NONE);
+  CHECK_EQ(engine.msUntilNext(), BUZZER_NO_TIMEOUT);
+  runUntil(2000);
+  sameTones({{0, BUZZER_TONE_HZ}, {500, 0}});
+}
+
+int main() {
+  const uint32_t starts[] = {0, 12345, 0xFFFFFFFF - 1000};
+  for (uint32_t start : starts) {
+    testDown(start);
+  }
+  testPatterns();
+  testDownNotDisturbed();
+  testDownReplaces();
+  testOffset();
+  testStop();
+  return checkResult("buzzertest");
+}
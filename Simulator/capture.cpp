@@ -0,0 +1,152 @@
+#include "capture.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ====== CaptureWriter ======================================================
+
+static size_t putVarint(uint8_t *buffer, uint64_t value) {
+  size_t length = 0;
+  do {
+    uint8_t byte = value & 0x7F;
+    value >>= 7;
+    buffer[length++] = value ? byte | 0x80 : byte;
+  } while (value);
+  return length;
+}
+
+bool CaptureWriter::open(const char *path, uint64_t startEpochUs) {
+  close();
+  file = fopen(path, "wb");
+  if (file == NULL) {
+    return false;
+  }
+  uint8_t header[CAPTURE_HEADER_SIZE] = {};
+  memcpy(header, CAPTURE_MAGIC, 4);
+  header[4] = CAPTURE_VERSION;
+  for (int i = 0; i < 8; i++) {
+    header[8 + i] = startEpochUs >> (8 * i);
+  }
+  lastTimeUs = 0;
+  count = 0;
+  return fwrite(header, 1, sizeof(header), file) == sizeof(header);
+}
+
+bool CaptureWriter::write(uint64_t timeUs, const char *topic, const uint8_t *payload, size_t length) {
+  if (file == NULL) {
+    return false;
+  }
+  size_t topicLength = strlen(topic);
+  if (topicLength > CAPTURE_MAX_TOPIC) {
+    topicLength = CAPTURE_MAX_TOPIC;
+  }
+  uint8_t prefix[30];
+  size_t prefixLength = putVarint(prefix, timeUs >= lastTimeUs ? timeUs - lastTimeUs : 0);
+  prefixLength += putVarint(prefix + prefixLength, topicLength);
+  prefixLength += putVarint(prefix + prefixLength, length);
+  if (timeUs > lastTimeUs) {
+    lastTimeUs = timeUs;
+  }
+  count++;
+  return fwrite(prefix, 1, prefixLength, file) == prefixLength &&
+         fwrite(topic, 1, topicLength, file) == topicLength &&
+         fwrite(payload, 1, length, file) == length;
+}
+
+void CaptureWriter::flush() {
+  if (file != NULL) {
+    fflush(file);
+  }
+}
+
+void CaptureWriter::close() {
+  if (file != NULL) {
+    fclose(file);
+    file = NULL;
+  }
+}
+
+// ====== CaptureReader ======================================================
+
+bool CaptureReader::open(const char *path) {
+  close();
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size < CAPTURE_HEADER_SIZE) {
+    ::close(fd);
+    return false;
+  }
+  void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+  madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+  data = (const uint8_t *)mapping;
+  size = info.st_size;
+
+  if (memcmp(data, CAPTURE_MAGIC, 4) != 0 || data[4] != CAPTURE_VERSION) {
+    close();
+    return false;
+  }
+  startUs = 0;
+  for (int i = 0; i < 8; i++) {
+    startUs |= (uint64_t)data[8 + i] << (8 * i);
+  }
+  rewind();
+  return true;
+}
+
+void CaptureReader::close() {
+  if (data != NULL) {
+    munmap((void *)data, size);
+  }
+  data = NULL;
+  size = 0;
+}
+
+void CaptureReader::rewind() {
+  position = CAPTURE_HEADER_SIZE;
+  timeUs = 0;
+  cut = false;
+}
+
+bool CaptureReader::readVarint(uint64_t &value) {
+  value = 0;
+  for (int shift = 0; shift < 64 && position < size; shift += 7) {
+    uint8_t byte = data[position++];
+    value |= (uint64_t)(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool CaptureReader::next(CaptureRecord &record) {
+  if (data == NULL || position >= size) {
+    return false;
+  }
+  uint64_t delta, topicLength, payloadLength;
+  if (!readVarint(delta) || !readVarint(topicLength) || !readVarint(payloadLength) ||
+      topicLength > CAPTURE_MAX_TOPIC || payloadLength > size - position ||
+      topicLength + payloadLength > size - position) {
+    cut = true;
+    position = size;
+    return false;
+  }
+  timeUs += delta;
+  record.timeUs = timeUs;
+  record.topic = (const char *)data + position;
+  record.topicLength = topicLength;
+  record.payload = data + position + topicLength;
+  record.payloadLength = payloadLength;
+  position += topicLength + payloadLength;
+  return true;
+}
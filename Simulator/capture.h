@@ -0,0 +1,66 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Binary capture of MQTT traffic, written by record and read by replay.
+//
+// Header (16 bytes): magic "RLCP" | version (1) | reserved (3) | start, µs since the epoch (8, LE)
+// Record: time since the previous record in µs | topic length | payload length | topic | payload
+// The three numbers are LEB128 varints, so a typical decision costs about 25 bytes.
+// A record cut short by the recorder being killed ends the capture.
+
+#define CAPTURE_MAGIC "RLCP"
+#define CAPTURE_VERSION 1
+#define CAPTURE_HEADER_SIZE 16
+#define CAPTURE_MAX_TOPIC 255
+
+struct CaptureRecord {
+  uint64_t timeUs;          // since the start of the capture
+  const char *topic;        // not NUL-terminated
+  size_t topicLength;
+  const uint8_t *payload;
+  size_t payloadLength;
+};
+
+class CaptureWriter {
+public:
+  ~CaptureWriter() { close(); }
+  bool open(const char *path, uint64_t startEpochUs);
+  bool write(uint64_t timeUs, const char *topic, const uint8_t *payload, size_t length);
+  void flush();
+  void close();
+  uint64_t records() const { return count; }
+
+private:
+  FILE *file = NULL;
+  uint64_t lastTimeUs = 0;
+  uint64_t count = 0;
+};
+
+// Maps the whole file read-only; records point into the mapping, so the page cache rather
+// than the heap holds the capture and day-long files replay in constant memory
+class CaptureReader {
+public:
+  ~CaptureReader() { close(); }
+  bool open(const char *path);
+  void close();
+  bool next(CaptureRecord &record);
+  void rewind();
+  uint64_t startEpochUs() const { return startUs; }
+  bool truncated() const { return cut; }
+
+private:
+  const uint8_t *data = NULL;
+  size_t size = 0;
+  size_t position = 0;
+  uint64_t timeUs = 0;
+  uint64_t startUs = 0;
+  bool cut = false;
+
+  bool readVarint(uint64_t &value);
+};
+
+#endif
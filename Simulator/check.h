@@ -0,0 +1,40 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+// Minimal assertions for the host-side tests: a failed check is reported and counted, the test
+// carries on, and main() returns checkResult() so a failure shows in the exit status.
+
+static int checkFailures = 0;
+static int checkCount = 0;
+
+#define CHECK(condition) checkThat((condition), #condition, __FILE__, __LINE__)
+#define CHECK_EQ(actual, expected) \
+  checkEqual((long long)(actual), (long long)(expected), #actual, __FILE__, __LINE__)
+
+static inline bool checkThat(bool ok, const char* text, const char* file, int line) {
+  checkCount++;
+  if (!ok) {
+    checkFailures++;
+    printf("%s:%d: check failed: %s\n", file, line, text);
+  }
+  return ok;
+}
+
+static inline bool checkEqual(long long actual, long long expected, const char* text, const char* file, int line) {
+  checkCount++;
+  if (actual != expected) {
+    checkFailures++;
+    printf("%s:%d: check failed: %s is %lld, expected %lld\n", file, line, text, actual, expected);
+    return false;
+  }
+  return true;
+}
+
+static inline int checkResult(const char* name) {
+  printf("%s: %d checks, %d failed\n", name, checkCount, checkFailures);
+  return checkFailures == 0 ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,231 @@
+// Round-trip and corruption tests for the controller's stored config record (config.cpp).
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=c++11 -IRefereeController -o configtest Simulator/configtest.cpp RefereeController/config.cpp
+//   ./configtest
+
+#include <stdio.h>
+#include <string.h>
+
+#include "check.h"
+#include "config.h"
+#include "decision.h"
+
+// Independent CRC-16/CCITT-FALSE, to build records by hand
+static uint16_t referenceCrc(const uint8_t* data, size_t length) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < length; i++) {
+    for (int b = 7; b >= 0; b--) {
+      bool bit = ((data[i] >> b) & 1) ^ (crc >> 15);
+      crc = (crc << 1) ^ (bit ? 0x1021 : 0);
+    }
+  }
+  return crc;
+}
+
+static void sealRecord(uint8_t* record, size_t crcPos) {
+  uint16_t crc = referenceCrc(record, crcPos);
+  record[crcPos] = crc & 0xFF;
+  record[crcPos + 1] = crc >> 8;
+}
+
+static bool sameConfig(const DeviceConfig& a, const DeviceConfig& b) {
+  return a.referee == b.referee && strcmp(a.wifiSSID, b.wifiSSID) == 0 &&
+         strcmp(a.wifiPassword, b.wifiPassword) == 0 && strcmp(a.mqttServer, b.mqttServer) == 0 &&
+         strcmp(a.platform, b.platform) == 0 &&
+         memcmp(&a.calibrationFactor, &b.calibrationFactor, sizeof(float)) == 0 &&
+         a.wifiChannel == b.wifiChannel && memcmp(a.wifiBssid, b.wifiBssid, 6) == 0 &&
+         a.decisionFormat == b.decisionFormat;
+}
+
+// Every field away from its default, strings at their longest
+static void fullConfig(DeviceConfig& cfg) {
+  setDefaultConfig(cfg);
+  cfg.referee = 3;
+  memset(cfg.wifiSSID, 's', CONFIG_SSID_SIZE - 1);
+  memset(cfg.wifiPassword, 'p', CONFIG_PASSWORD_SIZE - 1);
+  memset(cfg.mqttServer, 'm', CONFIG_SERVER_SIZE - 1);
+  memset(cfg.platform, 'f', CONFIG_PLATFORM_SIZE - 1);
+  cfg.calibrationFactor = -0.125f;
+  cfg.wifiChannel = 13;
+  const uint8_t bssid[6] = {0xde, 0xad, 0xbe, 0xef, 0x00, 0xff};
+  memcpy(cfg.wifiBssid, bssid, 6);
+  cfg.decisionFormat = DECISION_FORMAT_TEXT;
+}
+
+static void testReferenceCrc() {
+  CHECK_EQ(referenceCrc((const uint8_t*)"123456789", 9), 0x29B1);
+}
+
+// The network defaults come from the build-time defines
+static void testDefaults() {
+  DeviceConfig cfg;
+  memset(&cfg, 'x', sizeof(cfg));
+  setDefaultConfig(cfg);
+  CHECK(strcmp(cfg.wifiSSID, CONFIG_WIFI_SSID) == 0);
+  CHECK(strcmp(cfg.wifiPassword, CONFIG_WIFI_PASSWORD) == 0);
+  CHECK(strcmp(cfg.mqttServer, CONFIG_MQTT_SERVER) == 0);
+  CHECK_EQ(cfg.decisionFormat, DECISION_FORMAT_BINARY);
+  CHECK_EQ(cfg.referee, 1);
+}
+
+static void testRoundTrip() {
+  DeviceConfig defaults;
+  DeviceConfig full;
+  setDefaultConfig(defaults);
+  fullConfig(full);
+
+  const DeviceConfig* cases[] = {&defaults, &full};
+  for (const DeviceConfig* cfg : cases) {
+    uint8_t record[CONFIG_RECORD_SIZE];
+    CHECK_EQ(serializeConfig(*cfg, record, sizeof(record)), CONFIG_RECORD_SIZE);
+    DeviceConfig loaded;
+    setDefaultConfig(loaded);
+    CHECK(deserializeConfig(record, sizeof(record), loaded));
+    CHECK(sameConfig(loaded, *cfg));
+  }
+}
+
+// The stored layout is fixed little-endian, independent of struct padding
+static void testLayout() {
+  DeviceConfig cfg;
+  fullConfig(cfg);
+  uint8_t record[CONFIG_RECORD_SIZE];
+  serializeConfig(cfg, record, sizeof(record));
+
+  CHECK_EQ(record[0], CONFIG_VERSION);
+  CHECK_EQ(record[1] | (record[2] << 8), CONFIG_PAYLOAD_SIZE);
+  CHECK_EQ(record[3], 3);
+  CHECK_EQ(record[4], 's');
+  CHECK_EQ(record[4 + CONFIG_SSID_SIZE - 1], 0);
+  size_t calibration = 4 + CONFIG_SSID_SIZE + CONFIG_PASSWORD_SIZE + CONFIG_SERVER_SIZE + CONFIG_PLATFORM_SIZE;
+  // -0.125f is 0xBE000000
+  CHECK_EQ(record[calibration], 0x00);
+  CHECK_EQ(record[calibration + 3], 0xBE);
+  CHECK_EQ(record[calibration + 4], 13);
+  CHECK_EQ(record[calibration + 5], 0xde);
+  CHECK_EQ(record[calibration + 11], DECISION_FORMAT_TEXT);
+  uint16_t crc = referenceCrc(record, CONFIG_RECORD_SIZE - 2);
+  CHECK_EQ(record[CONFIG_RECORD_SIZE - 2] | (record[CONFIG_RECORD_SIZE - 1] << 8), crc);
+}
+
+// Strings longer than their field are cut, never left unterminated
+static void testTruncatedStrings() {
+  DeviceConfig cfg;
+  setDefaultConfig(cfg);
+  memset(cfg.platform, 'x', CONFIG_PLATFORM_SIZE);  // no terminator
+  uint8_t record[CONFIG_RECORD_SIZE];
+  serializeConfig(cfg, record, sizeof(record));
+  DeviceConfig loaded;
+  CHECK(deserializeConfig(record, sizeof(record), loaded));
+  CHECK_EQ(strlen(loaded.platform), CONFIG_PLATFORM_SIZE - 1);
+}
+
+static void testSmallBuffer() {
+  DeviceConfig cfg;
+  setDefaultConfig(cfg);
+  uint8_t record[CONFIG_RECORD_SIZE];
+  CHECK_EQ(serializeConfig(cfg, record, CONFIG_RECORD_SIZE - 1), 0);
+}
+
+// A rejected record leaves the config as it was
+static void expectRejected(const uint8_t* record, size_t length, const char* what, size_t index) {
+  DeviceConfig cfg;
+  DeviceConfig before;
+  fullConfig(cfg);
+  fullConfig(before);
+  if (!CHECK(!deserializeConfig(record, length, cfg))) {
+    printf("  accepted %s %u\n", what, (unsigned)index);
+  }
+  CHECK(sameConfig(cfg, before));
+}
+
+// Every single-bit flip and every truncation is caught
+static void testCorruption() {
+  DeviceConfig cfg;
+  setDefaultConfig(cfg);
+  uint8_t record[CONFIG_RECORD_SIZE];
+  serializeConfig(cfg, record, sizeof(record));
+
+  int failuresBefore = checkFailures;
+  for (size_t bit = 0; bit < CONFIG_RECORD_SIZE * 8; bit++) {
+    uint8_t corrupt[CONFIG_RECORD_SIZE];
+    memcpy(corrupt, record, sizeof(corrupt));
+    corrupt[bit / 8] ^= 1 << (bit % 8);
+    expectRejected(corrupt, sizeof(corrupt), "bit flip", bit);
+  }
+  for (size_t length = 0; length < CONFIG_RECORD_SIZE; length++) {
+    expectRejected(record, length, "truncated to", length);
+  }
+  CHECK_EQ(checkFailures, failuresBefore);
+}
+
+// Well-formed records with values the firmware cannot use
+static void testInvalidValues() {
+  DeviceConfig cfg;
+  setDefaultConfig(cfg);
+  uint8_t record[CONFIG_RECORD_SIZE];
+  serializeConfig(cfg, record, sizeof(record));
+  size_t crcPos = CONFIG_RECORD_SIZE - 2;
+
+  const uint8_t referees[] = {0, 4, 255};
+  for (uint8_t referee : referees) {
+    uint8_t bad[CONFIG_RECORD_SIZE];
+    memcpy(bad, record, sizeof(bad));
+    bad[CONFIG_HEADER_SIZE] = referee;
+    sealRecord(bad, crcPos);
+    expectRejected(bad, sizeof(bad), "referee", referee);
+  }
+
+  uint8_t badFormat[CONFIG_RECORD_SIZE];
+  memcpy(badFormat, record, sizeof(badFormat));
+  badFormat[crcPos - 1] = DECISION_FORMAT_BINARY + 1;
+  sealRecord(badFormat, crcPos);
+  expectRejected(badFormat, sizeof(badFormat), "decision format", badFormat[crcPos - 1]);
+
+  uint8_t future[CONFIG_RECORD_SIZE];
+  memcpy(future, record, sizeof(future));
+  future[0] = CONFIG_VERSION + 1;
+  sealRecord(future, crcPos);
+  expectRejected(future, sizeof(future), "version", future[0]);
+}
+
+// Version 1 records, written before the decision format existed, still load
+static void testVersion1() {
+  DeviceConfig cfg;
+  fullConfig(cfg);
+  uint8_t record[CONFIG_RECORD_SIZE];
+  serializeConfig(cfg, record, sizeof(record));
+
+  uint8_t v1[CONFIG_HEADER_SIZE + CONFIG_V1_PAYLOAD_SIZE + 2];
+  memcpy(v1, record, CONFIG_HEADER_SIZE + CONFIG_V1_PAYLOAD_SIZE);
+  v1[0] = 1;
+  v1[1] = CONFIG_V1_PAYLOAD_SIZE & 0xFF;
+  v1[2] = CONFIG_V1_PAYLOAD_SIZE >> 8;
+  sealRecord(v1, CONFIG_HEADER_SIZE + CONFIG_V1_PAYLOAD_SIZE);
+
+  DeviceConfig loaded;
+  CHECK(deserializeConfig(v1, sizeof(v1), loaded));
+  cfg.decisionFormat = CONFIG_DECISION_FORMAT;
+  CHECK(sameConfig(loaded, cfg));
+
+  // A v1 header in front of a v2-sized payload is not a v1 record
+  uint8_t mixed[CONFIG_RECORD_SIZE];
+  memcpy(mixed, record, sizeof(mixed));
+  mixed[0] = 1;
+  sealRecord(mixed, CONFIG_RECORD_SIZE - 2);
+  expectRejected(mixed, sizeof(mixed), "version", 1);
+}
+
+int main() {
+  testReferenceCrc();
+  testDefaults();
+  testRoundTrip();
+  testLayout();
+  testTruncatedStrings();
+  testSmallBuffer();
+  testCorruption();
+  testInvalidValues();
+  testVersion1();
+  return checkResult("configtest");
+}
@@ -0,0 +1,104 @@
+// Tests for the receivers' DecisionFilter (decision.h/decision.cpp): duplicates on both transport
+// paths, late and resent copies, epochs, and a controller that cold-boots and starts its sequence
+// numbers over.
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=c++11 -IDecisionLightBox -o decisiontest Simulator/decisiontest.cpp DecisionLightBox/decision.cpp
+//   ./decisiontest
+
+#include <stdio.h>
+
+#include "check.h"
+#include "decision.h"
+
+static Decision press(uint16_t seq, uint32_t pressedMs, uint8_t flags = 0, uint8_t epoch = 5) {
+  Decision decision = {};
+  decision.version = DECISION_WIRE_VERSION;
+  decision.referee = 2;
+  decision.good = true;
+  decision.seq = seq;
+  decision.pressedMs = pressedMs;
+  decision.flags = flags;
+  decision.epoch = epoch;
+  return decision;
+}
+
+// Every copy arrives on both paths; the second is a duplicate
+static void testBothPaths() {
+  DecisionFilter filter;
+  filter.reset(5);
+  for (uint16_t seq = 1; seq <= 40; seq++) {
+    uint8_t flags = seq == 1 ? DECISION_FLAG_BOOT : 0;
+    CHECK_EQ(filter.check(press(seq, 1000 + seq, flags)), DECISION_ACCEPT);
+    CHECK_EQ(filter.check(press(seq, 1000 + seq, flags)), DECISION_DUPLICATE);
+  }
+}
+
+// The MQTT copy of the boot press arrives after the next presses came in over the fast path
+static void testLateBootCopy() {
+  DecisionFilter filter;
+  filter.reset(5);
+  CHECK_EQ(filter.check(press(1, 7000, DECISION_FLAG_BOOT)), DECISION_ACCEPT);
+  CHECK_EQ(filter.check(press(2, 7400)), DECISION_ACCEPT);
+  CHECK_EQ(filter.check(press(3, 7900)), DECISION_ACCEPT);
+  CHECK_EQ(filter.check(press(1, 7000, DECISION_FLAG_BOOT)), DECISION_DUPLICATE);
+  // The window was not restarted: later copies are still duplicates, a new press still counts
+  CHECK_EQ(filter.check(press(3, 7900)), DECISION_DUPLICATE);
+  CHECK_EQ(filter.check(press(4, 8200)), DECISION_ACCEPT);
+}
+
+// A resent copy never restarts the window, even with the flag set (older firmware sets it)
+static void testResentBootCopy() {
+  DecisionFilter filter;
+  filter.reset(5);
+  CHECK_EQ(filter.check(press(1, 7000, DECISION_FLAG_BOOT)), DECISION_ACCEPT);
+  CHECK_EQ(filter.check(press(2, 7400)), DECISION_ACCEPT);
+  CHECK_EQ(filter.check(press(1, 7000, DECISION_FLAG_BOOT | DECISION_FLAG_RESENT)), DECISION_DUPLICATE);
+  CHECK_EQ(filter.check(press(1, 9100, DECISION_FLAG_BOOT | DECISION_FLAG_RESENT)), DECISION_DUPLICATE);
+  CHECK_EQ(filter.check(press(2, 7400)), DECISION_DUPLICATE);
+}
+
+// A cold boot in the middle of a lift: the numbers start over and are accepted, once
+static void testReboot() {
+  DecisionFilter filter;
+  filter.reset(5);
+  for (uint16_t seq = 1; seq <= 57; seq++) {
+    filter.check(press(seq, 1000 * seq, seq == 1 ? DECISION_FLAG_BOOT : 0));
+  }
+  CHECK_EQ(filter.check(press(1, 4200, DECISION_FLAG_BOOT)), DECISION_ACCEPT);
+  CHECK_EQ(filter.check(press(1, 4200, DECISION_FLAG_BOOT)), DECISION_DUPLICATE);
+  CHECK_EQ(filter.check(press(2, 4900)), DECISION_ACCEPT);
+  CHECK_EQ(filter.check(press(1, 4200, DECISION_FLAG_BOOT)), DECISION_DUPLICATE);
+  // And a second reboot
+  CHECK_EQ(filter.check(press(1, 3800, DECISION_FLAG_BOOT)), DECISION_ACCEPT);
+  CHECK_EQ(filter.check(press(2, 4500)), DECISION_ACCEPT);
+  CHECK_EQ(filter.check(press(1, 3800, DECISION_FLAG_BOOT)), DECISION_DUPLICATE);
+}
+
+static void testEpochs() {
+  DecisionFilter filter;
+  filter.reset(5);
+  CHECK_EQ(filter.check(press(10, 100)), DECISION_ACCEPT);
+  CHECK_EQ(filter.check(press(11, 200, 0, 6)), DECISION_NEW_EPOCH);
+  CHECK_EQ(filter.epoch(), 6);
+  CHECK_EQ(filter.check(press(12, 300, 0, 5)), DECISION_STALE);
+  CHECK(!filter.reset(6));
+  CHECK(filter.reset(7));
+  CHECK(filter.stale(6));
+
+  // Epochs run 1-255 and wrap
+  DecisionFilter wrapping;
+  wrapping.reset(254);
+  CHECK_EQ(wrapping.check(press(13, 400, 0, 254)), DECISION_ACCEPT);
+  CHECK_EQ(wrapping.check(press(14, 500, 0, 1)), DECISION_NEW_EPOCH);
+  CHECK_EQ(wrapping.check(press(15, 600, 0, 254)), DECISION_STALE);
+}
+
+int main() {
+  testBothPaths();
+  testLateBootCopy();
+  testResentBootCopy();
+  testReboot();
+  testEpochs();
+  return checkResult("decisiontest");
+}
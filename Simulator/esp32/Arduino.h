@@ -0,0 +1,15 @@
+#ifndef ARDUINO_ESP32_H
+#define ARDUINO_ESP32_H
+
+// Minimal stand-in for the ESP32 Arduino core so health.cpp builds on Linux: the POSIX stand-in
+// plus the FreeRTOS task calls the health module makes. The test defines the functions.
+
+#include "../posix/Arduino.h"
+
+typedef void* TaskHandle_t;
+typedef unsigned int UBaseType_t;
+
+TaskHandle_t xTaskGetCurrentTaskHandle();
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+
+#endif
@@ -0,0 +1,253 @@
+// Reaction latency and idle wake-ups of the firmware loop, event-driven (events.cpp) against
+// the delay(10) polling loop it replaced. The event loop is a Linux model of events.cpp: a
+// watcher thread blocks in select() and notifies the loop thread, which sleeps on a condition
+// variable (the task notification) until then or until the firmware TimerWheel's next
+// deadline, capped at LOOP_IDLE_MS. Both loops run the lightbox's heartbeat and health timers.
+// A sender thread puts timestamped datagrams on a loopback UDP socket at random gaps; the
+// reaction latency is the time from sendto() to the loop handling the datagram.
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=c++11 -pthread -IDecisionLightBox -o eventloop Simulator/eventloop.cpp
+//     DecisionLightBox/timers.cpp
+//   ./eventloop --samples 200 --idle 10
+//
+// Host threads stand in for FreeRTOS tasks, so this compares the two loop designs, not the
+// ESP32's scheduler or radio: the on-device figures still need a board (the health topic's
+// wakeups/s field gives the idle rate there).
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "timers.h"
+
+// Mirrors DecisionLightBox.ino, events.cpp and health.h
+#define LOOP_IDLE_MS 1000
+#define LOOP_POLL_MS 10
+#define WATCHER_SELECT_MS 100
+#define HEARTBEAT_INTERVAL_MS 250
+#define HEALTH_INTERVAL_MS 10000
+
+static int sampleCount = 200;
+static int idleSeconds = 10;
+
+static uint64_t nowUs() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+// ====== Firmware stand-ins ======================================================
+
+static Timer heartbeatTimer;
+static Timer healthTimer;
+static uint32_t timerFires = 0;
+
+static void sendHeartbeat(void*) {
+  timers.start(heartbeatTimer, HEARTBEAT_INTERVAL_MS, sendHeartbeat);
+  timerFires++;
+}
+
+static void publishHealth(void*) {
+  timers.start(healthTimer, HEALTH_INTERVAL_MS, publishHealth);
+  timerFires++;
+}
+
+static void timersLoop() {
+  timers.advance(nowUs() / 1000);
+}
+
+// ====== events.cpp on threads ======================================================
+
+#define EVENT_NETWORK (1 << 1)
+
+static std::mutex eventMutex;
+static std::condition_variable loopNotify;
+static std::condition_variable watcherNotify;
+static uint32_t pendingBits = 0;
+static bool drained = false;
+static std::atomic<bool> stopping(false);
+static uint32_t wakeups = 0;
+
+static uint32_t waitForEvents(uint32_t timeoutMs) {
+  std::unique_lock<std::mutex> lock(eventMutex);
+  loopNotify.wait_for(lock, std::chrono::milliseconds(timeoutMs), [] { return pendingBits != 0; });
+  uint32_t bits = pendingBits;
+  pendingBits = 0;
+  wakeups++;
+  return bits;
+}
+
+static void postEvent(uint32_t bits) {
+  std::lock_guard<std::mutex> lock(eventMutex);
+  pendingBits |= bits;
+  loopNotify.notify_one();
+}
+
+static void socketsDrained() {
+  std::lock_guard<std::mutex> lock(eventMutex);
+  drained = true;
+  watcherNotify.notify_one();
+}
+
+static void socketWatcher(int fd) {
+  while (!stopping) {
+    {
+      // Drop drain notices left over from loop passes that had nothing to do with us
+      std::lock_guard<std::mutex> lock(eventMutex);
+      drained = false;
+    }
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(fd, &readable);
+    struct timeval timeout = {0, WATCHER_SELECT_MS * 1000};
+    if (select(fd + 1, &readable, NULL, NULL, &timeout) <= 0) {
+      continue;
+    }
+    postEvent(EVENT_NETWORK);
+    std::unique_lock<std::mutex> lock(eventMutex);
+    watcherNotify.wait_for(lock, std::chrono::milliseconds(WATCHER_SELECT_MS), [] { return drained; });
+  }
+}
+
+// ====== Loops ======================================================
+
+static std::vector<uint32_t> latencies;   // us
+
+// The transport's receive: every pending datagram, like UdpTransport::loop()
+static void receiveAll(int fd) {
+  uint64_t sentUs;
+  while (recv(fd, &sentUs, sizeof(sentUs), MSG_DONTWAIT) == sizeof(sentUs)) {
+    latencies.push_back((uint32_t)(nowUs() - sentUs));
+  }
+}
+
+static void eventLoop(int fd) {
+  while (!stopping) {
+    waitForEvents(timers.msUntilNext(LOOP_IDLE_MS));
+    timersLoop();
+    receiveAll(fd);
+    socketsDrained();
+  }
+}
+
+static void pollingLoop(int fd) {
+  while (!stopping) {
+    usleep(LOOP_POLL_MS * 1000);
+    wakeups++;
+    timersLoop();
+    receiveAll(fd);
+  }
+}
+
+// ====== Runs ======================================================
+
+static int openSocket(struct sockaddr_in& address) {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  bind(fd, (struct sockaddr*)&address, sizeof(address));
+  socklen_t length = sizeof(address);
+  getsockname(fd, (struct sockaddr*)&address, &length);
+  return fd;
+}
+
+static void printLatency(std::vector<uint32_t>& samples) {
+  if (samples.empty()) {
+    printf("  reaction   no datagrams handled\n");
+    return;
+  }
+  std::sort(samples.begin(), samples.end());
+  size_t n = samples.size();
+  printf("  reaction   n=%-4zu p50=%-8.2f p90=%-8.2f p99=%-8.2f max=%-8.2f ms\n", n, samples[n / 2] / 1000.0,
+         samples[n * 9 / 10] / 1000.0, samples[n * 99 / 100] / 1000.0, samples[n - 1] / 1000.0);
+}
+
+static void runMode(bool events) {
+  struct sockaddr_in address;
+  int fd = openSocket(address);
+  int sender = socket(AF_INET, SOCK_DGRAM, 0);
+
+  timers = TimerWheel();
+  timers.begin(nowUs() / 1000);
+  timers.start(heartbeatTimer, HEARTBEAT_INTERVAL_MS, sendHeartbeat);
+  timers.start(healthTimer, HEALTH_INTERVAL_MS, publishHealth);
+  latencies.clear();
+  wakeups = 0;
+  timerFires = 0;
+  pendingBits = 0;
+  stopping = false;
+
+  std::thread watcher;
+  if (events) {
+    watcher = std::thread(socketWatcher, fd);
+  }
+  std::thread loop(events ? eventLoop : pollingLoop, fd);
+
+  // Idle: only the timers run
+  uint64_t idleStart = nowUs();
+  usleep(idleSeconds * 1000000);
+  uint32_t idleWakeups = wakeups;
+  double idleS = (nowUs() - idleStart) / 1e6;
+
+  // Traffic: datagrams at random gaps of 20-120 ms, out of phase with any polling period
+  uint64_t trafficStart = nowUs();
+  uint32_t trafficStartWakeups = wakeups;
+  for (int i = 0; i < sampleCount; i++) {
+    usleep((20 + rand() % 100) * 1000 + rand() % 1000);
+    uint64_t sentUs = nowUs();
+    sendto(sender, &sentUs, sizeof(sentUs), 0, (struct sockaddr*)&address, sizeof(address));
+  }
+  usleep(WATCHER_SELECT_MS * 1000);
+  double trafficS = (nowUs() - trafficStart) / 1e6;
+  uint32_t trafficWakeups = wakeups - trafficStartWakeups;
+
+  stopping = true;
+  postEvent(EVENT_NETWORK);
+  loop.join();
+  if (events) {
+    watcher.join();
+  }
+  close(fd);
+  close(sender);
+
+  printf("%s\n", events ? "event-driven (events.cpp)" : "polling (delay(10))");
+  printf("  idle       %.1f wakeups/s over %.0f s (%u timer callbacks in all)\n", idleWakeups / idleS, idleS,
+         timerFires);
+  printf("  traffic    %.1f wakeups/s at %.1f datagrams/s\n", trafficWakeups / trafficS, sampleCount / trafficS);
+  printLatency(latencies);
+  fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : "0";
+    if (strcmp(arg, "--samples") == 0) {
+      sampleCount = atoi(value), i++;
+    } else if (strcmp(arg, "--idle") == 0) {
+      idleSeconds = atoi(value), i++;
+    } else if (strcmp(arg, "--seed") == 0) {
+      srand(atoi(value)), i++;
+    } else {
+      fprintf(stderr, "unknown option %s\n", arg);
+      return 2;
+    }
+  }
+  runMode(false);
+  runMode(true);
+  return 0;
+}
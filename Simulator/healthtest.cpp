@@ -0,0 +1,221 @@
+// Tests for the health telemetry (health.h/health.cpp) against stubbed FreeRTOS and heap calls:
+// the stack, heap and largest-block thresholds, the hysteresis that clears a warning, when
+// healthSample() reports a new warning, the task limit, and the sample and warning texts.
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=c++11 -ISimulator/esp32 -IDecisionLightBox -o healthtest Simulator/healthtest.cpp
+//     DecisionLightBox/health.cpp DecisionLightBox/topics.cpp
+//   ./healthtest
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "esp_heap_caps.h"
+#include "health.h"
+
+// A value this far above its threshold clears the warning
+#define CLEAR_AT(threshold) ((threshold) + (threshold) * HEALTH_HYSTERESIS_PERCENT / 100)
+
+// ====== Stubs ======================================================
+
+static int taskIds[HEALTH_MAX_TASKS + 2];
+static uint32_t stackLeft[HEALTH_MAX_TASKS + 2];
+static TaskHandle_t currentTask = &taskIds[0];
+
+static size_t freeHeap = 100000;
+static size_t minFreeHeap = 90000;
+static size_t largestBlock = 60000;
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  return currentTask;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+  return stackLeft[(int*)task - taskIds];
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+  return caps == MALLOC_CAP_8BIT ? freeHeap : 0;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+  return caps == MALLOC_CAP_8BIT ? minFreeHeap : 0;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+  return caps == MALLOC_CAP_8BIT ? largestBlock : 0;
+}
+
+// ====== Helpers ======================================================
+
+static char text[HEALTH_MESSAGE_SIZE];
+
+static const char* warningText() {
+  healthFormatWarnings(text, sizeof(text));
+  return text;
+}
+
+static bool sameText(const char* actual, const char* expected) {
+  if (!CHECK(strcmp(actual, expected) == 0)) {
+    printf("  \"%s\", expected \"%s\"\n", actual, expected);
+    return false;
+  }
+  return true;
+}
+
+static void setHealthy() {
+  freeHeap = 100000;
+  minFreeHeap = 90000;
+  largestBlock = 60000;
+  for (int i = 0; i < HEALTH_MAX_TASKS + 2; i++) {
+    stackLeft[i] = 2048;
+  }
+}
+
+// ====== Tests ======================================================
+
+// The first four tasks are watched, the rest ignored; NULL is the calling task
+static void testWatch() {
+  setHealthy();
+  healthWatchTask("loop", NULL);
+  for (int i = 1; i < HEALTH_MAX_TASKS + 2; i++) {
+    static char labels[HEALTH_MAX_TASKS + 2][4];
+    snprintf(labels[i], sizeof(labels[i]), "t%d", i);
+    healthWatchTask(labels[i], &taskIds[i]);
+  }
+  CHECK(!healthSample());
+  healthFormat(text, sizeof(text));
+  sameText(text, "heap=100000 min=90000 block=60000 frag=40% loop=2048 t1=2048 t2=2048 t3=2048");
+  sameText(warningText(), "");
+  // An ignored task's stack never warns
+  stackLeft[HEALTH_MAX_TASKS] = 10;
+  CHECK(!healthSample());
+  sameText(warningText(), "");
+}
+
+// Raised below the threshold, reported once, held inside the hysteresis band, cleared above it
+static void testStackHysteresis() {
+  setHealthy();
+  healthSample();
+  stackLeft[2] = HEALTH_STACK_WARN_BYTES;
+  CHECK(!healthSample());
+  stackLeft[2] = HEALTH_STACK_WARN_BYTES - 1;
+  CHECK(healthSample());
+  sameText(warningText(), "t2 stack 511 (warn 512)");
+  CHECK(!healthSample());
+  stackLeft[2] = CLEAR_AT(HEALTH_STACK_WARN_BYTES) - 1;
+  CHECK(!healthSample());
+  sameText(warningText(), "t2 stack 639 (warn 512)");
+  stackLeft[2] = CLEAR_AT(HEALTH_STACK_WARN_BYTES);
+  CHECK(!healthSample());
+  sameText(warningText(), "");
+  // A second task going low is a new warning while the first is active
+  stackLeft[0] = 300;
+  CHECK(healthSample());
+  stackLeft[3] = 200;
+  CHECK(healthSample());
+  CHECK(!healthSample());
+  sameText(warningText(), "loop stack 300 (warn 512), t3 stack 200 (warn 512)");
+  setHealthy();
+  CHECK(!healthSample());
+  sameText(warningText(), "");
+}
+
+static void testHeap() {
+  setHealthy();
+  healthSample();
+  freeHeap = HEALTH_HEAP_WARN_BYTES - 1;
+  largestBlock = 9000;
+  CHECK(healthSample());
+  sameText(warningText(), "heap 16383 (warn 16384)");
+  largestBlock = HEALTH_BLOCK_WARN_BYTES - 1;
+  CHECK(healthSample());
+  sameText(warningText(), "heap 16383 (warn 16384), block 8191 (warn 8192)");
+  freeHeap = CLEAR_AT(HEALTH_HEAP_WARN_BYTES);
+  largestBlock = CLEAR_AT(HEALTH_BLOCK_WARN_BYTES) - 1;
+  CHECK(!healthSample());
+  sameText(warningText(), "block 10239 (warn 8192)");
+  // Back below the threshold after clearing: reported again
+  freeHeap = 100;
+  largestBlock = 100;
+  CHECK(healthSample());
+  healthFormat(text, sizeof(text));
+  sameText(text, "heap=100 min=90000 block=100 frag=0% loop=2048 t1=2048 t2=2048 t3=2048");
+  // No free heap at all does not divide by zero
+  freeHeap = 0;
+  largestBlock = 0;
+  CHECK(!healthSample());
+  healthFormat(text, sizeof(text));
+  CHECK(strstr(text, " frag=0% ") != NULL);
+}
+
+// A random walk of every value against a model of the thresholds and hysteresis
+static void testRandomWalk() {
+  setHealthy();
+  healthSample();
+  bool stackActive[HEALTH_MAX_TASKS] = {};
+  bool heapActive = false;
+  bool blockActive = false;
+  for (int round = 0; round < 100000; round++) {
+    for (int i = 0; i < HEALTH_MAX_TASKS; i++) {
+      stackLeft[i] = rand() % (2 * CLEAR_AT(HEALTH_STACK_WARN_BYTES));
+    }
+    freeHeap = rand() % (2 * CLEAR_AT(HEALTH_HEAP_WARN_BYTES));
+    largestBlock = rand() % (2 * CLEAR_AT(HEALTH_BLOCK_WARN_BYTES));
+
+    bool raised = false;
+    for (int i = 0; i < HEALTH_MAX_TASKS; i++) {
+      bool active = stackLeft[i] < HEALTH_STACK_WARN_BYTES ||
+                    (stackActive[i] && stackLeft[i] < CLEAR_AT(HEALTH_STACK_WARN_BYTES));
+      raised |= active && !stackActive[i];
+      stackActive[i] = active;
+    }
+    bool heap = freeHeap < HEALTH_HEAP_WARN_BYTES || (heapActive && freeHeap < CLEAR_AT(HEALTH_HEAP_WARN_BYTES));
+    bool block = largestBlock < HEALTH_BLOCK_WARN_BYTES ||
+                 (blockActive && largestBlock < CLEAR_AT(HEALTH_BLOCK_WARN_BYTES));
+    raised |= (heap && !heapActive) || (block && !blockActive);
+    heapActive = heap;
+    blockActive = block;
+
+    int failuresBefore = checkFailures;
+    CHECK_EQ(healthSample(), raised);
+    warningText();
+    CHECK_EQ(strstr(text, "heap ") != NULL, heapActive);
+    CHECK_EQ(strstr(text, "block ") != NULL, blockActive);
+    CHECK_EQ(strstr(text, "loop stack") != NULL, stackActive[0]);
+    CHECK_EQ(strstr(text, "t3 stack") != NULL, stackActive[3]);
+    if (checkFailures != failuresBefore) {
+      printf("  round %d: \"%s\"\n", round, text);
+      return;
+    }
+  }
+}
+
+// The warning list is cut at the buffer, still terminated
+static void testShortBuffer() {
+  setHealthy();
+  for (int i = 0; i < HEALTH_MAX_TASKS; i++) {
+    stackLeft[i] = 1;
+  }
+  freeHeap = largestBlock = 1;
+  healthSample();
+  char small[24];
+  memset(small, 'x', sizeof(small));
+  size_t length = healthFormatWarnings(small, sizeof(small));
+  CHECK(length < sizeof(small));
+  CHECK_EQ(strlen(small), length);
+  setHealthy();
+  healthSample();
+}
+
+int main() {
+  srand(1);
+  testWatch();
+  testStackHysteresis();
+  testHeap();
+  testShortBuffer();
+  testRandomWalk();
+  return checkResult("healthtest");
+}
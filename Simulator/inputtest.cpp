@@ -0,0 +1,376 @@
+// Tests for the controller's input engine (input.h/input.cpp) driven by contact waveforms: clean
+// edges, the bounce bursts of tactile and worn micro switches as a logic analyser shows them,
+// glitches, taps, long presses, chords and their near misses, a button held at power-on, and a
+// millis() wrap. Levels change with microsecond resolution; the engine sees the millisecond
+// clock, as on the device.
+//
+// Each waveform runs twice: woken like the firmware (on every pin edge and at the deadline from
+// msUntilNext()), and with a loop pass every millisecond on top, as network traffic and other
+// timers add. Extra passes must not change which events are reported, or when.
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=c++11 -IRefereeController -o inputtest Simulator/inputtest.cpp RefereeController/input.cpp
+//   ./inputtest
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "check.h"
+#include "input.h"
+
+#define GOOD 0
+#define BAD 1
+
+// Latest a press may be reported after its contact settles: the debounce, the chord window and
+// the millisecond clock's rounding
+#define PRESS_BOUND_MS (INPUT_DEBOUNCE_MS + INPUT_CHORD_WINDOW_MS + 1)
+#define RELEASE_BOUND_MS (INPUT_DEBOUNCE_MS + 1)
+
+// ====== Waveforms ======================================================
+
+struct Edge {
+  uint64_t us;
+  bool level;   // true while pressed
+};
+
+typedef std::vector<Edge> Waveform;
+
+// Contact closing at atUs: the burst alternates pressed and open for the given durations, then
+// the contact stays at the final level. Returns the time it settles.
+static uint64_t addBurst(Waveform& wave, uint64_t atUs, bool level, const uint32_t* durations, size_t count) {
+  uint64_t t = atUs;
+  bool current = level;
+  for (size_t i = 0; i < count; i++) {
+    wave.push_back({t, current});
+    t += durations[i];
+    current = !current;
+  }
+  wave.push_back({t, level});
+  return t;
+}
+
+// Close and open bursts, shaped after captures of the switch types the controllers use
+static const uint32_t tactileClose[] = {40, 70, 30, 110, 60, 90, 150, 50};
+static const uint32_t tactileOpen[] = {80, 120, 40, 200, 60};
+// A worn micro switch: chatter, then an open gap of over a millisecond before it settles
+static const uint32_t wornClose[] = {300, 200, 500, 1200, 700, 150, 200};
+static const uint32_t wornOpen[] = {600, 900, 400, 300};
+
+struct Burst {
+  const char* name;
+  const uint32_t* durations;
+  size_t count;
+};
+
+static const Burst closeBursts[] = {
+  {"clean", NULL, 0},
+  {"tactile", tactileClose, sizeof(tactileClose) / sizeof(tactileClose[0])},
+  {"worn", wornClose, sizeof(wornClose) / sizeof(wornClose[0])},
+};
+static const Burst openBursts[] = {
+  {"clean", NULL, 0},
+  {"tactile", tactileOpen, sizeof(tactileOpen) / sizeof(tactileOpen[0])},
+  {"worn", wornOpen, sizeof(wornOpen) / sizeof(wornOpen[0])},
+};
+
+// A press from pressUs to releaseUs with the given bursts; returns when each edge settles
+static void addPress(Waveform& wave, uint64_t pressUs, uint64_t releaseUs, const Burst& close, const Burst& open,
+                     uint64_t* pressSettledUs = NULL, uint64_t* releaseSettledUs = NULL) {
+  uint64_t settled = addBurst(wave, pressUs, true, close.durations, close.count);
+  if (pressSettledUs != NULL) {
+    *pressSettledUs = settled;
+  }
+  settled = addBurst(wave, releaseUs, false, open.durations, open.count);
+  if (releaseSettledUs != NULL) {
+    *releaseSettledUs = settled;
+  }
+}
+
+// ====== Driver ======================================================
+
+struct Logged {
+  uint32_t ms;   // since the start of the run
+  InputEvent event;
+  uint8_t button;
+};
+
+static Waveform waves[INPUT_MAX_BUTTONS];
+static bool initialLevels[INPUT_MAX_BUTTONS];
+static uint32_t startMs = 0;
+static uint64_t simUs = 0;
+static std::vector<Logged> logged;
+
+static uint32_t testClock() {
+  return startMs + (uint32_t)(simUs / 1000);
+}
+
+static bool levelAt(uint8_t button, uint64_t us) {
+  bool level = initialLevels[button];
+  for (const Edge& edge : waves[button]) {
+    if (edge.us > us) {
+      break;
+    }
+    level = edge.level;
+  }
+  return level;
+}
+
+static bool testReader(uint8_t button) {
+  return levelAt(button, simUs);
+}
+
+static void testHandler(InputEvent event, uint8_t button) {
+  logged.push_back({testClock() - startMs, event, button});
+}
+
+static InputEngine engine(testClock, testReader, testHandler);
+
+static uint64_t nextEdgeAfter(uint64_t us) {
+  uint64_t next = UINT64_MAX;
+  for (const Waveform& wave : waves) {
+    for (const Edge& edge : wave) {
+      if (edge.us > us && edge.us < next) {
+        next = edge.us;
+      }
+    }
+  }
+  return next;
+}
+
+// Runs the waveforms until endMs and returns the reported events
+static std::vector<Logged> run(uint32_t endMs, bool everyMs) {
+  logged.clear();
+  simUs = 0;
+  engine = InputEngine(testClock, testReader, testHandler);
+  engine.begin(INPUT_MAX_BUTTONS);
+  uint64_t endUs = (uint64_t)endMs * 1000;
+  while (simUs < endUs) {
+    // Woken by a pin edge or by the timer armed for the engine's next deadline
+    uint32_t wait = engine.msUntilNext();
+    CHECK(wait > 0);
+    uint64_t next = nextEdgeAfter(simUs);
+    if (wait != INPUT_NO_TIMEOUT) {
+      uint64_t deadline = (simUs / 1000 + wait) * 1000;
+      next = deadline < next ? deadline : next;
+    }
+    if (everyMs) {
+      // Plus a loop pass every millisecond for other work
+      uint64_t tick = (simUs / 1000 + 1) * 1000;
+      next = tick < next ? tick : next;
+    }
+    if (next > endUs) {
+      break;
+    }
+    simUs = next;
+    engine.poll();
+  }
+  return logged;
+}
+
+static void setUp(uint32_t start) {
+  startMs = start;
+  for (uint8_t i = 0; i < INPUT_MAX_BUTTONS; i++) {
+    waves[i].clear();
+    initialLevels[i] = false;
+  }
+}
+
+static int countEvents(const std::vector<Logged>& events, InputEvent event) {
+  int n = 0;
+  for (const Logged& e : events) {
+    n += e.event == event;
+  }
+  return n;
+}
+
+static const Logged* findEvent(const std::vector<Logged>& events, InputEvent event, uint8_t button) {
+  for (const Logged& e : events) {
+    if (e.event == event && (e.button == button || button == INPUT_NO_BUTTON)) {
+      return &e;
+    }
+  }
+  return NULL;
+}
+
+// Runs both ways and checks they agree; returns the events of the firmware's wake-ups
+static std::vector<Logged> runBoth(uint32_t endMs) {
+  std::vector<Logged> woken = run(endMs, false);
+  std::vector<Logged> busy = run(endMs, true);
+  if (CHECK_EQ(woken.size(), busy.size())) {
+    for (size_t i = 0; i < woken.size(); i++) {
+      CHECK_EQ(woken[i].ms, busy[i].ms);
+      CHECK_EQ(woken[i].event, busy[i].event);
+      CHECK_EQ(woken[i].button, busy[i].button);
+    }
+  }
+  return woken;
+}
+
+// ====== Tests ======================================================
+
+// Every close and open burst, on either button: one press and one release, within the bounds
+static void testSinglePress(uint32_t start) {
+  for (const Burst& close : closeBursts) {
+    for (const Burst& open : openBursts) {
+      for (uint8_t button = 0; button < INPUT_MAX_BUTTONS; button++) {
+        setUp(start);
+        uint64_t pressSettled, releaseSettled;
+        addPress(waves[button], 100300, 400700, close, open, &pressSettled, &releaseSettled);
+        std::vector<Logged> events = runBoth(600);
+        int failuresBefore = checkFailures;
+        CHECK_EQ(events.size(), 2);
+        const Logged* press = findEvent(events, INPUT_PRESS, button);
+        const Logged* release = findEvent(events, INPUT_RELEASE, button);
+        if (CHECK(press != NULL) && CHECK(release != NULL)) {
+          // Not before the contact first closed, and held back for the chord window
+          CHECK(press->ms >= 100 + INPUT_CHORD_WINDOW_MS);
+          CHECK(press->ms <= pressSettled / 1000 + PRESS_BOUND_MS);
+          CHECK(release->ms >= 400);
+          CHECK(release->ms <= releaseSettled / 1000 + RELEASE_BOUND_MS);
+        }
+        if (checkFailures != failuresBefore) {
+          printf("  %s close, %s open, button %d\n", close.name, open.name, button);
+        }
+      }
+    }
+  }
+}
+
+// Short spikes, one 2 ms glitch and a burst of chatter that never settles: nothing reported
+static void testGlitches() {
+  setUp(0);
+  waves[GOOD] = {{10000, true}, {10400, false}, {20000, true}, {22000, false}, {30000, true}, {30900, false}};
+  uint64_t t = 40000;
+  for (int i = 0; i < 20; i++) {
+    waves[BAD].push_back({t, true});
+    waves[BAD].push_back({t + 700, false});
+    t += 1500;
+  }
+  std::vector<Logged> events = runBoth(200);
+  CHECK_EQ(events.size(), 0);
+}
+
+// A tap shorter than the chord window is reported at its release, press first
+static void testTap() {
+  for (const Burst& close : closeBursts) {
+    setUp(1000);
+    uint64_t releaseSettled;
+    addPress(waves[GOOD], 50000, 90000, close, openBursts[1], NULL, &releaseSettled);
+    std::vector<Logged> events = runBoth(300);
+    if (CHECK_EQ(events.size(), 2)) {
+      CHECK_EQ(events[0].event, INPUT_PRESS);
+      CHECK_EQ(events[1].event, INPUT_RELEASE);
+      CHECK_EQ(events[0].ms, events[1].ms);
+      CHECK(events[1].ms <= releaseSettled / 1000 + RELEASE_BOUND_MS);
+    }
+  }
+}
+
+static void testLongPress() {
+  setUp(0);
+  addPress(waves[BAD], 100000, 2000000, closeBursts[1], openBursts[1]);
+  std::vector<Logged> events = runBoth(2100);
+  CHECK_EQ(events.size(), 3);
+  const Logged* press = findEvent(events, INPUT_PRESS, BAD);
+  const Logged* longPress = findEvent(events, INPUT_LONG_PRESS, BAD);
+  if (CHECK(press != NULL) && CHECK(longPress != NULL)) {
+    CHECK(longPress->ms >= 100 + INPUT_LONG_PRESS_MS);
+    CHECK(longPress->ms <= press->ms - INPUT_CHORD_WINDOW_MS + INPUT_LONG_PRESS_MS);
+  }
+}
+
+// Both buttons down within the window, in either order and with every skew up to it: a chord,
+// no press or release of either button, and a long chord if held
+static void testChord(uint32_t start) {
+  for (uint32_t skewMs = 0; skewMs < INPUT_CHORD_WINDOW_MS - 5; skewMs += 5) {
+    for (uint8_t first = 0; first < INPUT_MAX_BUTTONS; first++) {
+      setUp(start);
+      uint8_t second = 1 - first;
+      addPress(waves[first], 100000, 3500000, closeBursts[2], openBursts[2]);
+      addPress(waves[second], 100000 + skewMs * 1000, 3500000, closeBursts[1], openBursts[1]);
+      std::vector<Logged> events = runBoth(3700);
+      int failuresBefore = checkFailures;
+      CHECK_EQ(countEvents(events, INPUT_PRESS), 0);
+      CHECK_EQ(countEvents(events, INPUT_RELEASE), 0);
+      CHECK_EQ(countEvents(events, INPUT_LONG_PRESS), 0);
+      // Presses that settle in the same millisecond complete the chord in either order
+      const Logged* chord = findEvent(events, INPUT_CHORD, skewMs > 0 ? second : INPUT_NO_BUTTON);
+      const Logged* chordLong = findEvent(events, INPUT_CHORD_LONG, 0);
+      if (CHECK(chord != NULL) && CHECK(chordLong != NULL)) {
+        CHECK_EQ(chordLong->ms - chord->ms, INPUT_CHORD_LONG_MS);
+      }
+      if (checkFailures != failuresBefore) {
+        printf("  chord from %u, button %d first, %u ms apart\n", start, first, skewMs);
+      }
+    }
+  }
+}
+
+// The second button comes after the window: two presses, no chord
+static void testChordMissed() {
+  setUp(0);
+  addPress(waves[GOOD], 100000, 1000000, closeBursts[1], openBursts[1]);
+  addPress(waves[BAD], 100000 + (INPUT_CHORD_WINDOW_MS + 20) * 1000, 1000000, closeBursts[1], openBursts[1]);
+  std::vector<Logged> events = runBoth(1200);
+  CHECK_EQ(countEvents(events, INPUT_CHORD), 0);
+  CHECK_EQ(countEvents(events, INPUT_CHORD_LONG), 0);
+  CHECK_EQ(countEvents(events, INPUT_PRESS), 2);
+  CHECK_EQ(countEvents(events, INPUT_RELEASE), 2);
+  if (CHECK(events.size() >= 2)) {
+    CHECK_EQ(events[0].button, GOOD);
+    CHECK_EQ(events[1].button, BAD);
+  }
+}
+
+// A chord let go early: no long chord, re-pressing a button before both are up sends nothing,
+// and the next press after that is an ordinary one
+static void testChordReleasedEarly() {
+  setUp(0);
+  addPress(waves[GOOD], 100000, 1000000, closeBursts[1], openBursts[1]);
+  addPress(waves[GOOD], 1200000, 1300000, closeBursts[1], openBursts[1]);
+  addPress(waves[GOOD], 2000000, 2050000, closeBursts[0], openBursts[0]);
+  addPress(waves[BAD], 120000, 1500000, closeBursts[2], openBursts[2]);
+  std::vector<Logged> events = runBoth(4000);
+  CHECK_EQ(countEvents(events, INPUT_CHORD), 1);
+  CHECK_EQ(countEvents(events, INPUT_CHORD_LONG), 0);
+  if (CHECK_EQ(countEvents(events, INPUT_PRESS), 1)) {
+    const Logged* press = findEvent(events, INPUT_PRESS, GOOD);
+    CHECK(press != NULL && press->ms >= 2050);
+  }
+  CHECK_EQ(countEvents(events, INPUT_RELEASE), 1);
+}
+
+// A button held at power-on reports only its release, and no long press
+static void testHeldAtPowerOn() {
+  setUp(0);
+  initialLevels[GOOD] = true;
+  addBurst(waves[GOOD], 2500000, false, tactileOpen, sizeof(tactileOpen) / sizeof(tactileOpen[0]));
+  std::vector<Logged> events = runBoth(3000);
+  if (CHECK_EQ(events.size(), 1)) {
+    CHECK_EQ(events[0].event, INPUT_RELEASE);
+    CHECK_EQ(events[0].button, GOOD);
+  }
+  // The other button pressed meanwhile is not held back for a chord that cannot happen
+  setUp(0);
+  initialLevels[GOOD] = true;
+  addPress(waves[BAD], 100000, 200000, closeBursts[0], openBursts[0]);
+  events = runBoth(300);
+  const Logged* press = findEvent(events, INPUT_PRESS, BAD);
+  CHECK(press != NULL && press->ms <= 100 + INPUT_DEBOUNCE_MS + 1);
+}
+
+int main() {
+  const uint32_t starts[] = {0, 123456, 0xFFFFFFFF - 150, 0xFFFFFFFF - 3600};
+  for (uint32_t start : starts) {
+    testSinglePress(start);
+    testChord(start);
+  }
+  testGlitches();
+  testTap();
+  testLongPress();
+  testChordMissed();
+  testChordReleasedEarly();
+  testHeldAtPowerOn();
+  return checkResult("inputtest");
+}
@@ -0,0 +1,857 @@
+// Discrete-event simulator of one platform: three referee controllers, the lightbox and the
+// central decision box, connected through a simulated broker and UDP fast path.
+//
+// It links the firmware's portable modules unchanged (lift engine, decision payloads and the
+// transport mux with its cross-path de-duplication, the UDP frame codec and sequence window)
+// and runs them on a virtual clock, so thousands of lifts take seconds.
+//
+// Limits of the model:
+//  - The central box is a LiftEngine with the same rules, not RPILaunch.py itself, so
+//    "lightbox/central disagree" only catches lost or reordered messages, not a difference
+//    between the two rule sets; the Python rules have their own tests.
+//  - The lightbox's message handling (processDecision(), syncLiftStatus(), renderFrame()) is
+//    mirrored here by hand, leaving out the LEDs, timers and saved state; keep it in step.
+//  - Each press is one message; presses of different referees may arrive in another order at
+//    the lightbox and the central box, so with a large jitter the lightbox's own engine can
+//    go down before the central box does ("lightbox - central down" below).
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=c++11 -IDecisionLightBox -o liftsim Simulator/liftsim.cpp
+//     DecisionLightBox/lift.cpp DecisionLightBox/decision.cpp DecisionLightBox/transport.cpp
+//   ./liftsim --lifts 5000 --latency 15 --jitter 10 --loss 5 --mqtt-loss 0
+//   ./liftsim --text --dup 10
+//   ./liftsim --disconnects 20 --no-resync
+//   ./liftsim --frames
+//
+// Options:
+//   --lifts N        lifts to run (default 1000)
+//   --latency MS     one-way network latency (default 10)
+//   --jitter MS      uniform extra latency, 0..MS (default 5)
+//   --loss PCT       UDP datagram loss in percent (default 2)
+//   --mqtt-loss PCT  MQTT messages lost to a dropped connection, in percent (default 0)
+//   --no-udp         MQTT only
+//   --text           controllers send the text decision format, as for OWLCMS (default binary)
+//   --dup PCT        MQTT messages delivered a second time 0.1-2.5 s late, as a resend after
+//                    a reconnect would be; the copy lands out of order (default 0)
+//   --no-filter      receivers skip the sequence/epoch check (DecisionFilter)
+//   --disconnects PCT lifts in which the lightbox drops off the network for 1-4 s, in percent;
+//                    on reconnect the broker replays the retained reset and lift status (default 0)
+//   --no-resync      the lightbox ignores the retained lift status, as before it existed
+//   --frames         the central box publishes display frames and the lightbox renders from
+//                    them instead of its own lift engine; after the first frame it drops the
+//                    decisions, the down signal and the live lift status, and takes them again
+//                    on a reconnect until the next frame
+//   --seed N         random seed (default 1)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "lift.h"
+#include "decision.h"
+#include "transport.h"
+#include "buzzer.h"
+
+// ====== Virtual clock and event queue ======================================================
+
+static uint64_t simNow = 0;
+
+static uint32_t simClock() {
+  return (uint32_t)simNow;
+}
+
+struct SimEvent {
+  uint64_t time;
+  uint64_t order;   // FIFO among events due at the same time
+  int kind;
+  int node;
+  uint8_t arg;   // transport for EVENT_DELIVER, verdict for EVENT_PRESS
+  std::string topic;
+  std::string payload;
+  bool operator>(const SimEvent &other) const {
+    return time != other.time ? time > other.time : order > other.order;
+  }
+};
+
+enum { EVENT_DELIVER, EVENT_PRESS, EVENT_TICK, EVENT_LIFT_START, EVENT_DISCONNECT, EVENT_RECONNECT };
+
+static std::priority_queue<SimEvent, std::vector<SimEvent>, std::greater<SimEvent> > events;
+static uint64_t eventOrder = 0;
+
+static void schedule(uint64_t time, int kind, int node, uint8_t arg = 0,
+                     const std::string &topic = "", const std::string &payload = "") {
+  events.push(SimEvent{time, eventOrder++, kind, node, arg, topic, payload});
+}
+
+// ====== Settings ======================================================
+
+static int liftCount = 1000;
+static int latencyMs = 10;
+static int jitterMs = 5;
+static double udpLoss = 0.02;
+static double mqttLoss = 0.0;
+static bool useUdp = true;
+static bool binaryDecisions = true;
+static double mqttDuplicates = 0.0;
+static bool useFilter = true;
+static double disconnects = 0.0;
+static bool useResync = true;
+static bool useFrames = false;
+
+static double uniform() {
+  return rand() / (RAND_MAX + 1.0);
+}
+
+static uint64_t linkDelay() {
+  return latencyMs + (jitterMs > 0 ? rand() % (jitterMs + 1) : 0);
+}
+
+// ====== Simulated network ======================================================
+
+#define NODE_CONTROLLER1 0
+#define NODE_LIGHTBOX 3
+#define NODE_CENTRAL 4
+#define NODE_COUNT 5
+// Sender ids in the UDP frames; 0 would be unset in the firmware
+#define NODE_SENDER_ID(node) ((uint32_t)(node) + 1)
+
+struct Node;
+static Node *nodes[NODE_COUNT];
+
+// Stands in for MqttTransport or UdpTransport; publishes are routed by the simulator
+class SimTransport : public Transport {
+public:
+  SimTransport(int node, uint8_t kind) : node(node), kind(kind) {}
+  bool connected() override { return true; }
+  bool publish(const char *topic, const uint8_t *payload, unsigned int length) override;
+  bool subscribe(const char *topicFilter) override {
+    if (std::find(filters.begin(), filters.end(), std::string(topicFilter)) == filters.end()) {
+      filters.push_back(topicFilter);
+    }
+    return true;
+  }
+  bool unsubscribe(const char *topicFilter) override {
+    filters.erase(std::remove(filters.begin(), filters.end(), std::string(topicFilter)), filters.end());
+    return true;
+  }
+  void loop() override {}
+
+  bool matches(const char *topic) const {
+    for (size_t i = 0; i < filters.size(); i++) {
+      if (topicMatches(filters[i].c_str(), topic)) {
+        return true;
+      }
+    }
+    return false;
+  }
+  // An MQTT message, or a UDP frame checked against the sequence window as UdpTransport::loop() does
+  void receive(const std::string &topic, const std::string &payload) {
+    if (kind == TRANSPORT_UDP) {
+      std::vector<uint8_t> frame(payload.begin(), payload.end());
+      uint32_t sender, seq;
+      char *frameTopic;
+      uint8_t *framePayload;
+      unsigned int framePayloadLength;
+      if (!decodeUdpFrame(frame.data(), frame.size(), sender, seq, frameTopic, framePayload, framePayloadLength) ||
+          sender == NODE_SENDER_ID(node) || !window.accept(sender, seq)) {
+        repeatsDropped++;
+        return;
+      }
+      mux->deliver(id, frameTopic, framePayload, framePayloadLength, simClock());
+      return;
+    }
+    std::vector<char> topicBuffer(topic.begin(), topic.end());
+    topicBuffer.push_back('\0');
+    std::vector<uint8_t> payloadBuffer(payload.begin(), payload.end());
+    payloadBuffer.push_back(0);
+    mux->deliver(id, topicBuffer.data(), payloadBuffer.data(), payload.size(), simClock());
+  }
+
+  static uint64_t repeatsDropped;   // UDP copies stopped by a sequence window
+
+private:
+  int node;
+  uint8_t kind;
+  std::vector<std::string> filters;
+  uint32_t udpSeq = 0;
+  SequenceWindow window;
+};
+
+uint64_t SimTransport::repeatsDropped = 0;
+
+struct Node {
+  TransportMux mux;
+  SimTransport mqtt;
+  SimTransport udp;
+  bool online = true;   // deliveries to an offline node are lost
+  explicit Node(int index) : mqtt(index, TRANSPORT_MQTT), udp(index, TRANSPORT_UDP) {
+    mux.add(mqtt, TRANSPORT_MQTT);
+    if (useUdp) {
+      mux.add(udp, TRANSPORT_UDP);
+    }
+  }
+};
+
+// The broker's retained messages by topic, replayed to a node when it reconnects
+static std::map<std::string, std::string> retained;
+static uint64_t centralPublishes = 0;
+static uint64_t lightboxCopies = 0;   // network deliveries, before de-duplication
+
+bool SimTransport::publish(const char *topic, const uint8_t *payload, unsigned int length) {
+  std::string payloadCopy((const char *)payload, length);
+  if (node == NODE_CENTRAL && kind == TRANSPORT_MQTT) {
+    centralPublishes++;
+  }
+  // One frame and one sequence number for all UDP_REPEAT copies, as UdpTransport::publish() sends
+  std::string frame;
+  if (kind == TRANSPORT_UDP) {
+    uint8_t buffer[UDP_FRAME_MAX_SIZE];
+    size_t frameLength = encodeUdpFrame(buffer, sizeof(buffer), NODE_SENDER_ID(node), ++udpSeq, topic, payload, length);
+    if (frameLength == 0) {
+      return false;
+    }
+    frame.assign((const char *)buffer, frameLength);
+  }
+  for (int dest = 0; dest < NODE_COUNT; dest++) {
+    if (dest == node) {
+      continue;
+    }
+    SimTransport &receiver = kind == TRANSPORT_MQTT ? nodes[dest]->mqtt : nodes[dest]->udp;
+    if (!receiver.matches(topic)) {
+      continue;
+    }
+    if (kind == TRANSPORT_MQTT) {
+      // Client to broker to client; TCP hides loss except when a connection drops
+      if (uniform() < mqttLoss) {
+        continue;
+      }
+      schedule(simNow + linkDelay() + linkDelay(), EVENT_DELIVER, dest, kind, topic, payloadCopy);
+      if (uniform() < mqttDuplicates) {
+        schedule(simNow + 100 + rand() % 2400, EVENT_DELIVER, dest, kind, topic, payloadCopy);
+      }
+    } else {
+      for (int copy = 0; copy < UDP_REPEAT; copy++) {
+        if (uniform() >= udpLoss) {
+          schedule(simNow + linkDelay(), EVENT_DELIVER, dest, kind, topic, frame);
+        }
+      }
+    }
+  }
+  return true;
+}
+
+// ====== Lift bookkeeping ======================================================
+
+struct LiftRecord {
+  uint64_t start;
+  char finalVotes[3];
+  uint64_t majorityTime;        // when two presses first agreed (0 = never)
+  uint64_t lightboxDownTime;
+  uint64_t lightboxBuzzerTime;  // the down tone started
+  uint64_t lightboxShowTime;
+  char lightboxVotes[3];
+  uint64_t centralDownTime;
+  char centralVotes[3];
+  bool lightboxOffline;         // the lightbox lost its connection during the lift
+};
+
+static std::vector<LiftRecord> lifts;
+static int currentLift = -1;
+
+// Presses after the change window are ignored by the rules, so they are not part of the expected result
+static void recordPress(int referee, bool good) {
+  LiftRecord &lift = lifts[currentLift];
+  if (lift.majorityTime != 0 && simNow > lift.majorityTime + LIFT_CHANGE_WINDOW_MS) {
+    return;
+  }
+  lift.finalVotes[referee - 1] = good ? 'g' : 'b';
+  int goodCount = 0, badCount = 0;
+  for (int i = 0; i < 3; i++) {
+    goodCount += lift.finalVotes[i] == 'g';
+    badCount += lift.finalVotes[i] == 'b';
+  }
+  if (lift.majorityTime == 0 && (goodCount >= 2 || badCount >= 2)) {
+    lift.majorityTime = simNow;
+  }
+}
+
+// ====== Devices ======================================================
+
+static char decisionTopic[] = "owlcms/decision/A";
+static char downTopic[] = "owlcms/fop/down/A";
+static char resetTopic[] = "owlcms/fop/resetDecisions/A";
+static char liftStateTopic[] = "owlcms/fop/liftState/A";
+static char displayTopic[] = "owlcms/fop/display/A";
+static uint16_t pressSeq[3] = {0, 0, 0};
+// Epoch each controller learned from the central box's last reset, and the central's own
+static uint8_t controllerEpoch[3] = {DECISION_NO_EPOCH, DECISION_NO_EPOCH, DECISION_NO_EPOCH};
+static uint8_t centralEpoch = DECISION_NO_EPOCH;
+
+static void controllerPress(int referee, bool good) {
+  Decision decision = {(uint8_t)referee, good, ++pressSeq[referee - 1], simClock(), 0,
+                       controllerEpoch[referee - 1], DECISION_WIRE_VERSION};
+  recordPress(referee, good);
+  Node &node = *nodes[NODE_CONTROLLER1 + referee - 1];
+  if (binaryDecisions) {
+    uint8_t payload[DECISION_WIRE_SIZE];
+    size_t length = encodeDecision(decision, payload, sizeof(payload));
+    node.mux.publish(decisionTopic, payload, length);
+  } else {
+    char message[DECISION_TEXT_SIZE];
+    formatDecisionText(decision, message, sizeof(message));
+    node.mux.publish(decisionTopic, message);
+  }
+}
+
+static void onLightboxAction(LiftAction action, uint8_t referee);
+static void onCentralAction(LiftAction action, uint8_t referee);
+static LiftEngine lightboxLift(simClock, onLightboxAction);
+static LiftEngine centralLift(simClock, onCentralAction);
+static DecisionFilter lightboxFilter;
+static DecisionFilter centralFilter;
+static uint64_t droppedDuplicates = 0;
+static uint64_t droppedStale = 0;
+// Cleared on every reconnect, as in the lightbox firmware
+static bool lightboxSynced = false;
+static uint64_t lightboxSyncs = 0;
+// Display frame state of the lightbox, as in the firmware
+static uint8_t frameEpoch = DECISION_NO_EPOCH;
+static uint8_t frameSeq = 0;
+static bool frameSeen = false;
+static uint8_t frameBuzzer = BUZZER_NONE;
+
+// Messages the lightbox handled, after de-duplication
+enum { HANDLED_DECISION, HANDLED_DOWN, HANDLED_RESET, HANDLED_STATUS, HANDLED_FRAME, HANDLED_COUNT };
+static uint64_t lightboxHandled[HANDLED_COUNT] = {};
+
+static bool framesDrive() {
+  return frameEpoch != DECISION_NO_EPOCH;
+}
+
+// subscribeTopics() and updateSubscriptions() of the lightbox
+static void subscribeLightbox() {
+  TransportMux &mux = nodes[NODE_LIGHTBOX]->mux;
+  mux.subscribe(resetTopic);
+  if (useFrames) {
+    mux.subscribe(displayTopic);
+  }
+  mux.subscribe(decisionTopic);
+  mux.subscribe(downTopic);
+  if (useResync) {
+    mux.subscribe(liftStateTopic);
+  }
+}
+
+static void updateLightboxSubscriptions() {
+  TransportMux &mux = nodes[NODE_LIGHTBOX]->mux;
+  if (useFrames && lightboxSynced) {
+    mux.unsubscribe(liftStateTopic);
+  }
+  if (frameSeen && framesDrive()) {
+    mux.unsubscribe(decisionTopic);
+    mux.unsubscribe(downTopic);
+  }
+}
+
+// Same checks as processDecision() in the lightbox and handle_message() in RPILaunch.py
+static bool acceptDecision(DecisionFilter &filter, LiftEngine &engine, const Decision &decision) {
+  if (!useFilter) {
+    return true;
+  }
+  DecisionVerdict verdict = filter.check(decision);
+  if (verdict == DECISION_DUPLICATE) {
+    droppedDuplicates++;
+    return false;
+  }
+  if (verdict == DECISION_STALE) {
+    droppedStale++;
+    return false;
+  }
+  if (verdict == DECISION_NEW_EPOCH) {
+    engine.reset();
+  }
+  return true;
+}
+
+static void onLightboxAction(LiftAction action, uint8_t) {
+  if (currentLift < 0 || framesDrive()) {
+    return;
+  }
+  LiftRecord &lift = lifts[currentLift];
+  if (action == LIFT_ACTION_DOWN && lift.lightboxDownTime == 0) {
+    // downSignal(): LED and tone together
+    lift.lightboxDownTime = simNow;
+    lift.lightboxBuzzerTime = simNow;
+  } else if (action == LIFT_ACTION_SHOW) {
+    lift.lightboxShowTime = simNow;
+    for (int i = 0; i < 3; i++) {
+      lift.lightboxVotes[i] = lightboxLift.vote(i + 1);
+    }
+  }
+}
+
+// The central box publishes the down signal for the lightbox, as RPILaunch.py does
+static void onCentralAction(LiftAction action, uint8_t) {
+  if (currentLift < 0) {
+    return;
+  }
+  LiftRecord &lift = lifts[currentLift];
+  if (action == LIFT_ACTION_DOWN) {
+    lift.centralDownTime = simNow;
+    nodes[NODE_CENTRAL]->mux.publish(downTopic, "");
+  } else if (action == LIFT_ACTION_SHOW) {
+    for (int i = 0; i < 3; i++) {
+      lift.centralVotes[i] = centralLift.vote(i + 1);
+    }
+  }
+}
+
+// Same as syncLiftStatus() in the lightbox: the down signal and the lights are given for
+// whatever is left of their time
+static void syncLightbox(const LiftStatus &status) {
+  lightboxSynced = true;
+  if (status.phase >= LIFT_STATE_COUNT) {
+    return;
+  }
+  lightboxSyncs++;
+  lightboxLift.sync((LiftState)status.phase, status.votes, status.remainingMs);
+  if (currentLift < 0) {
+    return;
+  }
+  LiftRecord &lift = lifts[currentLift];
+  if (status.phase == LIFT_CHANGE_WINDOW && lift.lightboxDownTime == 0) {
+    lift.lightboxDownTime = simNow;
+    // The tone is played for what is left of it
+    if (LIFT_CHANGE_WINDOW_MS - status.remainingMs < BUZZER_DOWN_MS && lift.lightboxBuzzerTime == 0) {
+      lift.lightboxBuzzerTime = simNow;
+    }
+  } else if (status.phase == LIFT_COOLDOWN) {
+    if (lift.lightboxShowTime == 0) {
+      lift.lightboxShowTime = simNow;
+    }
+    memcpy(lift.lightboxVotes, status.votes, 3);
+  }
+}
+
+// Same as renderFrame() in the lightbox
+static void renderFrame(const DisplayFrame &frame) {
+  if (frame.epoch != frameEpoch) {
+    frameBuzzer = BUZZER_NONE;
+  }
+  frameSeen = true;
+  frameEpoch = frame.epoch;
+  frameSeq = frame.seq;
+  bool newTone = frame.buzzer != frameBuzzer && frame.buzzer != BUZZER_NONE;
+  frameBuzzer = frame.buzzer;
+  if (currentLift < 0) {
+    return;
+  }
+  LiftRecord &lift = lifts[currentLift];
+  if (newTone && frame.buzzer == BUZZER_DOWN && lift.lightboxBuzzerTime == 0) {
+    lift.lightboxBuzzerTime = simNow;
+  }
+  if (frame.down && lift.lightboxDownTime == 0) {
+    lift.lightboxDownTime = simNow;
+  }
+  if (frame.lights != 0) {
+    lift.lightboxShowTime = simNow;
+    for (int referee = 1; referee <= 3; referee++) {
+      lift.lightboxVotes[referee - 1] = frame.lights & DISPLAY_GOOD_LIGHT(referee) ? 'g'
+                                      : frame.lights & DISPLAY_BAD_LIGHT(referee) ? 'b' : 0;
+    }
+  }
+}
+
+static void onLightboxMessage(char *topic, uint8_t *payload, unsigned int length) {
+  Decision decision;
+  if (strcmp(topic, decisionTopic) == 0 && decodeDecision(payload, length, decision)) {
+    lightboxHandled[HANDLED_DECISION]++;
+    if (acceptDecision(lightboxFilter, lightboxLift, decision)) {
+      lightboxLift.decision(decision.referee, decision.good);
+    }
+  } else if (strcmp(topic, downTopic) == 0) {
+    lightboxHandled[HANDLED_DOWN]++;
+    lightboxLift.down();
+  } else if (strcmp(topic, resetTopic) == 0) {
+    lightboxHandled[HANDLED_RESET]++;
+    uint8_t epoch = parseEpoch(payload, length);
+    if (!useFilter || lightboxFilter.reset(epoch)) {
+      lightboxLift.reset();
+    }
+  } else if (strcmp(topic, displayTopic) == 0) {
+    lightboxHandled[HANDLED_FRAME]++;
+    DisplayFrame frame;
+    if (decodeDisplayFrame(payload, length, frame) && !lightboxFilter.stale(frame.epoch) &&
+        (!frameSeen || frame.epoch != frameEpoch || (int8_t)(frame.seq - frameSeq) > 0)) {
+      renderFrame(frame);
+      updateLightboxSubscriptions();
+    }
+  } else if (strcmp(topic, liftStateTopic) == 0) {
+    lightboxHandled[HANDLED_STATUS]++;
+    LiftStatus status;
+    if (decodeLiftStatus(payload, length, status) && !lightboxFilter.stale(status.epoch) &&
+        (lightboxFilter.reset(status.epoch) || !lightboxSynced)) {
+      syncLightbox(status);
+    }
+    updateLightboxSubscriptions();
+  }
+}
+
+static void onCentralMessage(char *topic, uint8_t *payload, unsigned int length) {
+  Decision decision;
+  if (strcmp(topic, decisionTopic) == 0 && decodeDecision(payload, length, decision) &&
+      acceptDecision(centralFilter, centralLift, decision)) {
+    centralLift.decision(decision.referee, decision.good);
+  }
+}
+
+static int controllerOf(Node *node) {
+  for (int referee = 1; referee <= 3; referee++) {
+    if (nodes[NODE_CONTROLLER1 + referee - 1] == node) {
+      return referee;
+    }
+  }
+  return 0;
+}
+
+static Node *receivingNode = NULL;
+
+// Controllers learn the lift epoch from the reset, as the firmware does
+static void onControllerMessage(char *topic, uint8_t *payload, unsigned int length) {
+  int referee = controllerOf(receivingNode);
+  uint8_t epoch = parseEpoch(payload, length);
+  if (referee != 0 && strcmp(topic, resetTopic) == 0 && epoch != DECISION_NO_EPOCH) {
+    controllerEpoch[referee - 1] = epoch;
+  }
+}
+
+// One pending tick per engine deadline; stale ticks are harmless no-ops
+static uint64_t scheduledTicks[2] = {0, 0};
+
+static void scheduleTicks() {
+  uint32_t timeouts[] = {lightboxLift.msUntilTimeout(), centralLift.msUntilTimeout()};
+  for (int i = 0; i < 2; i++) {
+    if (timeouts[i] != LIFT_NO_TIMEOUT && simNow + timeouts[i] != scheduledTicks[i]) {
+      scheduledTicks[i] = simNow + timeouts[i];
+      schedule(scheduledTicks[i], EVENT_TICK, 0);
+    }
+  }
+}
+
+// ====== Retained state ======================================================
+
+static void publishRetained(Node &node, const char *topic, const uint8_t *payload, unsigned int length) {
+  retained[topic] = std::string((const char *)payload, length);
+  node.mux.publish(topic, payload, length);
+}
+
+// The central box publishes its lift status after every transition and vote change, as
+// publish_lift_state() in RPILaunch.py does
+static void publishCentralStatus() {
+  static LiftStatus last = {};
+  static bool published = false;
+  LiftStatus status = {centralEpoch, (uint8_t)centralLift.state(), {}, 0, centralLift.msUntilTimeout()};
+  for (int i = 0; i < 3; i++) {
+    status.votes[i] = centralLift.vote(i + 1);
+  }
+  if (status.phase == LIFT_REMINDED) {
+    status.reminded = centralLift.missingReferee();
+  }
+  if (published && status.epoch == last.epoch && status.phase == last.phase &&
+      memcmp(status.votes, last.votes, 3) == 0) {
+    return;
+  }
+  published = true;
+  last = status;
+  uint8_t payload[LIFT_STATUS_SIZE];
+  size_t length = encodeLiftStatus(status, payload, sizeof(payload));
+  publishRetained(*nodes[NODE_CENTRAL], liftStateTopic, payload, length);
+}
+
+// One frame per visible change, composed like publish_display_frame() in RPILaunch.py
+static void publishCentralFrame() {
+  static DisplayFrame last = {};
+  static bool published = false;
+  LiftState phase = centralLift.state();
+  DisplayFrame frame = {centralEpoch, 0, 0, phase == LIFT_CHANGE_WINDOW,
+                        (uint8_t)(phase == LIFT_CHANGE_WINDOW ? BUZZER_DOWN : BUZZER_NONE), 0};
+  for (int referee = 1; referee <= 3 && phase == LIFT_COOLDOWN; referee++) {
+    if (centralLift.vote(referee) == 'g') {
+      frame.lights |= DISPLAY_GOOD_LIGHT(referee);
+    } else if (centralLift.vote(referee) == 'b') {
+      frame.lights |= DISPLAY_BAD_LIGHT(referee);
+    }
+  }
+  if (phase == LIFT_REMINDED && centralLift.missingReferee() != 0) {
+    frame.reminders = 1 << (centralLift.missingReferee() - 1);
+  }
+  // A new epoch alone changes nothing on the lightbox; it rides on the next frame
+  if (published && frame.lights == last.lights && frame.down == last.down &&
+      frame.buzzer == last.buzzer && frame.reminders == last.reminders) {
+    return;
+  }
+  frame.seq = published ? last.seq + 1 : 1;
+  published = true;
+  last = frame;
+  uint8_t payload[DISPLAY_FRAME_SIZE];
+  size_t length = encodeDisplayFrame(frame, payload, sizeof(payload));
+  nodes[NODE_CENTRAL]->mux.publish(displayTopic, payload, length);
+}
+
+// A (re)connected client gets the retained message of every topic it subscribes to
+static void replayRetained(int dest) {
+  SimTransport &receiver = nodes[dest]->mqtt;
+  std::map<std::string, std::string>::const_iterator it;
+  for (it = retained.begin(); it != retained.end(); ++it) {
+    if (receiver.matches(it->first.c_str())) {
+      schedule(simNow + linkDelay(), EVENT_DELIVER, dest, TRANSPORT_MQTT, it->first, it->second);
+    }
+  }
+}
+
+// ====== Lift script ======================================================
+
+#define LIFT_CYCLE_MS 15000
+#define CHANGE_PROBABILITY 0.05
+
+// The next athlete is called (decisions reset, as OWLCMS does), then each referee presses
+// after a reaction time of 0.3-2.5 s; a few change their mind
+static void startLift() {
+  centralLift.reset();
+  centralEpoch = centralEpoch % 255 + 1;
+  centralFilter.reset(centralEpoch);
+  char epoch[4];
+  snprintf(epoch, sizeof(epoch), "%u", centralEpoch);
+  publishRetained(*nodes[NODE_CENTRAL], resetTopic, (const uint8_t *)epoch, strlen(epoch));
+  currentLift++;
+  LiftRecord lift = {};
+  lift.start = simNow;
+  lifts.push_back(lift);
+
+  // The lightbox drops out somewhere between the first presses and the lights
+  if (uniform() < disconnects) {
+    uint64_t offline = simNow + 300 + rand() % 5000;
+    schedule(offline, EVENT_DISCONNECT, NODE_LIGHTBOX);
+    schedule(offline + 1000 + rand() % 3000, EVENT_RECONNECT, NODE_LIGHTBOX);
+  }
+
+  bool goodLift = uniform() < 0.7;
+  for (int referee = 1; referee <= 3; referee++) {
+    bool good = uniform() < 0.85 ? goodLift : !goodLift;
+    uint64_t pressTime = simNow + 300 + rand() % 2200;
+    schedule(pressTime, EVENT_PRESS, referee, good);
+    if (uniform() < CHANGE_PROBABILITY) {
+      schedule(pressTime + 200 + rand() % 2000, EVENT_PRESS, referee, !good);
+    }
+  }
+  if (currentLift + 1 < liftCount) {
+    schedule(simNow + LIFT_CYCLE_MS, EVENT_LIFT_START, 0);
+  }
+}
+
+// ====== Report ======================================================
+
+static void printDistribution(const char *name, std::vector<uint64_t> &samples) {
+  if (samples.empty()) {
+    printf("%-28s no samples\n", name);
+    return;
+  }
+  std::sort(samples.begin(), samples.end());
+  size_t n = samples.size();
+  printf("%-28s n=%-6zu p50=%-5llu p90=%-5llu p99=%-5llu max=%llu ms\n", name, n,
+         (unsigned long long)samples[n / 2], (unsigned long long)samples[n * 9 / 10],
+         (unsigned long long)samples[n * 99 / 100], (unsigned long long)samples[n - 1]);
+}
+
+static void report() {
+  std::vector<uint64_t> lightboxDown, centralDown, lights, lightboxLead, lightboxLag;
+  int missedBuzzer = 0;
+  int noMajority = 0, missedDown = 0, downBeforeMajority = 0, missedLights = 0, wrongLights = 0, disagreements = 0, lightsBeforeMajority = 0;
+  int offlineLifts = 0, offlineFailures = 0;
+  double perLift = lifts.empty() ? 0 : 1.0 / lifts.size();
+
+  for (size_t i = 0; i < lifts.size(); i++) {
+    LiftRecord &lift = lifts[i];
+    if (lift.majorityTime == 0) {
+      noMajority++;
+      continue;
+    }
+    if (lift.lightboxOffline) {
+      offlineLifts++;
+      offlineFailures += lift.lightboxDownTime == 0 || lift.lightboxShowTime == 0 ||
+                         memcmp(lift.lightboxVotes, lift.finalVotes, 3) != 0;
+    }
+    if (lift.lightboxDownTime == 0) {
+      missedDown++;
+    } else if (lift.lightboxDownTime < lift.majorityTime) {
+      downBeforeMajority++;
+    } else {
+      lightboxDown.push_back(lift.lightboxDownTime - lift.majorityTime);
+    }
+    if (lift.centralDownTime >= lift.majorityTime) {
+      centralDown.push_back(lift.centralDownTime - lift.majorityTime);
+    }
+    if (lift.lightboxDownTime != 0 && lift.centralDownTime != 0) {
+      if (lift.lightboxDownTime < lift.centralDownTime) {
+        lightboxLead.push_back(lift.centralDownTime - lift.lightboxDownTime);
+      } else {
+        lightboxLag.push_back(lift.lightboxDownTime - lift.centralDownTime);
+      }
+    }
+    missedBuzzer += lift.lightboxDownTime != 0 && lift.lightboxBuzzerTime == 0;
+    if (lift.lightboxShowTime == 0) {
+      missedLights++;
+      continue;
+    }
+    if (lift.lightboxShowTime < lift.majorityTime) {
+      lightsBeforeMajority++;
+    } else {
+      lights.push_back(lift.lightboxShowTime - lift.majorityTime);
+    }
+    if (memcmp(lift.lightboxVotes, lift.finalVotes, 3) != 0) {
+      wrongLights++;
+    }
+    if (memcmp(lift.lightboxVotes, lift.centralVotes, 3) != 0) {
+      disagreements++;
+    }
+  }
+
+  printf("lifts %zu, latency %d ms + 0-%d ms jitter, UDP loss %.1f%%, MQTT loss %.1f%%, MQTT duplicates %.1f%%, "
+         "%s, %s decisions%s, lightbox disconnects %.1f%%%s%s\n",
+         lifts.size(), latencyMs, jitterMs, udpLoss * 100, mqttLoss * 100, mqttDuplicates * 100,
+         useUdp ? "MQTT + UDP" : "MQTT only", binaryDecisions ? "binary" : "text", useFilter ? "" : ", no filter",
+         disconnects * 100, useResync ? "" : ", no resync", useFrames ? ", display frames" : "");
+  printDistribution("majority -> lightbox down", lightboxDown);
+  printDistribution("majority -> central down", centralDown);
+  printDistribution("central -> lightbox down", lightboxLag);
+  printDistribution("lightbox down before central", lightboxLead);
+  printDistribution("majority -> lights shown", lights);
+  printf("violations: no down %d, down before majority %d, down without buzzer %d, no lights %d, "
+         "lights differ from presses %d, lightbox/central disagree %d, lights before majority %d "
+         "(lifts without majority: %d)\n",
+         missedDown, downBeforeMajority, missedBuzzer, missedLights, wrongLights, disagreements,
+         lightsBeforeMajority, noMajority);
+  printf("decisions dropped: %llu duplicate, %llu stale; UDP repeats dropped %llu\n",
+         (unsigned long long)droppedDuplicates, (unsigned long long)droppedStale,
+         (unsigned long long)SimTransport::repeatsDropped);
+  printf("lifts with the lightbox offline: %d, of which missing or wrong down/lights %d; lift status syncs %llu\n",
+         offlineLifts, offlineFailures, (unsigned long long)lightboxSyncs);
+  printf("messages per lift: central publishes %.2f; lightbox receives %.2f copies, handles %.2f "
+         "(decisions %.2f, down %.2f, reset %.2f, status %.2f, frames %.2f)\n",
+         centralPublishes * perLift, lightboxCopies * perLift,
+         (lightboxHandled[HANDLED_DECISION] + lightboxHandled[HANDLED_DOWN] + lightboxHandled[HANDLED_RESET] +
+          lightboxHandled[HANDLED_STATUS] + lightboxHandled[HANDLED_FRAME]) * perLift,
+         lightboxHandled[HANDLED_DECISION] * perLift, lightboxHandled[HANDLED_DOWN] * perLift,
+         lightboxHandled[HANDLED_RESET] * perLift, lightboxHandled[HANDLED_STATUS] * perLift,
+         lightboxHandled[HANDLED_FRAME] * perLift);
+}
+
+// ====== Main ======================================================
+
+static void parseArguments(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : "0";
+    if (strcmp(arg, "--lifts") == 0) {
+      liftCount = atoi(value), i++;
+    } else if (strcmp(arg, "--latency") == 0) {
+      latencyMs = atoi(value), i++;
+    } else if (strcmp(arg, "--jitter") == 0) {
+      jitterMs = atoi(value), i++;
+    } else if (strcmp(arg, "--loss") == 0) {
+      udpLoss = atof(value) / 100, i++;
+    } else if (strcmp(arg, "--mqtt-loss") == 0) {
+      mqttLoss = atof(value) / 100, i++;
+    } else if (strcmp(arg, "--seed") == 0) {
+      srand(atoi(value)), i++;
+    } else if (strcmp(arg, "--no-udp") == 0) {
+      useUdp = false;
+    } else if (strcmp(arg, "--text") == 0) {
+      binaryDecisions = false;
+    } else if (strcmp(arg, "--dup") == 0) {
+      mqttDuplicates = atof(value) / 100, i++;
+    } else if (strcmp(arg, "--no-filter") == 0) {
+      useFilter = false;
+    } else if (strcmp(arg, "--disconnects") == 0) {
+      disconnects = atof(value) / 100, i++;
+    } else if (strcmp(arg, "--no-resync") == 0) {
+      useResync = false;
+    } else if (strcmp(arg, "--frames") == 0) {
+      useFrames = true;
+    } else {
+      fprintf(stderr, "unknown option %s\n", arg);
+      exit(1);
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  srand(1);
+  parseArguments(argc, argv);
+
+  for (int i = 0; i < NODE_COUNT; i++) {
+    nodes[i] = new Node(i);
+  }
+  for (int referee = 1; referee <= 3; referee++) {
+    nodes[NODE_CONTROLLER1 + referee - 1]->mux.setCallback(onControllerMessage);
+    nodes[NODE_CONTROLLER1 + referee - 1]->mux.subscribe(resetTopic);
+  }
+  nodes[NODE_LIGHTBOX]->mux.setCallback(onLightboxMessage);
+  subscribeLightbox();
+  nodes[NODE_CENTRAL]->mux.setCallback(onCentralMessage);
+  nodes[NODE_CENTRAL]->mux.subscribe(decisionTopic);
+
+  schedule(1000, EVENT_LIFT_START, 0);
+  while (!events.empty()) {
+    SimEvent event = events.top();
+    events.pop();
+    simNow = event.time;
+
+    switch (event.kind) {
+      case EVENT_LIFT_START:
+        startLift();
+        break;
+      case EVENT_PRESS:
+        controllerPress(event.node, event.arg);
+        break;
+      case EVENT_DELIVER: {
+        if (!nodes[event.node]->online) {
+          break;
+        }
+        SimTransport &transport = event.arg == TRANSPORT_MQTT ? nodes[event.node]->mqtt : nodes[event.node]->udp;
+        receivingNode = nodes[event.node];
+        lightboxCopies += event.node == NODE_LIGHTBOX;
+        transport.receive(event.topic, event.payload);
+        break;
+      }
+      case EVENT_TICK:
+        lightboxLift.tick();
+        centralLift.tick();
+        break;
+      case EVENT_DISCONNECT:
+        nodes[event.node]->online = false;
+        lifts[currentLift].lightboxOffline = true;
+        break;
+      case EVENT_RECONNECT:
+        nodes[event.node]->online = true;
+        lightboxSynced = false;
+        frameSeen = false;
+        subscribeLightbox();
+        replayRetained(event.node);
+        break;
+    }
+    publishCentralStatus();
+    if (useFrames) {
+      publishCentralFrame();
+    }
+    scheduleTicks();
+  }
+
+  report();
+  return 0;
+}
@@ -0,0 +1,373 @@
+// Exhaustive tests for the lift engine (lift.h/lift.cpp): every decision sequence of up to four
+// presses against a reference of the rules, and every millisecond around each state's window,
+// from several clock start points including the 32-bit wrap.
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=c++11 -IDecisionLightBox -o lifttest Simulator/lifttest.cpp DecisionLightBox/lift.cpp
+//   ./lifttest
+//
+// RPICentralControlBox/RPILaunch.py implements the same rules separately; keep the two in step
+// when a window changes.
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "check.h"
+#include "lift.h"
+
+static uint32_t clockMs = 0;
+
+static uint32_t liftClock() {
+  return clockMs;
+}
+
+struct Reported {
+  LiftAction action;
+  uint8_t referee;
+};
+
+static std::vector<Reported> reported;
+
+static void onAction(LiftAction action, uint8_t referee) {
+  reported.push_back({action, referee});
+}
+
+static bool reportedExactly(const std::vector<Reported>& expected) {
+  if (reported.size() != expected.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < expected.size(); i++) {
+    if (reported[i].action != expected[i].action || reported[i].referee != expected[i].referee) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Clock start points: zero, mid-range, and placed so the windows straddle the 32-bit wrap
+static const uint32_t starts[] = {0, 0x80000000u, 0xFFFFFFFFu - 1500, 0xFFFFFFFFu};
+
+// ====== Decision sequences ======================================================
+
+struct Press {
+  uint8_t referee;
+  bool good;
+};
+
+// The rules from lift.h, written out independently of the transition table
+static LiftState expectedState(const char votes[3], bool downGiven) {
+  if (downGiven) {
+    return LIFT_CHANGE_WINDOW;
+  }
+  int good = 0, bad = 0;
+  for (int i = 0; i < 3; i++) {
+    good += votes[i] == 'g';
+    bad += votes[i] == 'b';
+  }
+  if (good + bad == 0) {
+    return LIFT_IDLE;
+  }
+  if (good == 1 && bad == 1) {
+    return LIFT_SPLIT;
+  }
+  return LIFT_PENDING;
+}
+
+static bool hasMajority(const char votes[3]) {
+  int good = 0, bad = 0;
+  for (int i = 0; i < 3; i++) {
+    good += votes[i] == 'g';
+    bad += votes[i] == 'b';
+  }
+  return good >= 2 || bad >= 2;
+}
+
+// All 6^1 + ... + 6^4 press sequences at one instant: state, votes and a single down signal
+static void testSequences() {
+  int failuresBefore = checkFailures;
+  for (int length = 1; length <= 4; length++) {
+    int combinations = 1;
+    for (int i = 0; i < length; i++) {
+      combinations *= 6;
+    }
+    for (int code = 0; code < combinations; code++) {
+      LiftEngine lift(liftClock, onAction);
+      reported.clear();
+      char votes[3] = {0, 0, 0};
+      bool downGiven = false;
+      int downs = 0;
+      int c = code;
+      for (int i = 0; i < length; i++) {
+        Press press = {(uint8_t)(1 + (c % 6) / 2), (c % 2) == 0};
+        c /= 6;
+        lift.decision(press.referee, press.good);
+        votes[press.referee - 1] = press.good ? 'g' : 'b';
+        if (!downGiven && hasMajority(votes)) {
+          downGiven = true;
+          downs++;
+        }
+        if (!CHECK_EQ(lift.state(), expectedState(votes, downGiven))) {
+          printf("  sequence %d of length %d, after press %d\n", code, length, i + 1);
+        }
+      }
+      for (int r = 1; r <= 3; r++) {
+        CHECK_EQ(lift.vote(r), votes[r - 1]);
+      }
+      int reportedDowns = 0;
+      for (const Reported& r : reported) {
+        reportedDowns += r.action == LIFT_ACTION_DOWN;
+        CHECK(r.action == LIFT_ACTION_DOWN);
+      }
+      CHECK_EQ(reportedDowns, downs);
+    }
+  }
+  CHECK_EQ(checkFailures, failuresBefore);
+}
+
+// ====== Window boundaries ======================================================
+
+// Brings the engine into the state under test at the current clock
+typedef void (*Setup)(LiftEngine& lift);
+
+static void setupSplit(LiftEngine& lift) {
+  lift.decision(1, true);
+  lift.decision(2, false);
+}
+
+static void setupChangeWindow(LiftEngine& lift) {
+  lift.decision(1, true);
+  lift.decision(2, true);
+}
+
+static void setupDownOnly(LiftEngine& lift) {
+  lift.down();
+}
+
+// Cooldown entered at the current clock: the change window is synced as already expired
+static void setupCooldown(LiftEngine& lift) {
+  const char votes[3] = {'g', 'g', 'b'};
+  lift.sync(LIFT_CHANGE_WINDOW, votes, 0);
+  lift.tick();
+}
+
+static void setupPending(LiftEngine& lift) {
+  lift.decision(3, false);
+}
+
+static void setupReminded(LiftEngine& lift) {
+  const char votes[3] = {'g', 'b', 0};
+  lift.sync(LIFT_REMINDED, votes, 0);
+}
+
+struct Window {
+  const char* name;
+  Setup setup;
+  LiftState state;
+  uint32_t timeoutMs;          // LIFT_NO_TIMEOUT for untimed states
+  LiftAction expiryAction;
+  uint8_t expiryReferee;
+  LiftState expiredState;
+};
+
+static const Window windows[] = {
+  {"split", setupSplit, LIFT_SPLIT, LIFT_REMINDER_DELAY_MS, LIFT_ACTION_REMIND, 3, LIFT_REMINDED},
+  {"change window", setupChangeWindow, LIFT_CHANGE_WINDOW, LIFT_CHANGE_WINDOW_MS, LIFT_ACTION_SHOW, 0, LIFT_COOLDOWN},
+  {"down only", setupDownOnly, LIFT_CHANGE_WINDOW, LIFT_CHANGE_WINDOW_MS, LIFT_ACTION_SHOW, 0, LIFT_COOLDOWN},
+  {"cooldown", setupCooldown, LIFT_COOLDOWN, LIFT_COOLDOWN_MS, LIFT_ACTION_CLEAR, 0, LIFT_IDLE},
+  {"pending", setupPending, LIFT_PENDING, LIFT_NO_TIMEOUT, LIFT_ACTION_NONE, 0, LIFT_PENDING},
+  {"reminded", setupReminded, LIFT_REMINDED, LIFT_NO_TIMEOUT, LIFT_ACTION_NONE, 0, LIFT_REMINDED},
+};
+
+// Untimed states are swept over the longest window plus a margin
+#define UNTIMED_SWEEP_MS (LIFT_COOLDOWN_MS + 2)
+
+// Every millisecond from entry to one past the window: time left, and whether tick() expires it
+static void testWindowSweep() {
+  int failuresBefore = checkFailures;
+  for (const Window& w : windows) {
+    bool timed = w.timeoutMs != LIFT_NO_TIMEOUT;
+    uint32_t last = timed ? w.timeoutMs + 1 : UNTIMED_SWEEP_MS;
+    for (uint32_t start : starts) {
+      for (uint32_t d = 0; d <= last; d++) {
+        LiftEngine lift(liftClock, onAction);
+        clockMs = start;
+        w.setup(lift);
+        if (!CHECK_EQ(lift.state(), w.state)) {
+          printf("  %s: setup from %u\n", w.name, start);
+          break;
+        }
+        reported.clear();
+        clockMs = start + d;
+
+        uint32_t expectedLeft = !timed ? LIFT_NO_TIMEOUT : d >= w.timeoutMs ? 0 : w.timeoutMs - d;
+        bool expires = timed && d >= w.timeoutMs;
+        lift.tick();
+        bool ok = CHECK_EQ(lift.state(), expires ? w.expiredState : w.state);
+        if (expires) {
+          ok &= CHECK(reportedExactly({{w.expiryAction, w.expiryReferee}}));
+        } else {
+          ok &= CHECK(reported.empty());
+          ok &= CHECK_EQ(lift.msUntilTimeout(), expectedLeft);
+        }
+        if (!ok) {
+          printf("  %s: %u ms after entry at %u\n", w.name, d, start);
+        }
+      }
+    }
+  }
+  CHECK_EQ(checkFailures, failuresBefore);
+}
+
+// ====== Events at the window edge ======================================================
+
+// An event arriving d ms after the state was entered, with the firmware's timer firing first
+typedef void (*Event)(LiftEngine& lift);
+
+static void thirdGood(LiftEngine& lift) {
+  lift.decision(3, true);
+}
+
+static void firstChangesToBad(LiftEngine& lift) {
+  lift.decision(1, false);
+}
+
+static void secondPress(LiftEngine& lift) {
+  lift.decision(2, true);
+}
+
+static void downSignal(LiftEngine& lift) {
+  lift.down();
+}
+
+struct EdgeCase {
+  const char* name;
+  Setup setup;
+  uint32_t timeoutMs;
+  Event event;
+  // Expected outcome inside the window and once it has expired
+  std::vector<Reported> inside;
+  LiftState insideState;
+  std::vector<Reported> expired;
+  LiftState expiredState;
+};
+
+static void testWindowEdges() {
+  const EdgeCase cases[] = {
+    {"split, third referee decides", setupSplit, LIFT_REMINDER_DELAY_MS, thirdGood,
+     {{LIFT_ACTION_DOWN, 0}}, LIFT_CHANGE_WINDOW,
+     {{LIFT_ACTION_REMIND, 3}, {LIFT_ACTION_DOWN, 0}}, LIFT_CHANGE_WINDOW},
+    {"split, down from the central box", setupSplit, LIFT_REMINDER_DELAY_MS, downSignal,
+     {{LIFT_ACTION_DOWN, 0}}, LIFT_CHANGE_WINDOW,
+     {{LIFT_ACTION_REMIND, 3}, {LIFT_ACTION_DOWN, 0}}, LIFT_CHANGE_WINDOW},
+    {"change window, a referee changes", setupChangeWindow, LIFT_CHANGE_WINDOW_MS, firstChangesToBad,
+     {}, LIFT_CHANGE_WINDOW,
+     {{LIFT_ACTION_SHOW, 0}, {LIFT_ACTION_IGNORE, 1}}, LIFT_COOLDOWN},
+    {"cooldown, next lift's first press", setupCooldown, LIFT_COOLDOWN_MS, secondPress,
+     {{LIFT_ACTION_IGNORE, 2}}, LIFT_COOLDOWN,
+     {{LIFT_ACTION_CLEAR, 0}}, LIFT_PENDING},
+  };
+
+  int failuresBefore = checkFailures;
+  for (const EdgeCase& c : cases) {
+    for (uint32_t start : starts) {
+      for (uint32_t d = 0; d <= c.timeoutMs + 1; d++) {
+        LiftEngine lift(liftClock, onAction);
+        clockMs = start;
+        c.setup(lift);
+        reported.clear();
+        clockMs = start + d;
+        lift.tick();
+        c.event(lift);
+        bool expired = d >= c.timeoutMs;
+        bool ok = CHECK(reportedExactly(expired ? c.expired : c.inside));
+        ok &= CHECK_EQ(lift.state(), expired ? c.expiredState : c.insideState);
+        if (!ok) {
+          printf("  %s: %u ms after entry at %u\n", c.name, d, start);
+        }
+      }
+    }
+  }
+  CHECK_EQ(checkFailures, failuresBefore);
+}
+
+// A vote inside the change window is what the lights show; one after it is not
+static void testChangedVoteShown() {
+  for (uint32_t d : {0u, (uint32_t)LIFT_CHANGE_WINDOW_MS - 1, (uint32_t)LIFT_CHANGE_WINDOW_MS}) {
+    LiftEngine lift(liftClock, onAction);
+    clockMs = 100;
+    setupChangeWindow(lift);
+    clockMs = 100 + d;
+    lift.tick();
+    lift.decision(1, false);
+    clockMs = 100 + LIFT_CHANGE_WINDOW_MS;
+    lift.tick();
+    CHECK_EQ(lift.state(), LIFT_COOLDOWN);
+    CHECK_EQ(lift.vote(1), d < LIFT_CHANGE_WINDOW_MS ? 'b' : 'g');
+  }
+}
+
+// Staying in a state keeps its timer: a repeated press does not extend the split
+static void testTimerNotExtended() {
+  LiftEngine lift(liftClock, onAction);
+  clockMs = 0;
+  setupSplit(lift);
+  clockMs = LIFT_REMINDER_DELAY_MS - 1;
+  lift.decision(1, true);
+  CHECK_EQ(lift.state(), LIFT_SPLIT);
+  CHECK_EQ(lift.msUntilTimeout(), 1);
+  clockMs = LIFT_REMINDER_DELAY_MS;
+  reported.clear();
+  lift.tick();
+  CHECK_EQ(lift.state(), LIFT_REMINDED);
+  CHECK(reportedExactly({{LIFT_ACTION_REMIND, 3}}));
+}
+
+// sync() takes over the remaining time of a timed state, capped at its full window
+static void testSyncRemaining() {
+  const LiftState timedStates[] = {LIFT_SPLIT, LIFT_CHANGE_WINDOW, LIFT_COOLDOWN};
+  const uint32_t timeouts[] = {LIFT_REMINDER_DELAY_MS, LIFT_CHANGE_WINDOW_MS, LIFT_COOLDOWN_MS};
+  const char votes[3] = {'g', 'b', 0};
+  int failuresBefore = checkFailures;
+  for (int s = 0; s < 3; s++) {
+    for (uint32_t start : starts) {
+      for (uint32_t remaining = 0; remaining <= timeouts[s] + 1; remaining++) {
+        LiftEngine lift(liftClock, onAction);
+        clockMs = start;
+        reported.clear();
+        lift.sync(timedStates[s], votes, remaining);
+        CHECK(reported.empty());
+        CHECK_EQ(lift.state(), timedStates[s]);
+        CHECK_EQ(lift.msUntilTimeout(), remaining < timeouts[s] ? remaining : timeouts[s]);
+      }
+    }
+  }
+  CHECK_EQ(checkFailures, failuresBefore);
+}
+
+// A reset clears from every state
+static void testResetEverywhere() {
+  for (const Window& w : windows) {
+    LiftEngine lift(liftClock, onAction);
+    clockMs = 0;
+    w.setup(lift);
+    reported.clear();
+    lift.reset();
+    CHECK_EQ(lift.state(), LIFT_IDLE);
+    CHECK(reportedExactly({{LIFT_ACTION_CLEAR, 0}}));
+    for (int r = 1; r <= 3; r++) {
+      CHECK_EQ(lift.vote(r), 0);
+    }
+  }
+}
+
+int main() {
+  testSequences();
+  testWindowSweep();
+  testWindowEdges();
+  testChangedVoteShown();
+  testTimerNotExtended();
+  testSyncRemaining();
+  testResetEverywhere();
+  return checkResult("lifttest");
+}
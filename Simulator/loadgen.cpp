@@ -0,0 +1,696 @@
+// Load generator for the broker and the owlcms/... topic scheme. Runs hundreds of simulated
+// referee controllers, lightboxes, central boxes, jury devices and an OWLCMS observer as real
+// MQTT clients, using the firmware's vendored PubSubClient over POSIX sockets.
+//
+// Every platform follows a compressed lift cycle: the central box resets the decisions, the
+// three referees press, the central box publishes down on majority. OWLCMS lights the platform
+// LEDs for the lift and reminds one referee to decide, on the led and decisionRequest topics the
+// controllers subscribe to. All devices send their 250 ms heartbeats and retained presence like
+// the firmware does.
+//
+// Build and run from the repository root, against a local Mosquitto or Simulator/brokerd.cpp:
+//   g++ -O2 -std=c++11 -ISimulator/posix -IDecisionLightBox -o loadgen Simulator/loadgen.cpp
+//     Simulator/posix/posix_client.cpp DecisionLightBox/PubSubClient.cpp DecisionLightBox/decision.cpp
+//   ./loadgen --platforms 40 --duration 60
+//
+// Options:
+//   --host HOST       broker address (default 127.0.0.1)
+//   --port N          broker port (default 1883)
+//   --platforms N     platforms, each with 3 controllers, a lightbox and a central box (default 4)
+//   --jury N          jury devices per platform, subscribed to decisions and down (default 1)
+//   --no-owlcms       no venue-wide observer subscribed to owlcms/#
+//   --cycle MS        lift cycle length (default 10000)
+//   --duration S      measured run time (default 30)
+//   --text            controllers send the text decision format (default binary)
+//   --unscoped        controllers subscribe to owlcms/led/# and owlcms/summon/# for every platform,
+//                     as before user-032, to compare the per-controller inbound rate
+//   --broker-pid PID  process to sample for broker CPU (default: the first mosquitto or brokerd found)
+//   --seed N          random seed (default 1)
+//
+// The socket side needs more file descriptors than the default 1024 beyond ~900 devices:
+// raise it with ulimit -n.
+
+#include <dirent.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "posix_client.h"
+#include "PubSubClient.h"
+#include "decision.h"
+
+// Mirrors the firmware and RPILaunch.py
+#define HEARTBEAT_INTERVAL_MS 250
+#define CHANGE_PROBABILITY 0.1
+#define KEEPALIVE_SWEEP_MS 1000
+#define LATENCY_EXPIRY_US 5000000ULL
+
+// ====== Settings ======================================================
+
+static const char *brokerHost = "127.0.0.1";
+static int brokerPort = 1883;
+static int platformCount = 4;
+static int juryPerPlatform = 1;
+static bool owlcmsObserver = true;
+static int cycleMs = 10000;
+static int durationS = 30;
+static bool binaryDecisions = true;
+static bool unscopedControllers = false;
+static int brokerPid = 0;
+
+static double uniform() {
+  return rand() / (RAND_MAX + 1.0);
+}
+
+static uint64_t nowUs() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static uint64_t nowMs() {
+  return nowUs() / 1000;
+}
+
+static uint64_t cpuNs() {
+  struct timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// ====== Devices ======================================================
+
+enum Role { ROLE_CONTROLLER, ROLE_LIGHTBOX, ROLE_CENTRAL, ROLE_JURY, ROLE_OWLCMS, ROLE_COUNT };
+static const char *roleNames[ROLE_COUNT] = {"controller", "lightbox", "central", "jury", "owlcms"};
+
+struct Device {
+  Role role;
+  int platform;
+  int referee;   // 1-3 for controllers
+  char clientId[40];
+  char fop[12];
+  PosixClient net;
+  PubSubClient mqtt;
+  unsigned long heartbeatCount = 0;
+  uint16_t decisionSeq = 0;
+  uint64_t received = 0;
+  uint64_t receiveCpuNs = 0;   // reading, parsing and dispatching inbound packets
+
+  Device() : mqtt(net) {}
+};
+
+// Central box state for one platform, as in RPILaunch.py
+struct Platform {
+  char fop[12];
+  Device *central;
+  std::vector<Device *> controllers;
+  int votes[4];   // 0 none, 1 good, 2 bad
+  bool downSent;
+};
+
+static std::vector<Device *> devices;
+static std::vector<Platform> platforms;
+static Device *currentDevice = NULL;   // PubSubClient callbacks carry no context
+
+// ====== Measurements ======================================================
+
+enum TopicClass { CLASS_DECISION, CLASS_DOWN, CLASS_HEARTBEAT, CLASS_OTHER, CLASS_COUNT };
+static const char *classNames[CLASS_COUNT] = {"decision", "down", "heartbeat", "other"};
+
+static bool measuring = false;
+static uint64_t published[CLASS_COUNT];
+static uint64_t delivered[CLASS_COUNT];
+static std::vector<uint32_t> latencies[CLASS_COUNT];   // microseconds
+static uint64_t publishFailures = 0;
+static uint64_t disconnects = 0;
+
+// Send time of each message in flight, keyed by topic and payload
+static std::map<std::string, uint64_t> inFlight;
+
+static TopicClass classify(const char *topic) {
+  if (strncmp(topic, "owlcms/decision/", 16) == 0) {
+    return CLASS_DECISION;
+  }
+  if (strncmp(topic, "owlcms/fop/down/", 16) == 0) {
+    return CLASS_DOWN;
+  }
+  if (strncmp(topic, "owlcms/heartbeat/", 17) == 0) {
+    return CLASS_HEARTBEAT;
+  }
+  return CLASS_OTHER;
+}
+
+static std::string messageKey(const char *topic, const uint8_t *payload, unsigned int length) {
+  std::string key(topic);
+  key.push_back('\0');
+  key.append((const char *)payload, length);
+  return key;
+}
+
+static void expireInFlight(uint64_t now) {
+  for (std::map<std::string, uint64_t>::iterator it = inFlight.begin(); it != inFlight.end();) {
+    if (now - it->second > LATENCY_EXPIRY_US) {
+      inFlight.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+}
+
+static void publish(Device *device, const char *topic, const uint8_t *payload, unsigned int length,
+                    bool retained = false) {
+  TopicClass topicClass = classify(topic);
+  inFlight[messageKey(topic, payload, length)] = nowUs();
+  bool ok = device->mqtt.publish(topic, payload, length, retained);
+  if (measuring) {
+    published[topicClass]++;
+    if (!ok) {
+      publishFailures++;
+    }
+  }
+}
+
+static void publish(Device *device, const char *topic, const char *payload, bool retained = false) {
+  publish(device, topic, (const uint8_t *)payload, strlen(payload), retained);
+}
+
+// ====== Device behaviour ======================================================
+
+static void centralDecision(Platform &platform, const uint8_t *payload, unsigned int length) {
+  Decision decision;
+  if (platform.downSent || !decodeDecision(payload, length, decision)) {
+    return;
+  }
+  platform.votes[decision.referee] = decision.good ? 1 : 2;
+  int good = 0, bad = 0;
+  for (int referee = 1; referee <= 3; referee++) {
+    good += platform.votes[referee] == 1;
+    bad += platform.votes[referee] == 2;
+  }
+  if (good >= 2 || bad >= 2 || good + bad == 3) {
+    char topic[64];
+    snprintf(topic, sizeof(topic), "owlcms/fop/down/%s", platform.fop);
+    publish(platform.central, topic, "");
+    platform.downSent = true;
+  }
+}
+
+static void onMessage(char *topic, uint8_t *payload, unsigned int length) {
+  uint64_t now = nowUs();
+  Device *device = currentDevice;
+  device->received++;
+
+  TopicClass topicClass = classify(topic);
+  std::map<std::string, uint64_t>::iterator sent = inFlight.find(messageKey(topic, payload, length));
+  if (measuring) {
+    delivered[topicClass]++;
+    if (sent != inFlight.end()) {
+      latencies[topicClass].push_back((uint32_t)(now - sent->second));
+    }
+  }
+
+  if (device->role == ROLE_CENTRAL && topicClass == CLASS_DECISION) {
+    centralDecision(platforms[device->platform], payload, length);
+  }
+}
+
+static bool connectDevice(Device *device) {
+  char presenceTopic[96];
+  snprintf(presenceTopic, sizeof(presenceTopic), "owlcms/presence/%s/%s", device->fop, device->clientId);
+  device->mqtt.setServer(brokerHost, brokerPort);
+  device->mqtt.setCallback(onMessage);
+  device->mqtt.setSocketTimeout(5);
+  if (!device->mqtt.connect(device->clientId, presenceTopic, 1, true, "offline")) {
+    return false;
+  }
+
+  char filter[96];
+  switch (device->role) {
+    case ROLE_CONTROLLER:
+      // Same table as RefereeController/connections.cpp
+      snprintf(filter, sizeof(filter), "owlcms/decisionRequest/%s/+", device->fop);
+      device->mqtt.subscribe(filter, 1);
+      if (unscopedControllers) {
+        device->mqtt.subscribe("owlcms/led/#", 1);
+        device->mqtt.subscribe("owlcms/summon/#", 1);
+      } else {
+        snprintf(filter, sizeof(filter), "owlcms/led/%s/#", device->fop);
+        device->mqtt.subscribe(filter, 1);
+        snprintf(filter, sizeof(filter), "owlcms/summon/%s/#", device->fop);
+        device->mqtt.subscribe(filter, 1);
+      }
+      snprintf(filter, sizeof(filter), "owlcms/reset/%s", device->fop);
+      device->mqtt.subscribe(filter, 1);
+      snprintf(filter, sizeof(filter), "owlcms/fop/resetDecisions/%s", device->fop);
+      device->mqtt.subscribe(filter, 1);
+      snprintf(filter, sizeof(filter), "owlcms/fop/liftState/%s", device->fop);
+      device->mqtt.subscribe(filter, 1);
+      break;
+    case ROLE_LIGHTBOX:
+      snprintf(filter, sizeof(filter), "owlcms/fop/down/%s", device->fop);
+      device->mqtt.subscribe(filter, 1);
+      snprintf(filter, sizeof(filter), "owlcms/decision/%s", device->fop);
+      device->mqtt.subscribe(filter, 1);
+      snprintf(filter, sizeof(filter), "owlcms/fop/resetDecisions/%s", device->fop);
+      device->mqtt.subscribe(filter, 1);
+      break;
+    case ROLE_CENTRAL:
+      snprintf(filter, sizeof(filter), "owlcms/decision/%s", device->fop);
+      device->mqtt.subscribe(filter, 0);
+      snprintf(filter, sizeof(filter), "owlcms/heartbeat/%s/+", device->fop);
+      device->mqtt.subscribe(filter, 0);
+      break;
+    case ROLE_JURY:
+      snprintf(filter, sizeof(filter), "owlcms/decision/%s", device->fop);
+      device->mqtt.subscribe(filter, 1);
+      snprintf(filter, sizeof(filter), "owlcms/fop/down/%s", device->fop);
+      device->mqtt.subscribe(filter, 1);
+      break;
+    default:
+      device->mqtt.subscribe("owlcms/#", 0);
+      break;
+  }
+
+  char presence[48];
+  snprintf(presence, sizeof(presence), "online %s", roleNames[device->role]);
+  publish(device, presenceTopic, presence, true);
+  return true;
+}
+
+static void sendHeartbeat(Device *device) {
+  if (device->role != ROLE_CONTROLLER && device->role != ROLE_LIGHTBOX) {
+    return;
+  }
+  char topic[96];
+  char message[24];
+  snprintf(topic, sizeof(topic), "owlcms/heartbeat/%s/%s", device->fop, device->clientId);
+  if (device->role == ROLE_CONTROLLER) {
+    snprintf(message, sizeof(message), "ref%d %lu", device->referee, device->heartbeatCount++);
+  } else {
+    snprintf(message, sizeof(message), "lightbox %lu", device->heartbeatCount++);
+  }
+  publish(device, topic, message);
+}
+
+static void pressDecision(Device *device, bool good) {
+  Decision decision = {};
+  decision.referee = device->referee;
+  decision.good = good;
+  decision.seq = ++device->decisionSeq;
+  decision.pressedMs = (uint32_t)nowMs();
+
+  char topic[64];
+  snprintf(topic, sizeof(topic), "owlcms/decision/%s", device->fop);
+  uint8_t payload[DECISION_WIRE_SIZE];
+  char text[DECISION_TEXT_SIZE];
+  if (binaryDecisions) {
+    publish(device, topic, payload, encodeDecision(decision, payload, sizeof(payload)));
+  } else {
+    formatDecisionText(decision, text, sizeof(text));
+    publish(device, topic, text);
+  }
+}
+
+// ====== Schedule ======================================================
+
+enum { ACTION_HEARTBEAT, ACTION_LIFT_START, ACTION_PRESS, ACTION_SIGNAL };
+
+// OWLCMS signals to the controllers during a lift, sent from the platform's central box device
+struct Signal {
+  const char *prefix;
+  bool toReferee;   // addressed to one referee, otherwise to all (0)
+  bool on;
+  int delayMs;
+};
+
+static const Signal liftSignals[] = {
+  {"owlcms/led", false, true, 0},
+  {"owlcms/decisionRequest", true, true, 2000},
+  {"owlcms/decisionRequest", true, false, 2600},
+  {"owlcms/led", false, false, 3000},
+};
+#define LIFT_SIGNAL_COUNT (sizeof(liftSignals) / sizeof(liftSignals[0]))
+
+struct Action {
+  uint64_t time;
+  int kind;
+  int target;   // device for heartbeats and presses, platform for lift starts
+  bool good;
+  bool operator>(const Action &other) const { return time > other.time; }
+};
+
+static std::priority_queue<Action, std::vector<Action>, std::greater<Action> > actions;
+
+static void schedule(uint64_t time, int kind, int target, bool good = false) {
+  actions.push(Action{time, kind, target, good});
+}
+
+// The central box resets (as OWLCMS does when the next athlete is called), then the referees
+// press after a reaction time of 0.3-2.5 s; a few change their mind
+static void startLift(int index, uint64_t now) {
+  Platform &platform = platforms[index];
+  memset(platform.votes, 0, sizeof(platform.votes));
+  platform.downSent = false;
+  char topic[64];
+  snprintf(topic, sizeof(topic), "owlcms/fop/resetDecisions/%s", platform.fop);
+  publish(platform.central, topic, "");
+
+  bool goodLift = uniform() < 0.7;
+  for (size_t i = 0; i < platform.controllers.size(); i++) {
+    bool good = uniform() < 0.85 ? goodLift : !goodLift;
+    uint64_t pressTime = now + 300 + rand() % 2200;
+    int device = std::find(devices.begin(), devices.end(), platform.controllers[i]) - devices.begin();
+    schedule(pressTime, ACTION_PRESS, device, good);
+    if (uniform() < CHANGE_PROBABILITY) {
+      schedule(pressTime + 200 + rand() % 2000, ACTION_PRESS, device, !good);
+    }
+  }
+  for (size_t i = 0; i < LIFT_SIGNAL_COUNT; i++) {
+    schedule(now + liftSignals[i].delayMs, ACTION_SIGNAL, index * LIFT_SIGNAL_COUNT + i);
+  }
+  schedule(now + cycleMs, ACTION_LIFT_START, index);
+}
+
+static void sendSignal(int target) {
+  Platform &platform = platforms[target / LIFT_SIGNAL_COUNT];
+  const Signal &signal = liftSignals[target % LIFT_SIGNAL_COUNT];
+  char topic[64];
+  snprintf(topic, sizeof(topic), "%s/%s/%d", signal.prefix, platform.fop, signal.toReferee ? 1 + target % 3 : 0);
+  publish(platform.central, topic, signal.on ? "on" : "off");
+}
+
+static void runActions(uint64_t now) {
+  while (!actions.empty() && actions.top().time <= now) {
+    Action action = actions.top();
+    actions.pop();
+    switch (action.kind) {
+      case ACTION_HEARTBEAT:
+        sendHeartbeat(devices[action.target]);
+        schedule(action.time + HEARTBEAT_INTERVAL_MS, ACTION_HEARTBEAT, action.target);
+        break;
+      case ACTION_LIFT_START:
+        startLift(action.target, now);
+        break;
+      case ACTION_PRESS:
+        pressDecision(devices[action.target], action.good);
+        break;
+      case ACTION_SIGNAL:
+        sendSignal(action.target);
+        break;
+    }
+  }
+}
+
+// ====== Broker CPU ======================================================
+
+static int findBroker() {
+  DIR *proc = opendir("/proc");
+  if (proc == NULL) {
+    return 0;
+  }
+  int pid = 0;
+  struct dirent *entry;
+  while (pid == 0 && (entry = readdir(proc)) != NULL) {
+    char path[300], name[64] = "";
+    snprintf(path, sizeof(path), "/proc/%s/comm", entry->d_name);
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+      continue;
+    }
+    if (fgets(name, sizeof(name), file) != NULL &&
+        (strncmp(name, "mosquitto", 9) == 0 || strncmp(name, "brokerd", 7) == 0)) {
+      pid = atoi(entry->d_name);
+    }
+    fclose(file);
+  }
+  closedir(proc);
+  return pid;
+}
+
+// User plus system time in clock ticks, or -1 if the process cannot be read
+static long brokerCpuTicks() {
+  if (brokerPid == 0) {
+    return -1;
+  }
+  char path[64], line[1024];
+  snprintf(path, sizeof(path), "/proc/%d/stat", brokerPid);
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return -1;
+  }
+  bool ok = fgets(line, sizeof(line), file) != NULL;
+  fclose(file);
+  // The command name may contain spaces; fields resume after the closing parenthesis
+  const char *fields = ok ? strrchr(line, ')') : NULL;
+  unsigned long utime, stime;
+  if (fields == NULL || sscanf(fields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+                               &utime, &stime) != 2) {
+    return -1;
+  }
+  return (long)(utime + stime);
+}
+
+// ====== Report ======================================================
+
+static void printDistribution(const char *name, std::vector<uint32_t> &samples) {
+  if (samples.empty()) {
+    printf("%-22s no samples\n", name);
+    return;
+  }
+  std::sort(samples.begin(), samples.end());
+  size_t n = samples.size();
+  printf("%-22s n=%-8zu p50=%-7.2f p90=%-7.2f p99=%-7.2f max=%.2f ms\n", name, n, samples[n / 2] / 1000.0,
+         samples[n * 9 / 10] / 1000.0, samples[n * 99 / 100] / 1000.0, samples[n - 1] / 1000.0);
+}
+
+static void report(double seconds, long cpuTicks) {
+  printf("%d platforms, %zu devices, %d ms lift cycle, %.1f s measured, broker %s:%d\n", platformCount,
+         devices.size(), cycleMs, seconds, brokerHost, brokerPort);
+
+  printf("publish -> deliver latency\n");
+  for (int i = 0; i < CLASS_COUNT; i++) {
+    char name[32];
+    snprintf(name, sizeof(name), "  %s", classNames[i]);
+    printDistribution(name, latencies[i]);
+  }
+
+  printf("fan-out (deliveries per publish)\n");
+  uint64_t totalPublished = 0, totalDelivered = 0;
+  for (int i = 0; i < CLASS_COUNT; i++) {
+    totalPublished += published[i];
+    totalDelivered += delivered[i];
+    printf("  %-20s %8llu published %9llu delivered  x%.2f\n", classNames[i], (unsigned long long)published[i],
+           (unsigned long long)delivered[i], published[i] ? (double)delivered[i] / published[i] : 0.0);
+  }
+  printf("  %-20s %8llu published %9llu delivered  x%.2f (%.0f msg/s in, %.0f msg/s out)\n", "total",
+         (unsigned long long)totalPublished, (unsigned long long)totalDelivered,
+         totalPublished ? (double)totalDelivered / totalPublished : 0.0, totalPublished / seconds,
+         totalDelivered / seconds);
+
+  printf("messages received per device\n");
+  for (int role = 0; role < ROLE_COUNT; role++) {
+    uint64_t received = 0;
+    int count = 0;
+    for (size_t i = 0; i < devices.size(); i++) {
+      if (devices[i]->role == role) {
+        received += devices[i]->received;
+        count++;
+      }
+    }
+    if (count > 0) {
+      printf("  %-20s %5d devices  %.1f msg/s each\n", roleNames[role], count, received / seconds / count);
+    }
+  }
+
+  // The controller is the constrained device, so its receive cost is the one that matters
+  uint64_t controllerCpuNs = 0;
+  int controllers = 0;
+  for (size_t i = 0; i < devices.size(); i++) {
+    if (devices[i]->role == ROLE_CONTROLLER) {
+      controllerCpuNs += devices[i]->receiveCpuNs;
+      controllers++;
+    }
+  }
+  if (controllers > 0) {
+    printf("controller receive CPU: %.1f us/s each (PubSubClient read, parse and callback)\n",
+           controllerCpuNs / 1000.0 / seconds / controllers);
+  }
+
+  if (cpuTicks >= 0) {
+    printf("broker CPU (pid %d): %.1f%% of one core\n", brokerPid, 100.0 * cpuTicks / sysconf(_SC_CLK_TCK) / seconds);
+  } else {
+    printf("broker CPU: not sampled (use --broker-pid)\n");
+  }
+  printf("errors: %llu failed publishes, %llu disconnects\n", (unsigned long long)publishFailures,
+         (unsigned long long)disconnects);
+}
+
+// ====== Main ======================================================
+
+static void parseArguments(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : "0";
+    if (strcmp(arg, "--host") == 0) {
+      brokerHost = value, i++;
+    } else if (strcmp(arg, "--port") == 0) {
+      brokerPort = atoi(value), i++;
+    } else if (strcmp(arg, "--platforms") == 0) {
+      platformCount = atoi(value), i++;
+    } else if (strcmp(arg, "--jury") == 0) {
+      juryPerPlatform = atoi(value), i++;
+    } else if (strcmp(arg, "--cycle") == 0) {
+      cycleMs = atoi(value), i++;
+    } else if (strcmp(arg, "--duration") == 0) {
+      durationS = atoi(value), i++;
+    } else if (strcmp(arg, "--broker-pid") == 0) {
+      brokerPid = atoi(value), i++;
+    } else if (strcmp(arg, "--seed") == 0) {
+      srand(atoi(value)), i++;
+    } else if (strcmp(arg, "--no-owlcms") == 0) {
+      owlcmsObserver = false;
+    } else if (strcmp(arg, "--text") == 0) {
+      binaryDecisions = false;
+    } else if (strcmp(arg, "--unscoped") == 0) {
+      unscopedControllers = true;
+    } else {
+      fprintf(stderr, "unknown option %s\n", arg);
+      exit(1);
+    }
+  }
+}
+
+static Device *addDevice(Role role, int platform, int referee, const char *fop) {
+  Device *device = new Device();
+  device->role = role;
+  device->platform = platform;
+  device->referee = referee;
+  snprintf(device->fop, sizeof(device->fop), "%s", fop);
+  // Controllers and lightboxes use the firmware's id format, with the device index as the MAC
+  unsigned index = devices.size();
+  if (role == ROLE_CONTROLLER) {
+    snprintf(device->clientId, sizeof(device->clientId), "replogic-ref-0200%08x", index);
+  } else if (role == ROLE_LIGHTBOX) {
+    snprintf(device->clientId, sizeof(device->clientId), "replogic-lightbox-0200%08x", index);
+  } else {
+    snprintf(device->clientId, sizeof(device->clientId), "load-%s-%s%d", fop, roleNames[role], referee);
+  }
+  devices.push_back(device);
+  return device;
+}
+
+static void buildVenue() {
+  platforms.resize(platformCount);
+  for (int p = 0; p < platformCount; p++) {
+    Platform &platform = platforms[p];
+    if (p < 26) {
+      snprintf(platform.fop, sizeof(platform.fop), "%c", 'A' + p);
+    } else {
+      snprintf(platform.fop, sizeof(platform.fop), "P%d", p + 1);
+    }
+    for (int referee = 1; referee <= 3; referee++) {
+      platform.controllers.push_back(addDevice(ROLE_CONTROLLER, p, referee, platform.fop));
+    }
+    addDevice(ROLE_LIGHTBOX, p, 0, platform.fop);
+    platform.central = addDevice(ROLE_CENTRAL, p, 0, platform.fop);
+    for (int jury = 1; jury <= juryPerPlatform; jury++) {
+      addDevice(ROLE_JURY, p, jury, platform.fop);
+    }
+  }
+  if (owlcmsObserver) {
+    addDevice(ROLE_OWLCMS, 0, 0, "venue");
+  }
+}
+
+int main(int argc, char **argv) {
+  srand(1);
+  parseArguments(argc, argv);
+  if (brokerPid == 0) {
+    brokerPid = findBroker();
+  }
+  buildVenue();
+
+  for (size_t i = 0; i < devices.size(); i++) {
+    if (!connectDevice(devices[i])) {
+      fprintf(stderr, "%s could not connect to %s:%d (state %d)\n", devices[i]->clientId, brokerHost, brokerPort,
+              devices[i]->mqtt.state());
+      return 1;
+    }
+  }
+  printf("%zu devices connected\n", devices.size());
+
+  // Spread heartbeats and lift starts so the platforms are not in lockstep
+  uint64_t start = nowMs();
+  for (size_t i = 0; i < devices.size(); i++) {
+    schedule(start + rand() % HEARTBEAT_INTERVAL_MS, ACTION_HEARTBEAT, i);
+  }
+  for (int p = 0; p < platformCount; p++) {
+    schedule(start + rand() % cycleMs, ACTION_LIFT_START, p);
+  }
+
+  measuring = true;
+  long cpuStart = brokerCpuTicks();
+  uint64_t end = start + durationS * 1000ULL;
+  uint64_t nextSweep = start + KEEPALIVE_SWEEP_MS;
+  std::vector<struct pollfd> fds(devices.size());
+
+  while (nowMs() < end) {
+    uint64_t now = nowMs();
+    runActions(now);
+
+    int timeout = actions.empty() ? 50 : (int)std::min<uint64_t>(50, actions.top().time > now ? actions.top().time - now : 0);
+    for (size_t i = 0; i < devices.size(); i++) {
+      fds[i].fd = devices[i]->net.fd();
+      fds[i].events = POLLIN;
+      fds[i].revents = 0;
+    }
+    poll(fds.data(), fds.size(), timeout);
+
+    // Each loop() call handles one packet, so drain whatever is buffered
+    for (size_t i = 0; i < devices.size(); i++) {
+      if (fds[i].revents == 0) {
+        continue;
+      }
+      Device *device = devices[i];
+      currentDevice = device;
+      uint64_t cpuStart = cpuNs();
+      while (device->mqtt.loop() && device->net.available()) {
+      }
+      if (measuring) {
+        device->receiveCpuNs += cpuNs() - cpuStart;
+      }
+    }
+
+    // Keepalive pings and reconnects
+    now = nowMs();
+    if (now >= nextSweep) {
+      nextSweep = now + KEEPALIVE_SWEEP_MS;
+      expireInFlight(nowUs());
+      for (size_t i = 0; i < devices.size(); i++) {
+        Device *device = devices[i];
+        currentDevice = device;
+        if (!device->mqtt.loop()) {
+          disconnects++;
+          connectDevice(device);
+        }
+      }
+    }
+  }
+
+  double seconds = (nowMs() - start) / 1000.0;
+  long cpuEnd = brokerCpuTicks();
+  report(seconds, cpuStart >= 0 && cpuEnd >= 0 ? cpuEnd - cpuStart : -1);
+
+  for (size_t i = 0; i < devices.size(); i++) {
+    devices[i]->mqtt.disconnect();
+  }
+  return 0;
+}
@@ -0,0 +1,332 @@
+// Loopback latency of the decision path: a sending TransportMux (the controller) and a receiving
+// one (the lightbox) with MQTT through a broker, the UDP multicast fast path, or both as the
+// firmware runs them. Both transports are Linux versions of MqttTransport and UdpTransport;
+// the frame codec, sequence window and de-duplication are the firmware's own.
+//
+// Build and run from the repository root, with a broker on the host (Mosquitto or
+// Simulator/brokerd.cpp):
+//   g++ -O2 -std=c++11 -pthread -ISimulator/posix -IDecisionLightBox -o pathlatency Simulator/pathlatency.cpp
+//     Simulator/posix/posix_client.cpp DecisionLightBox/PubSubClient.cpp DecisionLightBox/decision.cpp
+//     DecisionLightBox/transport.cpp
+//   ./pathlatency --port 1883
+//
+// Options:
+//   --host HOST     broker address (default 127.0.0.1)
+//   --port N        broker port (default 1883)
+//   --samples N     decisions per mode (default 2000)
+//   --interval MS   gap between decisions (default 5)
+//
+// Loopback has no radio, so this measures what the code and the broker hop cost, not WiFi.
+// Multicast needs a route for 239.0.0.0/8 on lo; the tool joins the group on 127.0.0.1.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "posix_client.h"
+#include "PubSubClient.h"
+#include "decision.h"
+#include "transport.h"
+
+#define RECEIVE_TIMEOUT_US 1000000
+
+static const char* brokerHost = "127.0.0.1";
+static int brokerPort = 1883;
+static int sampleCount = 2000;
+static int intervalMs = 5;
+
+static uint64_t nowUs() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+// ====== Host transports ======================================================
+
+// PubSubClient callbacks carry no context; only the receiving side subscribes
+static TransportMux* mqttReceiver = NULL;
+
+class HostMqttTransport : public Transport {
+public:
+  PosixClient net;
+  PubSubClient client;
+
+  HostMqttTransport() : client(net) {}
+  bool begin(const char* clientId) {
+    client.setServer(brokerHost, brokerPort);
+    client.setCallback(onMessage);
+    return client.connect(clientId);
+  }
+  bool connected() override { return client.connected(); }
+  bool publish(const char* topic, const uint8_t* payload, unsigned int length) override {
+    return client.publish(topic, payload, length);
+  }
+  bool subscribe(const char* topicFilter) override {
+    mqttReceiver = mux;
+    return client.subscribe(topicFilter, 1);
+  }
+  bool unsubscribe(const char* topicFilter) override { return client.unsubscribe(topicFilter); }
+  // One packet per PubSubClient::loop() call, so drain what is buffered
+  void loop() override {
+    while (client.loop() && net.available()) {
+    }
+  }
+
+private:
+  static void onMessage(char* topic, uint8_t* payload, unsigned int length) {
+    mqttReceiver->deliver(TRANSPORT_MQTT, topic, payload, length, nowUs() / 1000);
+  }
+};
+
+// UdpTransport over a POSIX socket, joined to the multicast group on loopback
+class HostUdpTransport : public Transport {
+public:
+  bool begin(uint32_t senderId) {
+    this->senderId = senderId;
+    sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    int reuse = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
+
+    struct sockaddr_in local = {};
+    local.sin_family = AF_INET;
+    local.sin_port = htons(UDP_MULTICAST_PORT);
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    uint8_t group[4] = {UDP_MULTICAST_GROUP};
+    struct ip_mreq membership = {};
+    memcpy(&membership.imr_multiaddr.s_addr, group, 4);
+    membership.imr_interface.s_addr = htonl(INADDR_LOOPBACK);
+    struct in_addr interface = {};
+    interface.s_addr = htonl(INADDR_LOOPBACK);
+    uint8_t ttl = 1;
+    uint8_t loop = 1;
+
+    if (bind(sock, (struct sockaddr*)&local, sizeof(local)) < 0 ||
+        setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) < 0 ||
+        setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof(interface)) < 0 ||
+        setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0 ||
+        setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0) {
+      perror("multicast");
+      close(sock);
+      sock = -1;
+      return false;
+    }
+    fcntl(sock, F_SETFL, O_NONBLOCK);
+    return true;
+  }
+  int fd() const { return sock; }
+
+  bool connected() override { return sock >= 0; }
+  bool publish(const char* topic, const uint8_t* payload, unsigned int length) override {
+    size_t frameLength = encodeUdpFrame(frame, UDP_FRAME_MAX_SIZE, senderId, nextSeq++, topic, payload, length);
+    struct sockaddr_in group = {};
+    group.sin_family = AF_INET;
+    group.sin_port = htons(UDP_MULTICAST_PORT);
+    uint8_t address[4] = {UDP_MULTICAST_GROUP};
+    memcpy(&group.sin_addr.s_addr, address, 4);
+    bool sent = false;
+    for (int i = 0; i < UDP_REPEAT; i++) {
+      sent |= sendto(sock, frame, frameLength, 0, (struct sockaddr*)&group, sizeof(group)) == (ssize_t)frameLength;
+    }
+    return sent;
+  }
+  bool subscribe(const char* topicFilter) override {
+    filter = topicFilter;
+    return true;
+  }
+  bool unsubscribe(const char*) override {
+    filter = NULL;
+    return true;
+  }
+  void loop() override {
+    while (true) {
+      ssize_t length = recv(sock, frame, UDP_FRAME_MAX_SIZE + 1, MSG_DONTWAIT);
+      if (length < 0) {
+        return;
+      }
+      uint32_t sender, seq;
+      char* topic;
+      uint8_t* payload;
+      unsigned int payloadLength;
+      if (length > UDP_FRAME_MAX_SIZE || !decodeUdpFrame(frame, length, sender, seq, topic, payload, payloadLength)) {
+        continue;
+      }
+      if (sender == senderId || !window.accept(sender, seq) || filter == NULL || !topicMatches(filter, topic)) {
+        continue;
+      }
+      mux->deliver(id, topic, payload, payloadLength, nowUs() / 1000);
+    }
+  }
+
+private:
+  int sock = -1;
+  uint32_t senderId = 0;
+  uint32_t nextSeq = 1;
+  const char* filter = NULL;
+  SequenceWindow window;
+  uint8_t frame[UDP_FRAME_MAX_SIZE + 1];
+};
+
+// ====== Measurement ======================================================
+
+static const char decisionTopic[] = "owlcms/decision/A";
+
+// Receive time of each decision by sequence number, written by the receiving thread
+static std::vector<std::atomic<uint64_t> >* arrivals = NULL;
+static std::atomic<int> duplicates(0);
+static std::atomic<bool> receiving(false);
+
+static void onDecision(char*, uint8_t* payload, unsigned int length) {
+  Decision decision;
+  if (!decodeDecision(payload, length, decision) || decision.seq == 0 || decision.seq > arrivals->size()) {
+    return;
+  }
+  uint64_t expected = 0;
+  if (!(*arrivals)[decision.seq - 1].compare_exchange_strong(expected, nowUs())) {
+    duplicates++;
+  }
+}
+
+// The lightbox side runs on its own thread, as it would on its own device
+static void receiveLoop(TransportMux* receiver, HostMqttTransport* mqtt, HostUdpTransport* udp) {
+  struct pollfd fds[2];
+  int count = 0;
+  if (mqtt != NULL) {
+    fds[count].fd = mqtt->net.fd();
+    fds[count++].events = POLLIN;
+  }
+  if (udp != NULL) {
+    fds[count].fd = udp->fd();
+    fds[count++].events = POLLIN;
+  }
+  while (receiving) {
+    poll(fds, count, 10);
+    receiver->loop();
+  }
+}
+
+static void printDistribution(const char* name, std::vector<uint32_t>& samples, int lost) {
+  if (samples.empty()) {
+    printf("%-10s no samples\n", name);
+    return;
+  }
+  std::sort(samples.begin(), samples.end());
+  size_t n = samples.size();
+  printf("%-10s n=%-6zu p50=%-7.1f p90=%-7.1f p99=%-7.1f max=%-8.1f us  lost=%d duplicates=%d\n", name, n,
+         (double)samples[n / 2], (double)samples[n * 9 / 10], (double)samples[n * 99 / 100],
+         (double)samples[n - 1], lost, duplicates.load());
+}
+
+// Sends sampleCount decisions and times each until the receiver's callback sees it
+static void measure(const char* name, TransportMux& sender, TransportMux& receiver, HostMqttTransport* mqtt,
+                    HostUdpTransport* udp) {
+  std::vector<std::atomic<uint64_t> > received(sampleCount);
+  for (int i = 0; i < sampleCount; i++) {
+    received[i] = 0;
+  }
+  arrivals = &received;
+  duplicates = 0;
+  receiving = true;
+  std::thread receiverThread(receiveLoop, &receiver, mqtt, udp);
+
+  std::vector<uint32_t> samples;
+  int lost = 0;
+  for (int i = 0; i < sampleCount; i++) {
+    Decision decision = {};
+    decision.referee = 1 + i % 3;
+    decision.good = i % 2 == 0;
+    decision.seq = (uint16_t)(i + 1);
+    uint8_t payload[DECISION_WIRE_SIZE];
+    size_t length = encodeDecision(decision, payload, sizeof(payload));
+
+    uint64_t sentUs = nowUs();
+    sender.publish(decisionTopic, payload, length);
+    // Sleep rather than spin: the receive time is taken on the other thread, which needs the CPU
+    while (received[i] == 0 && nowUs() - sentUs < RECEIVE_TIMEOUT_US) {
+      usleep(100);
+    }
+    if (received[i] == 0) {
+      lost++;
+    } else {
+      samples.push_back((uint32_t)(received[i] - sentUs));
+    }
+    // Let late copies land (and be de-duplicated) before the next decision
+    usleep(intervalMs * 1000);
+  }
+
+  receiving = false;
+  receiverThread.join();
+  printDistribution(name, samples, lost);
+}
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : "0";
+    if (strcmp(arg, "--host") == 0) {
+      brokerHost = value, i++;
+    } else if (strcmp(arg, "--port") == 0) {
+      brokerPort = atoi(value), i++;
+    } else if (strcmp(arg, "--samples") == 0) {
+      sampleCount = atoi(value), i++;
+    } else if (strcmp(arg, "--interval") == 0) {
+      intervalMs = atoi(value), i++;
+    } else {
+      fprintf(stderr, "unknown option %s\n", arg);
+      return 2;
+    }
+  }
+
+  HostMqttTransport controllerMqtt, lightboxMqtt;
+  HostUdpTransport controllerUdp, lightboxUdp;
+  if (!controllerMqtt.begin("pathlatency-controller") || !lightboxMqtt.begin("pathlatency-lightbox")) {
+    fprintf(stderr, "cannot connect to %s:%d\n", brokerHost, brokerPort);
+    return 1;
+  }
+  if (!controllerUdp.begin(1) || !lightboxUdp.begin(2)) {
+    return 1;
+  }
+
+  printf("decision %s -> callback, %d samples per mode, broker %s:%d\n", decisionTopic, sampleCount, brokerHost,
+         brokerPort);
+
+  TransportMux mqttSender, mqttReceiver;
+  mqttSender.add(controllerMqtt, TRANSPORT_MQTT);
+  mqttReceiver.add(lightboxMqtt, TRANSPORT_MQTT);
+  mqttReceiver.setCallback(onDecision);
+  mqttReceiver.subscribe(decisionTopic);
+  measure("mqtt", mqttSender, mqttReceiver, &lightboxMqtt, NULL);
+  mqttReceiver.unsubscribe(decisionTopic);
+
+  TransportMux udpSender, udpReceiver;
+  udpSender.add(controllerUdp, TRANSPORT_UDP);
+  udpReceiver.add(lightboxUdp, TRANSPORT_UDP);
+  udpReceiver.setCallback(onDecision);
+  udpReceiver.subscribe(decisionTopic);
+  measure("udp", udpSender, udpReceiver, NULL, &lightboxUdp);
+  udpReceiver.unsubscribe(decisionTopic);
+
+  // As the firmware runs: both paths, first copy wins, the second is dropped by the mux
+  TransportMux sender, receiver;
+  sender.add(controllerMqtt, TRANSPORT_MQTT);
+  sender.add(controllerUdp, TRANSPORT_UDP);
+  receiver.add(lightboxMqtt, TRANSPORT_MQTT);
+  receiver.add(lightboxUdp, TRANSPORT_UDP);
+  receiver.setCallback(onDecision);
+  receiver.subscribe(decisionTopic);
+  measure("both", sender, receiver, &lightboxMqtt, &lightboxUdp);
+  return 0;
+}
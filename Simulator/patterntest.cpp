@@ -0,0 +1,254 @@
+// Tests for the controller's LED and haptic sequencer (pattern.h/pattern.cpp) on a virtual clock:
+// step timing of every pattern, durations and the levels held after them, the breathing glide,
+// per-channel intensity, and the soft-start ramp of the motors. The engine is ticked the way the
+// esp_timer drives it: at each msUntilNext() deadline, and again with callbacks running late.
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=c++11 -IRefereeController -o patterntest Simulator/patterntest.cpp RefereeController/pattern.cpp
+//   ./patterntest
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "check.h"
+#include "pattern.h"
+
+// Longest a soft-started motor may take from off to full: the ramp plus the tick that starts it
+#define SOFT_START_BOUND_MS (PATTERN_SOFT_START_MS + PATTERN_RAMP_STEP_MS)
+
+struct Write {
+  uint32_t ms;   // since the pattern started
+  uint8_t channel;
+  uint8_t level;
+};
+
+static uint32_t startMs = 0;
+static uint32_t nowMs = 0;
+static std::vector<Write> writes;
+
+static uint32_t testClock() {
+  return nowMs;
+}
+
+static void testWriter(uint8_t channel, uint8_t level) {
+  writes.push_back({nowMs - startMs, channel, level});
+}
+
+static PatternEngine engine(testClock, testWriter);
+
+static void setUp(uint32_t start) {
+  startMs = nowMs = start;
+  writes.clear();
+  engine = PatternEngine(testClock, testWriter);
+}
+
+// Ticks at every deadline until untilMs after the start, each callback up to lateMs late
+static void runUntil(uint32_t untilMs, uint32_t lateMs = 0) {
+  while (true) {
+    uint32_t wait = engine.msUntilNext();
+    if (wait == PATTERN_NO_TIMEOUT) {
+      nowMs = startMs + untilMs;
+      return;
+    }
+    // Like schedulePattern(): never less than 1 ms
+    uint32_t next = nowMs + (wait > 0 ? wait : 1) + (lateMs > 0 ? rand() % (lateMs + 1) : 0);
+    if (next - startMs > untilMs) {
+      nowMs = startMs + untilMs;
+      return;
+    }
+    nowMs = next;
+    engine.tick();
+  }
+}
+
+// Level of a channel at ms after the start, from the writes
+static uint8_t levelAt(uint8_t channel, uint32_t ms) {
+  uint8_t level = 0;
+  for (const Write& w : writes) {
+    if (w.ms > ms) {
+      break;
+    }
+    if (w.channel == channel) {
+      level = w.level;
+    }
+  }
+  return level;
+}
+
+// Time of the first write that takes a channel to level, at or after fromMs
+static uint32_t reachedAt(uint8_t channel, uint8_t level, uint32_t fromMs) {
+  for (const Write& w : writes) {
+    if (w.ms >= fromMs && w.channel == channel && w.level == level) {
+      return w.ms;
+    }
+  }
+  return PATTERN_NO_TIMEOUT;
+}
+
+// A motor never rises faster than full scale per PATTERN_SOFT_START_MS
+static void checkRiseLimited(uint8_t channel) {
+  uint32_t lastMs = 0;
+  uint8_t last = 0;
+  for (const Write& w : writes) {
+    if (w.channel != channel) {
+      continue;
+    }
+    if (w.level > last && !CHECK((uint32_t)(w.level - last) * PATTERN_SOFT_START_MS <= (w.ms - lastMs) * 255)) {
+      printf("  channel %d rose %d -> %d in %u ms\n", channel, last, w.level, w.ms - lastMs);
+    }
+    lastMs = w.ms;
+    last = w.level;
+  }
+}
+
+// The LED follows the steps exactly; the motors ramp up, drop at once, and stop with the pattern
+static void testReminder(uint32_t start) {
+  setUp(start);
+  engine.play(PATTERN_REMINDER);
+  runUntil(4000);
+  // LED on throughout and held after the 3 s
+  CHECK_EQ(reachedAt(PATTERN_LED, 255, 0), 0);
+  CHECK_EQ(levelAt(PATTERN_LED, 3999), 255);
+  for (uint8_t motor = PATTERN_HAPTIC1; motor <= PATTERN_HAPTIC2; motor++) {
+    checkRiseLimited(motor);
+    // A double buzz every second: 0-150 and 250-400 ms of each
+    for (uint32_t cycle = 0; cycle < 3000; cycle += 1000) {
+      uint32_t full = reachedAt(motor, 255, cycle);
+      CHECK(full >= cycle + PATTERN_SOFT_START_MS && full <= cycle + SOFT_START_BOUND_MS);
+      CHECK_EQ(reachedAt(motor, 0, cycle + 1), cycle + 150);
+      full = reachedAt(motor, 255, cycle + 250);
+      CHECK(full >= cycle + 250 + PATTERN_SOFT_START_MS && full <= cycle + 250 + SOFT_START_BOUND_MS);
+      CHECK_EQ(reachedAt(motor, 0, cycle + 251), cycle + 400);
+    }
+    CHECK_EQ(levelAt(motor, 3999), 0);
+  }
+  // Nothing left to do after the duration
+  CHECK_EQ(engine.msUntilNext(), PATTERN_NO_TIMEOUT);
+  CHECK_EQ(engine.current(), PATTERN_REMINDER);
+}
+
+static void testSummon() {
+  setUp(1000);
+  engine.play(PATTERN_SUMMON);
+  runUntil(6000);
+  int buzzes = 0;
+  for (const Write& w : writes) {
+    buzzes += w.channel == PATTERN_HAPTIC1 && w.level == 0;
+  }
+  // 250 ms on, 250 ms off for 5 s
+  CHECK_EQ(buzzes, 10);
+  CHECK_EQ(reachedAt(PATTERN_HAPTIC1, 0, 4501), 4750);
+  CHECK_EQ(levelAt(PATTERN_HAPTIC2, 5999), 0);
+  CHECK_EQ(levelAt(PATTERN_LED, 5999), 255);
+  checkRiseLimited(PATTERN_HAPTIC1);
+  checkRiseLimited(PATTERN_HAPTIC2);
+}
+
+// Played once, then everything off and idle
+static void testBoot() {
+  setUp(0);
+  engine.play(PATTERN_BOOT);
+  runUntil(1000);
+  CHECK_EQ(reachedAt(PATTERN_LED, 0, 1), 120);
+  CHECK_EQ(reachedAt(PATTERN_LED, 255, 1), 220);
+  CHECK_EQ(reachedAt(PATTERN_LED, 0, 221), 340);
+  CHECK_EQ(levelAt(PATTERN_HAPTIC1, 999), 0);
+  CHECK_EQ(engine.msUntilNext(), PATTERN_NO_TIMEOUT);
+}
+
+// The LED breathes, tracking the glide to within what PATTERN_RAMP_STEP_MS allows, until stopped
+static void testDisconnectGlide() {
+  setUp(0xFFFFFFFF - 3000);
+  engine.play(PATTERN_DISCONNECT);
+  runUntil(20000);
+  for (const Write& w : writes) {
+    CHECK_EQ(w.channel, PATTERN_LED);
+  }
+  const int slack = 255 * PATTERN_RAMP_STEP_MS / 2560 + 1;
+  int failuresBefore = checkFailures;
+  for (uint32_t ms = 0; ms < 20000 && checkFailures == failuresBefore; ms++) {
+    uint32_t t = ms % 5120;
+    int expected = t < 2560 ? 255 * t / 2560 : 255 - 255 * (t - 2560) / 2560;
+    int level = levelAt(PATTERN_LED, ms);
+    if (!CHECK(level >= expected - slack && level <= expected + slack)) {
+      printf("  LED %d at %u ms, expected %d\n", level, ms, expected);
+    }
+  }
+  CHECK(engine.msUntilNext() != PATTERN_NO_TIMEOUT);
+  engine.stop(PATTERN_DISCONNECT);
+  CHECK_EQ(writes.back().level, 0);
+  CHECK_EQ(engine.msUntilNext(), PATTERN_NO_TIMEOUT);
+}
+
+static void testIntensity() {
+  setUp(0);
+  engine.setIntensity(PATTERN_HAPTIC1, 50);
+  engine.setIntensity(PATTERN_LED, 0);
+  engine.play(PATTERN_SUMMON);
+  runUntil(1000);
+  uint8_t highest[PATTERN_CHANNELS] = {};
+  for (const Write& w : writes) {
+    highest[w.channel] = w.level > highest[w.channel] ? w.level : highest[w.channel];
+  }
+  CHECK_EQ(highest[PATTERN_LED], 0);
+  CHECK_EQ(highest[PATTERN_HAPTIC1], 127);
+  CHECK_EQ(highest[PATTERN_HAPTIC2], 255);
+  // A weaker motor reaches its level no later than a full one
+  CHECK(reachedAt(PATTERN_HAPTIC1, 127, 0) <= reachedAt(PATTERN_HAPTIC2, 255, 0));
+}
+
+// Late timer callbacks: the ramp earns only the time that passed, and the steps still end on time
+// within the lateness
+static void testLateTicks() {
+  for (int run = 0; run < 50; run++) {
+    setUp(rand());
+    engine.play(PATTERN_REMINDER);
+    runUntil(3500, 4);
+    checkRiseLimited(PATTERN_HAPTIC1);
+    checkRiseLimited(PATTERN_HAPTIC2);
+    uint32_t off = reachedAt(PATTERN_HAPTIC1, 0, 1);
+    CHECK(off >= 150 && off <= 154);
+    CHECK_EQ(levelAt(PATTERN_HAPTIC1, 3499), 0);
+  }
+}
+
+// Playing the running pattern again leaves it alone; stopping another pattern does nothing;
+// stopping it turns everything off at once
+static void testPlayAndStop() {
+  setUp(0);
+  engine.play(PATTERN_SUMMON);
+  runUntil(100);
+  size_t before = writes.size();
+  engine.play(PATTERN_SUMMON);
+  CHECK_EQ(writes.size(), before);
+  engine.stop(PATTERN_REMINDER);
+  CHECK_EQ(engine.current(), PATTERN_SUMMON);
+  CHECK_EQ(writes.size(), before);
+  engine.stop(PATTERN_SUMMON);
+  CHECK_EQ(engine.current(), PATTERN_NONE);
+  for (uint8_t c = 0; c < PATTERN_CHANNELS; c++) {
+    CHECK_EQ(levelAt(c, 100), 0);
+  }
+  CHECK_EQ(engine.msUntilNext(), PATTERN_NO_TIMEOUT);
+  // A new pattern starts from the top, its motors ramping from off again
+  engine.play(PATTERN_REMINDER);
+  runUntil(400);
+  CHECK(reachedAt(PATTERN_HAPTIC1, 255, 100) >= 100 + PATTERN_SOFT_START_MS);
+  checkRiseLimited(PATTERN_HAPTIC1);
+}
+
+int main() {
+  srand(1);
+  const uint32_t starts[] = {0, 5000, 0xFFFFFFFF - 1500};
+  for (uint32_t start : starts) {
+    testReminder(start);
+  }
+  testSummon();
+  testBoot();
+  testDisconnectGlide();
+  testIntensity();
+  testLateTicks();
+  testPlayAndStop();
+  return checkResult("patterntest");
+}
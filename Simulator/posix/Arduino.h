@@ -0,0 +1,27 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+// Minimal stand-in for the Arduino core so the vendored PubSubClient builds on Linux.
+// Only what PubSubClient uses is provided; this is not an Arduino emulation.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define PROGMEM
+#define pgm_read_byte_near(address) (*(const uint8_t *)(address))
+
+inline unsigned long millis() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long)(now.tv_sec * 1000UL + now.tv_nsec / 1000000UL);
+}
+
+inline void yield() {}
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef PRINT_H
+#define PRINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t value) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size) {
+    size_t written = 0;
+    while (size-- && write(*buffer++)) {
+      written++;
+    }
+    return written;
+  }
+};
+
+#endif
@@ -0,0 +1,139 @@
+#include "posix_client.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+int PosixClient::connectTo(const struct sockaddr *address, unsigned int length) {
+  stop();
+  sock = socket(AF_INET, SOCK_STREAM, 0);
+  if (sock < 0) {
+    return 0;
+  }
+  if (::connect(sock, address, length) != 0) {
+    stop();
+    return 0;
+  }
+  // Small latency-critical packets, like the firmware's lwIP default
+  int one = 1;
+  setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  closed = false;
+  inputStart = inputEnd = 0;
+  return 1;
+}
+
+int PosixClient::connect(IPAddress ip, uint16_t port) {
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  uint8_t octets[4] = {ip[0], ip[1], ip[2], ip[3]};
+  memcpy(&address.sin_addr, octets, 4);
+  return connectTo((struct sockaddr *)&address, sizeof(address));
+}
+
+int PosixClient::connect(const char *host, uint16_t port) {
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  char service[8];
+  snprintf(service, sizeof(service), "%u", port);
+  struct addrinfo *result = NULL;
+  if (getaddrinfo(host, service, &hints, &result) != 0 || result == NULL) {
+    return 0;
+  }
+  int connectedOk = connectTo(result->ai_addr, result->ai_addrlen);
+  freeaddrinfo(result);
+  return connectedOk;
+}
+
+size_t PosixClient::write(const uint8_t *buffer, size_t size) {
+  size_t written = 0;
+  while (sock >= 0 && written < size) {
+    ssize_t sent = send(sock, buffer + written, size - written, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      closed = true;
+      break;
+    }
+    written += sent;
+  }
+  return written;
+}
+
+// Pull whatever the kernel has without blocking
+void PosixClient::fill() {
+  if (sock < 0 || closed) {
+    return;
+  }
+  if (inputStart == inputEnd) {
+    inputStart = inputEnd = 0;
+  }
+  if (inputEnd == sizeof(input)) {
+    return;
+  }
+  ssize_t received = recv(sock, input + inputEnd, sizeof(input) - inputEnd, MSG_DONTWAIT);
+  if (received > 0) {
+    inputEnd += received;
+  } else if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+    closed = true;
+  }
+}
+
+int PosixClient::available() {
+  if (inputStart == inputEnd) {
+    fill();
+  }
+  return inputEnd - inputStart;
+}
+
+int PosixClient::read() {
+  if (!available()) {
+    return -1;
+  }
+  return input[inputStart++];
+}
+
+int PosixClient::read(uint8_t *buffer, size_t size) {
+  size_t count = available();
+  if (count > size) {
+    count = size;
+  }
+  memcpy(buffer, input + inputStart, count);
+  inputStart += count;
+  return count ? (int)count : -1;
+}
+
+int PosixClient::peek() {
+  if (!available()) {
+    return -1;
+  }
+  return input[inputStart];
+}
+
+void PosixClient::stop() {
+  if (sock >= 0) {
+    close(sock);
+  }
+  sock = -1;
+  inputStart = inputEnd = 0;
+}
+
+// Still connected while unread data remains, as the Arduino clients behave
+uint8_t PosixClient::connected() {
+  if (sock < 0) {
+    return 0;
+  }
+  if (inputStart == inputEnd) {
+    fill();
+  }
+  return !closed || inputStart != inputEnd;
+}
@@ -0,0 +1,38 @@
+#ifndef POSIX_CLIENT_H
+#define POSIX_CLIENT_H
+
+#include "Client.h"
+
+#define POSIX_CLIENT_BUFFER_SIZE 1024
+
+// Arduino Client over a plain TCP socket, so PubSubClient can run on Linux.
+// Reads are buffered and never block; writes block until the kernel takes the data.
+class PosixClient : public Client {
+public:
+  ~PosixClient() { stop(); }
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(const char *host, uint16_t port) override;
+  size_t write(uint8_t value) override { return write(&value, 1); }
+  size_t write(const uint8_t *buffer, size_t size) override;
+  int available() override;
+  int read() override;
+  int read(uint8_t *buffer, size_t size) override;
+  int peek() override;
+  void flush() override {}
+  void stop() override;
+  uint8_t connected() override;
+  operator bool() override { return sock >= 0; }
+  int fd() const { return sock; }
+
+private:
+  int sock = -1;
+  bool closed = false;
+  uint8_t input[POSIX_CLIENT_BUFFER_SIZE];
+  size_t inputStart = 0;
+  size_t inputEnd = 0;
+
+  int connectTo(const struct sockaddr *address, unsigned int length);
+  void fill();
+};
+
+#endif
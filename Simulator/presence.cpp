@@ -0,0 +1,217 @@
+// Offline-detection latency for a referee controller, against a broker on the host (Mosquitto or
+// Simulator/brokerd.cpp). A simulated controller connects like the firmware (retained offline
+// will on its presence topic, 250 ms heartbeats), runs for a while, then fails. An observer
+// stands in for the central box: it watches the presence topic and runs the same missed-heartbeat
+// monitor as RPILaunch.py.
+//
+// Two kinds of failure:
+//   cut     the socket closes without DISCONNECT (reset, crash): the broker sends the will at once
+//   silent  the device stops talking but the connection stays up (power or WiFi lost, no FIN):
+//           only the heartbeat monitor notices before the keep-alive runs out
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=c++11 -ISimulator/posix -IDecisionLightBox -o presence Simulator/presence.cpp
+//     Simulator/posix/posix_client.cpp DecisionLightBox/PubSubClient.cpp DecisionLightBox/topics.cpp
+//   ./presence --port 1883 --trials 20
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+
+#include "posix_client.h"
+#include "PubSubClient.h"
+#include "topics.h"
+
+// Mirrors the firmware and RPILaunch.py
+#define HEARTBEAT_INTERVAL_MS 250
+#define HEARTBEAT_TIMEOUT_MS 750
+#define MONITOR_INTERVAL_MS 50
+#define DEVICE_KEEPALIVE_S 20
+
+// How long to wait for each detection after the failure
+#define DETECTION_WAIT_MS 3000
+
+static const char* brokerHost = "127.0.0.1";
+static int brokerPort = 1883;
+static int trialCount = 20;
+
+static const char fop[] = "A";
+static const char deviceId[] = "replogic-ref-02000000beef";
+
+static uint64_t nowUs() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+// ====== Observer ======================================================
+
+static char presenceTopic[TOPIC_CLIENT_SIZE(TOPIC_PREFIX_PRESENCE)];
+static char heartbeatTopic[TOPIC_CLIENT_SIZE(TOPIC_PREFIX_HEARTBEAT)];
+
+static uint64_t lastHeartbeatUs = 0;
+static uint64_t willUs = 0;
+
+static void onObserved(char* topic, uint8_t* payload, unsigned int length) {
+  if (strcmp(topic, heartbeatTopic) == 0) {
+    lastHeartbeatUs = nowUs();
+  } else if (strcmp(topic, presenceTopic) == 0 && length == 7 && memcmp(payload, "offline", 7) == 0) {
+    willUs = nowUs();
+  }
+}
+
+// ====== Trials ======================================================
+
+struct Result {
+  std::vector<uint32_t> will;        // failure -> offline will delivered, us
+  std::vector<uint32_t> heartbeat;   // failure -> heartbeat monitor marks offline, us
+  int willMissed = 0;
+  int heartbeatMissed = 0;
+};
+
+static void pump(PosixClient& net, PubSubClient& client, int timeoutMs) {
+  struct pollfd fd = {net.fd(), POLLIN, 0};
+  poll(&fd, 1, timeoutMs);
+  while (client.loop() && net.available()) {
+  }
+}
+
+static bool runTrial(PubSubClient& observer, PosixClient& observerNet, bool silent, Result& result) {
+  PosixClient deviceNet;
+  PubSubClient device(deviceNet);
+  device.setServer(brokerHost, brokerPort);
+  device.setKeepAlive(DEVICE_KEEPALIVE_S);
+  if (!device.connect(deviceId, "", "", presenceTopic, 1, true, "offline", false)) {
+    fprintf(stderr, "device could not connect (state %d)\n", device.state());
+    return false;
+  }
+  device.publish(presenceTopic, "online ref 1", true);
+
+  // Heartbeats for 1-2 s, then the failure at a random point between two beats
+  willUs = 0;
+  lastHeartbeatUs = 0;
+  uint64_t runUntil = nowUs() + (1000 + rand() % 1000) * 1000ULL;
+  uint64_t nextBeat = nowUs();
+  unsigned long beat = 0;
+  while (nowUs() < runUntil) {
+    if (nowUs() >= nextBeat) {
+      char message[24];
+      TextWriter(message).text("ref1 ").integer(beat++);
+      device.publish(heartbeatTopic, message);
+      nextBeat += HEARTBEAT_INTERVAL_MS * 1000;
+    }
+    device.loop();
+    pump(observerNet, observer, 5);
+  }
+
+  uint64_t failedUs = nowUs();
+  if (!silent) {
+    deviceNet.stop();
+  }
+
+  // The central box's monitor, sampled as often as RPILaunch.py samples it
+  uint64_t markedUs = 0;
+  uint64_t nextCheck = failedUs;
+  // A silent device's will only comes when the keep-alive runs out, far past the wait
+  while (nowUs() - failedUs < DETECTION_WAIT_MS * 1000ULL && (markedUs == 0 || (willUs == 0 && !silent))) {
+    pump(observerNet, observer, 5);
+    uint64_t now = nowUs();
+    if (now >= nextCheck) {
+      if (markedUs == 0 && lastHeartbeatUs != 0 && now - lastHeartbeatUs > HEARTBEAT_TIMEOUT_MS * 1000ULL) {
+        markedUs = now;
+      }
+      nextCheck += MONITOR_INTERVAL_MS * 1000;
+    }
+  }
+
+  if (willUs != 0) {
+    result.will.push_back((uint32_t)(willUs - failedUs));
+  } else if (!silent) {
+    result.willMissed++;
+  }
+  if (markedUs != 0) {
+    result.heartbeat.push_back((uint32_t)(markedUs - failedUs));
+  } else {
+    result.heartbeatMissed++;
+  }
+  deviceNet.stop();
+  // Let the will of a silent device arrive before the next trial reuses the id
+  uint64_t settle = nowUs() + 100000;
+  while (nowUs() < settle) {
+    pump(observerNet, observer, 5);
+  }
+  return true;
+}
+
+static void printDistribution(const char* name, std::vector<uint32_t>& samples, int missed) {
+  if (samples.empty()) {
+    printf("  %-10s not detected within %d ms (%d trials)\n", name, DETECTION_WAIT_MS, missed);
+    return;
+  }
+  std::sort(samples.begin(), samples.end());
+  size_t n = samples.size();
+  printf("  %-10s n=%-4zu min=%-7.1f p50=%-7.1f p90=%-7.1f max=%-7.1f ms", name, n, samples[0] / 1000.0,
+         samples[n / 2] / 1000.0, samples[n * 9 / 10] / 1000.0, samples[n - 1] / 1000.0);
+  if (missed > 0) {
+    printf("  (%d not detected within %d ms)", missed, DETECTION_WAIT_MS);
+  }
+  printf("\n");
+}
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : "0";
+    if (strcmp(arg, "--host") == 0) {
+      brokerHost = value, i++;
+    } else if (strcmp(arg, "--port") == 0) {
+      brokerPort = atoi(value), i++;
+    } else if (strcmp(arg, "--trials") == 0) {
+      trialCount = atoi(value), i++;
+    } else if (strcmp(arg, "--seed") == 0) {
+      srand(atoi(value)), i++;
+    } else {
+      fprintf(stderr, "unknown option %s\n", arg);
+      return 2;
+    }
+  }
+
+  buildTopic(presenceTopic, TOPIC_PREFIX_PRESENCE, fop, deviceId);
+  buildTopic(heartbeatTopic, TOPIC_PREFIX_HEARTBEAT, fop, deviceId);
+
+  PosixClient observerNet;
+  PubSubClient observer(observerNet);
+  observer.setServer(brokerHost, brokerPort);
+  observer.setCallback(onObserved);
+  if (!observer.connect("presence-observer")) {
+    fprintf(stderr, "cannot connect to %s:%d\n", brokerHost, brokerPort);
+    return 1;
+  }
+  observer.subscribe(presenceTopic, 1);
+  observer.subscribe(heartbeatTopic, 0);
+
+  printf("%s, %d trials per failure, heartbeat %d ms, monitor timeout %d ms, keep-alive %d s\n", deviceId,
+         trialCount, HEARTBEAT_INTERVAL_MS, HEARTBEAT_TIMEOUT_MS, DEVICE_KEEPALIVE_S);
+  const char* names[2] = {"cut", "silent"};
+  for (int silent = 0; silent < 2; silent++) {
+    Result result;
+    for (int t = 0; t < trialCount; t++) {
+      if (!runTrial(observer, observerNet, silent, result)) {
+        return 1;
+      }
+    }
+    printf("%s\n", names[silent]);
+    if (silent) {
+      printf("  %-10s not before the broker's keep-alive expiry (1.5 x %d s)\n", "will", DEVICE_KEEPALIVE_S);
+    } else {
+      printDistribution("will", result.will, result.willMissed);
+    }
+    fflush(stdout);
+    printDistribution("heartbeat", result.heartbeat, result.heartbeatMissed);
+  }
+  return 0;
+}
@@ -0,0 +1,214 @@
+// Reconnect storm simulator: a fleet of devices loses the broker at once (the central box reboots or
+// its broker restarts) and reconnects through the firmware's ReconnectPolicy (backoff.cpp,
+// unchanged), on a virtual clock. It reports how long the whole fleet takes to be back online
+// after the broker returns, and the peak rate of connection attempts the broker sees once it is
+// back (over any 1 s window).
+//
+// The broker is modelled as an accept queue, not run: while it is down every attempt is refused;
+// once up it handles one CONNECT at a time, each taking --connect-ms, with at most --backlog
+// waiting. A full backlog refuses the attempt. A device that gets no CONNACK within the
+// firmware's 5 s socket timeout gives up, and the broker still spends the time on its CONNECT
+// later. A device retries when its policy is due, at its next 10 ms loop pass.
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=c++11 -IDecisionLightBox -o reconnectsim Simulator/reconnectsim.cpp DecisionLightBox/backoff.cpp
+//   ./reconnectsim --devices 50 --outage 8000
+//   ./reconnectsim --connect-ms 200 --backlog 16
+//   ./reconnectsim --base 5000 --cap 5000      (fixed 5 s retries, as before the policy)
+//
+// Options:
+//   --devices N       devices reconnecting (default 50)
+//   --outage MS       broker down for this long after the devices lose it (default 5000)
+//   --spread MS       devices notice the loss uniformly over 0..MS (default 0: all at once,
+//                     as when a restarted broker resets every connection)
+//   --connect-ms MS   broker time per CONNECT, TLS handshake included (default 50)
+//   --backlog N       connections waiting for the broker before it refuses more (default 64)
+//   --base MS         ReconnectPolicy base delay (default RECONNECT_BASE_MS)
+//   --cap MS          ReconnectPolicy cap (default RECONNECT_CAP_MS)
+//   --runs N          storms to simulate, each with its own random draws (default 100)
+//   --seed N          random seed (default 1)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <deque>
+#include <queue>
+#include <random>
+#include <vector>
+
+#include "backoff.h"
+
+// mqttClient.setSocketTimeout(5) in both firmwares
+#define CONNECT_TIMEOUT_MS 5000
+// LOOP_POLL_MS: the loop polls this often while MQTT is down
+#define LOOP_POLL_MS 10
+#define RATE_WINDOW_MS 1000
+
+static int deviceCount = 50;
+static uint32_t outageMs = 5000;
+static uint32_t spreadMs = 0;
+static uint32_t connectMs = 50;
+static size_t backlog = 64;
+static uint32_t baseMs = RECONNECT_BASE_MS;
+static uint32_t capMs = RECONNECT_CAP_MS;
+static int runs = 100;
+
+static std::mt19937 random32(1);
+
+// ====== One storm ======================================================
+
+struct Attempt {
+  uint64_t time;
+  int device;
+  bool operator>(const Attempt& other) const { return time > other.time; }
+};
+
+struct StormResult {
+  uint64_t allOnlineMs;   // after the broker came back
+  uint64_t medianOnlineMs;
+  int peakRate;           // attempts in the busiest RATE_WINDOW_MS once the broker is back
+  int attempts;
+  int refused;            // broker down or backlog full
+  int timedOut;           // queued, no CONNACK in time
+};
+
+static StormResult runStorm() {
+  std::vector<ReconnectPolicy> policies(deviceCount, ReconnectPolicy(baseMs, capMs));
+  std::priority_queue<Attempt, std::vector<Attempt>, std::greater<Attempt>> attempts;
+  std::deque<uint64_t> queued;   // completion times of CONNECTs the broker has accepted
+  std::vector<uint64_t> attemptTimes;
+  std::vector<uint64_t> onlineTimes;
+  StormResult result = {};
+
+  // The first attempt is made at once, as mqttReconnect() does on a fresh disconnect
+  for (int device = 0; device < deviceCount; device++) {
+    attempts.push({spreadMs > 0 ? random32() % (spreadMs + 1) : 0, device});
+  }
+
+  while (!attempts.empty()) {
+    Attempt attempt = attempts.top();
+    attempts.pop();
+    result.attempts++;
+    uint64_t now = attempt.time;
+
+    uint64_t failedAt = now;
+    bool connected = false;
+    if (now >= outageMs) {
+      attemptTimes.push_back(now);
+      while (!queued.empty() && queued.front() <= now) {
+        queued.pop_front();
+      }
+      if (queued.size() < backlog) {
+        uint64_t start = queued.empty() ? now : queued.back();
+        uint64_t done = start + connectMs;
+        queued.push_back(done);
+        if (done - now <= CONNECT_TIMEOUT_MS) {
+          onlineTimes.push_back(done - outageMs);
+          connected = true;
+        } else {
+          failedAt = now + CONNECT_TIMEOUT_MS;
+          result.timedOut++;
+        }
+      } else {
+        result.refused++;
+      }
+    } else {
+      result.refused++;
+    }
+    if (connected) {
+      continue;
+    }
+
+    ReconnectPolicy& policy = policies[attempt.device];
+    policy.failed((uint32_t)failedAt, random32());
+    // The next loop pass after the policy is due
+    uint64_t due = failedAt;
+    while (!policy.due((uint32_t)due)) {
+      due += LOOP_POLL_MS;
+    }
+    attempts.push({due + random32() % LOOP_POLL_MS, attempt.device});
+  }
+
+  std::sort(onlineTimes.begin(), onlineTimes.end());
+  result.allOnlineMs = onlineTimes.back();
+  result.medianOnlineMs = onlineTimes[onlineTimes.size() / 2];
+  std::sort(attemptTimes.begin(), attemptTimes.end());
+  for (size_t first = 0, last = 0; last < attemptTimes.size(); last++) {
+    while (attemptTimes[last] - attemptTimes[first] >= RATE_WINDOW_MS) {
+      first++;
+    }
+    result.peakRate = std::max(result.peakRate, (int)(last - first + 1));
+  }
+  return result;
+}
+
+// ====== Report ======================================================
+
+template <typename T>
+static void printDistribution(const char* name, std::vector<T>& samples, const char* unit) {
+  std::sort(samples.begin(), samples.end());
+  size_t n = samples.size();
+  printf("%-28s p50=%-6lld p90=%-6lld max=%lld %s\n", name, (long long)samples[n / 2],
+         (long long)samples[n * 9 / 10], (long long)samples[n - 1], unit);
+}
+
+static void parseArguments(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : "0";
+    if (strcmp(arg, "--devices") == 0) {
+      deviceCount = atoi(value), i++;
+    } else if (strcmp(arg, "--outage") == 0) {
+      outageMs = atoi(value), i++;
+    } else if (strcmp(arg, "--spread") == 0) {
+      spreadMs = atoi(value), i++;
+    } else if (strcmp(arg, "--connect-ms") == 0) {
+      connectMs = atoi(value), i++;
+    } else if (strcmp(arg, "--backlog") == 0) {
+      backlog = atoi(value), i++;
+    } else if (strcmp(arg, "--base") == 0) {
+      baseMs = atoi(value), i++;
+    } else if (strcmp(arg, "--cap") == 0) {
+      capMs = atoi(value), i++;
+    } else if (strcmp(arg, "--runs") == 0) {
+      runs = atoi(value), i++;
+    } else if (strcmp(arg, "--seed") == 0) {
+      random32.seed(atoi(value)), i++;
+    } else {
+      fprintf(stderr, "unknown option %s\n", arg);
+      exit(1);
+    }
+  }
+  if (deviceCount < 1 || runs < 1 || backlog < 1 || connectMs < 1 || baseMs < 1 || capMs < baseMs) {
+    fprintf(stderr, "need --devices, --runs, --backlog, --connect-ms and --base of at least 1, --cap >= --base\n");
+    exit(1);
+  }
+}
+
+int main(int argc, char** argv) {
+  parseArguments(argc, argv);
+
+  std::vector<uint64_t> allOnline, medianOnline;
+  std::vector<int> peakRates, attempts, refused, timedOut;
+  for (int run = 0; run < runs; run++) {
+    StormResult result = runStorm();
+    allOnline.push_back(result.allOnlineMs);
+    medianOnline.push_back(result.medianOnlineMs);
+    peakRates.push_back(result.peakRate);
+    attempts.push_back(result.attempts);
+    refused.push_back(result.refused);
+    timedOut.push_back(result.timedOut);
+  }
+
+  printf("%d devices, %d runs, broker down %u ms, loss noticed over %u ms, %u ms per CONNECT, backlog %zu, "
+         "backoff %u-%u ms\n",
+         deviceCount, runs, outageMs, spreadMs, connectMs, backlog, baseMs, capMs);
+  printDistribution("time to all online", allOnline, "ms after the broker is back");
+  printDistribution("time to half online", medianOnline, "ms after the broker is back");
+  printDistribution("peak connect rate", peakRates, "attempts/s");
+  printDistribution("attempts per storm", attempts, "");
+  printDistribution("refused per storm", refused, "");
+  printDistribution("timed out per storm", timedOut, "");
+  return 0;
+}
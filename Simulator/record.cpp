@@ -0,0 +1,148 @@
+// Records all owlcms/# traffic from a broker into a capture file (see capture.h), with
+// microsecond timestamps, for later replay against the lightbox logic.
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=c++11 -ISimulator/posix -IDecisionLightBox -o record Simulator/record.cpp
+//     Simulator/capture.cpp Simulator/posix/posix_client.cpp DecisionLightBox/PubSubClient.cpp
+//   ./record --host 192.168.1.10 --output meet.rlcp
+//
+// Options:
+//   --host HOST       broker address (default 127.0.0.1)
+//   --port N          broker port (default 1883)
+//   --output FILE     capture file (default capture.rlcp)
+//   --topic FILTER    topic filter to record (default owlcms/#)
+//   --duration S      stop after S seconds (default: until Ctrl-C)
+//
+// The file is flushed every second, so a capture stays usable if the recorder is killed.
+
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "posix_client.h"
+#include "PubSubClient.h"
+#include "capture.h"
+
+#define RECORD_CLIENT_ID "replogic-recorder"
+#define RECORD_BUFFER_SIZE 4096   // OWLCMS publishes larger payloads than the devices
+#define RECORD_FLUSH_MS 1000
+#define RECORD_RECONNECT_MS 2000
+
+static const char *brokerHost = "127.0.0.1";
+static int brokerPort = 1883;
+static const char *outputPath = "capture.rlcp";
+static const char *topicFilter = "owlcms/#";
+static int durationS = 0;
+
+static volatile sig_atomic_t stopRequested = 0;
+static PosixClient net;
+static PubSubClient mqtt(net);
+static CaptureWriter writer;
+static uint64_t startUs = 0;
+static uint64_t bytesReceived = 0;
+
+static uint64_t nowUs() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static uint64_t epochUs() {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_usec;
+}
+
+static void onStop(int) {
+  stopRequested = 1;
+}
+
+static void onMessage(char *topic, uint8_t *payload, unsigned int length) {
+  if (!writer.write(nowUs() - startUs, topic, payload, length)) {
+    fprintf(stderr, "write to %s failed\n", outputPath);
+    stopRequested = 1;
+  }
+  bytesReceived += length;
+}
+
+static bool connectBroker() {
+  if (!mqtt.connect(RECORD_CLIENT_ID)) {
+    fprintf(stderr, "cannot connect to %s:%d (state %d)\n", brokerHost, brokerPort, mqtt.state());
+    return false;
+  }
+  mqtt.subscribe(topicFilter, 0);
+  printf("recording %s from %s:%d into %s\n", topicFilter, brokerHost, brokerPort, outputPath);
+  return true;
+}
+
+static void parseArguments(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : "0";
+    if (strcmp(arg, "--host") == 0) {
+      brokerHost = value, i++;
+    } else if (strcmp(arg, "--port") == 0) {
+      brokerPort = atoi(value), i++;
+    } else if (strcmp(arg, "--output") == 0) {
+      outputPath = value, i++;
+    } else if (strcmp(arg, "--topic") == 0) {
+      topicFilter = value, i++;
+    } else if (strcmp(arg, "--duration") == 0) {
+      durationS = atoi(value), i++;
+    } else {
+      fprintf(stderr, "unknown option %s\n", arg);
+      exit(1);
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  parseArguments(argc, argv);
+  signal(SIGINT, onStop);
+  signal(SIGTERM, onStop);
+
+  if (!writer.open(outputPath, epochUs())) {
+    fprintf(stderr, "cannot create %s\n", outputPath);
+    return 1;
+  }
+  startUs = nowUs();
+  mqtt.setServer(brokerHost, brokerPort);
+  mqtt.setCallback(onMessage);
+  mqtt.setBufferSize(RECORD_BUFFER_SIZE);
+  mqtt.setSocketTimeout(5);
+  if (!connectBroker()) {
+    return 1;
+  }
+
+  uint64_t nextFlush = nowUs() + RECORD_FLUSH_MS * 1000;
+  uint64_t end = durationS > 0 ? startUs + durationS * 1000000ULL : 0;
+  while (!stopRequested && (end == 0 || nowUs() < end)) {
+    struct pollfd fd = {net.fd(), POLLIN, 0};
+    poll(&fd, 1, 100);
+    // Each loop() call handles one packet, so drain whatever is buffered
+    while (mqtt.loop() && net.available()) {
+    }
+
+    if (!mqtt.connected()) {
+      // Traffic while we are away is lost; the gap shows in the timestamps
+      fprintf(stderr, "connection lost, reconnecting\n");
+      usleep(RECORD_RECONNECT_MS * 1000);
+      connectBroker();
+    }
+    if (nowUs() >= nextFlush) {
+      writer.flush();
+      nextFlush = nowUs() + RECORD_FLUSH_MS * 1000;
+    }
+  }
+
+  mqtt.disconnect();
+  writer.close();
+  printf("%llu messages, %llu payload bytes in %.1f s\n", (unsigned long long)writer.records(),
+         (unsigned long long)bytesReceived, (nowUs() - startUs) / 1e6);
+  return 0;
+}
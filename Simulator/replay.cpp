@@ -0,0 +1,296 @@
+// Replays a capture (see capture.h) into the lightbox's decision logic compiled natively:
+// the transport mux, the decision decoder and the lift engine, on the capture's clock.
+// Every change of the lights is logged; --expect compares the log against a previous run
+// so a reproduced incident becomes a regression check.
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=c++11 -IDecisionLightBox -o replay Simulator/replay.cpp Simulator/capture.cpp
+//     DecisionLightBox/lift.cpp DecisionLightBox/decision.cpp DecisionLightBox/transport.cpp
+//   ./replay meet.rlcp --fop A --lights meet-A.lights
+//   ./replay meet.rlcp --fop A --expect meet-A.lights
+//
+// Options:
+//   --fop NAME        platform whose lightbox is replayed (default A)
+//   --speed X         1 replays in real time, 2 twice as fast; 0 as fast as possible (default 0)
+//   --lights FILE     write the light log ("-" for stdout)
+//   --expect FILE     compare the light log with FILE; exits with 1 on the first difference
+//   --verbose         print every replayed message of the platform
+//
+// The capture is memory-mapped and read in place, so a day-long file does not need to fit in RAM.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "capture.h"
+#include "decision.h"
+#include "lift.h"
+#include "transport.h"
+
+// Run on past the last message long enough for a pending down to show its lights
+#define REPLAY_TAIL_MS LIFT_CHANGE_WINDOW_MS
+
+static const char *fop = "A";
+static double speed = 0;
+static const char *lightsPath = NULL;
+static const char *expectPath = NULL;
+static bool verbose = false;
+
+// ====== Lightbox logic on the capture clock ======================================================
+
+static uint64_t replayUs = 0;
+
+static uint32_t replayClock() {
+  return (uint32_t)(replayUs / 1000);
+}
+
+static void onLiftAction(LiftAction action, uint8_t referee);
+
+static LiftEngine lift(replayClock, onLiftAction);
+static TransportMux transport;
+static DecisionFilter decisionFilter;
+
+static char decisionTopic[48];
+static char downSignalTopic[48];
+static char resetDecisionsTopic[48];
+
+struct LightsState {
+  bool downLed;
+  char votes[3];   // 'g', 'b' or 0 while the decision lights are off
+};
+
+static LightsState lights = {};
+static std::vector<std::string> lightLog;
+static uint64_t decisionCount = 0;
+static uint64_t invalidDecisions = 0;
+static uint64_t droppedDecisions = 0;
+
+static void logLights(const char *event) {
+  char line[64];
+  snprintf(line, sizeof(line), "%llu.%03llu %s %c%c%c", (unsigned long long)(replayUs / 1000000),
+           (unsigned long long)(replayUs / 1000 % 1000), event, lights.votes[0] ? lights.votes[0] : '-',
+           lights.votes[1] ? lights.votes[1] : '-', lights.votes[2] ? lights.votes[2] : '-');
+  lightLog.push_back(line);
+  if (verbose) {
+    printf("  lights: %s\n", line);
+  }
+}
+
+// Same handling as onLiftAction() in the lightbox, with the pins replaced by LightsState
+static void onLiftAction(LiftAction action, uint8_t) {
+  switch (action) {
+    case LIFT_ACTION_DOWN:
+      lights.downLed = true;
+      logLights("down");
+      break;
+    case LIFT_ACTION_SHOW:
+      lights.downLed = false;
+      for (int i = 0; i < 3; i++) {
+        lights.votes[i] = lift.vote(i + 1);
+      }
+      logLights("show");
+      break;
+    case LIFT_ACTION_CLEAR:
+      if (lights.downLed || lights.votes[0] || lights.votes[1] || lights.votes[2]) {
+        lights = LightsState();
+        logLights("clear");
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+// Same topic dispatch as callback() in the lightbox
+static void callback(char *topic, uint8_t *payload, unsigned int length) {
+  if (strncmp(topic, decisionTopic, strlen(decisionTopic)) == 0) {
+    Decision decision;
+    decisionCount++;
+    if (decodeDecision(payload, length, decision)) {
+      DecisionVerdict verdict = decisionFilter.check(decision);
+      if (verdict == DECISION_DUPLICATE || verdict == DECISION_STALE) {
+        droppedDecisions++;
+        return;
+      }
+      if (verdict == DECISION_NEW_EPOCH) {
+        lift.reset();
+      }
+      lift.decision(decision.referee, decision.good);
+    } else {
+      invalidDecisions++;
+    }
+  }
+  if (strncmp(topic, resetDecisionsTopic, strlen(resetDecisionsTopic)) == 0 &&
+      decisionFilter.reset(parseEpoch(payload, length))) {
+    lift.reset();
+  }
+  if (strncmp(topic, downSignalTopic, strlen(downSignalTopic)) == 0) {
+    lift.down();
+  }
+}
+
+// Fires the lift timeouts due before timeUs at their exact times
+static void advanceTo(uint64_t timeUs) {
+  for (;;) {
+    uint32_t remaining = lift.msUntilTimeout();
+    if (remaining == LIFT_NO_TIMEOUT || replayUs + remaining * 1000ULL > timeUs) {
+      break;
+    }
+    replayUs += remaining * 1000ULL;
+    lift.tick();
+  }
+  replayUs = timeUs;
+}
+
+// ====== Pacing ======================================================
+
+static uint64_t wallStartUs = 0;
+
+static uint64_t nowUs() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static void pace(uint64_t timeUs) {
+  if (speed <= 0) {
+    return;
+  }
+  uint64_t dueUs = wallStartUs + (uint64_t)(timeUs / speed);
+  uint64_t now = nowUs();
+  if (dueUs > now) {
+    usleep(dueUs - now);
+  }
+}
+
+// ====== Light logs ======================================================
+
+static bool writeLights(const char *path) {
+  FILE *file = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+  if (file == NULL) {
+    return false;
+  }
+  for (size_t i = 0; i < lightLog.size(); i++) {
+    fprintf(file, "%s\n", lightLog[i].c_str());
+  }
+  if (file != stdout) {
+    fclose(file);
+  }
+  return true;
+}
+
+// Returns 0 when the logs match, 1 on a difference, -1 if the file cannot be read
+static int compareLights(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return -1;
+  }
+  char line[128];
+  size_t index = 0;
+  int result = 0;
+  while (result == 0 && fgets(line, sizeof(line), file) != NULL) {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (index >= lightLog.size()) {
+      printf("expected %s, replay ended\n", line);
+      result = 1;
+    } else if (lightLog[index] != line) {
+      printf("line %zu: expected %s, got %s\n", index + 1, line, lightLog[index].c_str());
+      result = 1;
+    }
+    index++;
+  }
+  if (result == 0 && index < lightLog.size()) {
+    printf("line %zu: unexpected %s\n", index + 1, lightLog[index].c_str());
+    result = 1;
+  }
+  fclose(file);
+  return result;
+}
+
+// ====== Main ======================================================
+
+int main(int argc, char **argv) {
+  const char *capturePath = NULL;
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : "0";
+    if (strcmp(arg, "--fop") == 0) {
+      fop = value, i++;
+    } else if (strcmp(arg, "--speed") == 0) {
+      speed = atof(value), i++;
+    } else if (strcmp(arg, "--lights") == 0) {
+      lightsPath = value, i++;
+    } else if (strcmp(arg, "--expect") == 0) {
+      expectPath = value, i++;
+    } else if (strcmp(arg, "--verbose") == 0) {
+      verbose = true;
+    } else if (arg[0] != '-' && capturePath == NULL) {
+      capturePath = arg;
+    } else {
+      fprintf(stderr, "unknown option %s\n", arg);
+      return 2;
+    }
+  }
+  if (capturePath == NULL) {
+    fprintf(stderr, "usage: replay CAPTURE [--fop NAME] [--speed X] [--lights FILE] [--expect FILE]\n");
+    return 2;
+  }
+
+  CaptureReader reader;
+  if (!reader.open(capturePath)) {
+    fprintf(stderr, "cannot read capture %s\n", capturePath);
+    return 2;
+  }
+  snprintf(decisionTopic, sizeof(decisionTopic), "owlcms/decision/%s", fop);
+  snprintf(downSignalTopic, sizeof(downSignalTopic), "owlcms/fop/down/%s", fop);
+  snprintf(resetDecisionsTopic, sizeof(resetDecisionsTopic), "owlcms/fop/resetDecisions/%s", fop);
+  transport.setCallback(callback);
+
+  // The mux and the callback expect a NUL-terminated topic and a writable payload
+  char topic[CAPTURE_MAX_TOPIC + 1];
+  std::vector<uint8_t> payload;
+  uint64_t messages = 0;
+  CaptureRecord record;
+  wallStartUs = nowUs();
+  while (reader.next(record)) {
+    pace(record.timeUs);
+    advanceTo(record.timeUs);
+    memcpy(topic, record.topic, record.topicLength);
+    topic[record.topicLength] = '\0';
+    payload.assign(record.payload, record.payload + record.payloadLength);
+    payload.push_back(0);
+    if (verbose && strstr(topic, fop) != NULL) {
+      printf("%10.3f %s (%zu bytes)\n", record.timeUs / 1e6, topic, record.payloadLength);
+    }
+    transport.deliver(TRANSPORT_MQTT, topic, payload.data(), record.payloadLength, replayClock());
+    messages++;
+  }
+  advanceTo(replayUs + REPLAY_TAIL_MS * 1000ULL);
+
+  printf("%llu messages over %.1f s, %llu decisions for platform %s (%llu invalid, %llu duplicate or stale), "
+         "%zu light changes%s\n",
+         (unsigned long long)messages, replayUs / 1e6, (unsigned long long)decisionCount, fop,
+         (unsigned long long)invalidDecisions, (unsigned long long)droppedDecisions, lightLog.size(), reader.truncated() ? ", capture truncated" : "");
+  printf("final lights: down %s, decisions %c%c%c\n", lights.downLed ? "on" : "off",
+         lights.votes[0] ? lights.votes[0] : '-', lights.votes[1] ? lights.votes[1] : '-',
+         lights.votes[2] ? lights.votes[2] : '-');
+
+  if (lightsPath != NULL && !writeLights(lightsPath)) {
+    fprintf(stderr, "cannot write %s\n", lightsPath);
+    return 2;
+  }
+  if (expectPath != NULL) {
+    int result = compareLights(expectPath);
+    if (result < 0) {
+      fprintf(stderr, "cannot read %s\n", expectPath);
+      return 2;
+    }
+    printf(result == 0 ? "light log matches %s\n" : "light log differs from %s\n", expectPath);
+    return result;
+  }
+  return 0;
+}
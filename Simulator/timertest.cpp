@@ -0,0 +1,222 @@
+// Tests for the timer wheel (timers.h/timers.cpp) on a virtual clock: randomised start, cancel,
+// re-arm and advance against a plain list of deadlines, every level boundary, timers parked
+// beyond the wheel's range, and clocks past the 49.7-day point where a 32-bit millis() wraps.
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=c++11 -IDecisionLightBox -o timertest Simulator/timertest.cpp DecisionLightBox/timers.cpp
+//   ./timertest [--seed N]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "check.h"
+#include "timers.h"
+
+#define TEST_TIMERS 48
+#define TEST_ROUNDS 5000
+// Shortest period of a re-arming timer, so long advances stay cheap (the heartbeat is 250 ms)
+#define TEST_MIN_REARM_MS 250
+
+// 2^32 ms: where millis() wraps, about 49.7 days after boot
+#define MILLIS_WRAP_MS (1ULL << 32)
+
+static TimerWheel wheel;
+
+struct Tracked {
+  Timer timer;
+  bool armed = false;
+  uint64_t deadline = 0;
+  uint32_t rearmMs = 0;   // re-armed from its own callback with this delay, 0 for one-shot
+};
+
+static Tracked tracked[TEST_TIMERS];
+static uint64_t lastFiredAt = 0;
+static int fired = 0;
+static int late = 0;
+
+static void onFire(void* context) {
+  Tracked& t = *(Tracked*)context;
+  fired++;
+  // Fires exactly at its deadline, never early, and in deadline order across one advance()
+  if (!CHECK(t.armed) || !CHECK_EQ(wheel.now(), t.deadline) || !CHECK(wheel.now() >= lastFiredAt)) {
+    late++;
+  }
+  lastFiredAt = wheel.now();
+  t.armed = false;
+  if (t.rearmMs != 0) {
+    wheel.start(t.timer, t.rearmMs, onFire, &t);
+    t.armed = true;
+    t.deadline = wheel.now() + t.rearmMs;
+  }
+}
+
+static void arm(Tracked& t, uint32_t delayMs, uint32_t rearmMs) {
+  wheel.start(t.timer, delayMs, onFire, &t);
+  t.armed = true;
+  t.deadline = wheel.now() + (delayMs > 0 ? delayMs : 1);
+  t.rearmMs = rearmMs;
+}
+
+static uint64_t earliestDeadline() {
+  uint64_t earliest = UINT64_MAX;
+  for (Tracked& t : tracked) {
+    if (t.armed && t.deadline < earliest) {
+      earliest = t.deadline;
+    }
+  }
+  return earliest;
+}
+
+// Delays spread over every level and past the wheel's range
+static uint32_t randomDelay() {
+  switch (rand() % 6) {
+    case 0: return rand() % 4;
+    case 1: return rand() % TIMER_LEVEL0_SIZE;
+    case 2: return TIMER_LEVEL0_SIZE - 2 + rand() % 5;
+    case 3: return rand() % (TIMER_LEVEL0_SIZE * TIMER_LEVEL_SIZE);
+    case 4: return rand() % TIMER_RANGE_MS;
+    default: return TIMER_RANGE_MS - 2 + rand() % (3 * TIMER_RANGE_MS);
+  }
+}
+
+static uint64_t randomStep() {
+  switch (rand() % 4) {
+    case 0: return rand() % 3;
+    case 1: return rand() % 300;
+    case 2: return rand() % 20000;
+    default: return rand() % (2 * TIMER_RANGE_MS);
+  }
+}
+
+// Random operations from the given start time, each advance checked against the list
+static void testRandomised(uint64_t startMs) {
+  wheel = TimerWheel();
+  wheel.begin(startMs);
+  for (Tracked& t : tracked) {
+    t.armed = false;
+    t.timer = Timer();
+  }
+  int failuresBefore = checkFailures;
+  for (int round = 0; round < TEST_ROUNDS; round++) {
+    Tracked& t = tracked[rand() % TEST_TIMERS];
+    int op = rand() % 8;
+    if (op < 3) {
+      arm(t, randomDelay(), rand() % 4 == 0 ? TEST_MIN_REARM_MS + randomDelay() : 0);
+    } else if (op == 3) {
+      wheel.cancel(t.timer);
+      t.armed = false;
+    } else {
+      uint64_t earliest = earliestDeadline();
+      uint32_t until = wheel.msUntilNext(UINT32_MAX);
+      // Never later than the next deadline, so sleeping that long misses nothing
+      CHECK(earliest == UINT64_MAX || wheel.now() + until <= earliest);
+
+      uint64_t target = wheel.now() + randomStep();
+      int expected = 0;
+      for (Tracked& other : tracked) {
+        expected += other.armed && other.deadline <= target && other.rearmMs == 0;
+      }
+      fired = 0;
+      lastFiredAt = wheel.now();
+      wheel.advance(target);
+      CHECK_EQ(wheel.now(), target);
+      // One-shots due by the target all fired; re-arming ones fired at least once
+      CHECK(fired >= expected);
+      for (Tracked& other : tracked) {
+        if (!CHECK(!other.armed || other.deadline > target)) {
+          printf("  timer due at %llu still armed at %llu\n", (unsigned long long)other.deadline,
+                 (unsigned long long)target);
+        }
+        CHECK_EQ(wheel.active(other.timer), other.armed);
+      }
+    }
+    if (checkFailures != failuresBefore) {
+      printf("  first failure in round %d from %llu\n", round, (unsigned long long)startMs);
+      break;
+    }
+  }
+}
+
+// A timer for every delay around each level's boundary, from every offset within a level-0 turn
+static void testBoundaries(uint64_t startMs) {
+  const uint32_t edges[] = {1, TIMER_LEVEL0_SIZE, TIMER_LEVEL0_SIZE * TIMER_LEVEL_SIZE, TIMER_RANGE_MS};
+  int failuresBefore = checkFailures;
+  for (uint32_t offset = 0; offset < TIMER_LEVEL0_SIZE; offset += 7) {
+    for (uint32_t edge : edges) {
+      for (uint32_t delay = edge > 2 ? edge - 2 : 0; delay <= edge + 2; delay++) {
+        wheel = TimerWheel();
+        wheel.begin(startMs + offset);
+        Tracked& t = tracked[0];
+        t.timer = Timer();
+        arm(t, delay, 0);
+        fired = 0;
+        lastFiredAt = wheel.now();
+        wheel.advance(t.deadline - 1);
+        CHECK_EQ(fired, 0);
+        wheel.advance(t.deadline);
+        CHECK_EQ(fired, 1);
+        CHECK(!wheel.active(t.timer));
+      }
+    }
+  }
+  CHECK_EQ(checkFailures, failuresBefore);
+}
+
+// A heartbeat re-armed from its callback across the millis() wrap, stepped like the firmware loop
+static void testAcrossMillisWrap() {
+  wheel = TimerWheel();
+  wheel.begin(MILLIS_WRAP_MS - 1000);
+  Tracked& heartbeat = tracked[0];
+  Tracked& presence = tracked[1];
+  heartbeat.timer = Timer();
+  presence.timer = Timer();
+  arm(heartbeat, 250, 250);
+  arm(presence, 30000, 0);
+  fired = 0;
+  lastFiredAt = wheel.now();
+  late = 0;
+  for (uint64_t now = wheel.now(); now <= MILLIS_WRAP_MS + 60000; now += 10) {
+    wheel.advance(now);
+  }
+  // 61 s of 250 ms beats, one presence refresh, none late
+  CHECK_EQ(fired, 61000 / 250 + 1);
+  CHECK_EQ(late, 0);
+  CHECK(!presence.armed);
+  CHECK_EQ(heartbeat.deadline, MILLIS_WRAP_MS - 1000 + 61000 + 250);
+}
+
+// An idle wheel and a long sleep: the time jumps, nothing fires early
+static void testLongSleep() {
+  wheel = TimerWheel();
+  wheel.begin(123);
+  Tracked& t = tracked[0];
+  t.timer = Timer();
+  arm(t, 3 * TIMER_RANGE_MS + 5, 0);
+  fired = 0;
+  lastFiredAt = wheel.now();
+  CHECK(wheel.msUntilNext(UINT32_MAX) > 0);
+  wheel.advance(123 + 3 * TIMER_RANGE_MS + 4);
+  CHECK_EQ(fired, 0);
+  wheel.advance(123 + 3 * TIMER_RANGE_MS + 5);
+  CHECK_EQ(fired, 1);
+  CHECK_EQ(wheel.msUntilNext(500), 500);
+}
+
+int main(int argc, char** argv) {
+  unsigned seed = 1;
+  if (argc == 3 && strcmp(argv[1], "--seed") == 0) {
+    seed = atoi(argv[2]);
+  }
+  srand(seed);
+
+  const uint64_t starts[] = {0, 1000, MILLIS_WRAP_MS - 5000, MILLIS_WRAP_MS, 3 * MILLIS_WRAP_MS + 77};
+  for (uint64_t start : starts) {
+    testRandomised(start);
+    testBoundaries(start);
+  }
+  testAcrossMillisWrap();
+  testLongSleep();
+  return checkResult("timertest");
+}
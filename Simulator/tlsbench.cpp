@@ -0,0 +1,266 @@
+// Measures TLS handshake time with mbedTLS, the library under WiFiClientSecure on the ESP32,
+// against a local TLS broker. Three modes:
+//   full    a fresh handshake per connection, as the TLS build does today (setInsecure())
+//   resume  session ID / ticket resumption of the first session
+//   psk     pre-shared key suites, as the TLS_PSK build does (see certificates.h)
+// A desktop CPU is far faster than an ESP32, so compare the modes with each other; the firmware
+// prints its own "connected in N ms" on every reconnect.
+//
+// Build and run from the repository root (needs the mbedTLS 2.28 development package):
+//   g++ -O2 -std=c++11 -o tlsbench Simulator/tlsbench.cpp -lmbedtls -lmbedx509 -lmbedcrypto
+//   ./tlsbench --port 8883 --mode all
+//
+// A broker for the full and resume modes: Mosquitto with a certificate on 8883, or
+//   openssl s_server -accept 8883 -cert server.pem -key server.key
+// and for psk (key and identity from certificates.h):
+//   openssl s_server -accept 8884 -nocert -psk <key> -psk_identity replogic
+//
+// Options:
+//   --host HOST       broker address (default 127.0.0.1)
+//   --port N          TLS port (default 8883)
+//   --psk-port N      port for the psk mode (default: --port)
+//   --mode MODE       full, resume, psk or all (default all)
+//   --count N         handshakes per mode (default 50)
+//   --psk-identity ID (default replogic)
+//   --psk KEY         hex key (default: the placeholder in certificates.h)
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/error.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/ssl.h>
+
+#define TLSBENCH_MAX_PSK 64
+
+static const char *host = "127.0.0.1";
+static char port[8] = "8883";
+static char pskPort[8] = "";
+static const char *mode = "all";
+static int count = 50;
+static const char *pskIdentity = "replogic";
+static const char *pskHex = "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f";
+
+static mbedtls_entropy_context entropy;
+static mbedtls_ctr_drbg_context ctrDrbg;
+
+static double nowMs() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+}
+
+static void printError(const char *what, int error) {
+  char text[128];
+  mbedtls_strerror(error, text, sizeof(text));
+  fprintf(stderr, "%s: -0x%04x %s\n", what, -error, text);
+}
+
+// One connection: TCP connect (not timed), handshake (timed), close.
+// resume: session to offer; save: receives the negotiated session. Returns the handshake
+// time in ms, or a negative value on failure.
+static double handshake(const mbedtls_ssl_config &config, const char *service, const mbedtls_ssl_session *resume,
+                        mbedtls_ssl_session *save, bool &resumed) {
+  mbedtls_net_context net;
+  mbedtls_ssl_context ssl;
+  mbedtls_net_init(&net);
+  mbedtls_ssl_init(&ssl);
+  double elapsed = -1;
+  resumed = false;
+
+  int error = mbedtls_net_connect(&net, host, service, MBEDTLS_NET_PROTO_TCP);
+  if (error != 0) {
+    printError("connect", error);
+  } else if ((error = mbedtls_ssl_setup(&ssl, &config)) != 0) {
+    printError("setup", error);
+  } else {
+    // WiFiClientSecure's ssl_client sets this too; without it Nagle and delayed ACKs add
+    // about 40 ms per handshake flight and swamp the crypto being measured
+    int one = 1;
+    setsockopt(net.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    mbedtls_ssl_set_hostname(&ssl, host);
+    mbedtls_ssl_set_bio(&ssl, &net, mbedtls_net_send, mbedtls_net_recv, NULL);
+    if (resume != NULL) {
+      mbedtls_ssl_set_session(&ssl, resume);
+    }
+    double start = nowMs();
+    while ((error = mbedtls_ssl_handshake(&ssl)) == MBEDTLS_ERR_SSL_WANT_READ || error == MBEDTLS_ERR_SSL_WANT_WRITE) {
+    }
+    if (error != 0) {
+      printError("handshake", error);
+    } else {
+      elapsed = nowMs() - start;
+      mbedtls_ssl_session session;
+      mbedtls_ssl_session_init(&session);
+      if (mbedtls_ssl_get_session(&ssl, &session) == 0) {
+        // A resumed session keeps the master secret. The session ID is no use here: a server
+        // that issues tickets sends an empty one, and the client makes up a new one to resume.
+        resumed = resume != NULL && memcmp(session.master, resume->master, sizeof(session.master)) == 0;
+        if (save != NULL) {
+          mbedtls_ssl_session_free(save);
+          *save = session;
+        } else {
+          mbedtls_ssl_session_free(&session);
+        }
+      }
+      mbedtls_ssl_close_notify(&ssl);
+    }
+  }
+
+  mbedtls_ssl_free(&ssl);
+  mbedtls_net_free(&net);
+  return elapsed;
+}
+
+// Same settings as WiFiClientSecure with setInsecure(): no certificate verification
+static bool setupConfig(mbedtls_ssl_config &config) {
+  mbedtls_ssl_config_init(&config);
+  int error = mbedtls_ssl_config_defaults(&config, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                          MBEDTLS_SSL_PRESET_DEFAULT);
+  if (error != 0) {
+    printError("config", error);
+    return false;
+  }
+  mbedtls_ssl_conf_authmode(&config, MBEDTLS_SSL_VERIFY_NONE);
+  mbedtls_ssl_conf_rng(&config, mbedtls_ctr_drbg_random, &ctrDrbg);
+  mbedtls_ssl_conf_session_tickets(&config, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+  return true;
+}
+
+static bool setupPsk(mbedtls_ssl_config &config) {
+  static const int pskSuites[] = {
+    MBEDTLS_TLS_PSK_WITH_AES_128_GCM_SHA256,
+    MBEDTLS_TLS_PSK_WITH_AES_128_CBC_SHA256,
+    0
+  };
+  unsigned char key[TLSBENCH_MAX_PSK];
+  size_t length = strlen(pskHex) / 2;
+  if (strlen(pskHex) % 2 != 0 || length > sizeof(key)) {
+    fprintf(stderr, "invalid PSK\n");
+    return false;
+  }
+  for (size_t i = 0; i < length; i++) {
+    unsigned int byte;
+    if (sscanf(pskHex + 2 * i, "%2x", &byte) != 1) {
+      fprintf(stderr, "invalid PSK\n");
+      return false;
+    }
+    key[i] = byte;
+  }
+  int error = mbedtls_ssl_conf_psk(&config, key, length, (const unsigned char *)pskIdentity, strlen(pskIdentity));
+  if (error != 0) {
+    printError("psk", error);
+    return false;
+  }
+  mbedtls_ssl_conf_ciphersuites(&config, pskSuites);
+  return true;
+}
+
+static void report(const char *name, std::vector<double> &samples, int resumedCount) {
+  if (samples.empty()) {
+    printf("%-8s no successful handshakes\n", name);
+    return;
+  }
+  std::sort(samples.begin(), samples.end());
+  size_t n = samples.size();
+  printf("%-8s n=%-4zu p50=%-8.2f p90=%-8.2f max=%.2f ms", name, n, samples[n / 2], samples[n * 9 / 10],
+         samples[n - 1]);
+  if (resumedCount >= 0) {
+    printf("  (%d resumed)", resumedCount);
+  }
+  printf("\n");
+}
+
+static void runMode(const char *name) {
+  mbedtls_ssl_config config;
+  if (!setupConfig(config)) {
+    return;
+  }
+  bool psk = strcmp(name, "psk") == 0;
+  bool resume = strcmp(name, "resume") == 0;
+  if (psk && !setupPsk(config)) {
+    mbedtls_ssl_config_free(&config);
+    return;
+  }
+  const char *service = psk && pskPort[0] ? pskPort : port;
+
+  mbedtls_ssl_session session;
+  mbedtls_ssl_session_init(&session);
+  bool resumed = false;
+  if (resume && handshake(config, service, NULL, &session, resumed) < 0) {
+    mbedtls_ssl_session_free(&session);
+    mbedtls_ssl_config_free(&config);
+    return;
+  }
+
+  std::vector<double> samples;
+  int resumedCount = 0;
+  for (int i = 0; i < count; i++) {
+    double elapsed = handshake(config, service, resume ? &session : NULL, NULL, resumed);
+    if (elapsed < 0) {
+      break;
+    }
+    samples.push_back(elapsed);
+    resumedCount += resumed;
+  }
+  report(name, samples, resume ? resumedCount : -1);
+
+  mbedtls_ssl_session_free(&session);
+  mbedtls_ssl_config_free(&config);
+}
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : "0";
+    if (strcmp(arg, "--host") == 0) {
+      host = value, i++;
+    } else if (strcmp(arg, "--port") == 0) {
+      snprintf(port, sizeof(port), "%s", value), i++;
+    } else if (strcmp(arg, "--psk-port") == 0) {
+      snprintf(pskPort, sizeof(pskPort), "%s", value), i++;
+    } else if (strcmp(arg, "--mode") == 0) {
+      mode = value, i++;
+    } else if (strcmp(arg, "--count") == 0) {
+      count = atoi(value), i++;
+    } else if (strcmp(arg, "--psk-identity") == 0) {
+      pskIdentity = value, i++;
+    } else if (strcmp(arg, "--psk") == 0) {
+      pskHex = value, i++;
+    } else {
+      fprintf(stderr, "unknown option %s\n", arg);
+      return 2;
+    }
+  }
+
+  mbedtls_entropy_init(&entropy);
+  mbedtls_ctr_drbg_init(&ctrDrbg);
+  const char *personalization = "replogic-tlsbench";
+  int error = mbedtls_ctr_drbg_seed(&ctrDrbg, mbedtls_entropy_func, &entropy,
+                                    (const unsigned char *)personalization, strlen(personalization));
+  if (error != 0) {
+    printError("random seed", error);
+    return 2;
+  }
+
+  printf("TLS handshakes against %s (port %s%s%s)\n", host, port, pskPort[0] ? ", psk port " : "", pskPort);
+  static const char *modes[] = {"full", "resume", "psk"};
+  for (int i = 0; i < 3; i++) {
+    if (strcmp(mode, "all") == 0 || strcmp(mode, modes[i]) == 0) {
+      runMode(modes[i]);
+    }
+  }
+
+  mbedtls_ctr_drbg_free(&ctrDrbg);
+  mbedtls_entropy_free(&entropy);
+  return 0;
+}
@@ -0,0 +1,117 @@
+// Tests for the UDP frame codec of the transport layer (transport.h/transport.cpp): every topic
+// the firmwares build from topics.h, at the longest platform name and client id, goes through
+// encodeUdpFrame() and back; topics at and past TRANSPORT_MAX_TOPIC; and short or foreign frames.
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=c++11 -IDecisionLightBox -o transporttest Simulator/transporttest.cpp
+//     DecisionLightBox/transport.cpp DecisionLightBox/topics.cpp
+//   ./transporttest
+
+#include <stdio.h>
+#include <string.h>
+
+#include "check.h"
+#include "topics.h"
+#include "transport.h"
+
+static uint8_t frame[UDP_FRAME_MAX_SIZE + 1];
+
+// Encodes and decodes one message; true if it came back unchanged
+static bool roundTrip(const char* topic, const uint8_t* payload, unsigned int length) {
+  size_t frameLength = encodeUdpFrame(frame, UDP_FRAME_MAX_SIZE, 7, 42, topic, payload, length);
+  if (frameLength == 0) {
+    return false;
+  }
+  uint32_t sender, seq;
+  char* decodedTopic;
+  uint8_t* decodedPayload;
+  unsigned int decodedLength;
+  if (!decodeUdpFrame(frame, frameLength, sender, seq, decodedTopic, decodedPayload, decodedLength)) {
+    return false;
+  }
+  return sender == 7 && seq == 42 && strcmp(decodedTopic, topic) == 0 && decodedLength == length &&
+         memcmp(decodedPayload, payload, length) == 0;
+}
+
+// The longest topics the firmwares build, with a display-frame-sized payload
+static void testLongestTopics() {
+  char fop[TOPIC_FOP_MAX + 1];
+  char clientId[TOPIC_CLIENT_ID_MAX + 1];
+  memset(fop, 'f', TOPIC_FOP_MAX);
+  fop[TOPIC_FOP_MAX] = '\0';
+  memset(clientId, 'c', TOPIC_CLIENT_ID_MAX);
+  clientId[TOPIC_CLIENT_ID_MAX] = '\0';
+  const uint8_t payload[] = {1, 2, 3, 4, 5, 6, 7, 0, 'o', 'n', 'l', 'i', 'n', 'e'};
+
+  char heartbeat[TOPIC_CLIENT_SIZE(TOPIC_PREFIX_HEARTBEAT)];
+  CHECK_EQ(buildTopic(heartbeat, TOPIC_PREFIX_HEARTBEAT, fop, clientId), sizeof(heartbeat) - 1);
+  CHECK(isFastPathTopic(heartbeat));
+  CHECK(roundTrip(heartbeat, payload, sizeof(payload)));
+
+  char presence[TOPIC_CLIENT_SIZE(TOPIC_PREFIX_PRESENCE)];
+  buildTopic(presence, TOPIC_PREFIX_PRESENCE, fop, clientId);
+  CHECK(roundTrip(presence, payload, sizeof(payload)));
+
+  char warning[TOPIC_CLIENT_SUFFIX_SIZE(TOPIC_PREFIX_HEALTH, TOPIC_SUFFIX_WARNING)];
+  CHECK_EQ(buildTopic(warning, TOPIC_PREFIX_HEALTH, fop, clientId, TOPIC_SUFFIX_WARNING), sizeof(warning) - 1);
+  CHECK(roundTrip(warning, payload, sizeof(payload)));
+
+  char display[TOPIC_SIZE(TOPIC_PREFIX_DISPLAY)];
+  buildTopic(display, TOPIC_PREFIX_DISPLAY, fop);
+  CHECK(roundTrip(display, payload, sizeof(payload)));
+}
+
+// TRANSPORT_MAX_TOPIC counts the terminator: one character less fits, no more
+static void testTopicLimit() {
+  const uint8_t payload[] = {1};
+  char topic[TRANSPORT_MAX_TOPIC + 1];
+  memset(topic, 't', sizeof(topic));
+  topic[TRANSPORT_MAX_TOPIC - 1] = '\0';
+  CHECK(roundTrip(topic, payload, sizeof(payload)));
+  topic[TRANSPORT_MAX_TOPIC - 1] = 't';
+  topic[TRANSPORT_MAX_TOPIC] = '\0';
+  CHECK_EQ(encodeUdpFrame(frame, UDP_FRAME_MAX_SIZE, 7, 42, topic, payload, sizeof(payload)), 0);
+  CHECK_EQ(encodeUdpFrame(frame, UDP_FRAME_MAX_SIZE, 7, 42, "", payload, sizeof(payload)), 0);
+
+  // A received frame claiming a longer topic is dropped
+  size_t frameLength = encodeUdpFrame(frame, UDP_FRAME_MAX_SIZE, 7, 42, "owlcms/x", payload, sizeof(payload));
+  frame[UDP_FRAME_HEADER_SIZE - 1] = TRANSPORT_MAX_TOPIC;
+  uint32_t sender, seq;
+  char* decodedTopic;
+  uint8_t* decodedPayload;
+  unsigned int decodedLength;
+  CHECK(!decodeUdpFrame(frame, UDP_FRAME_MAX_SIZE, sender, seq, decodedTopic, decodedPayload, decodedLength));
+  CHECK(!decodeUdpFrame(frame, frameLength, sender, seq, decodedTopic, decodedPayload, decodedLength));
+}
+
+// A payload that would overflow the frame is refused, not cut
+static void testFrameSize() {
+  static uint8_t payload[UDP_FRAME_MAX_SIZE];
+  const char* topic = "owlcms/fop/display/A";
+  size_t room = UDP_FRAME_MAX_SIZE - UDP_FRAME_HEADER_SIZE - strlen(topic);
+  CHECK(roundTrip(topic, payload, room));
+  CHECK_EQ(encodeUdpFrame(frame, UDP_FRAME_MAX_SIZE, 7, 42, topic, payload, room + 1), 0);
+}
+
+static void testForeignFrames() {
+  uint32_t sender, seq;
+  char* topic;
+  uint8_t* payload;
+  unsigned int length;
+  const uint8_t value[] = {1};
+  size_t frameLength = encodeUdpFrame(frame, UDP_FRAME_MAX_SIZE, 7, 42, "owlcms/decision/A", value, 1);
+  CHECK(!decodeUdpFrame(frame, UDP_FRAME_HEADER_SIZE - 1, sender, seq, topic, payload, length));
+  frame[2] = UDP_FRAME_VERSION + 1;
+  CHECK(!decodeUdpFrame(frame, frameLength, sender, seq, topic, payload, length));
+  frame[2] = UDP_FRAME_VERSION;
+  frame[0] = 'X';
+  CHECK(!decodeUdpFrame(frame, frameLength, sender, seq, topic, payload, length));
+}
+
+int main() {
+  testLongestTopics();
+  testTopicLimit();
+  testFrameSize();
+  testForeignFrames();
+  return checkResult("transporttest");
+}